@@ -4,8 +4,17 @@
 #include <string>
 #include <vector>
 #include <iomanip>      // for std::setw
-#include <algorithm>    // for std::find_if
 #include <limits>       // for clearing std::cin
+#include <cctype>       // for std::tolower
+#include <cstdint>
+#include <cstdlib>      // for std::strtoul
+#include <csignal>      // for stopping the server on SIGINT and SIGTERM, promoting on SIGUSR1
+#include <thread>
+
+#include "booking/BookingService.h"
+#include "booking/OutputBuffer.h"
+#include "booking/Replication.h"
+#include "booking/Server.h"
 
 /**
  * @file main.cpp
@@ -13,7 +22,24 @@
  *
  * This application allows users to manage bus reservations, including installing new buses,
  * reserving seats, canceling reservations, viewing bus details, and searching buses by route.
+ * It is a thin interactive front end: all booking state and rules live in the headless
+ * BookingService, and this file only prompts, calls into it and prints the outcome.
+ */
+
+/**
+ * @brief The booking core driven by the menu.
  */
+BookingService service;
+
+/**
+ * @brief Buffer the bus displays are rendered into, written out once per screen.
+ */
+OutputBuffer screen(std::cout);
+
+/**
+ * @brief Journal size at which the state is snapshotted and the journal truncated.
+ */
+const std::uint64_t CHECKPOINT_BYTES = 4u << 20;
 
 /**
  * @brief ANSI escape codes to clear the terminal screen.
@@ -32,453 +58,671 @@ void clearScreen() {
  * @param length The number of times to repeat the character. Default is 80.
  */
 void printLine(char ch, int length = 80) {
-    for(int i = 0; i < length; ++i) std::cout << ch;
-    std::cout << std::endl;
+    screen.fill(ch, length).append('\n');
 }
 
 /**
- * @struct Seat
- * @brief Represents a single seat in the bus.
+ * @brief Prompt for a line of text.
  *
- * Each seat has a passenger name (or "Empty" if unreserved) and a fare price.
+ * @param prompt The prompt to print.
+ * @param value Receives the line.
+ * @return true If the user entered something other than "0" or an empty line.
+ * @return false If the user cancelled.
  */
-struct Seat {
-    std::string passengerName; /**< Name of the passenger. "Empty" if seat is vacant. */
-    double fare;               /**< Fare price for the seat. */
-
-    /**
-     * @brief Default constructor initializes seat as empty with zero fare.
-     */
-    Seat() : passengerName("Empty"), fare(0.0) {}
-};
+bool promptLine(const char* prompt, std::string& value) {
+    std::cout << prompt;
+    std::getline(std::cin, value);
+    return !(value == "0" || value.empty());
+}
 
 /**
- * @class Bus
- * @brief Represents a bus with its details and seat information.
+ * @brief Prompt for a seat number.
+ *
+ * Prints the appropriate message when the input is not a number, is 0 (cancel) or is
+ * outside 1 to seatCount.
+ *
+ * @param prompt The prompt to print.
+ * @param seatCount Seats on the bus.
+ * @param seatNumber Receives the seat number.
+ * @return true If a valid seat number was entered.
+ * @return false Otherwise.
  */
-class Bus {
-private:
-    std::string busNumber;          /**< Unique identifier for the bus. */
-    std::string driverName;         /**< Name of the bus driver. */
-    std::string arrivalTime;        /**< Arrival time of the bus. */
-    std::string departureTime;      /**< Departure time of the bus. */
-    std::string from;               /**< Origin location. */
-    std::string to;                 /**< Destination location. */
-
-    /**
-     * @brief 2D vector representing seats arranged in rows and columns.
-     *
-     * 8 rows with 4 seats each (total 32 seats).
-     */
-    std::vector<std::vector<Seat>> seats;
-
-public:
-    /**
-     * @brief Default constructor initializes seats with default fares.
-     */
-    Bus();
-
-    /**
-     * @brief Install a new bus by reading user input.
-     *
-     * Allows the user to input bus details. If the user enters "0" or leaves a prompt empty,
-     * the installation is canceled.
-     */
-    void install();
-
-    /**
-     * @brief Reserve a seat on the bus.
-     *
-     * Allows the user to reserve a seat by specifying the bus number and seat number.
-     * Ensures that the seat is available before booking.
-     */
-    void allotment();
-
-    /**
-     * @brief Cancel a seat reservation.
-     *
-     * Allows the user to cancel a previously reserved seat by specifying the bus number
-     * and seat number.
-     */
-    void cancelSeat();
-
-    /**
-     * @brief Display detailed information about the bus, including seat map.
-     */
-    void show() const;
-
-    /**
-     * @brief Display a concise summary of the bus information.
-     */
-    void printBasicInfo() const;
-
-    /**
-     * @brief Check if the bus matches the given route.
-     *
-     * @param origin Origin location to match.
-     * @param dest Destination location to match.
-     * @return true If the bus matches the route.
-     * @return false Otherwise.
-     */
-    bool matchesRoute(const std::string& origin, const std::string& dest) const;
-
-    /**
-     * @brief Get the bus number.
-     *
-     * @return std::string The bus number.
-     */
-    std::string getBusNumber() const;
-
-    /**
-     * @brief Friend function to allow access to private members for seat reservation and cancellation.
-     *
-     * @param seatNumber The seat number to access.
-     * @return Seat& Reference to the specified seat.
-     */
-    Seat& getSeat(int seatNumber);
-};
+bool promptSeat(const std::string& prompt, int seatCount, int& seatNumber) {
+    std::cout << prompt;
+    if(!(std::cin >> seatNumber)) {
+        std::cout << "Invalid input. Operation cancelled.\n";
+        // Clear the error flag and ignore invalid input
+        std::cin.clear();
+        std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+        return false;
+    }
+    // Clear buffer
+    std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
 
-/**
- * @brief Global container storing all buses.
- */
-std::vector<Bus> busList;
+    if(seatNumber == 0) {
+        std::cout << "Operation cancelled.\n";
+        return false;
+    }
 
-/****************************************
- *      Bus Class Method Definitions    *
- ****************************************/
+    if(seatNumber < 1 || seatNumber > seatCount) {
+        std::cout << "Invalid seat number. Please enter a number between 1 and " << seatCount << ".\n";
+        return false;
+    }
+    return true;
+}
 
-Bus::Bus()
-    : seats(8, std::vector<Seat>(4))  // 8 rows, each row has 4 Seat objects
-{
-    // Initialize default seat fares (e.g., 300.0 for all seats)
-    for(auto &row : seats) {
-        for(auto &seat : row) {
-            seat.fare = 300.0;
-        }
+/**
+ * @brief Prompt for a whole number, with a default for an empty answer.
+ *
+ * @param prompt The prompt to print.
+ * @param fallback Value used when the user just presses Enter.
+ * @param value Receives the number.
+ * @return true If the answer was empty or a non-negative whole number.
+ */
+bool promptCount(const char* prompt, int fallback, int& value) {
+    std::string text;
+    std::cout << prompt;
+    std::getline(std::cin, text);
+    if(text.empty()) {
+        value = fallback;
+        return true;
     }
+    if(text.size() > 6) return false;
+    value = 0;
+    for(char ch : text) {
+        if(ch < '0' || ch > '9') return false;
+        value = value * 10 + (ch - '0');
+    }
+    return true;
 }
 
-void Bus::install() {
-    std::cout << "Enter bus number (or 0 to cancel): ";
-    std::getline(std::cin, busNumber);
-    if(busNumber == "0" || busNumber.empty()) {
+/**
+ * @brief Install a new bus by reading user input.
+ *
+ * Allows the user to input bus details. If the user enters "0" or leaves a prompt empty,
+ * the installation is canceled.
+ */
+void installBus() {
+    BusInfo info;
+    if(!promptLine("Enter bus number (or 0 to cancel): ", info.busNumber)) {
         std::cout << "Installation cancelled.\n";
-        busNumber.clear();
         return;
     }
-
-    std::cout << "Enter driver's name (or 0 to cancel): ";
-    std::getline(std::cin, driverName);
-    if(driverName == "0" || driverName.empty()) {
-        std::cout << "Installation cancelled.\n";
-        busNumber.clear();
+    if(service.hasBus(info.busNumber)) {
+        std::cout << "A bus with this number already exists. Installation cancelled.\n";
         return;
     }
 
-    std::cout << "Enter arrival time (or 0 to cancel): ";
-    std::getline(std::cin, arrivalTime);
-    if(arrivalTime == "0" || arrivalTime.empty()) {
+    if(!promptLine("Enter driver's name (or 0 to cancel): ", info.driverName) ||
+       !promptLine("Enter arrival time, e.g. 14:30 (or 0 to cancel): ", info.arrivalTime) ||
+       !promptLine("Enter departure time, e.g. 09:15 (or 0 to cancel): ", info.departureTime) ||
+       !promptLine("Enter origin (From) (or 0 to cancel): ", info.from) ||
+       !promptLine("Enter destination (To) (or 0 to cancel): ", info.to)) {
         std::cout << "Installation cancelled.\n";
-        busNumber.clear();
-        driverName.clear();
         return;
     }
 
-    std::cout << "Enter departure time (or 0 to cancel): ";
-    std::getline(std::cin, departureTime);
-    if(departureTime == "0" || departureTime.empty()) {
-        std::cout << "Installation cancelled.\n";
-        busNumber.clear();
-        driverName.clear();
-        arrivalTime.clear();
+    int minutes;
+    if(!parseTime(info.arrivalTime, minutes) || !parseTime(info.departureTime, minutes)) {
+        std::cout << "Times must look like 14:30 or 2:30 pm. Installation cancelled.\n";
         return;
     }
 
-    std::cout << "Enter origin (From) (or 0 to cancel): ";
-    std::getline(std::cin, from);
-    if(from == "0" || from.empty()) {
+    std::cout << "Seat layouts:\n";
+    for(int kind = 0; kind < LAYOUT_COUNT; ++kind) {
+        std::cout << "  " << kind + 1 << ". " << LAYOUTS[kind].name << " ("
+                  << LAYOUTS[kind].seats << " seats)\n";
+    }
+    int choice;
+    std::cout << "Enter seat layout (or 0 to cancel): ";
+    if(!(std::cin >> choice)) {
+        std::cin.clear();
+        choice = 0;
+    }
+    std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+    if(choice < 1 || choice > LAYOUT_COUNT) {
         std::cout << "Installation cancelled.\n";
-        busNumber.clear();
-        driverName.clear();
-        arrivalTime.clear();
-        departureTime.clear();
         return;
     }
+    info.layout = static_cast<LayoutKind>(choice - 1);
 
-    std::cout << "Enter destination (To) (or 0 to cancel): ";
-    std::getline(std::cin, to);
-    if(to == "0" || to.empty()) {
-        std::cout << "Installation cancelled.\n";
-        busNumber.clear();
-        driverName.clear();
-        arrivalTime.clear();
-        departureTime.clear();
-        from.clear();
+    BookingStatus status = service.install(info);
+    if(status == BookingStatus::JournalFailed) {
+        std::cout << "Warning: the bus was installed but could not be saved.\n";
+        return;
+    }
+    if(status != BookingStatus::Ok) {
+        std::cout << "A bus with this number already exists. Installation cancelled.\n";
         return;
     }
-
     std::cout << "\nBus installed successfully!\n";
 }
 
-void Bus::allotment() {
-    std::cout << "Enter bus number to reserve seat (or 0 to cancel): ";
+/**
+ * @brief Reserve a seat on a bus.
+ *
+ * Allows the user to reserve a seat by specifying the bus number and seat number.
+ * Ensures that the seat is available before booking.
+ */
+void reserveSeat() {
     std::string number;
-    std::getline(std::cin, number);
-
-    if(number == "0" || number.empty()) {
+    if(!promptLine("Enter bus number to reserve seat (or 0 to cancel): ", number)) {
         std::cout << "Operation cancelled.\n";
         return;
     }
 
-    // Find the bus in the global busList
-    auto it = std::find_if(busList.begin(), busList.end(),
-        [&](const Bus &b){ return b.getBusNumber() == number; });
-
-    if(it == busList.end()) {
+    Bus bus;
+    if(service.getBus(number, bus) != BookingStatus::Ok) {
         std::cout << "Bus not found. Please try again.\n";
         return;
     }
 
     // Ask for seat number
-    std::cout << "Enter seat number (1-32) (or 0 to cancel): ";
+    const int seatCount = bus.seatCount();
     int seatNumber;
-    if(!(std::cin >> seatNumber)) {
-        std::cout << "Invalid input. Operation cancelled.\n";
-        // Clear the error flag and ignore invalid input
-        std::cin.clear();
-        std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+    if(!promptSeat("Enter seat number (1-" + std::to_string(seatCount) + ") (or 0 to cancel): ",
+                   seatCount, seatNumber)) {
         return;
     }
-    // Clear buffer
-    std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
 
-    if(seatNumber == 0) {
-        std::cout << "Operation cancelled.\n";
-        return;
-    }
-
-    if(seatNumber < 1 || seatNumber > 32) {
-        std::cout << "Invalid seat number. Please enter a number between 1 and 32.\n";
+    // Check if seat is already booked
+    Seat seat;
+    service.getSeat(number, seatNumber, seat);
+    if(seat.passengerName == "Held") {
+        std::cout << "That seat is held for another customer!\n";
         return;
     }
-
-    // Convert seatNumber to row and column
-    int row = (seatNumber - 1) / 4;
-    int col = (seatNumber - 1) % 4;
-
-    // Check if seat is already booked
-    if(it->seats[row][col].passengerName != "Empty") {
-        std::cout << "That seat is already reserved by " << it->seats[row][col].passengerName << "!\n";
+    if(seat.passengerName != "Empty") {
+        std::cout << "That seat is already reserved by " << seat.passengerName << "!\n";
         return;
     }
 
     // If empty, ask for passenger name
-    std::cout << "Enter passenger's name (or 0 to cancel): ";
     std::string passenger;
-    std::getline(std::cin, passenger);
-
-    if(passenger == "0" || passenger.empty()) {
+    if(!promptLine("Enter passenger's name (or 0 to cancel): ", passenger)) {
         std::cout << "Operation cancelled.\n";
         return;
     }
 
-    // Book seat
-    it->seats[row][col].passengerName = passenger;
-    double cost = it->seats[row][col].fare;
+    // Book seat; another agent may have claimed it while we were prompting
+    BookingStatus status = service.reserve(number, seatNumber, passenger);
+    if(status == BookingStatus::JournalFailed) {
+        std::cout << "Warning: the seat was reserved but the booking could not be saved.\n";
+    } else if(status == BookingStatus::InvalidPassenger) {
+        std::cout << "Passenger names can be at most " << PassengerStore::MAX_NAME << " characters.\n";
+        return;
+    } else if(status != BookingStatus::Ok) {
+        std::cout << "Sorry, that seat was just reserved by someone else.\n";
+        return;
+    }
 
+    // Show what was charged; demand pricing may have moved since the seat was looked up
+    service.getSeat(number, seatNumber, seat);
     std::cout << "Seat " << seatNumber << " reserved successfully for "
-              << passenger << ".\n"
-              << "Fare: Rs. " << std::fixed << std::setprecision(2) << cost << "\n";
+              << passenger << ".\n";
+    screen.append("Fare: Rs. ").appendPaise(seat.fare).append('\n');
+    BookingIndex::Id booking;
+    if(service.bookingOf(number, seatNumber, booking) == BookingStatus::Ok) {
+        screen.append("Booking ID: ").appendInt(static_cast<long long>(booking)).append('\n');
+    }
+    screen.flush();
 }
 
-void Bus::cancelSeat() {
-    std::cout << "Enter bus number to cancel a seat (or 0 to cancel): ";
+/**
+ * @brief Cancel a seat reservation.
+ *
+ * Allows the user to cancel a previously reserved seat by specifying the bus number
+ * and seat number.
+ */
+void cancelSeat() {
     std::string number;
-    std::getline(std::cin, number);
-
-    if(number == "0" || number.empty()) {
+    if(!promptLine("Enter bus number to cancel a seat (or 0 to cancel): ", number)) {
         std::cout << "Operation cancelled.\n";
         return;
     }
 
-    // Find the bus in the global busList
-    auto it = std::find_if(busList.begin(), busList.end(),
-        [&](const Bus &b){ return b.getBusNumber() == number; });
-
-    if(it == busList.end()) {
+    Bus bus;
+    if(service.getBus(number, bus) != BookingStatus::Ok) {
         std::cout << "Bus not found.\n";
         return;
     }
 
-    std::cout << "Enter seat number to cancel (1-32) (or 0 to cancel): ";
+    const int seatCount = bus.seatCount();
     int seatNumber;
-    if(!(std::cin >> seatNumber)) {
-        std::cout << "Invalid input. Operation cancelled.\n";
-        // Clear the error flag and ignore invalid input
-        std::cin.clear();
-        std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
-        return;
-    }
-    std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
-
-    if(seatNumber == 0) {
-        std::cout << "Operation cancelled.\n";
-        return;
-    }
-
-    if(seatNumber < 1 || seatNumber > 32) {
-        std::cout << "Invalid seat number. Please enter a number between 1 and 32.\n";
+    if(!promptSeat("Enter seat number to cancel (1-" + std::to_string(seatCount) + ") (or 0 to cancel): ",
+                   seatCount, seatNumber)) {
         return;
     }
 
-    int row = (seatNumber - 1) / 4;
-    int col = (seatNumber - 1) % 4;
-
-    if(it->seats[row][col].passengerName == "Empty") {
+    Seat seat;
+    service.getSeat(number, seatNumber, seat);
+    if(seat.passengerName == "Empty") {
         std::cout << "This seat is already empty.\n";
         return;
     }
 
     // Confirm cancellation
     std::cout << "Are you sure you want to cancel the reservation for seat "
-              << seatNumber << " (Passenger: " << it->seats[row][col].passengerName << ")? (y/n): ";
+              << seatNumber << " (Passenger: " << seat.passengerName << ")? (y/n): ";
     char confirm;
     std::cin >> confirm;
     std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
 
-    if(tolower(confirm) != 'y') {
+    if(std::tolower(confirm) != 'y') {
         std::cout << "Cancellation aborted.\n";
         return;
     }
 
     // Cancel the booking
-    it->seats[row][col].passengerName = "Empty";
+    BookingStatus status = service.cancel(number, seatNumber);
+    if(status == BookingStatus::JournalFailed) {
+        std::cout << "Warning: the cancellation could not be saved.\n";
+    } else if(status != BookingStatus::Ok) {
+        std::cout << "This seat is already empty.\n";
+        return;
+    }
     std::cout << "Reservation for seat " << seatNumber << " has been cancelled.\n";
 }
 
-void Bus::show() const {
+/**
+ * @brief List the bookings made under a passenger name and optionally cancel one.
+ *
+ * The name is matched ignoring case and extra spaces. Cancelling a booking frees every
+ * seat still reserved under it.
+ */
+void findBookings() {
+    std::string passenger;
+    if(!promptLine("Enter passenger's name (or 0 to cancel): ", passenger)) {
+        std::cout << "Operation cancelled.\n";
+        return;
+    }
+
+    std::vector<Booking> found;
+    if(service.findBookings(passenger, found) == 0) {
+        std::cout << "No bookings found for " << passenger << ".\n";
+        return;
+    }
+    printLine('=');
+    for(const Booking &booking : found) {
+        screen.append("Booking ").appendInt(static_cast<long long>(booking.id))
+              .append("  Bus ").append(booking.busNumber).append("  Seats");
+        for(SeatMask rest = booking.seats; rest; rest &= rest - 1) screen.append(' ').appendInt(lowestBit(rest) + 1);
+        screen.append("  (").append(booking.passenger).append(", Rs. ").appendPaise(booking.fare).append(")\n");
+    }
+    printLine('=');
+    screen.flush();
+
+    std::string text;
+    if(!promptLine("Enter a booking ID to cancel it (or 0 to keep them all): ", text)) return;
+    char *end;
+    const unsigned long long id = std::strtoull(text.c_str(), &end, 10);
+    if(*end != '\0') {
+        std::cout << "Invalid booking ID.\n";
+        return;
+    }
+
+    std::vector<int> seats;
+    Paise refund = 0;
+    BookingStatus status = service.cancelBooking(id, seats, refund);
+    if(status == BookingStatus::NoBooking) {
+        std::cout << "No such booking.\n";
+        return;
+    }
+    if(status == BookingStatus::JournalFailed) std::cout << "Warning: the cancellation could not be saved.\n";
+    std::cout << "Booking " << id << " cancelled (" << seats.size() << " seat" << (seats.size() == 1 ? "" : "s") << ").\n";
+    screen.append("Refund: Rs. ").appendPaise(refund).append('\n');
+    screen.flush();
+}
+
+/**
+ * @brief Display detailed information about a bus, including seat map.
+ */
+void showBus(const Bus& bus) {
     printLine('*');
-    std::cout << "Bus Number   : " << busNumber << "\n"
-              << "Driver       : " << driverName << "\n"
-              << "Arrival Time : " << arrivalTime << "\n"
-              << "Departure Time: " << departureTime << "\n"
-              << "From         : " << from << "\n"
-              << "To           : " << to << "\n";
+    screen.append("Bus Number   : ").append(bus.getBusNumber())
+          .append("\nDriver       : ").append(service.text(bus.getDriverName()))
+          .append("\nArrival Time : ").append(service.text(bus.getArrivalTime()))
+          .append("\nDeparture Time: ").append(service.text(bus.getDepartureTime()))
+          .append("\nFrom         : ").append(service.text(bus.getOrigin()))
+          .append("\nTo           : ").append(service.text(bus.getDestination())).append('\n');
     printLine('*');
 
     int seatIndex = 1;
-    int emptyCount = 0;
-
-    // Print seats in a grid
-    for(int i = 0; i < 8; ++i) {
-        std::cout << "\nRow " << (i+1) << ":\n";
-        for(int j = 0; j < 4; ++j) {
-            std::cout << "  Seat " << std::setw(2) << seatIndex << ": ";
-            if(seats[i][j].passengerName == "Empty") {
-                std::cout << "Empty (Rs. " << std::fixed << std::setprecision(2) << seats[i][j].fare << ")";
-                emptyCount++;
+    const int seatCount = bus.seatCount();
+
+    // Print seats in a grid; the last row of a layout may be partial
+    for(int i = 0; i < bus.rowCount(); ++i) {
+        screen.append("\nRow ").appendInt(i + 1).append(":\n");
+        for(int j = 0; j < bus.columnCount() && seatIndex <= seatCount; ++j) {
+            screen.append("  Seat ").appendInt(seatIndex, 2).append(": ");
+            if(bus.isHeld(seatIndex)) {
+                screen.append("Held");
+            } else if(!bus.isReserved(seatIndex)) {
+                screen.append("Empty");
             } else {
-                std::cout << seats[i][j].passengerName
-                          << " (Rs. " << std::fixed << std::setprecision(2) << seats[i][j].fare << ")";
+                screen.append(service.passengerName(bus.passengerOf(seatIndex)));
             }
-            std::cout << "\n";
+            screen.append(" (Rs. ").appendPaise(bus.getFare(seatIndex)).append(")\n");
             seatIndex++;
         }
     }
-    std::cout << "\nTotal empty seats: " << emptyCount << "\n\n";
-}
-
-void Bus::printBasicInfo() const {
-    std::cout << "Bus Number    : " << busNumber << "\n"
-              << "Driver        : " << driverName << "\n"
-              << "Arrival Time  : " << arrivalTime << "\n"
-              << "Departure Time: " << departureTime << "\n"
-              << "Route         : " << from << " -> " << to << "\n";
-}
-
-bool Bus::matchesRoute(const std::string& origin, const std::string& dest) const {
-    return (from == origin && to == dest);
+    screen.append("\nTotal empty seats: ").appendInt(bus.emptySeatCount()).append("\n\n");
+    screen.flush();
 }
 
-std::string Bus::getBusNumber() const {
-    return busNumber;
-}
-
-Seat& Bus::getSeat(int seatNumber) {
-    int row = (seatNumber - 1) / 4;
-    int col = (seatNumber - 1) % 4;
-    return seats[row][col];
+/**
+ * @brief Display a concise summary of the bus information.
+ */
+void printBasicInfo(const Bus& bus) {
+    screen.append("Bus Number    : ").append(bus.getBusNumber())
+          .append("\nDriver        : ").append(service.text(bus.getDriverName()))
+          .append("\nArrival Time  : ").append(service.text(bus.getArrivalTime()))
+          .append("\nDeparture Time: ").append(service.text(bus.getDepartureTime()))
+          .append("\nRoute         : ").append(service.text(bus.getOrigin())).append(" -> ")
+          .append(service.text(bus.getDestination())).append('\n');
 }
 
-/****************************************
- *        Other Global Functions        *
- ****************************************/
-
 /**
  * @brief Display all buses available in the system.
  *
- * Iterates through the global bus list and prints basic information for each bus.
+ * Iterates through the bus registry and prints basic information for each bus. The
+ * listing is rendered into the screen buffer and written a page at a time.
  */
 void showAllBuses() {
-    if(busList.empty()) {
+    if(service.empty()) {
         std::cout << "No buses available.\n";
         return;
     }
-    for(const auto &b : busList) {
-        // If busNumber is empty, skip printing (shouldn't be in the list)
-        if(b.getBusNumber().empty()) continue;
-
+    service.forEachBus([](const Bus &b) {
         printLine('*');
-        b.printBasicInfo();
+        printBasicInfo(b);
         printLine('*');
-    }
+    });
+    screen.flush();
 }
 
 /**
  * @brief Search for buses based on origin and destination.
  *
- * Prompts the user to enter origin and destination, then displays matching buses.
+ * Prompts the user to enter origin and destination, and optionally a window of departure
+ * times, then displays matching buses using the registry's route index. Buses in a window
+ * are listed in departure order.
  */
 void searchBusesByRoute() {
-    if(busList.empty()) {
+    if(service.empty()) {
         std::cout << "No buses available.\n";
         return;
     }
 
-    std::cout << "Enter origin (From): ";
     std::string origin;
-    std::getline(std::cin, origin);
-
-    // Check cancel
-    if(origin == "0" || origin.empty()) {
+    if(!promptLine("Enter origin (From): ", origin)) {
         std::cout << "Search cancelled.\n";
         return;
     }
 
-    std::cout << "Enter destination (To): ";
     std::string destination;
-    std::getline(std::cin, destination);
-
-    if(destination == "0" || destination.empty()) {
+    if(!promptLine("Enter destination (To): ", destination)) {
         std::cout << "Search cancelled.\n";
         return;
     }
 
-    bool foundAny = false;
-    for(const auto &b : busList) {
-        if(b.matchesRoute(origin, destination)) {
-            foundAny = true;
-            printLine('=');
-            b.printBasicInfo();
-            printLine('=');
+    // An empty answer searches the whole day; otherwise both ends of the window are needed
+    std::string earliest;
+    std::cout << "Earliest departure, e.g. 06:00 (or press Enter for any time): ";
+    std::getline(std::cin, earliest);
+
+    auto printBus = [](const Bus &b) {
+        printLine('=');
+        printBasicInfo(b);
+        printLine('=');
+    };
+    std::size_t found;
+    if(earliest.empty()) {
+        found = service.forEachOnRoute(origin, destination, printBus);
+    } else {
+        std::string latest;
+        int fromMinute, toMinute;
+        if(!parseTime(earliest, fromMinute) || !promptLine("Latest departure, e.g. 10:00: ", latest)
+           || !parseTime(latest, toMinute)) {
+            std::cout << "Times must look like 14:30 or 2:30 pm. Search cancelled.\n";
+            return;
         }
+        found = service.forEachDeparting(origin, destination, fromMinute, toMinute, printBus);
     }
-    if(!foundAny) {
+    screen.flush();
+    if(found == 0) {
         std::cout << "No matching buses found for route "
                   << origin << " -> " << destination << ".\n";
     }
 }
 
+/**
+ * @brief Find the earliest-arriving journey between two places, changing buses if needed.
+ *
+ * Prompts for origin, destination, earliest departure, seats needed and the minimum time to
+ * change buses, then prints each leg of the journey found.
+ */
+void findConnections() {
+    if(service.empty()) {
+        std::cout << "No buses available.\n";
+        return;
+    }
+
+    std::string origin, destination;
+    if(!promptLine("Enter origin (From): ", origin) || !promptLine("Enter destination (To): ", destination)) {
+        std::cout << "Search cancelled.\n";
+        return;
+    }
+
+    JourneyQuery query;
+    std::string earliest;
+    std::cout << "Earliest departure, e.g. 06:00 (or press Enter for midnight): ";
+    std::getline(std::cin, earliest);
+    if(!earliest.empty() && !parseTime(earliest, query.departAfter)) {
+        std::cout << "Times must look like 14:30 or 2:30 pm. Search cancelled.\n";
+        return;
+    }
+    if(!promptCount("Seats needed (press Enter for 1): ", 1, query.seats) || query.seats < 1
+       || !promptCount("Minimum minutes to change buses (press Enter for 15): ", 15, query.minTransfer)) {
+        std::cout << "Invalid number. Search cancelled.\n";
+        return;
+    }
+
+    std::size_t legs = service.findJourney(origin, destination, query, [](const Bus &b, const JourneyLeg &leg) {
+        screen.append("Bus ").append(b.getBusNumber()).append("  ")
+              .append(service.text(b.getOrigin())).append(" -> ").append(service.text(b.getDestination()))
+              .append("  ").append(formatTime(leg.departure)).append(" - ").append(formatTime(leg.arrival));
+        if(leg.arrival >= MINUTES_PER_DAY) screen.append("  (+1 day)");
+        screen.append('\n');
+    });
+    if(legs == 0) {
+        std::cout << "No connection found from " << origin << " to " << destination << ".\n";
+        return;
+    }
+    printLine('=');
+    screen.flush();
+}
+
+/****************************************
+ *              Server Mode             *
+ ****************************************/
+
+/**
+ * @brief The running server, for the signal handler to stop.
+ */
+Server* activeServer = nullptr;
+
+/**
+ * @brief The running follower, for the signal handler to promote.
+ */
+Follower* activeFollower = nullptr;
+
+void stopServer(int) {
+    if(activeServer) activeServer->stop();
+}
+
+void promoteFollower(int) {
+    if(activeFollower) activeFollower->promote();
+}
+
+/**
+ * @brief Parse a TCP port number, complaining on the console if it is not one.
+ */
+bool parsePort(const char* text, std::uint16_t& port) {
+    char *end;
+    const unsigned long value = std::strtoul(text, &end, 10);
+    if(*text == '\0' || *end != '\0' || value > 65535) {
+        std::cerr << "Invalid port " << text << ".\n";
+        return false;
+    }
+    port = static_cast<std::uint16_t>(value);
+    return true;
+}
+
+/**
+ * @brief Serve the booking core on a port until SIGINT or SIGTERM, then snapshot it if it
+ *        is journaled.
+ *
+ * @return int Exit status.
+ */
+int runServer(std::uint16_t port, bool journaled) {
+    Server server(service);
+    if(!server.listen(port)) {
+        std::cerr << "Could not listen on port " << port << ".\n";
+        return 1;
+    }
+    activeServer = &server;
+    std::signal(SIGINT, stopServer);
+    std::signal(SIGTERM, stopServer);
+
+    const int threads = std::thread::hardware_concurrency() ? static_cast<int>(std::thread::hardware_concurrency()) : 1;
+    std::cout << "Serving " << service.size() << " buses on port " << server.port() << " with " << threads
+              << " threads.\n";
+    const bool served = server.run(threads);
+    activeServer = nullptr;
+    if(!served) {
+        std::cerr << "Could not start the server.\n";
+        return 1;
+    }
+    if(journaled && !service.checkpoint()) {
+        std::cerr << "Warning: could not write a snapshot; the journal is kept in full.\n";
+    }
+    return 0;
+}
+
+/**
+ * @brief Serve the booking core over TCP (see booking/Protocol.h) until SIGINT or SIGTERM.
+ *
+ * @param portText The port to listen on.
+ * @param journalPath Journal to restore from and log to, or null to run in memory.
+ * @param replicateText Port to ship the journal to followers on (see booking/Replication.h),
+ *        or null for none. Needs a journal.
+ * @return int Exit status.
+ */
+int serve(const char* portText, const char* journalPath, const char* replicateText) {
+    std::uint16_t port, replicatePort = 0;
+    if(!parsePort(portText, port) || (replicateText && !parsePort(replicateText, replicatePort))) return 1;
+    if(journalPath && !service.openJournal(journalPath, CHECKPOINT_BYTES)) {
+        std::cerr << "Could not open journal " << journalPath << ".\n";
+        return 1;
+    }
+
+    ReplicationSource source(service);
+    if(replicateText) {
+        if(!source.listen(replicatePort) || !source.start()) {
+            std::cerr << "Could not ship the journal on port " << replicatePort << ".\n";
+            return 1;
+        }
+        std::cout << "Shipping the journal to followers on port " << source.port() << ".\n";
+    }
+    const int status = runServer(port, journalPath != nullptr);
+    source.stop();
+    return status;
+}
+
+/**
+ * @brief Serve a read-only copy of a primary's booking core, kept up to date over its
+ *        replication port, until SIGINT or SIGTERM. SIGUSR1 promotes it to a writable
+ *        primary in place.
+ *
+ * @param host The primary's address or host name.
+ * @param replicateText The primary's replication port.
+ * @param portText The port to serve on.
+ * @param journalPath The follower's own journal: empty, or one a follower kept earlier.
+ * @return int Exit status.
+ */
+int follow(const char* host, const char* replicateText, const char* portText, const char* journalPath) {
+    std::uint16_t replicatePort, port;
+    if(!parsePort(replicateText, replicatePort) || !parsePort(portText, port)) return 1;
+    if(!service.openJournal(journalPath, CHECKPOINT_BYTES)) {
+        std::cerr << "Could not open journal " << journalPath << ".\n";
+        return 1;
+    }
+
+    Follower follower(service);
+    if(!follower.start(host, replicatePort)) {
+        std::cerr << "Journal " << journalPath << " was not written by a follower.\n";
+        return 1;
+    }
+    activeFollower = &follower;
+    std::signal(SIGUSR1, promoteFollower);
+    std::cout << "Following " << host << " on port " << replicatePort << "; SIGUSR1 promotes.\n";
+
+    const int status = runServer(port, true);
+    std::signal(SIGUSR1, SIG_DFL);
+    activeFollower = nullptr;
+    follower.stop();
+    if(follower.error()) std::cerr << "Stopped following: " << follower.error() << ".\n";
+    return status;
+}
+
+/****************************************
+ *            Bulk Load and Export      *
+ ****************************************/
+
+/**
+ * @brief Install the buses of a fleet file (see booking/BulkIO.h) into a journal, then
+ *        snapshot it so the next start does not replay every install.
+ *
+ * @return int Exit status.
+ */
+int importFleet(const char* fleetPath, const char* journalPath) {
+    if(!service.openJournal(journalPath, CHECKPOINT_BYTES)) {
+        std::cerr << "Could not open journal " << journalPath << ".\n";
+        return 1;
+    }
+    ImportReport report;
+    const bool imported = service.importFleet(fleetPath, report);
+    if(report.error) std::cerr << "Import failed: " << report.error << ".\n";
+    std::cout << "Read " << report.rows << " rows: " << report.installed << " buses installed, "
+              << report.duplicates << " duplicates skipped, " << report.rejected << " rows rejected.\n";
+    if(report.rejected) std::cout << "First rejected row is on line " << report.firstRejectedLine << ".\n";
+    if(report.installed && !service.checkpoint()) {
+        std::cerr << "Warning: could not write a snapshot; the journal is kept in full.\n";
+    }
+    return imported ? 0 : 1;
+}
+
+/**
+ * @brief Write the seat occupancy of every bus in a journal to a file: CSV if its name
+ *        ends in ".csv", otherwise the columnar format.
+ *
+ * @return int Exit status.
+ */
+int exportOccupancy(const std::string& outputPath, const char* journalPath) {
+    if(!service.openJournal(journalPath)) {
+        std::cerr << "Could not open journal " << journalPath << ".\n";
+        return 1;
+    }
+    const bool csv = outputPath.size() >= 4 && outputPath.compare(outputPath.size() - 4, 4, ".csv") == 0;
+    if(!service.exportOccupancy(outputPath, csv ? ExportFormat::Csv : ExportFormat::Columnar)) {
+        std::cerr << "Could not write " << outputPath << ".\n";
+        return 1;
+    }
+    std::cout << "Exported " << service.size() << " buses to " << outputPath << ".\n";
+    return 0;
+}
+
 /****************************************
  *              Main Function           *
  ****************************************/
@@ -487,11 +731,30 @@ void searchBusesByRoute() {
  * @brief Entry point of the Bus Booking System.
  *
  * Presents a menu-driven interface for users to interact with the system.
- * Continuously loops until the user chooses to exit.
+ * Continuously loops until the user chooses to exit. If a journal file is given on the
+ * command line, buses and bookings are restored from it and every change is saved to it;
+ * the state is snapshotted on exit so the next start does not replay the whole history.
+ * Started as "--serve PORT [journal [--replicate RPORT]]" it serves the booking core over
+ * TCP instead, optionally shipping its journal to followers; "--follow HOST RPORT PORT
+ * journal" serves a read-only follower of such a primary. "--import FLEET journal" loads a
+ * fleet file into the journal and "--export FILE journal" writes out its seat occupancy.
  *
  * @return int Exit status.
  */
-int main() {
+int main(int argc, char** argv) {
+    if(argc > 2 && std::string(argv[1]) == "--serve") {
+        const bool replicate = argc > 5 && std::string(argv[4]) == "--replicate";
+        return serve(argv[2], argc > 3 ? argv[3] : nullptr, replicate ? argv[5] : nullptr);
+    }
+    if(argc > 5 && std::string(argv[1]) == "--follow") return follow(argv[2], argv[3], argv[4], argv[5]);
+    if(argc > 3 && std::string(argv[1]) == "--import") return importFleet(argv[2], argv[3]);
+    if(argc > 3 && std::string(argv[1]) == "--export") return exportOccupancy(argv[2], argv[3]);
+
+    if(argc > 1 && !service.openJournal(argv[1], CHECKPOINT_BYTES)) {
+        std::cerr << "Could not open journal " << argv[1] << ".\n";
+        return 1;
+    }
+
     clearScreen();
     while(true) {
         std::cout << "\n\t\t===== Bus Booking System =====\n"
@@ -501,12 +764,14 @@ int main() {
                   << "\t\t4. Show All Buses Available\n"
                   << "\t\t5. Cancel (Remove) a Seat\n"
                   << "\t\t6. Search Buses by Route\n"
-                  << "\t\t7. Exit\n\n"
+                  << "\t\t7. Find Connections\n"
+                  << "\t\t8. Find My Bookings\n"
+                  << "\t\t9. Exit\n\n"
                   << "\t\tEnter your choice:-> ";
 
         int choice;
         if(!(std::cin >> choice)) {
-            std::cout << "Invalid input. Please enter a number between 1 and 7.\n";
+            std::cout << "Invalid input. Please enter a number between 1 and 9.\n";
             // Clear the error flag and ignore invalid input
             std::cin.clear();
             std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
@@ -517,42 +782,32 @@ int main() {
 
         switch(choice) {
             case 1: {
-                Bus newBus;
-                newBus.install();
-                // Only add if busNumber is valid
-                if(!newBus.getBusNumber().empty()) {
-                    busList.push_back(newBus);
-                }
+                installBus();
                 break;
             }
             case 2: {
-                if(busList.empty()) {
+                if(service.empty()) {
                     std::cout << "No buses installed. Please install a bus first.\n";
                 } else {
-                    // Handle seat allotment using the Bus class
-                    Bus dummy; // Temporary object to call the method
-                    dummy.allotment();
+                    reserveSeat();
                 }
                 break;
             }
             case 3: {
-                if(busList.empty()) {
+                if(service.empty()) {
                     std::cout << "No buses installed yet.\n";
                     break;
                 }
-                std::cout << "Enter bus number to show details (or 0 to cancel): ";
                 std::string number;
-                std::getline(std::cin, number);
-                if(number == "0" || number.empty()) {
+                if(!promptLine("Enter bus number to show details (or 0 to cancel): ", number)) {
                     std::cout << "Operation cancelled.\n";
                     break;
                 }
-                auto it = std::find_if(busList.begin(), busList.end(),
-                    [&](const Bus &b){ return b.getBusNumber() == number; });
-                if(it == busList.end()) {
+                Bus bus;
+                if(service.getBus(number, bus) != BookingStatus::Ok) {
                     std::cout << "Bus not found.\n";
                 } else {
-                    it->show();
+                    showBus(bus);
                 }
                 break;
             }
@@ -561,12 +816,10 @@ int main() {
                 break;
             }
             case 5: {
-                if(busList.empty()) {
+                if(service.empty()) {
                     std::cout << "No buses installed yet.\n";
                 } else {
-                    // Handle seat cancellation using the Bus class
-                    Bus dummy; // Temporary object to call the method
-                    dummy.cancelSeat();
+                    cancelSeat();
                 }
                 break;
             }
@@ -575,11 +828,22 @@ int main() {
                 break;
             }
             case 7: {
+                findConnections();
+                break;
+            }
+            case 8: {
+                findBookings();
+                break;
+            }
+            case 9: {
+                if(argc > 1 && !service.checkpoint()) {
+                    std::cout << "Warning: could not write a snapshot; the journal is kept in full.\n";
+                }
                 std::cout << "Exiting... Have a nice day!\n";
                 return 0;
             }
             default: {
-                std::cout << "Invalid choice. Please enter a number between 1 and 7.\n";
+                std::cout << "Invalid choice. Please enter a number between 1 and 9.\n";
                 break;
             }
         }
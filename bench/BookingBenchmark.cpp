@@ -0,0 +1,571 @@
+// BookingBenchmark.cpp
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <random>
+#include <algorithm>
+#include <functional>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+
+#include <unistd.h>
+
+#include "../booking/BookingService.h"
+#include "../booking/FileUtil.h"
+#include "../booking/FleetColumns.h"
+#include "../booking/OutputBuffer.h"
+#include "../booking/ShardedService.h"
+
+/**
+ * @file BookingBenchmark.cpp
+ * @brief Microbenchmarks for the headless booking core.
+ *
+ * Synthesizes a fleet of N buses spread over a fixed set of cities, pre-fills a share of
+ * their seats, then measures throughput and p50/p99 latency of reserve, cancel, bus-number
+ * lookup, route search, route search filtered by free seats and full-fleet listing, and
+ * how fast the same fleet bulk imports from a fleet file and exports its occupancy. Fleet
+ * scans (free seats, any of several routes, occupancy totals) are timed per pass, beside a
+ * walk over the Bus objects answering the first. With
+ * --shards it repeats reserve, cancel and route search against a ShardedService, and with
+ * --metrics it ends by printing the core's own metrics (see Metrics). --check instead runs
+ * every fleet scan kernel the CPU supports against a plain loop over random filters and
+ * exits with status 2 on any mismatch. Run with --help for the options.
+ */
+
+/**
+ * @brief Benchmark parameters, settable from the command line.
+ */
+struct Options {
+    std::size_t buses = 100000;    /**< Buses to install (1K to 10M is the intended range). */
+    std::size_t ops = 1000000;     /**< Operations per timed phase (listing runs fewer passes). */
+    int cities = 200;              /**< Distinct cities the routes are drawn from. */
+    int occupancy = 50;            /**< Percentage of seats reserved before timing starts. */
+    int threads = 1;               /**< Threads for the reserve, cancel and lookup phases. */
+    int shards = 0;                /**< Shards for the sharded phases, or 0 to skip them. */
+    std::uint64_t seed = 42;       /**< Seed for the synthetic data and access pattern. */
+    bool metrics = false;          /**< Print BookingService::writeMetrics() at the end. */
+    bool check = false;            /**< Only check the fleet scan kernels; see checkKernels(). */
+};
+
+/**
+ * @brief Latency samples and wall time of one timed phase.
+ */
+struct PhaseResult {
+    std::vector<std::uint32_t> latencies;  /**< Per-operation latency in nanoseconds. */
+    double seconds = 0.0;                  /**< Wall time of the whole phase. */
+    std::size_t ops = 0;                   /**< Operations performed. */
+    std::size_t hits = 0;                  /**< Operations that succeeded or matched. */
+};
+
+typedef std::chrono::steady_clock Clock;
+
+/**
+ * @brief Stream buffer that discards everything, so listing measures rendering alone.
+ */
+struct NullBuffer : std::streambuf {
+    std::streamsize xsputn(const char*, std::streamsize n) override { return n; }
+    int overflow(int c) override { return c; }
+};
+
+/**
+ * @brief Nanoseconds between two clock readings, saturated to 32 bits.
+ */
+static std::uint32_t elapsedNs(Clock::time_point start, Clock::time_point end) {
+    long long ns = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+    return ns > 0xFFFFFFFFll ? 0xFFFFFFFFu : static_cast<std::uint32_t>(ns);
+}
+
+/**
+ * @brief Latency at the given percentile of a sorted sample.
+ */
+static std::uint32_t percentile(const std::vector<std::uint32_t>& sorted, double p) {
+    if(sorted.empty()) return 0;
+    std::size_t index = static_cast<std::size_t>(p / 100.0 * (sorted.size() - 1) + 0.5);
+    return sorted[index];
+}
+
+/**
+ * @brief Print one result row: ops/sec, hit rate and latency percentiles.
+ */
+static void report(const char* name, PhaseResult& result) {
+    std::sort(result.latencies.begin(), result.latencies.end());
+    double opsPerSec = result.seconds > 0 ? result.ops / result.seconds : 0.0;
+    double hitRate = result.ops ? 100.0 * result.hits / result.ops : 0.0;
+    std::cout << std::left << std::setw(14) << name << std::right
+              << std::setw(14) << std::fixed << std::setprecision(0) << opsPerSec
+              << std::setw(9) << std::setprecision(1) << hitRate << "%"
+              << std::setw(12) << percentile(result.latencies, 50.0)
+              << std::setw(12) << percentile(result.latencies, 99.0) << "\n";
+}
+
+/**
+ * @brief Run op(thread, i) ops times split across the given number of threads, timing each call.
+ *
+ * @param threads Number of worker threads.
+ * @param ops Total operations across all threads.
+ * @param op Returns true when the operation succeeded or matched.
+ */
+static PhaseResult runPhase(int threads, std::size_t ops,
+                            const std::function<bool(int, std::size_t)>& op) {
+    std::vector<PhaseResult> partial(threads);
+    std::vector<std::thread> workers;
+    const std::size_t perThread = ops / threads;
+
+    Clock::time_point start = Clock::now();
+    for(int t = 0; t < threads; ++t) {
+        workers.emplace_back([&, t]() {
+            PhaseResult &mine = partial[t];
+            mine.latencies.reserve(perThread);
+            for(std::size_t i = 0; i < perThread; ++i) {
+                Clock::time_point before = Clock::now();
+                bool hit = op(t, i);
+                mine.latencies.push_back(elapsedNs(before, Clock::now()));
+                if(hit) ++mine.hits;
+            }
+            mine.ops = perThread;
+        });
+    }
+    for(std::thread &worker : workers) worker.join();
+
+    PhaseResult result;
+    result.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    for(PhaseResult &p : partial) {
+        result.latencies.insert(result.latencies.end(), p.latencies.begin(), p.latencies.end());
+        result.ops += p.ops;
+        result.hits += p.hits;
+    }
+    return result;
+}
+
+/**
+ * @brief Parse the command line into opts.
+ *
+ * @return true If the benchmark should run.
+ * @return false If --help was given or an option was invalid.
+ */
+static bool parseOptions(int argc, char** argv, Options& opts) {
+    for(int i = 1; i < argc; ++i) {
+        const char* arg = argv[i];
+        const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+        if(std::strcmp(arg, "--help") == 0) {
+            std::cout << "Usage: BookingBenchmark [--buses N] [--ops N] [--cities N] "
+                         "[--occupancy PCT] [--threads N] [--shards N] [--seed N] [--metrics] [--check]\n";
+            return false;
+        }
+        if(std::strcmp(arg, "--metrics") == 0) {
+            opts.metrics = true;
+            continue;
+        }
+        if(std::strcmp(arg, "--check") == 0) {
+            opts.check = true;
+            continue;
+        }
+        if(!value) {
+            std::cerr << "Missing value for " << arg << "\n";
+            return false;
+        }
+        unsigned long long n = std::strtoull(value, nullptr, 10);
+        if(std::strcmp(arg, "--buses") == 0) opts.buses = n;
+        else if(std::strcmp(arg, "--ops") == 0) opts.ops = n;
+        else if(std::strcmp(arg, "--cities") == 0) opts.cities = static_cast<int>(n);
+        else if(std::strcmp(arg, "--occupancy") == 0) opts.occupancy = static_cast<int>(n);
+        else if(std::strcmp(arg, "--threads") == 0) opts.threads = static_cast<int>(n);
+        else if(std::strcmp(arg, "--shards") == 0) opts.shards = static_cast<int>(n);
+        else if(std::strcmp(arg, "--seed") == 0) opts.seed = n;
+        else {
+            std::cerr << "Unknown option " << arg << "\n";
+            return false;
+        }
+        ++i;
+    }
+    if(opts.buses == 0 || opts.cities < 2 || opts.threads < 1 || opts.occupancy > 100) {
+        std::cerr << "Invalid options.\n";
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Bus number for the i-th synthetic bus.
+ */
+static std::string busNumberOf(std::size_t i) {
+    char buffer[24];
+    std::snprintf(buffer, sizeof(buffer), "BUS%08zu", i);
+    return buffer;
+}
+
+/**
+ * @brief Write text to a new temporary file.
+ *
+ * @return std::string The file's path, or empty if it could not be written.
+ */
+static std::string writeTempFile(const std::string& text) {
+    char path[] = "/tmp/BookingBenchmark.XXXXXX";
+    const int fd = ::mkstemp(path);
+    if(fd < 0) return std::string();
+    const bool ok = writeAll(fd, text.data(), text.size());
+    ::close(fd);
+    if(!ok) {
+        std::remove(path);
+        return std::string();
+    }
+    return path;
+}
+
+/**
+ * @brief City name for the i-th synthetic city.
+ */
+static std::string cityOf(int i) {
+    return "City" + std::to_string(i);
+}
+
+/**
+ * @brief Whether a row matches filter, worked out from FleetFilter's documented meaning
+ *        rather than from the kernels' Predicate.
+ */
+static bool plainMatch(const FleetFilter& filter, int free, std::uint32_t route, int departure) {
+    if(free < filter.minFree) return false;
+    if(!filter.routes.empty() && std::find(filter.routes.begin(), filter.routes.end(), route) == filter.routes.end()) {
+        return false;
+    }
+    if(filter.fromMinute == NO_TIME) return true;
+    if(departure == NO_TIME) return false;
+    if(filter.fromMinute <= filter.toMinute) return departure >= filter.fromMinute && departure <= filter.toMinute;
+    return departure >= filter.fromMinute || departure <= filter.toMinute;
+}
+
+/**
+ * @brief Check count(), select() and occupancy() of every fleet scan kernel the CPU
+ *        supports against plain loops over the same rows.
+ *
+ * The rows span several slabs and end partway into one, with sold-out, unsold and untimed
+ * buses among them. Each filter runs over a random prefix of the rows, so the kernels'
+ * tails are covered too; filters mix free-seat minimums, route sets and departure windows,
+ * wrapped and single-minute ones included.
+ *
+ * @return true If every kernel agreed with the plain loops.
+ */
+static bool checkKernels(const Options& opts) {
+    const std::size_t rows = 3 * FleetColumns::SLAB_ROWS + 77;
+    const int filters = 2000;
+    const int seatChoices[] = { 1, 7, 30, 40, 64 };
+    std::mt19937_64 rng(opts.seed);
+    FleetColumns columns;
+    std::vector<int> free(rows), seats(rows), departures(rows);
+    std::vector<std::uint32_t> routeIds(rows);
+    for(std::size_t i = 0; i < rows; ++i) {
+        seats[i] = seatChoices[rng() % 5];
+        const int pick = static_cast<int>(rng() % 8);
+        free[i] = pick == 0 ? 0 : pick == 1 ? seats[i] : static_cast<int>(rng() % (seats[i] + 1));
+        routeIds[i] = static_cast<std::uint32_t>(rng() % 16);
+        departures[i] = rng() % 10 == 0 ? NO_TIME : static_cast<int>(rng() % MINUTES_PER_DAY);
+        columns.append(seats[i], routeIds[i], departures[i]);
+        columns.freeSeats(i).store(free[i], std::memory_order_relaxed);
+    }
+
+    bool ok = true;
+    for(const char* name : FleetColumns::kernelNames()) {
+        FleetColumns::useKernels(name);
+        std::mt19937_64 pick(opts.seed + 1);
+        std::size_t mismatches = 0;
+        for(int f = 0; f < filters; ++f) {
+            FleetFilter filter;
+            filter.minFree = static_cast<int>(pick() % 8) - 1;
+            if(pick() % 2) {
+                const std::size_t n = 1 + pick() % 8;
+                for(std::size_t r = 0; r < n; ++r) filter.routes.push_back(static_cast<std::uint32_t>(pick() % 20));
+            }
+            switch(pick() % 4) {
+            case 0:
+                break;
+            case 1:
+                filter.fromMinute = filter.toMinute = static_cast<int>(pick() % MINUTES_PER_DAY);
+                break;
+            default:
+                // About half of these start after they end and wrap past midnight
+                filter.fromMinute = static_cast<int>(pick() % MINUTES_PER_DAY);
+                filter.toMinute = static_cast<int>(pick() % MINUTES_PER_DAY);
+                break;
+            }
+            const std::size_t n = f % 4 == 0 ? rows : pick() % (rows + 1);
+
+            std::vector<std::size_t> want, got;
+            FleetOccupancy plain;
+            plain.buses = n;
+            for(std::size_t i = 0; i < n; ++i) {
+                if(plainMatch(filter, free[i], routeIds[i], departures[i])) want.push_back(i);
+                plain.seats += seats[i];
+                plain.freeSeats += free[i];
+                plain.soldOut += free[i] == 0;
+                plain.unsold += free[i] == seats[i];
+            }
+            const std::size_t counted = columns.count(filter, n);
+            const std::size_t selected = columns.select(filter, n, [&](std::size_t row) { got.push_back(row); });
+            const FleetOccupancy totals = columns.occupancy(n);
+            if(counted != want.size() || selected != want.size() || got != want || totals.buses != plain.buses ||
+               totals.seats != plain.seats || totals.freeSeats != plain.freeSeats ||
+               totals.soldOut != plain.soldOut || totals.unsold != plain.unsold) {
+                ++mismatches;
+            }
+        }
+        std::cout << "kernel check (" << name << "): " << filters << " filters over up to " << rows << " rows, "
+                  << mismatches << " mismatches\n";
+        ok = ok && mismatches == 0;
+    }
+    return ok;
+}
+
+/**
+ * @brief Repeat the reserve, cancel and route search phases on a ShardedService holding the
+ *        same fleet, one session per thread.
+ */
+static void runSharded(const Options& opts, const std::vector<std::string>& numbers,
+                       const std::vector<std::pair<std::string, std::string>>& routes,
+                       const std::vector<std::uint32_t>& pickBus, const std::vector<std::uint8_t>& pickSeat) {
+    ShardedService sharded(opts.shards);
+    std::vector<ShardedService::Session*> sessions;
+    for(int t = 0; t < opts.threads; ++t) sessions.push_back(sharded.openSession());
+
+    Clock::time_point start = Clock::now();
+    for(std::size_t i = 0; i < opts.buses; ++i) {
+        BusInfo info;
+        info.busNumber = numbers[i];
+        info.driverName = "Driver";
+        info.arrivalTime = "12:00";
+        info.departureTime = "10:30";
+        info.from = routes[i].first;
+        info.to = routes[i].second;
+        sessions[0]->install(info);
+    }
+    double installSeconds = std::chrono::duration<double>(Clock::now() - start).count();
+    std::cout << "\nshards=" << opts.shards << " install: " << std::setprecision(0)
+              << opts.buses / installSeconds << " buses/sec\n";
+
+    const std::string passenger = "Passenger";
+    const std::size_t perThread = opts.ops / opts.threads;
+    PhaseResult reserve = runPhase(opts.threads, opts.ops, [&](int t, std::size_t i) {
+        std::size_t k = t * perThread + i;
+        return sessions[t]->reserve(numbers[pickBus[k]], pickSeat[k], passenger) == BookingStatus::Ok;
+    });
+    report("shard reserve", reserve);
+
+    PhaseResult cancel = runPhase(opts.threads, opts.ops, [&](int t, std::size_t i) {
+        std::size_t k = t * perThread + i;
+        return sessions[t]->cancel(numbers[pickBus[k]], pickSeat[k]) == BookingStatus::Ok;
+    });
+    report("shard cancel", cancel);
+
+    std::vector<std::vector<RouteMatch>> matches(opts.threads);
+    PhaseResult search = runPhase(opts.threads, std::min<std::size_t>(opts.ops, 100000), [&](int t, std::size_t i) {
+        const std::pair<std::string, std::string> &route = routes[pickBus[t * perThread + i]];
+        return sessions[t]->searchRoute(route.first, route.second, NO_TIME, NO_TIME, matches[t]) > 0;
+    });
+    report("shard route", search);
+}
+
+int main(int argc, char** argv) {
+    Options opts;
+    if(!parseOptions(argc, argv, opts)) return 1;
+    if(opts.check) return checkKernels(opts) ? 0 : 2;
+
+    BookingService service;
+    std::mt19937_64 rng(opts.seed);
+    std::vector<std::string> numbers(opts.buses);
+    std::vector<std::pair<std::string, std::string>> routes(opts.buses);
+
+    // Build the fleet, keeping a copy as a fleet file for the bulk import
+    std::string fleet = "bus_number,driver,arrival,departure,from,to\n";
+    Clock::time_point start = Clock::now();
+    for(std::size_t i = 0; i < opts.buses; ++i) {
+        int from = static_cast<int>(rng() % opts.cities);
+        int to = static_cast<int>((from + 1 + rng() % (opts.cities - 1)) % opts.cities);
+        BusInfo info;
+        info.busNumber = numbers[i] = busNumberOf(i);
+        info.driverName = "Driver" + std::to_string(rng() % 1000);
+        info.arrivalTime = std::to_string(rng() % 24) + ":00";
+        info.departureTime = std::to_string(rng() % 24) + ":30";
+        info.from = routes[i].first = cityOf(from);
+        info.to = routes[i].second = cityOf(to);
+        service.install(info);
+        fleet.append(info.busNumber).append(",").append(info.driverName).append(",").append(info.arrivalTime)
+             .append(",").append(info.departureTime).append(",").append(info.from).append(",").append(info.to)
+             .append("\n");
+    }
+    double installSeconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    double importSeconds = 0.0;
+    const std::string fleetPath = writeTempFile(fleet);
+    if(!fleetPath.empty()) {
+        BookingService imported;
+        ImportReport report;
+        start = Clock::now();
+        imported.importFleet(fleetPath, report, static_cast<unsigned>(opts.threads));
+        importSeconds = std::chrono::duration<double>(Clock::now() - start).count();
+        std::remove(fleetPath.c_str());
+    }
+    std::string().swap(fleet);
+
+    // Pre-fill the requested share of seats
+    const std::string passenger = "Passenger";
+    for(std::size_t i = 0; i < opts.buses; ++i) {
+        for(int seat = 1; seat <= CoachLayout::SEAT_COUNT; ++seat) {
+            if(static_cast<int>(rng() % 100) < opts.occupancy) service.reserve(numbers[i], seat, passenger);
+        }
+    }
+
+    std::cout << "buses=" << opts.buses << " cities=" << opts.cities
+              << " occupancy=" << opts.occupancy << "% threads=" << opts.threads
+              << " ops=" << opts.ops << "\n"
+              << "install: " << std::fixed << std::setprecision(0)
+              << opts.buses / installSeconds << " buses/sec";
+    if(importSeconds > 0.0) std::cout << ", bulk import: " << opts.buses / importSeconds << " buses/sec";
+    std::cout << "\n\n"
+              << std::left << std::setw(14) << "operation" << std::right
+              << std::setw(14) << "ops/sec" << std::setw(10) << "hit"
+              << std::setw(12) << "p50 ns" << std::setw(12) << "p99 ns" << "\n";
+
+    // Pre-generate the access pattern so the timed loops only touch the service
+    std::vector<std::uint32_t> pickBus(opts.ops);
+    std::vector<std::uint8_t> pickSeat(opts.ops);
+    for(std::size_t i = 0; i < opts.ops; ++i) {
+        pickBus[i] = static_cast<std::uint32_t>(rng() % opts.buses);
+        pickSeat[i] = static_cast<std::uint8_t>(1 + rng() % CoachLayout::SEAT_COUNT);
+    }
+    const std::size_t perThread = opts.ops / opts.threads;
+
+    PhaseResult lookup = runPhase(opts.threads, opts.ops, [&](int t, std::size_t i) {
+        return service.hasBus(numbers[pickBus[t * perThread + i]]);
+    });
+    report("lookup", lookup);
+
+    PhaseResult reserve = runPhase(opts.threads, opts.ops, [&](int t, std::size_t i) {
+        std::size_t k = t * perThread + i;
+        return service.reserve(numbers[pickBus[k]], pickSeat[k], passenger) == BookingStatus::Ok;
+    });
+    report("reserve", reserve);
+
+    PhaseResult cancel = runPhase(opts.threads, opts.ops, [&](int t, std::size_t i) {
+        std::size_t k = t * perThread + i;
+        return service.cancel(numbers[pickBus[k]], pickSeat[k]) == BookingStatus::Ok;
+    });
+    report("cancel", cancel);
+
+    // Hold a seat and give it straight back, as a customer abandoning checkout would
+    PhaseResult hold = runPhase(opts.threads, opts.ops, [&](int t, std::size_t i) {
+        std::size_t k = t * perThread + i;
+        HoldTable::Id id;
+        if(service.hold(numbers[pickBus[k]], { pickSeat[k] }, 60, id) != BookingStatus::Ok) return false;
+        return service.releaseHold(id) == BookingStatus::Ok;
+    });
+    report("hold+release", hold);
+
+    PhaseResult search = runPhase(1, opts.ops, [&](int, std::size_t i) {
+        const std::pair<std::string, std::string> &route = routes[pickBus[i]];
+        std::size_t seen = 0;
+        service.forEachOnRoute(route.first, route.second, [&](const Bus &b) { seen += b.emptySeatCount(); });
+        return seen > 0;
+    });
+    report("route search", search);
+
+    // The same routes, keeping only buses with room for a group of four
+    PhaseResult filter = runPhase(1, opts.ops, [&](int, std::size_t i) {
+        const std::pair<std::string, std::string> &route = routes[pickBus[i]];
+        return service.forEachWithFreeSeats(route.first, route.second, 4, [](const Bus &) {}) > 0;
+    });
+    report("free >= 4", filter);
+
+    // Multi-leg journeys between random cities; the first search builds the connection index
+    std::size_t journeys = std::min<std::size_t>(opts.ops, 2000);
+    start = Clock::now();
+    service.findJourney(cityOf(0), cityOf(1), JourneyQuery(), [](const Bus &, const JourneyLeg &) {});
+    std::cout << "connection index build: " << std::setprecision(1)
+              << std::chrono::duration<double, std::milli>(Clock::now() - start).count() << " ms\n";
+    PhaseResult journey = runPhase(1, journeys, [&](int, std::size_t i) {
+        const int from = static_cast<int>(pickBus[i] % opts.cities);
+        JourneyQuery query;
+        query.departAfter = pickSeat[i] * 37 % MINUTES_PER_DAY;
+        query.seats = 2;
+        return service.findJourney(cityOf(from), cityOf((from + 1 + pickSeat[i]) % opts.cities), query,
+                                   [](const Bus &, const JourneyLeg &) {}) > 0;
+    });
+    report("journey", journey);
+
+    // Listing renders every bus the way showAllBuses does, paging into a discarding stream
+    NullBuffer discard;
+    std::ostream sink(&discard);
+    OutputBuffer screen(sink);
+    std::size_t passes = std::max<std::size_t>(1, std::min<std::size_t>(20, opts.ops / opts.buses));
+    PhaseResult listing = runPhase(1, passes, [&](int, std::size_t) {
+        service.forEachBus([&](const Bus &b) {
+            screen.fill('*', 80).append('\n')
+                  .append("Bus Number    : ").append(b.getBusNumber())
+                  .append("\nDriver        : ").append(service.text(b.getDriverName()))
+                  .append("\nArrival Time  : ").append(service.text(b.getArrivalTime()))
+                  .append("\nDeparture Time: ").append(service.text(b.getDepartureTime()))
+                  .append("\nRoute         : ").append(service.text(b.getOrigin())).append(" -> ")
+                  .append(service.text(b.getDestination())).append('\n')
+                  .fill('*', 80).append('\n');
+        });
+        screen.flush();
+        return true;
+    });
+    std::cout << "\nlisting: " << std::setprecision(0)
+              << listing.ops * opts.buses / listing.seconds << " buses/sec over "
+              << listing.ops << " full passes\n";
+    report("listing pass", listing);
+
+    // Fleet-wide filters scan the columns; the walk answers the first one bus by bus
+    const std::size_t scans = std::max<std::size_t>(1, std::min<std::size_t>(100, opts.ops / opts.buses * 10));
+    FleetQuery roomy;
+    roomy.minFree = 4;
+    FleetQuery anyRoute;
+    for(std::size_t i = 0; i < 8; ++i) anyRoute.routes.push_back(routes[pickBus[i]]);
+    std::size_t roomyCount = 0, walkCount = 0, routeCount = 0;
+    FleetOccupancy totals;
+    auto perPass = [&](const std::function<void()>& scan) {
+        Clock::time_point began = Clock::now();
+        for(std::size_t pass = 0; pass < scans; ++pass) scan();
+        return std::chrono::duration<double, std::milli>(Clock::now() - began).count() / scans;
+    };
+    const double roomyMs = perPass([&]() { roomyCount = service.countMatching(roomy); });
+    const double selectMs = perPass([&]() { service.forEachMatching(roomy, [](const Bus &) {}); });
+    const double walkMs = perPass([&]() {
+        walkCount = 0;
+        service.forEachBus([&](const Bus &b) { walkCount += service.freeSeats(b.getBusNumber()) >= 4; });
+    });
+    const double routeMs = perPass([&]() { routeCount = service.countMatching(anyRoute); });
+    const double occupancyMs = perPass([&]() { totals = service.occupancy(); });
+    std::cout << "\nfleet scans (" << FleetColumns::kernelName() << "), ms per pass over " << scans << " passes:\n"
+              << std::setprecision(3)
+              << "  free >= 4 count   " << roomyMs << " ms, " << roomyCount << " buses\n"
+              << "  free >= 4 select  " << selectMs << " ms\n"
+              << "  free >= 4 walk    " << walkMs << " ms, " << walkCount << " buses"
+              << (walkCount == roomyCount ? "" : " (MISMATCH)") << "\n"
+              << "  any of 8 routes   " << routeMs << " ms, " << routeCount << " buses\n"
+              << "  occupancy         " << occupancyMs << " ms, " << totals.freeSeats << " of " << totals.seats
+              << " seats empty, " << totals.soldOut << " buses sold out\n";
+
+    const std::string exportPath = writeTempFile(std::string());
+    if(!exportPath.empty()) {
+        start = Clock::now();
+        service.exportOccupancy(exportPath, ExportFormat::Columnar);
+        const double exportSeconds = std::chrono::duration<double>(Clock::now() - start).count();
+        std::cout << "occupancy export: " << std::setprecision(0) << opts.buses / exportSeconds << " buses/sec\n";
+        std::remove(exportPath.c_str());
+    }
+
+    if(opts.shards > 0) runSharded(opts, numbers, routes, pickBus, pickSeat);
+
+    if(opts.metrics) {
+        std::string metrics;
+        service.writeMetrics(metrics);
+        std::cout << "\n" << metrics;
+    }
+    return 0;
+}
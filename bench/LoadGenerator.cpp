@@ -0,0 +1,631 @@
+// LoadGenerator.cpp
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <algorithm>
+#include <functional>
+#include <unordered_map>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+
+#include "../booking/BookingService.h"
+#include "../booking/Journal.h"
+
+/**
+ * @file LoadGenerator.cpp
+ * @brief Drives the booking core with production-like traffic and checks it stayed
+ *        consistent.
+ *
+ * Two modes:
+ *
+ *  - Generate (the default): installs a synthetic fleet, pre-fills a share of its seats,
+ *    then runs a configurable mix of install, reserve, cancel, route search and full
+ *    listing from several threads. Buses are picked with Zipfian popularity, and so are
+ *    the routes searched, since a route is searched as often as its buses are booked.
+ *    With --journal the run is journaled, which both measures durable bookings and records
+ *    traffic for later replay.
+ *  - Replay (--replay JOURNAL): re-issues every change recorded in a journal as a call on
+ *    a fresh in-memory core, with the records of each bus on one thread and in journal
+ *    order, so the end state is deterministic however many threads run. The journal should
+ *    hold its whole history; one compacted after a snapshot starts from state it does not
+ *    contain, and its records that relied on that state are reported as divergent.
+ *
+ * Either way it reports throughput, per-operation latency percentiles, and consistency
+ * violations. Every successful reserve and cancel is counted per seat, and once the load
+ * stops each seat's count must be 1 if the core has it reserved and 0 otherwise: a seat
+ * sold twice ends at 2 (or 1 on an empty seat), whatever the interleaving. The core's own
+ * free-seat and booking counters are checked against its seat maps as well. Dated trips
+ * are replayed and timed but not checked. Exits with status 2 if anything was violated.
+ * Run with --help for the options.
+ */
+
+/**
+ * @brief Kinds of operation, generated or replayed.
+ */
+enum class Op {
+    Install,
+    Reserve,
+    Cancel,
+    Search,
+    List,
+    ReserveSeats,
+    CancelSeats,
+    Schedule,
+    ReserveTrip,
+    CancelTrip
+};
+
+const int OP_COUNT = 10;
+const int GENERATED_OP_COUNT = 5;  /**< Install to List can be generated; the rest only replayed. */
+const char* const OP_NAMES[OP_COUNT] = {
+    "install", "reserve", "cancel", "search", "list",
+    "reserve-seats", "cancel-seats", "schedule", "reserve-trip", "cancel-trip"
+};
+
+/**
+ * @brief Parameters, settable from the command line.
+ */
+struct Options {
+    std::size_t buses = 10000;     /**< Buses installed before the load starts. */
+    std::size_t ops = 1000000;     /**< Operations to generate, across all threads. */
+    int cities = 100;              /**< Distinct cities the routes are drawn from. */
+    int occupancy = 30;            /**< Percentage of seats reserved before the load starts. */
+    int threads = 4;               /**< Threads issuing operations. */
+    double zipf = 0.99;            /**< Zipf exponent of bus popularity; 0 for uniform. */
+    int mix[GENERATED_OP_COUNT] = { 1, 55, 35, 9, 0 };  /**< Relative weight of each generated kind. */
+    std::uint64_t seed = 42;       /**< Seed for the fleet and the access pattern. */
+    std::string journal;           /**< Journal to log the generated run to, or empty. */
+    std::string replay;            /**< Journal to replay instead of generating, or empty. */
+};
+
+typedef std::chrono::steady_clock Clock;
+
+/**
+ * @brief Latencies and outcomes of one kind of operation, on one thread or merged.
+ */
+struct OpStats {
+    std::vector<std::uint32_t> latencies;  /**< Nanoseconds, one per operation. */
+    std::size_t ok = 0;                    /**< Operations that returned Ok or found something. */
+};
+
+/**
+ * @brief What a worker thread measured.
+ */
+struct WorkerStats {
+    OpStats ops[OP_COUNT];
+    std::size_t divergent = 0;             /**< Replayed changes that did not return Ok. */
+    std::size_t seen = 0;                  /**< What searches and listings read, summed so the
+                                                reads are not optimised away. */
+};
+
+/**
+ * @brief Samples ranks 0 to n - 1 with probability proportional to 1 / (rank + 1)^s.
+ *
+ * Inverts the cumulative distribution by binary search, so a sample costs a few dozen
+ * comparisons whatever the skew.
+ */
+class Zipf {
+public:
+    Zipf(std::size_t n, double s) : cdf(s > 0 ? n : 0), count(n) {
+        double sum = 0;
+        for(std::size_t k = 0; k < cdf.size(); ++k) {
+            sum += 1.0 / std::pow(static_cast<double>(k + 1), s);
+            cdf[k] = sum;
+        }
+        for(double &p : cdf) p /= sum;
+    }
+
+    std::size_t operator()(std::mt19937_64& rng) const {
+        if(cdf.empty()) return rng() % count;
+        const double u = std::uniform_real_distribution<double>(0.0, 1.0)(rng);
+        const std::size_t k = std::lower_bound(cdf.begin(), cdf.end(), u) - cdf.begin();
+        return k < count ? k : count - 1;
+    }
+
+private:
+    std::vector<double> cdf;  /**< Cumulative probability per rank, or empty for uniform. */
+    std::size_t count;
+};
+
+/**
+ * @brief Successful reserves minus successful cancels, per seat of every bus the load
+ *        touches, updated by all threads at once.
+ */
+class SeatLedger {
+public:
+    explicit SeatLedger(std::size_t buses) : balance(new std::atomic<std::int32_t>[buses * Bus::MAX_SEATS]), size(buses) {
+        for(std::size_t i = 0; i < buses * Bus::MAX_SEATS; ++i) balance[i].store(0, std::memory_order_relaxed);
+    }
+    ~SeatLedger() { delete[] balance; }
+
+    SeatLedger(const SeatLedger&) = delete;
+    SeatLedger& operator=(const SeatLedger&) = delete;
+
+    void reserved(std::size_t bus, int seatNumber) { at(bus, seatNumber).fetch_add(1, std::memory_order_relaxed); }
+    void cancelled(std::size_t bus, int seatNumber) { at(bus, seatNumber).fetch_sub(1, std::memory_order_relaxed); }
+    std::int32_t of(std::size_t bus, int seatNumber) const {
+        return balance[bus * Bus::MAX_SEATS + seatNumber - 1].load(std::memory_order_relaxed);
+    }
+    std::size_t buses() const { return size; }
+
+private:
+    std::atomic<std::int32_t>* balance;
+    std::size_t size;
+
+    std::atomic<std::int32_t>& at(std::size_t bus, int seatNumber) {
+        return balance[bus * Bus::MAX_SEATS + seatNumber - 1];
+    }
+};
+
+/**
+ * @brief Violations found once the load has stopped.
+ */
+struct Violations {
+    std::size_t doubleBooked = 0;   /**< Seats sold more often than cancelled, twice over. */
+    std::size_t lost = 0;           /**< Seats whose reservation does not match their ledger. */
+    std::size_t counters = 0;       /**< Counters that disagree with the seat maps. */
+
+    std::size_t total() const { return doubleBooked + lost + counters; }
+};
+
+/**
+ * @brief Nanoseconds between two clock readings, saturated to 32 bits.
+ */
+static std::uint32_t elapsedNs(Clock::time_point start, Clock::time_point end) {
+    long long ns = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+    return ns > 0xFFFFFFFFll ? 0xFFFFFFFFu : static_cast<std::uint32_t>(ns);
+}
+
+/**
+ * @brief Latency at the given percentile of a sorted sample.
+ */
+static std::uint32_t percentile(const std::vector<std::uint32_t>& sorted, double p) {
+    if(sorted.empty()) return 0;
+    std::size_t index = static_cast<std::size_t>(p / 100.0 * (sorted.size() - 1) + 0.5);
+    return sorted[index];
+}
+
+/**
+ * @brief Parse "reserve=55,cancel=35,..." into weights for the generated kinds. Kinds
+ *        not named get weight 0.
+ */
+static bool parseMix(const char* text, int* mix) {
+    int weights[GENERATED_OP_COUNT] = {};
+    int total = 0;
+    for(const char* p = text; *p; ) {
+        const char* equals = std::strchr(p, '=');
+        if(!equals) return false;
+        int kind = 0;
+        while(kind < GENERATED_OP_COUNT && std::strncmp(p, OP_NAMES[kind], equals - p) != 0) ++kind;
+        if(kind == GENERATED_OP_COUNT || OP_NAMES[kind][equals - p] != '\0') return false;
+        char *end;
+        const long weight = std::strtol(equals + 1, &end, 10);
+        if(end == equals + 1 || weight < 0 || weight > 1000000 || (*end != ',' && *end != '\0')) return false;
+        weights[kind] = static_cast<int>(weight);
+        total += static_cast<int>(weight);
+        p = *end ? end + 1 : end;
+    }
+    if(total == 0) return false;
+    std::copy(weights, weights + GENERATED_OP_COUNT, mix);
+    return true;
+}
+
+/**
+ * @brief Parse the command line into opts.
+ *
+ * @return true If the load should run.
+ * @return false If --help was given or an option was invalid.
+ */
+static bool parseOptions(int argc, char** argv, Options& opts) {
+    for(int i = 1; i < argc; ++i) {
+        const char* arg = argv[i];
+        const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+        if(std::strcmp(arg, "--help") == 0) {
+            std::cout << "Usage: LoadGenerator [--buses N] [--ops N] [--cities N] [--occupancy PCT] "
+                         "[--threads N] [--zipf S] [--mix KIND=W,...] [--seed N] [--journal FILE]\n"
+                         "       LoadGenerator --replay JOURNAL [--threads N]\n"
+                         "Generated kinds: install, reserve, cancel, search, list "
+                         "(default mix install=1,reserve=55,cancel=35,search=9).\n";
+            return false;
+        }
+        if(!value) {
+            std::cerr << "Missing value for " << arg << "\n";
+            return false;
+        }
+        unsigned long long n = std::strtoull(value, nullptr, 10);
+        if(std::strcmp(arg, "--buses") == 0) opts.buses = n;
+        else if(std::strcmp(arg, "--ops") == 0) opts.ops = n;
+        else if(std::strcmp(arg, "--cities") == 0) opts.cities = static_cast<int>(n);
+        else if(std::strcmp(arg, "--occupancy") == 0) opts.occupancy = static_cast<int>(n);
+        else if(std::strcmp(arg, "--threads") == 0) opts.threads = static_cast<int>(n);
+        else if(std::strcmp(arg, "--zipf") == 0) opts.zipf = std::strtod(value, nullptr);
+        else if(std::strcmp(arg, "--seed") == 0) opts.seed = n;
+        else if(std::strcmp(arg, "--journal") == 0) opts.journal = value;
+        else if(std::strcmp(arg, "--replay") == 0) opts.replay = value;
+        else if(std::strcmp(arg, "--mix") == 0) {
+            if(!parseMix(value, opts.mix)) {
+                std::cerr << "Invalid mix " << value << "\n";
+                return false;
+            }
+        } else {
+            std::cerr << "Unknown option " << arg << "\n";
+            return false;
+        }
+        ++i;
+    }
+    if(opts.buses == 0 || opts.cities < 2 || opts.threads < 1 || opts.occupancy > 100 || opts.zipf < 0) {
+        std::cerr << "Invalid options.\n";
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Bus number for the i-th bus, installed up front or during the load.
+ */
+static std::string busNumberOf(std::size_t i) {
+    char buffer[24];
+    std::snprintf(buffer, sizeof(buffer), "BUS%08zu", i);
+    return buffer;
+}
+
+/**
+ * @brief City name for the i-th synthetic city.
+ */
+static std::string cityOf(int i) {
+    return "City" + std::to_string(i);
+}
+
+/**
+ * @brief Time one call into the service and file it under its kind.
+ *
+ * @param call Returns true when the operation succeeded or found something.
+ */
+template <typename Call>
+static bool timed(WorkerStats& stats, Op op, Call call) {
+    const Clock::time_point before = Clock::now();
+    const bool ok = call();
+    OpStats &s = stats.ops[static_cast<int>(op)];
+    s.latencies.push_back(elapsedNs(before, Clock::now()));
+    s.ok += ok;
+    return ok;
+}
+
+/**
+ * @brief Compare the ledger with the seat maps, and the core's counters with both.
+ *
+ * @param numbers Bus number per ledger index, covering every bus the core has; numbers
+ *        never installed are skipped.
+ * @param singleSeatBookings Every booking made had one seat, so bookings must equal
+ *        reserved seats.
+ */
+static Violations check(const BookingService& service, const SeatLedger& ledger,
+                        const std::vector<std::string>& numbers, bool singleSeatBookings) {
+    Violations found;
+    std::int64_t empty = 0;
+    std::size_t reservedSeats = 0;
+    Bus bus;
+    for(std::size_t i = 0; i < ledger.buses(); ++i) {
+        if(service.getBus(numbers[i], bus) != BookingStatus::Ok) continue;
+        for(int seatNumber = 1; seatNumber <= bus.seatCount(); ++seatNumber) {
+            const std::int32_t balance = ledger.of(i, seatNumber);
+            const int reserved = bus.isReserved(seatNumber) ? 1 : 0;
+            if(balance > 1) ++found.doubleBooked;
+            else if(balance != reserved) ++found.lost;
+        }
+        reservedSeats += countBits(bus.occupiedSeats());
+        if(service.freeSeats(numbers[i]) != bus.emptySeatCount()) ++found.counters;
+        empty += bus.emptySeatCount();
+    }
+    if(service.totalFreeSeats() != empty) ++found.counters;
+    if(singleSeatBookings && service.bookingCount() != reservedSeats) ++found.counters;
+    return found;
+}
+
+/**
+ * @brief Print throughput, the per-kind latency table and the violations.
+ *
+ * @return int Exit status: 0, or 2 if anything was violated.
+ */
+static int report(std::vector<WorkerStats>& workers, double seconds, const Violations& violations) {
+    OpStats merged[OP_COUNT];
+    std::size_t total = 0, divergent = 0;
+    for(WorkerStats &w : workers) {
+        for(int k = 0; k < OP_COUNT; ++k) {
+            merged[k].latencies.insert(merged[k].latencies.end(), w.ops[k].latencies.begin(), w.ops[k].latencies.end());
+            merged[k].ok += w.ops[k].ok;
+        }
+        divergent += w.divergent;
+    }
+    for(OpStats &s : merged) total += s.latencies.size();
+
+    std::cout << std::fixed << std::setprecision(0) << total << " operations in " << std::setprecision(2)
+              << seconds << " s: " << std::setprecision(0) << (seconds > 0 ? total / seconds : 0.0)
+              << " ops/sec\n\n"
+              << std::left << std::setw(14) << "operation" << std::right << std::setw(10) << "count"
+              << std::setw(8) << "ok" << std::setw(11) << "p50 ns" << std::setw(11) << "p90 ns"
+              << std::setw(11) << "p99 ns" << std::setw(11) << "p99.9 ns" << std::setw(11) << "max ns" << "\n";
+    for(int k = 0; k < OP_COUNT; ++k) {
+        std::vector<std::uint32_t> &l = merged[k].latencies;
+        if(l.empty()) continue;
+        std::sort(l.begin(), l.end());
+        std::cout << std::left << std::setw(14) << OP_NAMES[k] << std::right << std::setw(10) << l.size()
+                  << std::setw(7) << std::setprecision(1) << 100.0 * merged[k].ok / l.size() << "%"
+                  << std::setw(11) << percentile(l, 50.0) << std::setw(11) << percentile(l, 90.0)
+                  << std::setw(11) << percentile(l, 99.0) << std::setw(11) << percentile(l, 99.9)
+                  << std::setw(11) << l.back() << "\n";
+    }
+
+    std::cout << "\nconsistency: " << violations.total() << " violations (" << violations.doubleBooked
+              << " double-booked seats, " << violations.lost << " seats out of step with their bookings, "
+              << violations.counters << " counter mismatches)\n";
+    if(divergent) std::cout << "replay: " << divergent << " changes did not apply\n";
+    return violations.total() ? 2 : 0;
+}
+
+/**
+ * @brief Install the fleet and pre-fill its seats, recording the reservations in the
+ *        ledger.
+ */
+static void buildFleet(BookingService& service, const Options& opts, std::mt19937_64& rng,
+                       std::vector<std::string>& numbers, std::vector<std::pair<std::string, std::string>>& routes,
+                       SeatLedger& ledger) {
+    for(std::size_t i = 0; i < opts.buses; ++i) {
+        const int from = static_cast<int>(rng() % opts.cities);
+        const int to = static_cast<int>((from + 1 + rng() % (opts.cities - 1)) % opts.cities);
+        BusInfo info;
+        info.busNumber = numbers[i];
+        info.driverName = "Driver" + std::to_string(rng() % 1000);
+        info.arrivalTime = std::to_string(rng() % 24) + ":00";
+        info.departureTime = std::to_string(rng() % 24) + ":30";
+        info.from = routes[i].first = cityOf(from);
+        info.to = routes[i].second = cityOf(to);
+        service.install(info);
+    }
+    service.beginDeferred();
+    for(std::size_t i = 0; i < opts.buses; ++i) {
+        for(int seat = 1; seat <= CoachLayout::SEAT_COUNT; ++seat) {
+            if(static_cast<int>(rng() % 100) >= opts.occupancy) continue;
+            if(service.reserve(numbers[i], seat, "Passenger" + std::to_string(rng() % 1000)) == BookingStatus::Ok) {
+                ledger.reserved(i, seat);
+            }
+        }
+    }
+    service.endDeferred();
+}
+
+/**
+ * @brief Generate the mix against a synthetic fleet.
+ */
+static int generate(const Options& opts) {
+    BookingService service;
+    if(!opts.journal.empty()) {
+        if(!service.openJournal(opts.journal)) {
+            std::cerr << "Could not open journal " << opts.journal << "\n";
+            return 1;
+        }
+        if(!service.empty()) {
+            std::cerr << "Journal " << opts.journal << " is not new\n";
+            return 1;
+        }
+    }
+
+    // Buses installed during the load take the numbers after the fleet's, with room for
+    // twice the expected share; installs beyond that are skipped
+    int totalWeight = 0;
+    for(int w : opts.mix) totalWeight += w;
+    const double installShare = static_cast<double>(opts.mix[static_cast<int>(Op::Install)]) / totalWeight;
+    const std::size_t installs = installShare > 0 ? static_cast<std::size_t>(2 * installShare * opts.ops) + 1000 : 0;
+    std::vector<std::string> numbers(opts.buses + installs);
+    for(std::size_t i = 0; i < numbers.size(); ++i) numbers[i] = busNumberOf(i);
+    std::vector<std::pair<std::string, std::string>> routes(opts.buses);
+    SeatLedger ledger(numbers.size());
+
+    std::mt19937_64 rng(opts.seed);
+    Clock::time_point start = Clock::now();
+    buildFleet(service, opts, rng, numbers, routes, ledger);
+    std::cout << "buses=" << opts.buses << " cities=" << opts.cities << " occupancy=" << opts.occupancy
+              << "% threads=" << opts.threads << " zipf=" << std::setprecision(2) << opts.zipf << " mix=";
+    for(int k = 0; k < GENERATED_OP_COUNT; ++k) std::cout << (k ? "," : "") << OP_NAMES[k] << "=" << opts.mix[k];
+    std::cout << (opts.journal.empty() ? "" : " journaled") << "\nfleet built in " << std::setprecision(2)
+              << std::chrono::duration<double>(Clock::now() - start).count() << " s\n";
+
+    // Popularity ranks map to buses through a shuffle, so the busiest buses are not the oldest
+    const Zipf zipf(opts.buses, opts.zipf);
+    std::vector<std::uint32_t> busOfRank(opts.buses);
+    for(std::size_t i = 0; i < opts.buses; ++i) busOfRank[i] = static_cast<std::uint32_t>(i);
+    std::shuffle(busOfRank.begin(), busOfRank.end(), rng);
+
+    std::atomic<std::size_t> nextInstall(opts.buses);
+    std::vector<WorkerStats> workers(opts.threads);
+    std::vector<std::thread> threads;
+    start = Clock::now();
+    for(int t = 0; t < opts.threads; ++t) {
+        threads.emplace_back([&, t]() {
+            WorkerStats &stats = workers[t];
+            std::mt19937_64 local(opts.seed + 1 + t);
+            const std::size_t count = opts.ops / opts.threads + (static_cast<std::size_t>(t) < opts.ops % opts.threads);
+            for(OpStats &s : stats.ops) s.latencies.reserve(count / 2);
+            const std::string passenger = "Rider" + std::to_string(t);
+            std::size_t seen = 0;
+
+            for(std::size_t i = 0; i < count; ++i) {
+                int pick = static_cast<int>(local() % totalWeight), kind = 0;
+                while(pick >= opts.mix[kind]) pick -= opts.mix[kind++];
+                const std::size_t bus = busOfRank[zipf(local)];
+                const int seat = 1 + static_cast<int>(local() % CoachLayout::SEAT_COUNT);
+
+                switch(static_cast<Op>(kind)) {
+                    case Op::Install: {
+                        const std::size_t n = nextInstall.fetch_add(1, std::memory_order_relaxed);
+                        if(n >= numbers.size()) break;
+                        BusInfo info;
+                        info.busNumber = numbers[n];
+                        info.driverName = "Driver";
+                        info.arrivalTime = "12:00";
+                        info.departureTime = "10:30";
+                        info.from = routes[bus].first;
+                        info.to = routes[bus].second;
+                        timed(stats, Op::Install, [&]() { return service.install(info) == BookingStatus::Ok; });
+                        break;
+                    }
+                    case Op::Reserve:
+                        if(timed(stats, Op::Reserve, [&]() { return service.reserve(numbers[bus], seat, passenger) == BookingStatus::Ok; })) {
+                            ledger.reserved(bus, seat);
+                        }
+                        break;
+                    case Op::Cancel:
+                        if(timed(stats, Op::Cancel, [&]() { return service.cancel(numbers[bus], seat) == BookingStatus::Ok; })) {
+                            ledger.cancelled(bus, seat);
+                        }
+                        break;
+                    case Op::Search:
+                        // Buses on the route with a seat left, as a customer would search;
+                        // the seat maps themselves are not safe to read from the callback
+                        timed(stats, Op::Search, [&]() {
+                            return service.forEachWithFreeSeats(routes[bus].first, routes[bus].second, 1,
+                                                                [&](const Bus &) { ++seen; }) > 0;
+                        });
+                        break;
+                    default:
+                        timed(stats, Op::List, [&]() {
+                            std::size_t buses = 0;
+                            service.forEachBus([&](const Bus &b) { seen += b.getBusNumber().size(); ++buses; });
+                            return buses > 0;
+                        });
+                        break;
+                }
+            }
+            stats.seen = seen;
+        });
+    }
+    for(std::thread &thread : threads) thread.join();
+    const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    return report(workers, seconds, check(service, ledger, numbers, true));
+}
+
+/**
+ * @brief A change read from the journal, bound to the bus's ledger index.
+ */
+struct Replayed {
+    JournalRecord record;
+    std::size_t bus;
+};
+
+/**
+ * @brief Re-issue the changes recorded in a journal.
+ */
+static int replay(const Options& opts) {
+    // Read everything first, so only the calls are timed; a follower's batches are unpacked
+    std::vector<std::vector<Replayed>> work(opts.threads);
+    std::unordered_map<std::string, std::size_t> busIndex;
+    std::vector<std::string> numbers;
+    std::function<void(const JournalRecord&)> collect = [&](const JournalRecord& record) {
+        if(record.type == JournalRecordType::Epoch) return;
+        if(record.type == JournalRecordType::Replicated) {
+            Journal::decode(record.records, record.recordBytes, collect);
+            return;
+        }
+        const std::size_t bus = busIndex.emplace(record.bus.busNumber, numbers.size()).first->second;
+        if(bus == numbers.size()) numbers.push_back(record.bus.busNumber);
+        work[bus % opts.threads].push_back({ record, bus });
+        work[bus % opts.threads].back().record.records = nullptr;
+    };
+    std::uint64_t validBytes;
+    if(!Journal::replay(opts.replay, collect, validBytes) || numbers.empty()) {
+        std::cerr << "Could not read any changes from " << opts.replay << "\n";
+        return 1;
+    }
+
+    std::size_t records = 0;
+    for(const std::vector<Replayed> &w : work) records += w.size();
+    std::cout << "replaying " << records << " changes to " << numbers.size() << " buses from " << opts.replay
+              << " on " << opts.threads << " threads\n";
+
+    BookingService service;
+    SeatLedger ledger(numbers.size());
+    std::vector<WorkerStats> workers(opts.threads);
+    std::vector<std::thread> threads;
+    const Clock::time_point start = Clock::now();
+    for(int t = 0; t < opts.threads; ++t) {
+        threads.emplace_back([&, t]() {
+            WorkerStats &stats = workers[t];
+            Paise fare;
+            for(const Replayed &r : work[t]) {
+                const JournalRecord &rec = r.record;
+                const std::string &number = rec.bus.busNumber;
+                bool ok = true;
+                switch(rec.type) {
+                    case JournalRecordType::Install:
+                        ok = timed(stats, Op::Install, [&]() { return service.install(rec.bus) == BookingStatus::Ok; });
+                        break;
+                    case JournalRecordType::Reserve:
+                        ok = timed(stats, Op::Reserve, [&]() {
+                            return service.reserve(number, rec.seatNumber, rec.passenger) == BookingStatus::Ok;
+                        });
+                        if(ok) ledger.reserved(r.bus, rec.seatNumber);
+                        break;
+                    case JournalRecordType::Cancel:
+                        ok = timed(stats, Op::Cancel, [&]() { return service.cancel(number, rec.seatNumber) == BookingStatus::Ok; });
+                        if(ok) ledger.cancelled(r.bus, rec.seatNumber);
+                        break;
+                    case JournalRecordType::ReserveSeats:
+                        ok = timed(stats, Op::ReserveSeats, [&]() {
+                            return service.reserveSeats(number, rec.seatNumbers, rec.passenger, fare) == BookingStatus::Ok;
+                        });
+                        if(ok) for(int seat : rec.seatNumbers) ledger.reserved(r.bus, seat);
+                        break;
+                    case JournalRecordType::CancelSeats:
+                        ok = timed(stats, Op::CancelSeats, [&]() {
+                            bool all = true;
+                            for(int seat : rec.seatNumbers) {
+                                if(service.cancel(number, seat) == BookingStatus::Ok) ledger.cancelled(r.bus, seat);
+                                else all = false;
+                            }
+                            return all;
+                        });
+                        break;
+                    case JournalRecordType::Schedule:
+                        ok = timed(stats, Op::Schedule, [&]() {
+                            return service.schedule(number, rec.date, rec.lastDate, rec.weekdays) == BookingStatus::Ok;
+                        });
+                        break;
+                    case JournalRecordType::ReserveTrip:
+                        ok = timed(stats, Op::ReserveTrip, [&]() {
+                            return service.reserveTrip(number, rec.date, rec.seatNumber, rec.passenger) == BookingStatus::Ok;
+                        });
+                        break;
+                    case JournalRecordType::CancelTrip:
+                        ok = timed(stats, Op::CancelTrip, [&]() {
+                            return service.cancelTrip(number, rec.date, rec.seatNumber) == BookingStatus::Ok;
+                        });
+                        break;
+                    default:
+                        break;
+                }
+                // The journal holds only changes that were made, so each should be made again
+                if(!ok) ++stats.divergent;
+            }
+        });
+    }
+    for(std::thread &thread : threads) thread.join();
+    const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    return report(workers, seconds, check(service, ledger, numbers, false));
+}
+
+int main(int argc, char** argv) {
+    Options opts;
+    if(!parseOptions(argc, argv, opts)) return 1;
+    return opts.replay.empty() ? generate(opts) : replay(opts);
+}
@@ -0,0 +1,176 @@
+// BookingIndex.cpp
+
+#include "BookingIndex.h"
+
+namespace {
+
+bool isSpace(unsigned char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f' || c == '\v';
+}
+
+unsigned char lower(unsigned char c) {
+    return c >= 'A' && c <= 'Z' ? static_cast<unsigned char>(c - 'A' + 'a') : c;
+}
+
+/**
+ * @brief Walks a name in normalised form, one byte at a time.
+ */
+struct NameCursor {
+    const unsigned char* p;
+    const unsigned char* end;
+
+    NameCursor(const char* name, std::size_t length)
+        : p(reinterpret_cast<const unsigned char*>(name)), end(p + length) {
+        while(end > p && isSpace(end[-1])) --end;
+        while(p < end && isSpace(*p)) ++p;
+    }
+
+    /**
+     * @brief Next normalised byte, or -1 at the end.
+     */
+    int next() {
+        if(p == end) return -1;
+        if(isSpace(*p)) {
+            while(p < end && isSpace(*p)) ++p;
+            return ' ';
+        }
+        return lower(*p++);
+    }
+};
+
+/**
+ * @brief Spread a tag over the table; booking ids differ mostly in their low bits.
+ */
+std::uint64_t mix(std::uint64_t tag) {
+    return (tag * 0x9E3779B97F4A7C15ull) >> 32;
+}
+
+} // namespace
+
+std::uint32_t nameKey(const char* name, std::size_t length) {
+    std::uint32_t h = 2166136261u;
+    NameCursor cursor(name, length);
+    for(int c = cursor.next(); c >= 0; c = cursor.next()) {
+        h ^= static_cast<std::uint32_t>(c);
+        h *= 16777619u;
+    }
+    return h;
+}
+
+bool sameName(const char* a, std::size_t aLength, const char* b, std::size_t bLength) {
+    NameCursor x(a, aLength), y(b, bLength);
+    for(;;) {
+        const int c = x.next();
+        if(c != y.next()) return false;
+        if(c < 0) return true;
+    }
+}
+
+void BookingIndex::add(std::uint32_t key, Id booking) {
+    Stripe &s = stripeOf(key);
+    std::lock_guard<std::mutex> lock(s.mutex);
+
+    std::uint32_t e = s.freeList;
+    if(e != NONE) {
+        s.freeList = s.entries[e].next;
+    } else {
+        e = static_cast<std::uint32_t>(s.entries.size());
+        s.entries.emplace_back();
+    }
+    const std::uint32_t head = s.byKey.find(key);
+    Entry &entry = s.entries[e];
+    entry.booking = booking;
+    entry.key = key;
+    entry.prev = NONE;
+    entry.next = head;
+    if(head != NONE) s.entries[head].prev = e;
+    s.byKey.set(key, e);
+    s.byBooking.set(booking, e);
+}
+
+void BookingIndex::remove(std::uint32_t key, Id booking) {
+    Stripe &s = stripeOf(key);
+    std::lock_guard<std::mutex> lock(s.mutex);
+
+    const std::uint32_t e = s.byBooking.find(booking);
+    if(e == NONE) return;
+    Entry &entry = s.entries[e];
+    if(entry.next != NONE) s.entries[entry.next].prev = entry.prev;
+    if(entry.prev != NONE) {
+        s.entries[entry.prev].next = entry.next;
+    } else if(entry.next != NONE) {
+        s.byKey.set(key, entry.next);
+    } else {
+        s.byKey.erase(key);
+    }
+    s.byBooking.erase(booking);
+    entry.next = s.freeList;
+    s.freeList = e;
+}
+
+void BookingIndex::find(std::uint32_t key, std::vector<Id>& out) const {
+    const Stripe &s = stripeOf(key);
+    std::lock_guard<std::mutex> lock(s.mutex);
+    for(std::uint32_t e = s.byKey.find(key); e != NONE; e = s.entries[e].next) out.push_back(s.entries[e].booking);
+}
+
+std::size_t BookingIndex::size() const {
+    std::size_t total = 0;
+    for(const Stripe &s : stripes) {
+        std::lock_guard<std::mutex> lock(s.mutex);
+        total += s.byBooking.count;
+    }
+    return total;
+}
+
+std::uint32_t BookingIndex::Table::find(std::uint64_t tag) const {
+    if(slots.empty()) return NONE;
+    const std::size_t mask = slots.size() - 1;
+    for(std::size_t i = mix(tag) & mask; ; i = (i + 1) & mask) {
+        const Slot &slot = slots[i];
+        if(slot.entry == NONE) return NONE;
+        if(slot.tag == tag) return slot.entry;
+    }
+}
+
+void BookingIndex::Table::set(std::uint64_t tag, std::uint32_t entry) {
+    if((count + 1) * 2 > slots.size()) grow();
+    const std::size_t mask = slots.size() - 1;
+    std::size_t i = mix(tag) & mask;
+    while(slots[i].entry != NONE && slots[i].tag != tag) i = (i + 1) & mask;
+    if(slots[i].entry == NONE) ++count;
+    slots[i].tag = tag;
+    slots[i].entry = entry;
+}
+
+void BookingIndex::Table::erase(std::uint64_t tag) {
+    if(slots.empty()) return;
+    const std::size_t mask = slots.size() - 1;
+    std::size_t hole = mix(tag) & mask;
+    while(slots[hole].entry != NONE && slots[hole].tag != tag) hole = (hole + 1) & mask;
+    if(slots[hole].entry == NONE) return;
+
+    // Pull back every later entry of the run whose home slot is not after the hole
+    for(std::size_t i = (hole + 1) & mask; slots[i].entry != NONE; i = (i + 1) & mask) {
+        const std::size_t home = mix(slots[i].tag) & mask;
+        if(((i - home) & mask) >= ((i - hole) & mask)) {
+            slots[hole] = slots[i];
+            hole = i;
+        }
+    }
+    slots[hole].entry = NONE;
+    --count;
+}
+
+void BookingIndex::Table::grow() {
+    const Slot empty = { 0, NONE };
+    std::vector<Slot> bigger(slots.empty() ? 16 : slots.size() * 2, empty);
+    const std::size_t mask = bigger.size() - 1;
+    for(const Slot &slot : slots) {
+        if(slot.entry == NONE) continue;
+        std::size_t i = mix(slot.tag) & mask;
+        while(bigger[i].entry != NONE) i = (i + 1) & mask;
+        bigger[i] = slot;
+    }
+    slots.swap(bigger);
+}
@@ -0,0 +1,126 @@
+#ifndef BOOKING_BOOKINGINDEX_H
+#define BOOKING_BOOKINGINDEX_H
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <cstdint>
+#include <cstddef>
+
+/**
+ * @file BookingIndex.h
+ * @brief Reverse index from passenger names to the bookings made under them.
+ */
+
+/**
+ * @brief Hash of a passenger name as typed by someone looking for their bookings: ASCII
+ *        case is ignored, and so is whitespace at either end, while any run of whitespace
+ *        inside counts as one space.
+ */
+std::uint32_t nameKey(const char* name, std::size_t length);
+
+inline std::uint32_t nameKey(const std::string& name) { return nameKey(name.data(), name.size()); }
+
+/**
+ * @brief Check whether two passenger names are the same after the normalisation nameKey()
+ *        applies.
+ */
+bool sameName(const char* a, std::size_t aLength, const char* b, std::size_t bLength);
+
+/**
+ * @class BookingIndex
+ * @brief Booking ids by normalised passenger name, maintained as seats are reserved and
+ *        cancelled.
+ *
+ * A booking is the seats one reservation took on one bus, under one name. The index maps
+ * each name key to the bookings made under it through a doubly-linked list per key, and
+ * each booking to its list entry, so adding, removing and finding a name's bookings are
+ * all O(1) plus the bookings found. Both maps are open-addressing tables with backward
+ * shift on removal, like the passenger table.
+ *
+ * The index is split into STRIPES independently locked stripes by name key, so bookers
+ * under different names rarely meet on a lock. The registry calls in while holding a bus
+ * lock, so a stripe lock is always innermost; it is never held together with the
+ * passenger table's lock.
+ */
+class BookingIndex {
+public:
+    /**
+     * @brief Booking id: the bus's registry handle in the high half and the bus's booking
+     *        serial in the low half. Serials start at 1, so no id is npos.
+     */
+    typedef std::uint64_t Id;
+    static const Id npos = 0;  /**< "No booking". */
+
+    /**
+     * @brief Record a booking under a name key. The booking must not be indexed already.
+     */
+    void add(std::uint32_t key, Id booking);
+
+    /**
+     * @brief Drop a booking recorded under a name key, if it is there.
+     */
+    void remove(std::uint32_t key, Id booking);
+
+    /**
+     * @brief Append every booking recorded under a name key to out, newest first.
+     */
+    void find(std::uint32_t key, std::vector<Id>& out) const;
+
+    /**
+     * @brief Number of bookings indexed.
+     */
+    std::size_t size() const;
+
+private:
+    static const std::size_t STRIPES = 64;
+    static const std::uint32_t NONE = 0xFFFFFFFFu;  /**< Empty slot or end of a list. */
+
+    /**
+     * @brief One indexed booking, linked into the list of its name key.
+     */
+    struct Entry {
+        Id booking;
+        std::uint32_t key;
+        std::uint32_t prev;  /**< Previous entry of the key's list, or NONE. */
+        std::uint32_t next;  /**< Next entry of the key's list, or next free entry, or NONE. */
+    };
+
+    /**
+     * @brief Open-addressing map from a 64-bit tag to an entry number.
+     */
+    struct Table {
+        struct Slot {
+            std::uint64_t tag;
+            std::uint32_t entry;  /**< NONE if the slot is empty. */
+        };
+        std::vector<Slot> slots;  /**< Size is zero or a power of two. */
+        std::size_t count = 0;
+
+        std::uint32_t find(std::uint64_t tag) const;
+        void set(std::uint64_t tag, std::uint32_t entry);  /**< Insert or overwrite. */
+        void erase(std::uint64_t tag);
+        void grow();
+    };
+
+    /**
+     * @brief One independently locked part of the index.
+     */
+    struct alignas(64) Stripe {
+        mutable std::mutex mutex;
+        std::vector<Entry> entries;
+        std::uint32_t freeList = NONE;
+        Table byBooking;  /**< Booking id to its entry. */
+        Table byKey;      /**< Name key to the first entry of its list. */
+    };
+
+    Stripe stripes[STRIPES];
+
+    /**
+     * @brief Stripe of a name key, from its high bits; the tables use the low ones.
+     */
+    Stripe& stripeOf(std::uint32_t key) { return stripes[key >> 26]; }
+    const Stripe& stripeOf(std::uint32_t key) const { return stripes[key >> 26]; }
+};
+
+#endif // BOOKING_BOOKINGINDEX_H
@@ -0,0 +1,852 @@
+// BookingService.cpp
+
+#include "BookingService.h"
+#include "FileUtil.h"
+#include "Metrics.h"
+#include "Snapshot.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+namespace {
+
+/**
+ * @brief Per-thread buffer for encoding journal records, reused to avoid an allocation
+ *        per booking.
+ */
+std::string& recordBuffer() {
+    thread_local std::string buffer;
+    return buffer;
+}
+
+/**
+ * @brief Times one reserve or cancel call and counts whether it succeeded.
+ */
+class Measured {
+public:
+    Measured(Timer timer, Counter ok, Counter failed) : timer(timer), ok(ok), failed(failed) {}
+
+    /**
+     * @brief Count the call's outcome and pass it on.
+     */
+    BookingStatus operator()(BookingStatus status) const {
+        Metrics::count(status == BookingStatus::Ok ? ok : failed);
+        return status;
+    }
+
+private:
+    ScopedTimer timer;
+    Counter ok;
+    Counter failed;
+};
+
+Measured measureReserve() {
+    return Measured(Timer::Reserve, Counter::ReserveOk, Counter::ReserveFailed);
+}
+
+Measured measureCancel() {
+    return Measured(Timer::Cancel, Counter::CancelOk, Counter::CancelFailed);
+}
+
+/**
+ * @brief Check a bus detail is non-empty and short enough to journal whole.
+ */
+bool validDetail(const std::string& detail) {
+    return !detail.empty() && detail.size() <= Journal::MAX_STRING;
+}
+
+/**
+ * @brief Check bus details as install() requires them: every string non-empty and short
+ *        enough to journal, a known layout and positive fares.
+ */
+bool validBus(const BusInfo& info) {
+    if(!validDetail(info.busNumber) || !validDetail(info.driverName) || !validDetail(info.arrivalTime) ||
+       !validDetail(info.departureTime) || !validDetail(info.from) || !validDetail(info.to) ||
+       static_cast<int>(info.layout) >= LAYOUT_COUNT) {
+        return false;
+    }
+    for(std::int32_t base : info.fares.base) {
+        if(base <= 0) return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Fleet file bytes per parsing thread, at the least.
+ */
+const std::size_t IMPORT_CHUNK_BYTES = 1024 * 1024;
+
+/**
+ * @brief One thread's share of a fleet file and what it made of it.
+ */
+struct ImportChunk {
+    const char* begin = nullptr;
+    const char* end = nullptr;     /**< One past the last line break of the chunk, or the end of the file. */
+    std::vector<Bus> buses;        /**< Buses of the valid rows, in file order. */
+    std::string records;           /**< Their install records, when journaling. */
+    std::size_t lines = 0;
+    std::size_t rows = 0;
+    std::size_t rejected = 0;
+    std::size_t firstRejected = 0; /**< Line of the first rejected row within the chunk, from 1. */
+};
+
+/**
+ * @brief The line break ending the line that starts at p, or end.
+ */
+const char* lineEnd(const char* p, const char* end) {
+    const char* newline = static_cast<const char*>(std::memchr(p, '\n', static_cast<std::size_t>(end - p)));
+    return newline ? newline : end;
+}
+
+/**
+ * @brief End of a line's text, before a carriage return from a CRLF line break.
+ */
+const char* withoutReturn(const char* line, const char* stop) {
+    return stop > line && stop[-1] == '\r' ? stop - 1 : stop;
+}
+
+/**
+ * @brief Check a passenger name fits a PassengerStore record.
+ */
+bool validPassenger(const std::string& passenger) {
+    return !passenger.empty() && passenger.size() <= PassengerStore::MAX_NAME;
+}
+
+/**
+ * @brief A journaled passenger name cut to the record limit; journals written before the
+ *        limit existed may hold longer ones.
+ */
+std::string replayedPassenger(const std::string& passenger) {
+    return passenger.substr(0, PassengerStore::MAX_NAME);
+}
+
+/**
+ * @brief Durability waits put off by BookingService::beginDeferred() on this thread.
+ */
+struct Deferral {
+    bool active = false;
+    std::uint64_t last = 0;  /**< Highest sequence number appended while deferring, or 0. */
+};
+
+Deferral& deferral() {
+    thread_local Deferral pending;
+    return pending;
+}
+
+/**
+ * @brief Wait for a journaled change to become durable and fold the outcome into status.
+ *
+ * While the thread is deferring, only note the record for endDeferred() to wait on.
+ */
+BookingStatus waitDurable(BookingStatus status, const JournalWrite& log) {
+    if(status != BookingStatus::Ok) return status;
+    Deferral &deferred = deferral();
+    if(deferred.active) {
+        if(log.sequence > deferred.last) deferred.last = log.sequence;
+        return BookingStatus::Ok;
+    }
+    ScopedTimer waiting(Timer::JournalWait);
+    return log.journal->sync(log.sequence) ? BookingStatus::Ok : BookingStatus::JournalFailed;
+}
+
+} // namespace
+
+BookingService::BookingService()
+    : following(false), hasSource(false), sourceEpoch(0), sourceOffset(0), checkpointBytes(0), stopping(false),
+      started(std::chrono::steady_clock::now())
+{
+}
+
+BookingService::~BookingService() {
+    {
+        std::lock_guard<std::mutex> lock(checkpointerMutex);
+        stopping = true;
+    }
+    checkpointerWake.notify_one();
+    reaperWake.notify_one();
+    if(checkpointer.joinable()) checkpointer.join();
+    if(reaper.joinable()) reaper.join();
+}
+
+bool BookingService::openJournal(const std::string& path, std::uint64_t checkpointAt) {
+    const std::string snapshotFile = path + ".snapshot";
+    SnapshotInfo snapshot = { 0, 0, 0, 0 };
+    const bool haveSnapshot = fileExists(snapshotFile);
+    if(haveSnapshot && !Snapshot::load(snapshotFile, symbols, registry, snapshot)) return false;
+
+    // The journal's leading Epoch record says whether it continues the snapshot or is the
+    // older journal the snapshot was taken from (a crash hit before it was compacted)
+    std::uint64_t epoch = 0;
+    std::uint64_t skipBefore = 0;
+    bool matches = true;
+    bool first = true;
+    auto replayRecord = [&](const JournalRecord& record) {
+        if(first) {
+            first = false;
+            if(record.type == JournalRecordType::Epoch) epoch = record.epoch;
+            if(haveSnapshot) {
+                if(epoch == snapshot.coveredEpoch && epoch != snapshot.epoch) skipBefore = snapshot.coveredOffset;
+                else matches = epoch == snapshot.epoch;
+            }
+        }
+        if(matches && record.offset >= skipBefore) apply(record);
+    };
+
+    std::uint64_t validBytes = 0;
+    const bool replayed = Journal::replay(path, replayRecord, validBytes);
+    flushInstalls();
+    if(!replayed || !matches) return false;
+    if(validBytes == 0) epoch = snapshot.epoch;
+
+    std::unique_ptr<Journal> opened(new Journal());
+    if(!opened->open(path, validBytes, epoch)) return false;
+    journal = std::move(opened);
+    snapshotPath = snapshotFile;
+
+    checkpointBytes = checkpointAt;
+    if(checkpointBytes) checkpointer = std::thread(&BookingService::checkpointLoop, this);
+    return true;
+}
+
+bool BookingService::checkpoint() {
+    if(!journal) return false;
+    std::lock_guard<std::mutex> lock(checkpointMutex);
+
+    std::string image;
+    SnapshotInfo info = { 0, 0, 0, 0 };
+    std::uint64_t sequence = 0;
+    {
+        // A replicated batch is either wholly in the snapshot or wholly after it
+        std::lock_guard<std::mutex> applying(replicaMutex);
+        capture(image, info, sequence);
+        // The snapshot has no room for the primary position; restate it after the records
+        // the snapshot covers, so that compaction keeps it
+        if(hasSource) {
+            std::string &record = recordBuffer();
+            Journal::encodeReplicated(sourceEpoch, sourceOffset, nullptr, 0, record);
+            sequence = journal->append(record);
+        }
+    }
+
+    if(!Snapshot::write(snapshotPath, image.data(), image.size())) return false;
+    return journal->compact(info.coveredOffset, sequence, info.epoch);
+}
+
+void BookingService::capture(std::string& image, SnapshotInfo& info, std::uint64_t& sequence) {
+    // Capture the state together with the journal position it corresponds to
+    registry.freeze([&](const BusStore& buses, const SeatBookingStore& booked, const TripStore& trips,
+                        const PassengerStore& passengers) {
+        journal->position(info.coveredOffset, sequence);
+        info.coveredEpoch = journal->epoch();
+        info.epoch = info.coveredEpoch + 1;
+        Snapshot::encode(symbols, buses, booked, trips, passengers, info, image);
+    });
+}
+
+void BookingService::promote() {
+    std::lock_guard<std::mutex> lock(replicaMutex);
+    if(hasSource && journal) {
+        // A later restart must not take this node for a follower still at the old position
+        std::string &record = recordBuffer();
+        Journal::encodeReplicated(NO_PRIMARY, 0, nullptr, 0, record);
+        journal->sync(journal->append(record));
+    }
+    hasSource = false;
+    following.store(false, std::memory_order_release);
+}
+
+bool BookingService::replicaPosition(std::uint64_t& epoch, std::uint64_t& offset) const {
+    std::lock_guard<std::mutex> lock(replicaMutex);
+    epoch = sourceEpoch;
+    offset = sourceOffset;
+    return hasSource;
+}
+
+bool BookingService::applyReplicated(std::uint64_t epoch, std::uint64_t offset, const char* records,
+                                     std::size_t size) {
+    // Check the whole batch first, so that a damaged one changes nothing
+    if(Journal::decode(records, size, [](const JournalRecord&) {}) != size) return false;
+
+    std::unique_lock<std::mutex> lock(replicaMutex);
+    if(size == 0 && hasSource && epoch == sourceEpoch && offset == sourceOffset) return true;
+    Journal::decode(records, size, [this](const JournalRecord& record) { apply(record); });
+    flushInstalls();
+    hasSource = true;
+    sourceEpoch = epoch;
+    sourceOffset = offset;
+    if(!journal) return true;
+
+    std::string &record = recordBuffer();
+    Journal::encodeReplicated(epoch, offset, records, size, record);
+    const std::uint64_t sequence = journal->append(record);
+    lock.unlock();
+    return journal->sync(sequence);
+}
+
+bool BookingService::replicaImage(std::string& image, std::uint64_t& epoch, std::uint64_t& offset) {
+    if(!journal) return false;
+    // Without the lock a compaction could move the journal between reading its length and epoch
+    std::lock_guard<std::mutex> lock(checkpointMutex);
+    SnapshotInfo info = { 0, 0, 0, 0 };
+    std::uint64_t sequence = 0;
+    capture(image, info, sequence);
+    epoch = info.coveredEpoch;
+    offset = info.coveredOffset;
+    return true;
+}
+
+bool BookingService::loadReplicaImage(const char* image, std::size_t size, std::uint64_t epoch,
+                                      std::uint64_t offset) {
+    // A fresh pool holds only the empty string, which the image re-interns first
+    if(!journal || !registry.empty() || symbols.size() > 1) return false;
+
+    // Snapshot::load() maps a file; the image goes beside the snapshot and is rewritten
+    // as this node's own snapshot by the checkpoint below
+    const std::string imagePath = snapshotPath + ".replica";
+    if(!Snapshot::write(imagePath, image, size)) return false;
+    bool loaded;
+    {
+        std::lock_guard<std::mutex> lock(replicaMutex);
+        SnapshotInfo info = { 0, 0, 0, 0 };
+        loaded = Snapshot::load(imagePath, symbols, registry, info);
+        if(loaded) {
+            hasSource = true;
+            sourceEpoch = epoch;
+            sourceOffset = offset;
+        }
+    }
+    std::remove(imagePath.c_str());
+    return loaded && checkpoint();
+}
+
+void BookingService::reapLoop() {
+    std::unique_lock<std::mutex> lock(checkpointerMutex);
+    while(!stopping) {
+        reaperWake.wait_for(lock, std::chrono::milliseconds(HOLD_TICK_MS));
+        if(stopping) break;
+
+        lock.unlock();
+        expireHolds();
+        lock.lock();
+    }
+}
+
+void BookingService::checkpointLoop() {
+    std::unique_lock<std::mutex> lock(checkpointerMutex);
+    while(!stopping) {
+        checkpointerWake.wait_for(lock, std::chrono::seconds(1));
+        if(stopping) break;
+
+        std::uint64_t bytes = 0, sequence = 0;
+        journal->position(bytes, sequence);
+        if(bytes < checkpointBytes) continue;
+
+        lock.unlock();
+        checkpoint();
+        lock.lock();
+    }
+}
+
+void BookingService::apply(const JournalRecord& record) {
+    // Later records may refer to the buses installed so far
+    if(record.type != JournalRecordType::Install) flushInstalls();
+    switch(record.type) {
+        case JournalRecordType::Install:
+            // addAll() skips numbers already taken, by then or earlier in the batch
+            if(validBus(record.bus)) pendingInstalls.push_back(makeBus(record.bus));
+            break;
+        case JournalRecordType::Reserve: {
+            const std::string passenger = replayedPassenger(record.passenger);
+            if(validPassenger(passenger)) registry.reserve(record.bus.busNumber, record.seatNumber, passenger);
+            break;
+        }
+        case JournalRecordType::Cancel:
+            registry.cancel(record.bus.busNumber, record.seatNumber);
+            break;
+        case JournalRecordType::ReserveSeats: {
+            const std::string passenger = replayedPassenger(record.passenger);
+            const std::size_t count = record.seatNumbers.size();
+            Paise fareTotal;
+            if(validPassenger(passenger) && count > 0 && count <= static_cast<std::size_t>(Bus::MAX_SEATS)) {
+                registry.reserveSeats(record.bus.busNumber, record.seatNumbers.data(), static_cast<int>(count), passenger,
+                                      fareTotal);
+            }
+            break;
+        }
+        case JournalRecordType::CancelSeats:
+            for(int seatNumber : record.seatNumbers) registry.cancel(record.bus.busNumber, seatNumber);
+            break;
+        case JournalRecordType::Schedule:
+            if(record.lastDate >= record.date) {
+                registry.schedule(record.bus.busNumber, record.date, record.lastDate, record.weekdays);
+            }
+            break;
+        case JournalRecordType::ReserveTrip: {
+            const std::string passenger = replayedPassenger(record.passenger);
+            if(validPassenger(passenger)) registry.reserveTrip(record.bus.busNumber, record.date, record.seatNumber, passenger);
+            break;
+        }
+        case JournalRecordType::CancelTrip:
+            registry.cancelTrip(record.bus.busNumber, record.date, record.seatNumber);
+            break;
+        case JournalRecordType::Replicated:
+            // From replay, or from a primary that once followed another; in a batch the
+            // position applyReplicated() sets afterwards wins
+            Journal::decode(record.records, record.recordBytes, [this](const JournalRecord& batched) { apply(batched); });
+            hasSource = record.epoch != NO_PRIMARY;
+            sourceEpoch = record.epoch;
+            sourceOffset = record.sourceOffset;
+            break;
+        case JournalRecordType::Epoch:
+            break;
+    }
+}
+
+void BookingService::flushInstalls() {
+    if(pendingInstalls.empty()) return;
+    registry.addAll(pendingInstalls);
+    pendingInstalls.clear();
+}
+
+void BookingService::beginDeferred() {
+    deferral().active = true;
+}
+
+bool BookingService::endDeferred() {
+    Deferral &deferred = deferral();
+    const std::uint64_t last = deferred.last;
+    deferred.active = false;
+    deferred.last = 0;
+    // Sequence numbers rise monotonically, so the last record's flush covers the others
+    if(last == 0 || !journal) return true;
+    ScopedTimer waiting(Timer::JournalWait);
+    return journal->sync(last);
+}
+
+BookingStatus BookingService::install(const BusInfo& info) {
+    if(isFollower()) return BookingStatus::ReadOnly;
+    if(!validBus(info)) return BookingStatus::InvalidBus;
+    if(registry.find(info.busNumber) != BusRegistry::npos) return BookingStatus::DuplicateBus;
+
+    Bus bus = makeBus(info);
+
+    // add() re-checks the number under the registry lock in case another thread won the race
+    if(!journal) {
+        return registry.add(std::move(bus)) == BusRegistry::npos ? BookingStatus::DuplicateBus : BookingStatus::Ok;
+    }
+
+    std::string &record = recordBuffer();
+    Journal::encodeInstall(info, record);
+    JournalWrite log = { journal.get(), &record, 0 };
+    BookingStatus status = registry.add(std::move(bus), &log) == BusRegistry::npos ? BookingStatus::DuplicateBus
+                                                                                  : BookingStatus::Ok;
+    return waitDurable(status, log);
+}
+
+Bus BookingService::makeBus(const BusInfo& info) {
+    // Times are kept as entered for display; ones that do not parse carry no minutes
+    int departs = NO_TIME, arrives = NO_TIME;
+    if(!parseTime(info.departureTime, departs)) departs = NO_TIME;
+    if(!parseTime(info.arrivalTime, arrives)) arrives = NO_TIME;
+
+    return Bus(info.busNumber,
+               symbols.intern(info.driverName),
+               symbols.intern(info.arrivalTime),
+               symbols.intern(info.departureTime),
+               symbols.intern(info.from),
+               symbols.intern(info.to),
+               info.layout,
+               info.fares,
+               departs,
+               arrives);
+}
+
+bool BookingService::importFleet(const std::string& path, ImportReport& report, unsigned threads) {
+    report = ImportReport();
+    if(isFollower()) {
+        report.error = "the service is a read-only follower";
+        return false;
+    }
+    MappedFile file;
+    if(!file.map(path)) {
+        report.error = "the file could not be read";
+        return false;
+    }
+    const char* begin = file.data();
+    const char* end = begin + file.size();
+    if(end - begin >= 3 && std::memcmp(begin, "\xEF\xBB\xBF", 3) == 0) begin += 3;  // UTF-8 byte order mark
+
+    FleetCsv csv;
+    const char* body = lineEnd(begin, end);
+    if(!csv.parseHeader(begin, withoutReturn(begin, body))) {
+        report.error = "the header line does not name the fleet columns";
+        return false;
+    }
+    if(body < end) ++body;
+
+    // Small files are not worth splitting
+    if(threads == 0) threads = std::thread::hardware_concurrency() ? std::thread::hardware_concurrency() : 1;
+    const std::size_t bytes = static_cast<std::size_t>(end - body);
+    if(threads > bytes / IMPORT_CHUNK_BYTES + 1) threads = static_cast<unsigned>(bytes / IMPORT_CHUNK_BYTES + 1);
+
+    // Cut at line starts, so each line belongs to exactly one chunk
+    std::vector<ImportChunk> chunks(threads);
+    const char* at = body;
+    for(unsigned i = 0; i < threads; ++i) {
+        const char* cut = i + 1 == threads ? end : body + bytes / threads * (i + 1);
+        if(cut < at) cut = at;
+        if(cut > at && cut < end && cut[-1] != '\n') {
+            cut = lineEnd(cut, end);
+            if(cut < end) ++cut;
+        }
+        chunks[i].begin = at;
+        chunks[i].end = cut;
+        at = cut;
+    }
+
+    const bool journaled = journal != nullptr;
+    auto parse = [&](ImportChunk& chunk) {
+        BusInfo info;
+        std::string spare, record;
+        // A bus is large; size the chunk's vector up front instead of moving them all as it grows
+        chunk.buses.reserve(static_cast<std::size_t>(std::count(chunk.begin, chunk.end, '\n')) + 1);
+        for(const char* line = chunk.begin; line < chunk.end; ) {
+            const char* stop = lineEnd(line, chunk.end);
+            const char* text = withoutReturn(line, stop);
+            ++chunk.lines;
+            if(text > line) {
+                ++chunk.rows;
+                if(csv.parseRow(line, text, info, spare) && validBus(info)) {
+                    chunk.buses.push_back(makeBus(info));
+                    if(journaled) {
+                        Journal::encodeInstall(info, record);
+                        chunk.records += record;
+                    }
+                } else if(chunk.rejected++ == 0) {
+                    chunk.firstRejected = chunk.lines;
+                }
+            }
+            line = stop < chunk.end ? stop + 1 : chunk.end;
+        }
+    };
+    std::vector<std::thread> workers;
+    for(unsigned i = 1; i < threads; ++i) workers.emplace_back(parse, std::ref(chunks[i]));
+    parse(chunks[0]);
+    for(std::thread &worker : workers) worker.join();
+
+    // Gather the chunks in file order; the header is line 1
+    std::vector<Bus> &buses = chunks[0].buses;
+    std::string &records = chunks[0].records;
+    std::size_t lines = 1, total = 0;
+    for(const ImportChunk &chunk : chunks) total += chunk.buses.size();
+    buses.reserve(total);
+    for(unsigned i = 0; i < threads; ++i) {
+        ImportChunk &chunk = chunks[i];
+        report.rows += chunk.rows;
+        if(chunk.rejected && !report.rejected) report.firstRejectedLine = lines + chunk.firstRejected;
+        report.rejected += chunk.rejected;
+        lines += chunk.lines;
+        if(i == 0) continue;
+        buses.insert(buses.end(), std::make_move_iterator(chunk.buses.begin()), std::make_move_iterator(chunk.buses.end()));
+        records += chunk.records;
+        std::vector<Bus>().swap(chunk.buses);
+        std::string().swap(chunk.records);
+    }
+    const std::size_t parsed = buses.size();
+
+    if(!journaled || records.empty()) {
+        report.installed = registry.addAll(buses);
+    } else {
+        JournalWrite log = { journal.get(), &records, 0 };
+        report.installed = registry.addAll(buses, &log);
+        if(waitDurable(BookingStatus::Ok, log) != BookingStatus::Ok) report.error = "the journal could not be written";
+    }
+    report.duplicates = parsed - report.installed;
+    return report.error == nullptr;
+}
+
+bool BookingService::exportOccupancy(const std::string& path, ExportFormat format) const {
+    const std::string tmpPath = path + ".tmp";
+    bool ok;
+    {
+        std::ofstream out(tmpPath.c_str(), std::ios::binary | std::ios::trunc);
+        if(!out) return false;
+        OccupancyWriter writer(out, format);
+        registry.forEachOccupancy([&](const Bus& bus, SeatMask reserved, SeatMask held, Paise paid) {
+            writer.add(bus, symbols, reserved, held, paid);
+        });
+        ok = writer.finish();
+    }
+    if(!ok || std::rename(tmpPath.c_str(), path.c_str()) != 0) {
+        std::remove(tmpPath.c_str());
+        return false;
+    }
+    return true;
+}
+
+BookingStatus BookingService::reserve(const std::string& busNumber, int seatNumber, const std::string& passenger) {
+    const Measured measured = measureReserve();
+    if(isFollower()) return measured(BookingStatus::ReadOnly);
+    if(!validPassenger(passenger)) return measured(BookingStatus::InvalidPassenger);
+    if(!journal) return measured(registry.reserve(busNumber, seatNumber, passenger));
+
+    std::string &record = recordBuffer();
+    Journal::encodeReserve(busNumber, seatNumber, passenger, record);
+    JournalWrite log = { journal.get(), &record, 0 };
+    return measured(waitDurable(registry.reserve(busNumber, seatNumber, passenger, &log), log));
+}
+
+BookingStatus BookingService::cancel(const std::string& busNumber, int seatNumber) {
+    const Measured measured = measureCancel();
+    if(isFollower()) return measured(BookingStatus::ReadOnly);
+    if(!journal) return measured(registry.cancel(busNumber, seatNumber));
+
+    std::string &record = recordBuffer();
+    Journal::encodeCancel(busNumber, seatNumber, record);
+    JournalWrite log = { journal.get(), &record, 0 };
+    return measured(waitDurable(registry.cancel(busNumber, seatNumber, &log), log));
+}
+
+BookingStatus BookingService::reserveSeats(const std::string& busNumber, const std::vector<int>& seatNumbers,
+                                           const std::string& passenger, Paise& fareTotal) {
+    const Measured measured = measureReserve();
+    if(isFollower()) return measured(BookingStatus::ReadOnly);
+    if(!validPassenger(passenger)) return measured(BookingStatus::InvalidPassenger);
+    if(seatNumbers.empty() || seatNumbers.size() > static_cast<std::size_t>(Bus::MAX_SEATS)) {
+        return measured(BookingStatus::InvalidSeat);
+    }
+
+    const int count = static_cast<int>(seatNumbers.size());
+    if(!journal) return measured(registry.reserveSeats(busNumber, seatNumbers.data(), count, passenger, fareTotal));
+
+    std::string &record = recordBuffer();
+    Journal::encodeReserveSeats(busNumber, seatNumbers.data(), count, passenger, record);
+    JournalWrite log = { journal.get(), &record, 0 };
+    return measured(waitDurable(registry.reserveSeats(busNumber, seatNumbers.data(), count, passenger, fareTotal, &log), log));
+}
+
+BookingStatus BookingService::cancelBooking(BookingIndex::Id id, std::vector<int>& seatNumbers, Paise& refund) {
+    const Measured measured = measureCancel();
+    if(isFollower()) return measured(BookingStatus::ReadOnly);
+    int cancelled[Bus::MAX_SEATS];
+    int count = 0;
+    BookingStatus status;
+    if(!journal) {
+        status = registry.cancelBooking(id, cancelled, count, refund);
+    } else {
+        // The registry writes a CancelSeats record once it knows the seats
+        std::string &record = recordBuffer();
+        JournalWrite log = { journal.get(), &record, 0 };
+        status = waitDurable(registry.cancelBooking(id, cancelled, count, refund, &log), log);
+    }
+    if(status == BookingStatus::Ok || status == BookingStatus::JournalFailed) {
+        seatNumbers.assign(cancelled, cancelled + count);
+    }
+    return measured(status);
+}
+
+BookingStatus BookingService::hold(const std::string& busNumber, const std::vector<int>& seatNumbers, int ttlSeconds,
+                                   HoldTable::Id& hold) {
+    if(isFollower()) return BookingStatus::ReadOnly;
+    if(seatNumbers.empty() || seatNumbers.size() > static_cast<std::size_t>(Bus::MAX_SEATS)) {
+        return BookingStatus::InvalidSeat;
+    }
+    if(ttlSeconds < 1) ttlSeconds = 1;
+    if(ttlSeconds > MAX_HOLD_SECONDS) ttlSeconds = MAX_HOLD_SECONDS;
+
+    std::call_once(reaperStarted, [this] { reaper = std::thread(&BookingService::reapLoop, this); });
+    const std::uint64_t expiry = holdTick() + static_cast<std::uint64_t>(ttlSeconds) * 1000 / HOLD_TICK_MS;
+    return registry.hold(busNumber, seatNumbers.data(), static_cast<int>(seatNumbers.size()), expiry, hold);
+}
+
+BookingStatus BookingService::confirmHold(HoldTable::Id hold, const std::string& passenger,
+                                          std::vector<int>& seatNumbers, Paise& fareTotal) {
+    const Measured measured = measureReserve();
+    if(isFollower()) return measured(BookingStatus::ReadOnly);
+    if(!validPassenger(passenger)) return measured(BookingStatus::InvalidPassenger);
+
+    int chosen[Bus::MAX_SEATS];
+    int count = 0;
+    BookingStatus status;
+    if(!journal) {
+        status = registry.confirmHold(hold, passenger, chosen, count, fareTotal);
+    } else {
+        // The registry writes an ordinary ReserveSeats record once it knows the seats
+        std::string &record = recordBuffer();
+        JournalWrite log = { journal.get(), &record, 0 };
+        status = waitDurable(registry.confirmHold(hold, passenger, chosen, count, fareTotal, &log), log);
+    }
+    if(status == BookingStatus::Ok || status == BookingStatus::JournalFailed) {
+        seatNumbers.assign(chosen, chosen + count);
+    }
+    return measured(status);
+}
+
+BookingStatus BookingService::reserveAuto(const std::string& busNumber, const SeatRequest& request,
+                                          const std::string& passenger, std::vector<int>& seatNumbers,
+                                          Paise& fareTotal) {
+    const Measured measured = measureReserve();
+    const int count = request.count;
+    if(isFollower()) return measured(BookingStatus::ReadOnly);
+    if(!validPassenger(passenger)) return measured(BookingStatus::InvalidPassenger);
+    if(count < 1 || count > Bus::MAX_SEATS) return measured(BookingStatus::InvalidSeat);
+
+    int chosen[Bus::MAX_SEATS];
+    BookingStatus status;
+    if(!journal) {
+        status = registry.reserveAuto(busNumber, request, passenger, chosen, fareTotal);
+    } else {
+        // The registry fills in the chosen seats before appending, so replay is exact
+        std::string &record = recordBuffer();
+        Journal::encodeReserveSeats(busNumber, nullptr, count, passenger, record);
+        JournalWrite log = { journal.get(), &record, 0 };
+        status = waitDurable(registry.reserveAuto(busNumber, request, passenger, chosen, fareTotal, &log), log);
+    }
+    if(status == BookingStatus::Ok || status == BookingStatus::JournalFailed) {
+        seatNumbers.assign(chosen, chosen + count);
+    }
+    return measured(status);
+}
+
+BookingStatus BookingService::schedule(const std::string& busNumber, ServiceDate first, ServiceDate last,
+                                       std::uint8_t weekdays) {
+    if(isFollower()) return BookingStatus::ReadOnly;
+    if(last < first) return BookingStatus::InvalidBus;
+    if(!journal) return registry.schedule(busNumber, first, last, weekdays);
+
+    std::string &record = recordBuffer();
+    Journal::encodeSchedule(busNumber, first, last, weekdays, record);
+    JournalWrite log = { journal.get(), &record, 0 };
+    return waitDurable(registry.schedule(busNumber, first, last, weekdays, &log), log);
+}
+
+BookingStatus BookingService::reserveTrip(const std::string& busNumber, ServiceDate date, int seatNumber,
+                                          const std::string& passenger) {
+    const Measured measured = measureReserve();
+    if(isFollower()) return measured(BookingStatus::ReadOnly);
+    if(!validPassenger(passenger)) return measured(BookingStatus::InvalidPassenger);
+    if(!journal) return measured(registry.reserveTrip(busNumber, date, seatNumber, passenger));
+
+    std::string &record = recordBuffer();
+    Journal::encodeReserveTrip(busNumber, date, seatNumber, passenger, record);
+    JournalWrite log = { journal.get(), &record, 0 };
+    return measured(waitDurable(registry.reserveTrip(busNumber, date, seatNumber, passenger, &log), log));
+}
+
+BookingStatus BookingService::cancelTrip(const std::string& busNumber, ServiceDate date, int seatNumber) {
+    const Measured measured = measureCancel();
+    if(isFollower()) return measured(BookingStatus::ReadOnly);
+    if(!journal) return measured(registry.cancelTrip(busNumber, date, seatNumber));
+
+    std::string &record = recordBuffer();
+    Journal::encodeCancelTrip(busNumber, date, seatNumber, record);
+    JournalWrite log = { journal.get(), &record, 0 };
+    return measured(waitDurable(registry.cancelTrip(busNumber, date, seatNumber, &log), log));
+}
+
+BookingStatus BookingService::getTrip(const std::string& busNumber, ServiceDate date, TripSeats& seats) const {
+    const BusRegistry::Handle handle = registry.find(busNumber);
+    if(handle == BusRegistry::npos) return BookingStatus::BusNotFound;
+    seats = registry.tripSnapshot(handle, date);
+    if(!seats.occupied && !registry.withBus(handle, [&](const Bus& bus) { return bus.runsOn(date); })) {
+        return BookingStatus::NoTrip;
+    }
+    return BookingStatus::Ok;
+}
+
+BookingStatus BookingService::quoteSeats(const std::string& busNumber, const std::vector<int>& seatNumbers,
+                                         Paise& fareTotal) const {
+    ScopedTimer timer(Timer::Lookup);
+    const BusRegistry::Handle handle = registry.find(busNumber);
+    if(handle == BusRegistry::npos) return BookingStatus::BusNotFound;
+
+    return registry.withBus(handle, [&](const Bus& bus) {
+        SeatMask mask = 0;
+        for(int seatNumber : seatNumbers) {
+            if(!bus.isValidSeat(seatNumber)) return BookingStatus::InvalidSeat;
+            const SeatMask bit = SeatMask(1) << (seatNumber - 1);
+            if(mask & bit) return BookingStatus::InvalidSeat;
+            mask |= bit;
+        }
+        fareTotal = batchPrice(bus.getFares(), bus.getLayout(), mask, bus.currentTier());
+        return BookingStatus::Ok;
+    });
+}
+
+int BookingService::freeSeats(const std::string& busNumber) const {
+    const BusRegistry::Handle handle = registry.find(busNumber);
+    return handle == BusRegistry::npos ? -1 : registry.freeSeats(handle);
+}
+
+std::int64_t BookingService::routeFreeSeats(const std::string& origin, const std::string& dest) const {
+    const StringPool::Id originId = symbols.find(origin);
+    const StringPool::Id destId = symbols.find(dest);
+    if(originId == StringPool::npos || destId == StringPool::npos) return 0;
+    return registry.routeFreeSeats(originId, destId);
+}
+
+std::size_t BookingService::countMatching(const FleetQuery& query) const {
+    ScopedTimer timer(Timer::FleetScan);
+    FleetFilter filter;
+    return toFilter(query, filter) ? registry.countMatching(filter) : 0;
+}
+
+FleetOccupancy BookingService::occupancy() const {
+    ScopedTimer timer(Timer::FleetScan);
+    return registry.occupancy();
+}
+
+bool BookingService::toFilter(const FleetQuery& query, FleetFilter& filter) const {
+    filter.minFree = query.minFree;
+    filter.fromMinute = query.fromMinute;
+    filter.toMinute = query.toMinute;
+    filter.routes.clear();
+    for(const std::pair<std::string, std::string> &route : query.routes) {
+        const StringPool::Id originId = symbols.find(route.first);
+        const StringPool::Id destId = symbols.find(route.second);
+        if(originId == StringPool::npos || destId == StringPool::npos) continue;
+        const std::uint32_t id = registry.routeId(originId, destId);
+        if(id != RouteIndex::npos) filter.routes.push_back(id);
+    }
+    return query.routes.empty() || !filter.routes.empty();
+}
+
+void BookingService::writeMetrics(std::string& out) const {
+    MetricsSnapshot snapshot;
+    Metrics::collect(snapshot);
+    Metrics::writePrometheus(snapshot, out);
+    Metrics::writeGauge(out, "booking_buses", "Buses installed.", size());
+    Metrics::writeGauge(out, "booking_free_seats", "Empty seats across the fleet.",
+                        static_cast<std::uint64_t>(totalFreeSeats()));
+    Metrics::writeGauge(out, "booking_bookings", "Bookings with at least one seat still reserved.", bookingCount());
+    Metrics::writeGauge(out, "booking_holds", "Seat holds outstanding.", holdCount());
+    Metrics::writeGauge(out, "booking_revenue_paise", "Prices paid for every seat currently reserved.",
+                        static_cast<std::uint64_t>(revenue()));
+}
+
+BookingStatus BookingService::getSeat(const std::string& busNumber, int seatNumber, Seat& seat) const {
+    ScopedTimer timer(Timer::Lookup);
+    const BusRegistry::Handle handle = registry.find(busNumber);
+    if(handle == BusRegistry::npos) return BookingStatus::BusNotFound;
+
+    return registry.withBus(handle, [&](const Bus& bus) {
+        if(!bus.isValidSeat(seatNumber)) return BookingStatus::InvalidSeat;
+        seat = Seat();
+        if(bus.isReserved(seatNumber)) seat.passengerName = registry.passengerName(bus.passengerOf(seatNumber));
+        else if(bus.isHeld(seatNumber)) seat.passengerName = "Held";
+        seat.fare = bus.getFare(seatNumber);
+        return BookingStatus::Ok;
+    });
+}
+
+BookingStatus BookingService::getBus(const std::string& busNumber, Bus& bus) const {
+    ScopedTimer timer(Timer::Lookup);
+    const BusRegistry::Handle handle = registry.find(busNumber);
+    if(handle == BusRegistry::npos) return BookingStatus::BusNotFound;
+    bus = registry.snapshot(handle);
+    return BookingStatus::Ok;
+}
@@ -0,0 +1,736 @@
+#ifndef BOOKING_BOOKINGSERVICE_H
+#define BOOKING_BOOKINGSERVICE_H
+
+#include <string>
+#include <vector>
+#include <utility>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <chrono>
+
+#include "BulkIO.h"
+#include "Bus.h"
+#include "BusRegistry.h"
+#include "Journal.h"
+#include "Metrics.h"
+#include "StringPool.h"
+
+struct SnapshotInfo;
+
+/**
+ * @struct FleetQuery
+ * @brief Which buses a fleet-wide scan matches; every condition given must hold.
+ */
+struct FleetQuery {
+    int minFree = 0;           /**< Fewest empty seats a bus may have. */
+    std::vector<std::pair<std::string, std::string>> routes;  /**< (origin, destination) pairs, any of which matches; empty for all. */
+    int fromMinute = NO_TIME;  /**< Earliest departure, or NO_TIME for no departure window. */
+    int toMinute = NO_TIME;    /**< Latest departure, inclusive; before fromMinute wraps past midnight. */
+};
+
+/**
+ * @file BookingService.h
+ * @brief Headless booking core: installs buses, books and cancels seats, answers queries.
+ *
+ * Nothing in the booking core reads from or writes to the terminal. Every operation
+ * reports its outcome as a BookingStatus, so the same core can sit behind the
+ * interactive menu, a server or a benchmark loop.
+ */
+
+/**
+ * @class BookingService
+ * @brief Owns the booking state (symbol table and bus registry) and exposes it as pure
+ *        operations.
+ *
+ * All methods are thread-safe; see BusRegistry for the locking scheme. State is kept in
+ * memory only unless openJournal() is called, after which every successful install,
+ * reserve and cancel is durable in the journal before the call returns.
+ *
+ * Besides its undated seat map, a bus given a service window with schedule() runs one
+ * trip per service date, booked through reserveTrip() and cancelTrip(). A trip's seat
+ * map is only allocated when its first seat sells.
+ *
+ * checkpoint() writes the whole state to a snapshot file next to the journal and drops
+ * the journal records it covers, so start-up maps the snapshot and replays only the tail.
+ *
+ * A service can also be a read-only follower of another one (see Replication.h): every
+ * call that would change its state returns ReadOnly (importFleet() returns false), and it
+ * takes the primary's journal records through applyReplicated() instead, logging them to
+ * its own journal. promote() makes it writable in place, with nothing reloaded.
+ */
+class BookingService {
+public:
+    BookingService();
+    ~BookingService();
+
+    /**
+     * @brief Restore state from a snapshot and journal and log every later change.
+     *
+     * Must be called before any other operation. If path + ".snapshot" exists it is
+     * loaded first, then the journal records it does not cover are replayed in order; a
+     * torn record at the end (from a crash mid-write) is discarded.
+     *
+     * @param path Journal file; created if missing.
+     * @param checkpointBytes If non-zero, a background thread calls checkpoint() whenever
+     *        the journal grows past this many bytes.
+     * @return true On success.
+     * @return false If the snapshot or journal could not be read, they do not belong
+     *         together, or the journal could not be opened for appending.
+     */
+    bool openJournal(const std::string& path, std::uint64_t checkpointBytes = 0);
+
+    /**
+     * @brief Snapshot the current state and truncate the journal to the records after it.
+     *
+     * Bookings are blocked only while the state is copied into memory; writing the
+     * snapshot and compacting the journal happen while bookings continue.
+     *
+     * @return true If a new snapshot is durable and the journal was compacted.
+     * @return false If no journal is open or a write failed. Nothing is lost either way.
+     */
+    bool checkpoint();
+
+    /**
+     * @brief Refuse every change with ReadOnly from now on, so that the state only changes
+     *        through applyReplicated().
+     */
+    void beginFollowing() { following.store(true, std::memory_order_release); }
+
+    /**
+     * @brief Accept changes again, as the new primary.
+     *
+     * The state and journal already hold every replicated batch applied so far, so nothing
+     * is reloaded. The primary position is forgotten, in the journal too.
+     */
+    void promote();
+
+    /**
+     * @brief True while changes are refused; see beginFollowing().
+     */
+    bool isFollower() const { return following.load(std::memory_order_acquire); }
+
+    /**
+     * @brief Where the state stands in the primary's journal.
+     *
+     * Restored by openJournal() from the last replicated batch.
+     *
+     * @return false If no replicated batch was applied and no replica image loaded, or the
+     *         service was promoted since.
+     */
+    bool replicaPosition(std::uint64_t& epoch, std::uint64_t& offset) const;
+
+    /**
+     * @brief Apply a batch of the primary's journal records, in order, as one change.
+     *
+     * With a journal open the batch is logged as a single Replicated record carrying the
+     * position after it, and is durable before the call returns: one flush for the whole
+     * batch. A batch of no records only moves the position, and is logged only if it does.
+     * Snapshots never see part of a batch.
+     *
+     * @param epoch The primary's epoch after the batch.
+     * @param offset The primary's journal offset after the batch.
+     * @param records Whole records as they appear in the primary's journal.
+     * @return false If the records are damaged, in which case none is applied, or the
+     *         journal failed.
+     */
+    bool applyReplicated(std::uint64_t epoch, std::uint64_t offset, const char* records, std::size_t size);
+
+    /**
+     * @brief Encode the whole state as a snapshot image, for a new follower to start from.
+     *
+     * @param epoch Receives the journal epoch the image was taken at.
+     * @param offset Receives the journal offset it covers up to, counting records not yet
+     *        durable; a follower continues from there.
+     * @return false If no journal is open.
+     */
+    bool replicaImage(std::string& image, std::uint64_t& epoch, std::uint64_t& offset);
+
+    /**
+     * @brief Adopt an image from replicaImage() as the state of this service, which must be
+     *        empty, and checkpoint it so the image is durable.
+     *
+     * @param image The image, which is read in place.
+     * @param size Its length in bytes.
+     * @param epoch The primary position the image covers, from replicaImage().
+     * @param offset Likewise.
+     * @return false If no journal is open, the service is not empty, or the image could not
+     *         be written or loaded. A failed load may leave part of the image installed.
+     */
+    bool loadReplicaImage(const char* image, std::size_t size, std::uint64_t epoch, std::uint64_t offset);
+
+    /**
+     * @brief The journal opened by openJournal(), or null; for shipping to followers.
+     */
+    Journal* openedJournal() const { return journal.get(); }
+
+    /**
+     * @brief Let journaled changes made on the calling thread return as soon as they are
+     *        applied and logged, without waiting for durability, until endDeferred().
+     *
+     * An event loop can then answer a burst of requests with one durability wait instead
+     * of one per change. Until endDeferred() returns, an Ok only means the change was
+     * applied; other threads may already see it.
+     */
+    void beginDeferred();
+
+    /**
+     * @brief Stop deferring and wait for every change deferred since beginDeferred().
+     *
+     * @return true If they are all durable, or no journal is open.
+     * @return false If the journal failed; each deferred Ok should be reported as
+     *         JournalFailed, as a non-deferred call would have.
+     */
+    bool endDeferred();
+
+    /**
+     * @brief Install a new bus.
+     *
+     * @param info The bus details. Every string must be 1 to Journal::MAX_STRING bytes,
+     *        the layout valid and every base fare positive.
+     * @return BookingStatus Ok, InvalidBus, DuplicateBus or JournalFailed.
+     */
+    BookingStatus install(const BusInfo& info);
+
+    /**
+     * @brief Install every bus listed in a fleet file; see FleetCsv for its columns.
+     *
+     * The file is mapped and split at line boundaries into one chunk per thread. Each
+     * thread parses its rows in place and builds their buses, then all of them are added
+     * in one BusRegistry::addAll() call, which indexes them in a single pass, and journaled
+     * as one batch with a single durability wait. Rows are checked as install() checks
+     * them, and duplicates resolve in file order: the first row with a bus number wins.
+     *
+     * @param path The fleet file.
+     * @param report Receives the row counts, and why the import failed if it did.
+     * @param threads Parsing threads, or 0 for one per core.
+     * @return true If the file was read; rejected and duplicate rows are only counted.
+     * @return false If the file or its header could not be read, so nothing was
+     *         installed, or the journal failed after report.installed buses were installed.
+     */
+    bool importFleet(const std::string& path, ImportReport& report, unsigned threads = 0);
+
+    /**
+     * @brief Write the seat occupancy of every bus's undated seat map to a file, one row per
+     *        bus in installation order; see OccupancyWriter for the formats.
+     *
+     * Each bus is read under its own lock only, so bookings carry on during the export;
+     * installs wait for it. The file is written beside path and renamed into place, so
+     * readers never see a partial export.
+     *
+     * @return true If the export is complete.
+     */
+    bool exportOccupancy(const std::string& path, ExportFormat format) const;
+
+    /**
+     * @brief Reserve a seat for a passenger.
+     *
+     * @param busNumber The bus number.
+     * @param seatNumber The seat number (1 to the bus's seat count).
+     * @param passenger Name of the passenger. 1 to PassengerStore::MAX_NAME bytes.
+     * @return BookingStatus Ok, BusNotFound, InvalidSeat, InvalidPassenger, SeatTaken or
+     *         JournalFailed.
+     */
+    BookingStatus reserve(const std::string& busNumber, int seatNumber, const std::string& passenger);
+
+    /**
+     * @brief Cancel the reservation of a seat.
+     *
+     * @param busNumber The bus number.
+     * @param seatNumber The seat number (1 to the bus's seat count).
+     * @return BookingStatus Ok, BusNotFound, InvalidSeat, SeatEmpty or JournalFailed.
+     */
+    BookingStatus cancel(const std::string& busNumber, int seatNumber);
+
+    /**
+     * @brief Reserve a list of seats for a group, all or none.
+     *
+     * @param busNumber The bus number.
+     * @param seatNumbers The seats to reserve (each on the bus, no repeats).
+     * @param passenger Name the seats are booked under. 1 to PassengerStore::MAX_NAME bytes.
+     * @param fareTotal Receives the price charged for the seats, in paise, on success.
+     * @return BookingStatus Ok, BusNotFound, InvalidSeat, InvalidPassenger, SeatTaken or
+     *         JournalFailed. No seat is reserved unless the result is Ok or JournalFailed.
+     */
+    BookingStatus reserveSeats(const std::string& busNumber, const std::vector<int>& seatNumbers,
+                               const std::string& passenger, Paise& fareTotal);
+
+    /**
+     * @brief Let the system pick and reserve seats, so callers never race for a seat number.
+     *
+     * See Bus::chooseSeats() for how seats are picked.
+     *
+     * @param busNumber The bus number.
+     * @param request Number of seats wanted, preference and fit.
+     * @param passenger Name the seats are booked under. 1 to PassengerStore::MAX_NAME bytes.
+     * @param seatNumbers Receives the reserved seats in ascending order.
+     * @param fareTotal Receives the price charged for the seats, in paise, on success.
+     * @return BookingStatus Ok, BusNotFound, InvalidSeat, InvalidPassenger, NotEnoughSeats
+     *         or JournalFailed.
+     */
+    BookingStatus reserveAuto(const std::string& busNumber, const SeatRequest& request, const std::string& passenger,
+                              std::vector<int>& seatNumbers, Paise& fareTotal);
+
+    /**
+     * @brief Reserve count seats for a group, preferring seats next to each other.
+     */
+    BookingStatus reserveAdjacent(const std::string& busNumber, int count, const std::string& passenger,
+                                  std::vector<int>& seatNumbers, Paise& fareTotal) {
+        SeatRequest request;
+        request.count = count;
+        return reserveAuto(busNumber, request, passenger, seatNumbers, fareTotal);
+    }
+
+    /**
+     * @brief Booking a reserved seat belongs to; see BusRegistry::bookingOf().
+     *
+     * @return BookingStatus Ok, BusNotFound, InvalidSeat or SeatEmpty.
+     */
+    BookingStatus bookingOf(const std::string& busNumber, int seatNumber, BookingIndex::Id& booking) const {
+        return registry.bookingOf(busNumber, seatNumber, booking);
+    }
+
+    /**
+     * @brief Look a booking up by id.
+     *
+     * @return BookingStatus Ok or NoBooking.
+     */
+    BookingStatus getBooking(BookingIndex::Id id, Booking& booking) const { return registry.getBooking(id, booking); }
+
+    /**
+     * @brief Every booking under a passenger name, ignoring case and extra whitespace,
+     *        newest first. Costs one index lookup, however many buses there are.
+     *
+     * @return std::size_t Bookings found.
+     */
+    std::size_t findBookings(const std::string& passenger, std::vector<Booking>& found) const {
+        return registry.findBookings(passenger, found);
+    }
+
+    /**
+     * @brief Cancel every seat still reserved under a booking, all at once.
+     *
+     * @param id The booking.
+     * @param seatNumbers Receives the cancelled seats in ascending order.
+     * @param refund Receives the price that had been paid for them, in paise.
+     * @return BookingStatus Ok, NoBooking or JournalFailed.
+     */
+    BookingStatus cancelBooking(BookingIndex::Id id, std::vector<int>& seatNumbers, Paise& refund);
+
+    /**
+     * @brief Number of bookings with at least one seat still reserved.
+     */
+    std::size_t bookingCount() const { return registry.bookingCount(); }
+
+    /**
+     * @brief Hold seats while a customer pays, all or none; see BusRegistry::hold().
+     *
+     * Held seats are unavailable to everyone else until the hold is confirmed, released
+     * or its time to live runs out, when a background thread frees them (within one
+     * HOLD_TICK_MS tick). Holds are kept in memory only, never journaled.
+     *
+     * @param busNumber The bus number.
+     * @param seatNumbers The seats to hold (each on the bus, no repeats).
+     * @param ttlSeconds How long the hold lasts, clamped to 1 second .. MAX_HOLD_SECONDS.
+     * @param hold Receives the hold id on success.
+     * @return BookingStatus Ok, BusNotFound, InvalidSeat or SeatTaken.
+     */
+    BookingStatus hold(const std::string& busNumber, const std::vector<int>& seatNumbers, int ttlSeconds,
+                       HoldTable::Id& hold);
+
+    /**
+     * @brief Turn a live hold into a reservation, priced at the bus's demand tier now.
+     *
+     * @param hold The hold.
+     * @param passenger Name the seats are booked under. 1 to PassengerStore::MAX_NAME bytes.
+     * @param seatNumbers Receives the reserved seats in ascending order.
+     * @param fareTotal Receives the price charged for the seats, in paise, on success.
+     * @return BookingStatus Ok, InvalidPassenger (the hold stays live), NoHold or
+     *         JournalFailed.
+     */
+    BookingStatus confirmHold(HoldTable::Id hold, const std::string& passenger, std::vector<int>& seatNumbers,
+                              Paise& fareTotal);
+
+    /**
+     * @brief Give up a live hold before it expires.
+     *
+     * @return BookingStatus Ok or NoHold.
+     */
+    BookingStatus releaseHold(HoldTable::Id hold) { return registry.releaseHold(hold); }
+
+    /**
+     * @brief Free the seats of every hold past its time to live now, without waiting for
+     *        the background thread.
+     *
+     * @return std::size_t Holds released.
+     */
+    std::size_t expireHolds() { return registry.expireHolds(holdTick()); }
+
+    /**
+     * @brief Number of live holds.
+     */
+    std::size_t holdCount() const { return registry.holdCount(); }
+
+    static constexpr int HOLD_TICK_MS = 100;           /**< Resolution of hold expiry. */
+    static constexpr int MAX_HOLD_SECONDS = 24 * 3600; /**< Longest hold. */
+
+    /**
+     * @brief Set the dates a bus runs on; see BusRegistry::schedule().
+     *
+     * @param busNumber The bus number.
+     * @param first First service date.
+     * @param last Last service date, not before first.
+     * @param weekdays Days of the week it runs, bit 0 = Monday (EVERY_DAY for daily).
+     * @return BookingStatus Ok, BusNotFound, InvalidBus (last before first) or JournalFailed.
+     */
+    BookingStatus schedule(const std::string& busNumber, ServiceDate first, ServiceDate last,
+                           std::uint8_t weekdays = EVERY_DAY);
+
+    /**
+     * @brief Reserve a seat on a bus's trip of a given date.
+     *
+     * The fare is priced from the demand on that trip alone.
+     *
+     * @return BookingStatus Ok, BusNotFound, InvalidSeat, InvalidPassenger, NoTrip, SeatTaken
+     *         or JournalFailed.
+     */
+    BookingStatus reserveTrip(const std::string& busNumber, ServiceDate date, int seatNumber,
+                              const std::string& passenger);
+
+    /**
+     * @brief Cancel a seat on a bus's trip of a given date.
+     *
+     * @return BookingStatus Ok, BusNotFound, InvalidSeat, SeatEmpty or JournalFailed.
+     */
+    BookingStatus cancelTrip(const std::string& busNumber, ServiceDate date, int seatNumber);
+
+    /**
+     * @brief Consistent copy of a trip's seat map.
+     *
+     * @param busNumber The bus number.
+     * @param date The service date.
+     * @param seats Receives the seat map; every seat is empty if none has sold.
+     * @return BookingStatus Ok, BusNotFound or NoTrip (the bus does not run that day and
+     *         has nothing sold on it).
+     */
+    BookingStatus getTrip(const std::string& busNumber, ServiceDate date, TripSeats& seats) const;
+
+    /**
+     * @brief Price a list of seats at the bus's current demand tier, without reserving them.
+     *
+     * The quote is what reserveSeats() would charge if nothing else were booked first.
+     *
+     * @param busNumber The bus number.
+     * @param seatNumbers The seats to price (each on the bus, no repeats).
+     * @param fareTotal Receives the price, in paise.
+     * @return BookingStatus Ok, BusNotFound or InvalidSeat.
+     */
+    BookingStatus quoteSeats(const std::string& busNumber, const std::vector<int>& seatNumbers,
+                             Paise& fareTotal) const;
+
+    /**
+     * @brief Check whether a bus is installed.
+     */
+    bool hasBus(const std::string& busNumber) const {
+        ScopedTimer timer(Timer::Lookup);
+        return registry.find(busNumber) != BusRegistry::npos;
+    }
+
+    /**
+     * @brief Snapshot of a single seat.
+     *
+     * @param busNumber The bus number.
+     * @param seatNumber The seat number (1 to the bus's seat count).
+     * @param seat Receives the passenger name ("Empty" if vacant, "Held" if held) and fare
+     *        in paise.
+     * @return BookingStatus Ok, BusNotFound or InvalidSeat.
+     */
+    BookingStatus getSeat(const std::string& busNumber, int seatNumber, Seat& seat) const;
+
+    /**
+     * @brief Consistent copy of a bus, including its seat map.
+     *
+     * @param busNumber The bus number.
+     * @param bus Receives the copy.
+     * @return BookingStatus Ok or BusNotFound.
+     */
+    BookingStatus getBus(const std::string& busNumber, Bus& bus) const;
+
+    /**
+     * @brief Seats of a bus that changed since a version of its seat map.
+     *
+     * For clients that poll availability: a refresh carries only the seats booked,
+     * cancelled, held or released since the last one, not the whole bus.
+     *
+     * @param busNumber The bus number.
+     * @param since delta.version from the previous call, or 0 the first time.
+     * @param delta Receives the version now, the changed seats and which of them are
+     *        reserved or held.
+     * @return BookingStatus Ok or BusNotFound.
+     */
+    BookingStatus seatChanges(const std::string& busNumber, std::uint32_t since, SeatDelta& delta) const {
+        ScopedTimer timer(Timer::Lookup);
+        return registry.seatChanges(busNumber, since, delta);
+    }
+
+    /**
+     * @brief Call fn(const Bus&) for every bus, in installation order.
+     *
+     * See BusRegistry::forEach() for what fn may read.
+     */
+    template <typename Fn>
+    void forEachBus(Fn fn) const { registry.forEach(fn); }
+
+    /**
+     * @brief Call fn(const Bus&) for every bus serving a route, in installation order.
+     *
+     * See BusRegistry::forEach() for what fn may read.
+     *
+     * @return std::size_t The number of matching buses.
+     */
+    template <typename Fn>
+    std::size_t forEachOnRoute(const std::string& origin, const std::string& dest, Fn fn) const {
+        ScopedTimer timer(Timer::RouteSearch);
+        // Cities that were never interned cannot be served by any bus
+        const StringPool::Id originId = symbols.find(origin);
+        const StringPool::Id destId = symbols.find(dest);
+        if(originId == StringPool::npos || destId == StringPool::npos) return 0;
+        return registry.forEachOnRoute(originId, destId, fn);
+    }
+
+    /**
+     * @brief Call fn(const Bus&) for every bus on a route departing within a window of the
+     *        day, in departure order.
+     *
+     * Buses whose departure time could not be parsed are never matched. See
+     * RouteIndex::forEachDeparting() for windows that wrap past midnight.
+     *
+     * @param fromMinute Earliest departure, minutes since midnight (see parseTime()).
+     * @param toMinute Latest departure, inclusive.
+     * @return std::size_t The number of matching buses.
+     */
+    template <typename Fn>
+    std::size_t forEachDeparting(const std::string& origin, const std::string& dest, int fromMinute, int toMinute,
+                                 Fn fn) const {
+        ScopedTimer timer(Timer::RouteSearch);
+        const StringPool::Id originId = symbols.find(origin);
+        const StringPool::Id destId = symbols.find(dest);
+        if(originId == StringPool::npos || destId == StringPool::npos) return 0;
+        return registry.forEachDeparting(originId, destId, fromMinute, toMinute, fn);
+    }
+
+    /**
+     * @brief Find the journey from origin to dest that arrives earliest, changing buses at
+     *        intermediate places, and call fn(const Bus&, const JourneyLeg&) for each leg in
+     *        travel order.
+     *
+     * Only buses whose departure and arrival times parsed take part. A journey may run on
+     * into the next day.
+     *
+     * @param query Earliest departure (0 to 1439), minimum transfer time (not negative),
+     *        seats needed on every leg (at least 1) and an optional travel date.
+     * @return std::size_t The number of legs, or 0 if there is no such journey or the query
+     *         is out of range.
+     */
+    template <typename Fn>
+    std::size_t findJourney(const std::string& origin, const std::string& dest, const JourneyQuery& query,
+                            Fn fn) const {
+        if(query.departAfter < 0 || query.departAfter >= MINUTES_PER_DAY || query.minTransfer < 0
+           || query.seats < 1) return 0;
+        const StringPool::Id originId = symbols.find(origin);
+        const StringPool::Id destId = symbols.find(dest);
+        if(originId == StringPool::npos || destId == StringPool::npos) return 0;
+        return registry.findJourney(originId, destId, query, fn);
+    }
+
+    /**
+     * @brief Call fn(const Bus&, int freeSeats) for every bus running a route on a date,
+     *        in installation order.
+     *
+     * See BusRegistry::forEachTrip().
+     *
+     * @return std::size_t The number of trips found.
+     */
+    template <typename Fn>
+    std::size_t forEachTrip(const std::string& origin, const std::string& dest, ServiceDate date, Fn fn) const {
+        ScopedTimer timer(Timer::RouteSearch);
+        const StringPool::Id originId = symbols.find(origin);
+        const StringPool::Id destId = symbols.find(dest);
+        if(originId == StringPool::npos || destId == StringPool::npos) return 0;
+        return registry.forEachTrip(originId, destId, date, fn);
+    }
+
+    /**
+     * @brief Call fn(const Bus&) for every bus on a route with at least minFree empty seats.
+     *
+     * Filtering reads only the availability counters. See BusRegistry::forEach() for
+     * what fn may read.
+     *
+     * @return std::size_t The number of matching buses.
+     */
+    template <typename Fn>
+    std::size_t forEachWithFreeSeats(const std::string& origin, const std::string& dest, int minFree, Fn fn) const {
+        ScopedTimer timer(Timer::RouteSearch);
+        const StringPool::Id originId = symbols.find(origin);
+        const StringPool::Id destId = symbols.find(dest);
+        if(originId == StringPool::npos || destId == StringPool::npos) return 0;
+        return registry.forEachWithFreeSeats(originId, destId, minFree, fn);
+    }
+
+    /**
+     * @brief Call fn(const Bus&) for every bus in the fleet that matches a query, in
+     *        installation order.
+     *
+     * For filters no index answers, such as every bus with a few free seats, or any of
+     * several routes: the fleet columns are scanned with SIMD kernels (see FleetColumns)
+     * and only matching buses are touched. See BusRegistry::forEach() for what fn may read.
+     *
+     * @return std::size_t The number of matching buses.
+     */
+    template <typename Fn>
+    std::size_t forEachMatching(const FleetQuery& query, Fn fn) const {
+        ScopedTimer timer(Timer::FleetScan);
+        FleetFilter filter;
+        if(!toFilter(query, filter)) return 0;
+        return registry.forEachMatching(filter, fn);
+    }
+
+    /**
+     * @brief Number of buses in the fleet that match a query, without touching any of them.
+     */
+    std::size_t countMatching(const FleetQuery& query) const;
+
+    /**
+     * @brief Seat totals over the whole fleet: buses, seats, empty seats, and buses sold out
+     *        or wholly unsold. Held seats count as taken.
+     */
+    FleetOccupancy occupancy() const;
+
+    /**
+     * @brief Empty seats on a bus, or -1 if no such bus is installed.
+     */
+    int freeSeats(const std::string& busNumber) const;
+
+    /**
+     * @brief Empty seats across every bus serving a route.
+     */
+    std::int64_t routeFreeSeats(const std::string& origin, const std::string& dest) const;
+
+    /**
+     * @brief Empty seats across the whole fleet.
+     */
+    std::int64_t totalFreeSeats() const { return registry.totalFreeSeats(); }
+
+    /**
+     * @brief Prices paid for every seat currently reserved, in paise.
+     */
+    Paise revenue() const { return registry.revenuePaise(); }
+
+    /**
+     * @brief Append the process-wide metrics (see Metrics) and the fleet's size, free seats,
+     *        bookings, holds and revenue as gauges, in the Prometheus text format.
+     */
+    void writeMetrics(std::string& out) const;
+
+    /**
+     * @brief The text behind an interned id stored in a Bus.
+     */
+    const std::string& text(StringPool::Id id) const { return symbols.str(id); }
+
+    /**
+     * @brief Name of the passenger holding a seat of a Bus copy, from Bus::passengerOf().
+     *
+     * A passenger record is reused once its last seat is cancelled, so the name is only
+     * right while the seat is still reserved.
+     */
+    std::string passengerName(PassengerStore::Id id) const { return registry.passengerName(id); }
+
+    bool empty() const { return registry.empty(); }
+    std::size_t size() const { return registry.size(); }
+
+private:
+    StringPool symbols;    /**< City, driver and time strings. */
+    BusRegistry registry;  /**< All installed buses. */
+    std::unique_ptr<Journal> journal;  /**< Write-ahead log, or null when running in memory. */
+    std::string snapshotPath;          /**< Snapshot file beside the journal. */
+    std::mutex checkpointMutex;        /**< Serialises checkpoint(). */
+
+    std::atomic<bool> following;       /**< Changes are refused; the state comes from a primary. */
+    mutable std::mutex replicaMutex;   /**< Keeps replicated batches whole; guards the position. */
+    bool hasSource;                    /**< The primary position below is known. */
+    std::uint64_t sourceEpoch;         /**< The primary's journal epoch after the last batch. */
+    std::uint64_t sourceOffset;        /**< The primary's journal offset after the last batch. */
+    std::vector<Bus> pendingInstalls;  /**< Installs apply() has yet to add; see flushInstalls(). */
+
+    std::uint64_t checkpointBytes;     /**< Journal size that triggers a checkpoint, or 0. */
+    bool stopping;                     /**< The destructor has asked the background threads to exit. */
+    std::mutex checkpointerMutex;      /**< Guards stopping. */
+    std::condition_variable checkpointerWake; /**< Wakes the checkpointer early to stop. */
+    std::thread checkpointer;          /**< Background checkpoint thread, if enabled. */
+
+    std::chrono::steady_clock::time_point started; /**< Hold tick 0. */
+    std::once_flag reaperStarted;      /**< Starts the reaper on the first hold. */
+    std::condition_variable reaperWake; /**< Wakes the reaper early to stop; uses checkpointerMutex. */
+    std::thread reaper;                /**< Background hold expiry thread, once a hold was taken. */
+
+    /**
+     * @brief Body of the checkpointer thread.
+     */
+    void checkpointLoop();
+
+    /**
+     * @brief Body of the reaper thread: expires holds once a tick.
+     */
+    void reapLoop();
+
+    /**
+     * @brief Hold ticks elapsed since the service was created.
+     */
+    std::uint64_t holdTick() const {
+        return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
+                   std::chrono::steady_clock::now() - started).count() / HOLD_TICK_MS);
+    }
+
+    /**
+     * @brief Encode the state as a snapshot image together with the journal position it
+     *        corresponds to. Caller holds checkpointMutex.
+     *
+     * @param sequence Receives the sequence number of the last record the image includes.
+     */
+    void capture(std::string& image, SnapshotInfo& info, std::uint64_t& sequence);
+
+    /**
+     * @brief Build a checked bus from its details, interning its strings.
+     */
+    Bus makeBus(const BusInfo& info);
+
+    /**
+     * @brief Translate a query's routes to route ids.
+     *
+     * @return false If the query names routes but no bus serves any of them, so nothing
+     *         can match.
+     */
+    bool toFilter(const FleetQuery& query, FleetFilter& filter) const;
+
+    /**
+     * @brief Apply one replayed or replicated journal record straight to the registry, as
+     *        the call that logged it did, without journaling it again.
+     *
+     * A run of installs is collected and added as one batch when the next other record
+     * comes, or at flushInstalls(), so the route index is sorted once per run rather than
+     * copied per bus. Callers are replay, before the service is shared, and replicated
+     * batches under replicaMutex.
+     */
+    void apply(const JournalRecord& record);
+
+    /**
+     * @brief Add the installs apply() has collected, in journal order.
+     */
+    void flushInstalls();
+};
+
+#endif // BOOKING_BOOKINGSERVICE_H
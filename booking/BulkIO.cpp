@@ -0,0 +1,292 @@
+// BulkIO.cpp
+
+#include "BulkIO.h"
+
+#include <cstring>
+
+namespace {
+
+/**
+ * @brief Layout names in fleet files and exports, indexed by LayoutKind.
+ */
+const char* const LAYOUT_KEYS[LAYOUT_COUNT] = { "coach", "sleeper", "double-decker" };
+
+const char COLUMNAR_MAGIC[8] = { 'B', 'U', 'S', 'O', 'C', 'C', '0', '1' };
+
+/**
+ * @brief Parse a layout name or menu number; empty means coach.
+ */
+bool parseLayout(const std::string& text, LayoutKind& layout) {
+    if(text.empty()) {
+        layout = LayoutKind::Coach;
+        return true;
+    }
+    for(int kind = 0; kind < LAYOUT_COUNT; ++kind) {
+        if(text == LAYOUT_KEYS[kind] || (text.size() == 1 && text[0] == '1' + kind)) {
+            layout = static_cast<LayoutKind>(kind);
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Parse rupees with up to two decimals ("300", "300.5", "300.50") into paise;
+ *        empty leaves fare as it was.
+ */
+bool parseFare(const std::string& text, std::int32_t& fare) {
+    if(text.empty()) return true;
+    std::int64_t paise = 0;
+    std::size_t i = 0;
+    for(; i < text.size() && text[i] >= '0' && text[i] <= '9'; ++i) {
+        paise = paise * 10 + (text[i] - '0');
+        if(paise > 0x7FFFFFFF / 100) return false;
+    }
+    if(i == 0) return false;
+    paise *= 100;
+    if(i < text.size() && text[i] == '.') {
+        const std::size_t decimals = text.size() - i - 1;
+        if(decimals < 1 || decimals > 2) return false;
+        for(std::size_t d = 0; d < 2; ++d) {
+            const char c = d < decimals ? text[i + 1 + d] : '0';
+            if(c < '0' || c > '9') return false;
+            paise += (c - '0') * (d == 0 ? 10 : 1);
+        }
+    } else if(i != text.size()) {
+        return false;
+    }
+    if(paise > 0x7FFFFFFF) return false;
+    fare = static_cast<std::int32_t>(paise);
+    return true;
+}
+
+void putU8(std::string& out, std::uint8_t v) {
+    out.push_back(static_cast<char>(v));
+}
+
+void putLittle(std::string& out, std::uint64_t v, int bytes) {
+    for(int i = 0; i < bytes; ++i) out.push_back(static_cast<char>((v >> (8 * i)) & 0xFFu));
+}
+
+/**
+ * @brief Append a CSV field, quoting it if it holds a comma, quote or line break.
+ */
+void appendCsvField(OutputBuffer& output, const std::string& text) {
+    if(text.find_first_of(",\"\r\n") == std::string::npos) {
+        output.append(text);
+        return;
+    }
+    output.append('"');
+    for(char c : text) {
+        if(c == '"') output.append('"');
+        output.append(c);
+    }
+    output.append('"');
+}
+
+/**
+ * @brief Append the seat numbers in mask, separated by spaces.
+ */
+void appendSeatList(OutputBuffer& output, SeatMask mask) {
+    for(SeatMask rest = mask; rest; rest &= rest - 1) {
+        output.appendInt(lowestBit(rest) + 1);
+        if(rest & (rest - 1)) output.append(' ');
+    }
+}
+
+} // namespace
+
+bool readCsvField(const char*& p, const char* end, std::string& out, bool& more) {
+    if(p == end || *p != '"') {
+        const char* comma = static_cast<const char*>(std::memchr(p, ',', static_cast<std::size_t>(end - p)));
+        more = comma != nullptr;
+        const char* stop = more ? comma : end;
+        out.assign(p, static_cast<std::size_t>(stop - p));
+        p = more ? comma + 1 : end;
+        return true;
+    }
+
+    out.clear();
+    for(++p; ; ) {
+        const char* quote = static_cast<const char*>(std::memchr(p, '"', static_cast<std::size_t>(end - p)));
+        if(!quote) return false;
+        out.append(p, static_cast<std::size_t>(quote - p));
+        p = quote + 1;
+        if(p < end && *p == '"') {
+            // A doubled quote is a literal one
+            out.push_back('"');
+            ++p;
+            continue;
+        }
+        more = p < end;
+        if(more && *p++ != ',') return false;
+        return true;
+    }
+}
+
+bool FleetCsv::parseHeader(const char* line, const char* end) {
+    static const struct {
+        const char* name;
+        Column column;
+    } NAMES[] = {
+        { "bus_number", Column::Number }, { "driver", Column::Driver }, { "arrival", Column::Arrival },
+        { "departure", Column::Departure }, { "from", Column::From }, { "to", Column::To },
+        { "layout", Column::Layout }, { "fare_standard", Column::FareStandard },
+        { "fare_window", Column::FareWindow }, { "fare_front", Column::FareFront }
+    };
+
+    columns.clear();
+    unsigned seen = 0;
+    std::string name;
+    const char* p = line;
+    for(bool more = true; more; ) {
+        if(!readCsvField(p, end, name, more)) return false;
+        Column column = Column::Ignored;
+        for(const auto &known : NAMES) {
+            if(name != known.name) continue;
+            const unsigned bit = 1u << static_cast<int>(known.column);
+            if(seen & bit) return false;
+            seen |= bit;
+            column = known.column;
+        }
+        columns.push_back(column);
+    }
+
+    // Every BusInfo string must have a column
+    for(Column required : { Column::Number, Column::Driver, Column::Arrival, Column::Departure, Column::From, Column::To }) {
+        if(!(seen & (1u << static_cast<int>(required)))) return false;
+    }
+    return true;
+}
+
+bool FleetCsv::parseRow(const char* line, const char* end, BusInfo& info, std::string& spare) const {
+    info.layout = LayoutKind::Coach;
+    info.fares = DEFAULT_FARES;
+
+    const char* p = line;
+    bool more = true;
+    for(std::size_t i = 0; i < columns.size(); ++i) {
+        if(!more) return false;
+        std::string* target = &spare;
+        switch(columns[i]) {
+            case Column::Number:    target = &info.busNumber; break;
+            case Column::Driver:    target = &info.driverName; break;
+            case Column::Arrival:   target = &info.arrivalTime; break;
+            case Column::Departure: target = &info.departureTime; break;
+            case Column::From:      target = &info.from; break;
+            case Column::To:        target = &info.to; break;
+            default: break;
+        }
+        if(!readCsvField(p, end, *target, more)) return false;
+        switch(columns[i]) {
+            case Column::Layout:
+                if(!parseLayout(spare, info.layout)) return false;
+                break;
+            case Column::FareStandard:
+                if(!parseFare(spare, info.fares.base[static_cast<int>(FareClass::Standard)])) return false;
+                break;
+            case Column::FareWindow:
+                if(!parseFare(spare, info.fares.base[static_cast<int>(FareClass::Window)])) return false;
+                break;
+            case Column::FareFront:
+                if(!parseFare(spare, info.fares.base[static_cast<int>(FareClass::Front)])) return false;
+                break;
+            default:
+                break;
+        }
+    }
+    return !more;
+}
+
+OccupancyWriter::OccupancyWriter(std::ostream& stream, ExportFormat kind)
+    : out(stream), format(kind), output(stream, 1024 * 1024), rows(0)
+{
+    static const struct {
+        const char* name;
+        Type type;
+    } COLUMNS[] = {
+        { "bus_number", Type::String }, { "from", Type::String }, { "to", Type::String },
+        { "departure", Type::I16 }, { "layout", Type::U8 }, { "seats", Type::U8 },
+        { "reserved", Type::U8 }, { "held", Type::U8 }, { "revenue", Type::I64 },
+        { "reserved_seats", Type::Mask }, { "held_seats", Type::Mask }
+    };
+
+    if(format == ExportFormat::Csv) {
+        output.append("bus_number,from,to,departure,layout,seats,reserved,held,revenue,reserved_seats,held_seats\n");
+        return;
+    }
+    std::string header(COLUMNAR_MAGIC, sizeof(COLUMNAR_MAGIC));
+    putLittle(header, sizeof(COLUMNS) / sizeof(COLUMNS[0]), 4);
+    for(const auto &column : COLUMNS) {
+        putU8(header, static_cast<std::uint8_t>(column.type));
+        putU8(header, static_cast<std::uint8_t>(std::strlen(column.name)));
+        header += column.name;
+        columns.push_back(ColumnData{ column.name, column.type, std::string(), std::string() });
+    }
+    output.append(header);
+}
+
+void OccupancyWriter::add(const Bus& bus, const StringPool& symbols, SeatMask reserved, SeatMask held, Paise paid) {
+    const std::string &from = symbols.str(bus.getOrigin());
+    const std::string &to = symbols.str(bus.getDestination());
+    const int layout = static_cast<int>(bus.getLayout());
+
+    if(format == ExportFormat::Csv) {
+        appendCsvField(output, bus.getBusNumber());
+        output.append(',');
+        appendCsvField(output, from);
+        output.append(',');
+        appendCsvField(output, to);
+        output.append(',');
+        appendCsvField(output, symbols.str(bus.getDepartureTime()));
+        output.append(',').append(LAYOUT_KEYS[layout]).append(',');
+        output.appendInt(bus.seatCount()).append(',');
+        output.appendInt(countBits(reserved)).append(',');
+        output.appendInt(countBits(held)).append(',');
+        output.appendPaise(paid).append(',');
+        appendSeatList(output, reserved);
+        output.append(',');
+        appendSeatList(output, held);
+        output.append('\n');
+        return;
+    }
+
+    const std::string* strings[] = { &bus.getBusNumber(), &from, &to };
+    for(int i = 0; i < 3; ++i) {
+        putLittle(columns[i].values, strings[i]->size(), 4);
+        columns[i].bytes += *strings[i];
+    }
+    putLittle(columns[3].values, static_cast<std::uint16_t>(bus.getDepartureMinute()), 2);
+    putU8(columns[4].values, static_cast<std::uint8_t>(layout));
+    putU8(columns[5].values, static_cast<std::uint8_t>(bus.seatCount()));
+    putU8(columns[6].values, static_cast<std::uint8_t>(countBits(reserved)));
+    putU8(columns[7].values, static_cast<std::uint8_t>(countBits(held)));
+    putLittle(columns[8].values, static_cast<std::uint64_t>(paid), 8);
+    putLittle(columns[9].values, reserved, 8);
+    putLittle(columns[10].values, held, 8);
+    if(++rows == ROW_GROUP) flushGroup();
+}
+
+bool OccupancyWriter::finish() {
+    if(format == ExportFormat::Columnar) {
+        if(rows) flushGroup();
+        std::string last;
+        putLittle(last, 0, 4);
+        output.append(last);
+    }
+    return output.flush() && static_cast<bool>(out);
+}
+
+void OccupancyWriter::flushGroup() {
+    std::string prefix;
+    putLittle(prefix, rows, 4);
+    output.append(prefix);
+    for(ColumnData &column : columns) {
+        prefix.clear();
+        putLittle(prefix, column.values.size() + column.bytes.size(), 8);
+        output.append(prefix).append(column.values).append(column.bytes);
+        column.values.clear();
+        column.bytes.clear();
+    }
+    rows = 0;
+}
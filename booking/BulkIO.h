@@ -0,0 +1,175 @@
+#ifndef BOOKING_BULKIO_H
+#define BOOKING_BULKIO_H
+
+#include <string>
+#include <vector>
+#include <ostream>
+#include <cstdint>
+#include <cstddef>
+
+#include "Bus.h"
+#include "OutputBuffer.h"
+#include "StringPool.h"
+
+/**
+ * @file BulkIO.h
+ * @brief Fleet files in and seat occupancy files out, for loading and analysing whole
+ *        timetables at once.
+ */
+
+/**
+ * @struct ImportReport
+ * @brief What a fleet import did with each row of the file.
+ */
+struct ImportReport {
+    std::size_t rows = 0;               /**< Data rows read; the header and blank lines are not rows. */
+    std::size_t installed = 0;          /**< Buses installed. */
+    std::size_t duplicates = 0;         /**< Rows whose bus number was already installed or came earlier in the file. */
+    std::size_t rejected = 0;           /**< Rows that were malformed or failed the checks install() makes. */
+    std::size_t firstRejectedLine = 0;  /**< Line number (from 1) of the first rejected row, or 0. */
+    const char* error = nullptr;        /**< Why the import failed as a whole, if it did. */
+};
+
+/**
+ * @brief Layout of an occupancy export.
+ */
+enum class ExportFormat : std::uint8_t {
+    Csv,      /**< One line per bus, with a header line. */
+    Columnar  /**< Binary columns in row groups; see OccupancyWriter. */
+};
+
+/**
+ * @brief Read one CSV field starting at p into out, leaving p just past the field and
+ *        its comma.
+ *
+ * Fields follow RFC 4180: a field in double quotes may hold commas, and "" inside it
+ * stands for one quote. Line breaks inside fields are not supported. out is assigned, so
+ * its capacity is reused from row to row.
+ *
+ * @param p Start of the field; on return, the start of the next one.
+ * @param end End of the line, without its line break.
+ * @param more Set to whether a comma followed, so another field comes next.
+ * @return false If a quoted field is not closed, or is followed by anything but a comma.
+ */
+bool readCsvField(const char*& p, const char* end, std::string& out, bool& more);
+
+/**
+ * @class FleetCsv
+ * @brief The columns of a fleet file, read from its header line, and the parser of its
+ *        rows.
+ *
+ * A fleet file is CSV with a header line naming its columns, in any order:
+ *
+ *  - bus_number, driver, arrival, departure, from, to: the BusInfo strings, all required.
+ *  - layout: "coach", "sleeper" or "double-decker", or 1 to 3 as in the install menu.
+ *    Optional; coach if missing or empty.
+ *  - fare_standard, fare_window, fare_front: base fares in rupees, with up to two
+ *    decimals. Optional; each defaults to DEFAULT_FARES if missing or empty.
+ *
+ * Other columns are ignored. Rows are parsed straight from the file's bytes into a
+ * caller-owned BusInfo, so steady-state parsing allocates nothing. A parser is read-only
+ * once its header is set and can be shared by parsing threads.
+ */
+class FleetCsv {
+public:
+    /**
+     * @brief Learn the column order from the header line.
+     *
+     * @return false If a required column is missing or any known column appears twice.
+     */
+    bool parseHeader(const char* line, const char* end);
+
+    /**
+     * @brief Parse one data row.
+     *
+     * @param info Receives the row; every string field is assigned. The checks install()
+     *        makes are left to the caller.
+     * @param spare Scratch for the columns that are not strings of BusInfo.
+     * @return false If the row is malformed: wrong field count, bad quoting, or a layout or
+     *         fare that does not parse.
+     */
+    bool parseRow(const char* line, const char* end, BusInfo& info, std::string& spare) const;
+
+private:
+    enum class Column : std::uint8_t {
+        Ignored, Number, Driver, Arrival, Departure, From, To, Layout, FareStandard, FareWindow, FareFront
+    };
+
+    std::vector<Column> columns;  /**< Meaning of each field, in file order. */
+};
+
+/**
+ * @class OccupancyWriter
+ * @brief Streams one row per bus, describing its seats, to an occupancy file.
+ *
+ * Both formats carry the same columns: bus_number, from, to, departure, layout, seats,
+ * reserved, held, revenue, reserved_seats and held_seats. CSV gives the departure time as
+ * entered, revenue in rupees and seat lists as seat numbers separated by spaces; the
+ * columnar file gives the departure minute, revenue in paise and seat masks.
+ *
+ * The columnar file suits analytics readers that load whole columns. It is the magic
+ * "BUSOCC01", a u32 column count, and for each column a u8 type and a u8-length-prefixed
+ * name; then row groups of up to ROW_GROUP rows, each a u32 row count followed by every
+ * column's values for those rows, each column prefixed by its u64 byte length; then a u32
+ * zero. Strings are stored as a u32 length per row followed by their bytes, and seat lists
+ * as u64 masks with bit n - 1 for seat n. Integers are little-endian.
+ */
+class OccupancyWriter {
+public:
+    static const std::size_t ROW_GROUP = 65536;  /**< Rows per columnar row group. */
+
+    /**
+     * @brief Column value types of the columnar format.
+     */
+    enum class Type : std::uint8_t {
+        String = 1,
+        U8 = 2,
+        I16 = 3,  /**< The departure minute; -1 if the time did not parse. */
+        I64 = 4,
+        Mask = 5  /**< u64 seat mask. */
+    };
+
+    /**
+     * @brief Write the file header, or the CSV header line, to out.
+     */
+    OccupancyWriter(std::ostream& out, ExportFormat format);
+
+    /**
+     * @brief Add one bus's row.
+     *
+     * @param symbols The pool the bus's strings were interned in.
+     * @param reserved, held, paid The bus's seats, as BusRegistry::forEachOccupancy() gives them.
+     */
+    void add(const Bus& bus, const StringPool& symbols, SeatMask reserved, SeatMask held, Paise paid);
+
+    /**
+     * @brief Write any buffered rows and the end of the file.
+     *
+     * @return true If every byte reached the stream.
+     */
+    bool finish();
+
+private:
+    /**
+     * @brief One column of the current row group.
+     */
+    struct ColumnData {
+        const char* name;
+        Type type;
+        std::string values;  /**< Fixed-size values, or the lengths of a string column. */
+        std::string bytes;   /**< Bytes of a string column. */
+    };
+
+    std::ostream& out;
+    ExportFormat format;
+    OutputBuffer output;
+    std::vector<ColumnData> columns;
+    std::uint32_t rows;  /**< Rows in the current row group. */
+
+    /**
+     * @brief Write the current row group and start the next.
+     */
+    void flushGroup();
+};
+
+#endif // BOOKING_BULKIO_H
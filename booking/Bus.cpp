@@ -0,0 +1,21 @@
+// Bus.cpp
+
+#include "Bus.h"
+
+Bus::Bus()
+    : driverName(0), arrivalTime(0), departureTime(0), from(0), to(0),
+      departureMinute(NO_TIME), arrivalMinute(NO_TIME), firstDate(0), lastDate(0), weekdays(0),
+      layout(LayoutKind::Coach), occupied(0), held(0), fares(DEFAULT_FARES)
+{
+}
+
+Bus::Bus(const std::string& number, StringPool::Id driver, StringPool::Id arrival,
+         StringPool::Id departure, StringPool::Id origin, StringPool::Id dest, LayoutKind kind,
+         const FareTable& fareTable, int departs, int arrives)
+    : busNumber(number),
+      driverName(driver), arrivalTime(arrival), departureTime(departure), from(origin), to(dest),
+      departureMinute(static_cast<std::int16_t>(departs)), arrivalMinute(static_cast<std::int16_t>(arrives)),
+      firstDate(0), lastDate(0), weekdays(0),
+      layout(kind), occupied(0), held(0), fares(fareTable)
+{
+}
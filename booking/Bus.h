@@ -0,0 +1,301 @@
+#ifndef BOOKING_BUS_H
+#define BOOKING_BUS_H
+
+#include <string>
+#include <cstdint>
+
+#include "Calendar.h"
+#include "PassengerStore.h"
+#include "Pricing.h"
+#include "SeatLayout.h"
+#include "StringPool.h"
+
+/**
+ * @file Bus.h
+ * @brief The Bus record, its compact seat map, and the Seat and BusInfo value types.
+ */
+
+/**
+ * @struct Seat
+ * @brief Snapshot of a single seat in the bus.
+ *
+ * Each seat has a passenger name (or "Empty" if unreserved) and a fare price. Buses do not
+ * store Seat objects; the booking service hands out these snapshots built from the compact
+ * seat map.
+ */
+struct Seat {
+    std::string passengerName; /**< Name of the passenger. "Empty" if seat is vacant. */
+    Paise fare;                /**< Price paid for the seat, or its current price if vacant. */
+
+    /**
+     * @brief Default constructor initializes seat as empty with zero fare.
+     */
+    Seat() : passengerName("Empty"), fare(0) {}
+};
+
+/**
+ * @struct BusInfo
+ * @brief The details needed to install a new bus.
+ */
+struct BusInfo {
+    std::string busNumber;      /**< Unique identifier for the bus. */
+    std::string driverName;     /**< Name of the bus driver. */
+    std::string arrivalTime;    /**< Arrival time of the bus. */
+    std::string departureTime;  /**< Departure time of the bus. */
+    std::string from;           /**< Origin location. */
+    std::string to;             /**< Destination location. */
+    LayoutKind layout = LayoutKind::Coach;  /**< Seat geometry. */
+    FareTable fares = DEFAULT_FARES;        /**< Base fare per fare class. */
+};
+
+/**
+ * @class Bus
+ * @brief Represents a bus with its details and seat information.
+ *
+ * A Bus is plain data: every string except the bus number is an id into the StringPool
+ * owned by the BookingService, and seat state changes only through the BusRegistry.
+ *
+ * The seat map held here is the bus's undated inventory. Once the bus is given a service
+ * window it also runs dated trips, whose seat maps live in the registry's TripStore. The
+ * booking serials of its reserved seats and the history of its seat map live beside it
+ * too, in a SeatBookingStore and a SeatHistoryStore.
+ */
+class Bus {
+private:
+    std::string busNumber;          /**< Unique identifier for the bus. */
+    StringPool::Id driverName;      /**< Name of the bus driver (interned). */
+    StringPool::Id arrivalTime;     /**< Arrival time of the bus (interned). */
+    StringPool::Id departureTime;   /**< Departure time of the bus (interned). */
+    StringPool::Id from;            /**< Origin location (interned). */
+    StringPool::Id to;              /**< Destination location (interned). */
+    std::int16_t departureMinute;   /**< Departure time, minutes since midnight, or NO_TIME. */
+    std::int16_t arrivalMinute;     /**< Arrival time, minutes since midnight, or NO_TIME. */
+
+    ServiceDate firstDate;          /**< First date of the service window. */
+    ServiceDate lastDate;           /**< Last date of the service window. */
+    std::uint8_t weekdays;          /**< Days of the week it runs (bit 0 = Monday); 0 until scheduled. */
+
+public:
+    static const int MAX_SEATS = 64;  /**< Most seats any layout has; seat maps are 64-bit. */
+
+private:
+    LayoutKind layout;              /**< Seat geometry. */
+
+    /**
+     * @brief Occupancy bitmask: bit (n - 1) is set when seat n is reserved.
+     *
+     * Seats are numbered row by row, so seat n sits in row (n - 1) / columns of the layout.
+     */
+    SeatMask occupied;
+
+    /**
+     * @brief Seats kept for a customer by an outstanding hold: not reserved, but not free
+     *        either. Never overlaps occupied.
+     */
+    SeatMask held;
+
+    /**
+     * @brief Passenger record per seat, in the registry's PassengerStore.
+     *
+     * Only meaningful for seats whose occupancy bit is set.
+     */
+    PassengerStore::Id passengers[MAX_SEATS];
+
+    /**
+     * @brief Demand tier each reserved seat was charged at, so its refund matches the price.
+     *
+     * Only meaningful for seats whose occupancy bit is set.
+     */
+    std::uint8_t paidTiers[MAX_SEATS];
+
+    FareTable fares;                /**< Base fare per fare class. */
+
+public:
+    /**
+     * @brief Default constructor creates an empty, unnamed bus with default fares.
+     */
+    Bus();
+
+    /**
+     * @brief Construct a bus with all seats empty and default fares.
+     *
+     * @param number Unique bus number.
+     * @param driver Interned driver name.
+     * @param arrival Interned arrival time.
+     * @param departure Interned departure time.
+     * @param origin Interned origin location.
+     * @param dest Interned destination location.
+     * @param kind Seat geometry.
+     * @param fareTable Base fare per fare class.
+     * @param departs Parsed departure time in minutes since midnight, or NO_TIME.
+     * @param arrives Parsed arrival time in minutes since midnight, or NO_TIME.
+     */
+    Bus(const std::string& number, StringPool::Id driver, StringPool::Id arrival,
+        StringPool::Id departure, StringPool::Id origin, StringPool::Id dest,
+        LayoutKind kind = LayoutKind::Coach, const FareTable& fareTable = DEFAULT_FARES,
+        int departs = NO_TIME, int arrives = NO_TIME);
+
+    /**
+     * @brief Check if the bus matches the given route.
+     *
+     * @param origin Interned origin location to match.
+     * @param dest Interned destination location to match.
+     * @return true If the bus matches the route.
+     * @return false Otherwise.
+     */
+    bool matchesRoute(StringPool::Id origin, StringPool::Id dest) const { return from == origin && to == dest; }
+
+    /**
+     * @brief Get the bus number.
+     *
+     * @return const std::string& The bus number (no copy is made).
+     */
+    const std::string& getBusNumber() const { return busNumber; }
+
+    StringPool::Id getDriverName() const { return driverName; }        /**< Interned driver name. */
+    StringPool::Id getArrivalTime() const { return arrivalTime; }      /**< Interned arrival time. */
+    StringPool::Id getDepartureTime() const { return departureTime; }  /**< Interned departure time. */
+    StringPool::Id getOrigin() const { return from; }                  /**< Interned origin location. */
+    StringPool::Id getDestination() const { return to; }               /**< Interned destination location. */
+    int getDepartureMinute() const { return departureMinute; }         /**< Minutes since midnight, or NO_TIME. */
+    int getArrivalMinute() const { return arrivalMinute; }             /**< Minutes since midnight, or NO_TIME. */
+
+    ServiceDate getFirstDate() const { return firstDate; }             /**< First date of the service window. */
+    ServiceDate getLastDate() const { return lastDate; }               /**< Last date of the service window. */
+    std::uint8_t getWeekdays() const { return weekdays; }              /**< Running days, bit 0 = Monday. */
+
+    /**
+     * @brief Check whether the bus has a trip on a service date.
+     */
+    bool runsOn(ServiceDate date) const {
+        return date >= firstDate && date <= lastDate && ((weekdays >> weekdayOf(date)) & 1u);
+    }
+
+    LayoutKind getLayout() const { return layout; }                        /**< Seat geometry. */
+    int seatCount() const { return LAYOUTS[static_cast<int>(layout)].seats; }   /**< Seats on the bus. */
+    int rowCount() const { return LAYOUTS[static_cast<int>(layout)].rows; }     /**< Seat rows. */
+    int columnCount() const { return LAYOUTS[static_cast<int>(layout)].columns; } /**< Seats per full row. */
+    SeatMask allSeats() const { return LAYOUTS[static_cast<int>(layout)].all; } /**< Mask of every seat. */
+
+    /**
+     * @brief Check whether a seat number exists on this bus.
+     */
+    bool isValidSeat(int seatNumber) const { return seatNumber >= 1 && seatNumber <= seatCount(); }
+
+    const FareTable& getFares() const { return fares; }                   /**< Base fare per fare class. */
+
+    /**
+     * @brief Fare class of a seat.
+     *
+     * @param seatNumber The seat number (1 to seatCount()).
+     */
+    FareClass fareClassOf(int seatNumber) const { return ::fareClassOf(layout, seatNumber); }
+
+    /**
+     * @brief Demand tier the next booking on this bus is charged at. Only sold seats
+     *        count; holds do not move the price.
+     */
+    int currentTier() const { return demandTier(countBits(occupied), seatCount()); }
+
+    /**
+     * @brief Fare of a seat, in paise: what was paid for it if reserved, otherwise what it
+     *        would cost now.
+     *
+     * @param seatNumber The seat number (1 to seatCount()).
+     */
+    Paise getFare(int seatNumber) const {
+        const int tier = isReserved(seatNumber) ? paidTiers[seatNumber - 1] : currentTier();
+        return unitPrice(fares, fareClassOf(seatNumber), tier);
+    }
+
+    /**
+     * @brief Check whether a seat is reserved.
+     *
+     * @param seatNumber The seat number (1 to seatCount()).
+     */
+    bool isReserved(int seatNumber) const { return (occupied >> (seatNumber - 1)) & 1u; }
+
+    /**
+     * @brief Mask of the reserved seats.
+     */
+    SeatMask occupiedSeats() const { return occupied; }
+
+    /**
+     * @brief Check whether a seat is held for a customer who has not confirmed yet.
+     *
+     * @param seatNumber The seat number (1 to seatCount()).
+     */
+    bool isHeld(int seatNumber) const { return (held >> (seatNumber - 1)) & 1u; }
+
+    /**
+     * @brief Mask of the held seats.
+     */
+    SeatMask heldSeats() const { return held; }
+
+    /**
+     * @brief Passenger record of the passenger holding a reserved seat.
+     *
+     * @param seatNumber The seat number (1 to seatCount()). Must be reserved.
+     */
+    PassengerStore::Id passengerOf(int seatNumber) const { return passengers[seatNumber - 1]; }
+
+    /**
+     * @brief Number of empty seats (neither reserved nor held), computed with a single
+     *        popcount.
+     */
+    int emptySeatCount() const { return seatCount() - countBits(occupied | held); }
+
+    /**
+     * @brief Lowest-numbered empty seat, or 0 if the bus is full.
+     */
+    int firstEmptySeat() const {
+        const SeatMask empty = ~(occupied | held) & allSeats();
+        return empty ? lowestBit(empty) + 1 : 0;
+    }
+
+    /**
+     * @brief Pick empty seats for a booking, preferring seats next to each other.
+     *
+     * Tries, in order: count adjacent seats in one row among the preferred seats, the same
+     * among all empty seats, count consecutive seat numbers (running on into the next row),
+     * and finally the lowest-numbered empty seats. Row searches are a few mask operations
+     * and a bit scan; no seat is visited individually. The search runs in the bus's
+     * SeatLayout, so its row and column arithmetic is specialised per layout.
+     *
+     * @param request Number of seats, preference and fit.
+     * @return SeatMask Mask of the chosen seats (bit n - 1 for seat n), or 0 if fewer
+     *         than request.count seats are empty. Held seats are never chosen.
+     */
+    SeatMask chooseSeats(const SeatRequest& request) const {
+        const SeatMask taken = occupied | held;
+        return dispatchLayout(layout, [&](auto seats) { return decltype(seats)::chooseSeats(taken, request); });
+    }
+
+private:
+    /**
+     * @brief Mark an empty seat as reserved for a passenger record, charged at a demand
+     *        tier. The seat takes over one reference to the record.
+     */
+    void occupy(int seatNumber, PassengerStore::Id passenger, int tier) {
+        passengers[seatNumber - 1] = passenger;
+        paidTiers[seatNumber - 1] = static_cast<std::uint8_t>(tier);
+        occupied |= SeatMask(1) << (seatNumber - 1);
+    }
+
+    /**
+     * @brief Mark a reserved seat as empty again. The caller releases its passenger record.
+     */
+    void vacate(int seatNumber) { occupied &= ~(SeatMask(1) << (seatNumber - 1)); }
+
+    /**
+     * @brief The registry changes seat state only while holding the bus's lock.
+     */
+    friend class BusRegistry;
+
+    /**
+     * @brief Snapshots copy the seat map in and out wholesale.
+     */
+    friend class Snapshot;
+};
+
+#endif // BOOKING_BUS_H
@@ -0,0 +1,545 @@
+// BusRegistry.cpp
+
+#include "BusRegistry.h"
+
+BusRegistry::Handle BusRegistry::find(const std::string& number) const {
+    std::shared_lock<std::shared_mutex> lock(mutex);
+    return findLocked(number);
+}
+
+BusRegistry::Handle BusRegistry::findLocked(const std::string& number) const {
+    if(slots.empty()) return npos;
+
+    const std::uint32_t h = hashString(number);
+    const std::size_t mask = slots.size() - 1;
+    for(std::size_t i = h & mask; ; i = (i + 1) & mask) {
+        const Slot &slot = slots[i];
+        if(slot.handle == npos) return npos;
+        if(slot.hash == h && buses[slot.handle].getBusNumber() == number) return slot.handle;
+    }
+}
+
+BusRegistry::Handle BusRegistry::add(Bus&& incoming, JournalWrite* log) {
+    std::unique_lock<std::shared_mutex> lock(mutex);
+    if(findLocked(incoming.getBusNumber()) != npos) return npos;
+    if((buses.size() + 1) * 2 > slots.size()) grow();
+
+    const Handle handle = insertLocked(std::move(incoming), true);
+    published.store(buses.size(), std::memory_order_release);
+    if(log) log->sequence = log->journal->append(*log->record);
+    return handle;
+}
+
+std::size_t BusRegistry::addAll(std::vector<Bus>& incoming, JournalWrite* log) {
+    std::unique_lock<std::shared_mutex> lock(mutex);
+    const std::size_t total = buses.size() + incoming.size();
+    buses.reserve(total);
+    serials.reserve(total);
+    history.reserve(total);
+    columns.reserve(total);
+    while(total * 2 > slots.size()) grow();
+
+    std::size_t added = 0;
+    for(Bus &bus : incoming) {
+        if(findLocked(bus.getBusNumber()) != npos) continue;
+        insertLocked(std::move(bus), false);
+        ++added;
+    }
+    routes.publishUnsorted();
+    published.store(buses.size(), std::memory_order_release);
+    if(log) log->sequence = log->journal->append(*log->record);
+    return added;
+}
+
+BusRegistry::Handle BusRegistry::insertLocked(Bus&& incoming, bool sorted) {
+    const Handle handle = static_cast<Handle>(buses.size());
+    const Bus &bus = buses.push(std::move(incoming));
+    busLocks.emplace_back();
+    serials.emplace();
+    history.emplace();
+
+    const std::uint32_t h = hashString(bus.getBusNumber());
+    const std::size_t mask = slots.size() - 1;
+    std::size_t i = h & mask;
+    while(slots[i].handle != npos) i = (i + 1) & mask;
+    slots[i].hash = h;
+    slots[i].handle = handle;
+
+    // Route searches read the counter without the lock once the route lists the bus, so
+    // the row goes in first, under the id the route has or is about to get
+    const int seats = bus.seatCount();
+    std::uint32_t route = routes.findRoute(bus.getOrigin(), bus.getDestination());
+    if(route == RouteIndex::npos) route = static_cast<std::uint32_t>(routes.count());
+    columns.append(seats, route, bus.getDepartureMinute());
+    if(sorted) routes.add(bus.getOrigin(), bus.getDestination(), handle, bus.getDepartureMinute());
+    else routes.addUnsorted(bus.getOrigin(), bus.getDestination(), handle, bus.getDepartureMinute());
+    if(route == routeFree.size()) routeFree.emplace_back(0);
+    routeFree[route].fetch_add(seats, std::memory_order_relaxed);
+    fleetFree.fetch_add(seats, std::memory_order_relaxed);
+    // A bus restored from a snapshot arrives with seats already taken
+    Paise paid = 0;
+    for(SeatMask rest = bus.occupied; rest; rest &= rest - 1) paid += bus.getFare(lowestBit(rest) + 1);
+    countSeats(handle, bus.occupied, paid, true);
+    return handle;
+}
+
+BookingStatus BusRegistry::reserve(const std::string& number, int seatNumber, const std::string& passenger,
+                                   JournalWrite* log) {
+    const std::uint32_t key = nameKey(passenger);
+    std::shared_lock<std::shared_mutex> lock(mutex);
+    const Handle handle = findLocked(number);
+    if(handle == npos) return BookingStatus::BusNotFound;
+    if(!buses[handle].isValidSeat(seatNumber)) return BookingStatus::InvalidSeat;
+
+    BusGuard busLock(busLocks[handle]);
+    Bus &bus = buses[handle];
+    if(bus.isReserved(seatNumber) || bus.isHeld(seatNumber)) return BookingStatus::SeatTaken;
+    const std::uint32_t serial = serials[handle].open(SeatMask(1) << (seatNumber - 1));
+    bus.occupy(seatNumber, passengers.acquire(passenger), tierOf(handle));
+    history[handle].record(SeatMask(1) << (seatNumber - 1));
+    bookings.add(key, bookingId(handle, serial));
+    countSeats(handle, SeatMask(1) << (seatNumber - 1), bus.getFare(seatNumber), true);
+    if(log) log->sequence = log->journal->append(*log->record);
+    return BookingStatus::Ok;
+}
+
+BookingStatus BusRegistry::cancel(const std::string& number, int seatNumber, JournalWrite* log) {
+    std::shared_lock<std::shared_mutex> lock(mutex);
+    const Handle handle = findLocked(number);
+    if(handle == npos) return BookingStatus::BusNotFound;
+    if(!buses[handle].isValidSeat(seatNumber)) return BookingStatus::InvalidSeat;
+
+    BusGuard busLock(busLocks[handle]);
+    Bus &bus = buses[handle];
+    if(!bus.isReserved(seatNumber)) return BookingStatus::SeatEmpty;
+    const Paise refund = bus.getFare(seatNumber);
+    const std::uint32_t serial = serials[handle].of(seatNumber);
+    const PassengerStore::Id passenger = bus.passengerOf(seatNumber);
+    bus.vacate(seatNumber);
+    history[handle].record(SeatMask(1) << (seatNumber - 1));
+    // The booking leaves the index with its last seat, before the name can be freed
+    if(!serials[handle].seatsOf(serial, bus.occupied)) bookings.remove(keyOf(passenger), bookingId(handle, serial));
+    passengers.release(passenger);
+    countSeats(handle, SeatMask(1) << (seatNumber - 1), refund, false);
+    if(log) log->sequence = log->journal->append(*log->record);
+    return BookingStatus::Ok;
+}
+
+BookingStatus BusRegistry::reserveSeats(const std::string& number, const int* seatNumbers, int count,
+                                        const std::string& passenger, Paise& fareTotal, JournalWrite* log) {
+    if(count < 1 || count > Bus::MAX_SEATS) return BookingStatus::InvalidSeat;
+
+    // Validate the whole request up front so the locked section is only the occupancy test
+    SeatMask mask = 0;
+    for(int i = 0; i < count; ++i) {
+        const int seatNumber = seatNumbers[i];
+        if(seatNumber < 1 || seatNumber > Bus::MAX_SEATS) return BookingStatus::InvalidSeat;
+        const SeatMask bit = SeatMask(1) << (seatNumber - 1);
+        if(mask & bit) return BookingStatus::InvalidSeat;
+        mask |= bit;
+    }
+
+    const std::uint32_t key = nameKey(passenger);
+    std::shared_lock<std::shared_mutex> lock(mutex);
+    const Handle handle = findLocked(number);
+    if(handle == npos) return BookingStatus::BusNotFound;
+    if(mask & ~buses[handle].allSeats()) return BookingStatus::InvalidSeat;
+
+    BusGuard busLock(busLocks[handle]);
+    if((buses[handle].occupied | buses[handle].held) & mask) return BookingStatus::SeatTaken;
+    fareTotal = occupyAll(handle, mask, passengers.acquire(passenger, count), key);
+    if(log) log->sequence = log->journal->append(*log->record);
+    return BookingStatus::Ok;
+}
+
+BookingStatus BusRegistry::reserveAuto(const std::string& number, const SeatRequest& request, const std::string& passenger,
+                                       int* seatNumbers, Paise& fareTotal, JournalWrite* log) {
+    const int count = request.count;
+    if(count < 1 || count > Bus::MAX_SEATS) return BookingStatus::InvalidSeat;
+
+    const std::uint32_t key = nameKey(passenger);
+    std::shared_lock<std::shared_mutex> lock(mutex);
+    const Handle handle = findLocked(number);
+    if(handle == npos) return BookingStatus::BusNotFound;
+    if(count > buses[handle].seatCount()) return BookingStatus::InvalidSeat;
+
+    BusGuard busLock(busLocks[handle]);
+    const SeatMask mask = buses[handle].chooseSeats(request);
+    if(!mask) return BookingStatus::NotEnoughSeats;
+    fareTotal = occupyAll(handle, mask, passengers.acquire(passenger, count), key);
+
+    int n = 0;
+    for(SeatMask rest = mask; rest; rest &= rest - 1) seatNumbers[n++] = lowestBit(rest) + 1;
+    if(log) {
+        Journal::fillSeats(seatNumbers, count, *log->record);
+        log->sequence = log->journal->append(*log->record);
+    }
+    return BookingStatus::Ok;
+}
+
+BookingStatus BusRegistry::hold(const std::string& number, const int* seatNumbers, int count, std::uint64_t expiry,
+                                HoldTable::Id& hold) {
+    if(count < 1 || count > Bus::MAX_SEATS) return BookingStatus::InvalidSeat;
+
+    SeatMask mask = 0;
+    for(int i = 0; i < count; ++i) {
+        const int seatNumber = seatNumbers[i];
+        if(seatNumber < 1 || seatNumber > Bus::MAX_SEATS) return BookingStatus::InvalidSeat;
+        const SeatMask bit = SeatMask(1) << (seatNumber - 1);
+        if(mask & bit) return BookingStatus::InvalidSeat;
+        mask |= bit;
+    }
+
+    std::shared_lock<std::shared_mutex> lock(mutex);
+    const Handle handle = findLocked(number);
+    if(handle == npos) return BookingStatus::BusNotFound;
+    if(mask & ~buses[handle].allSeats()) return BookingStatus::InvalidSeat;
+    {
+        BusGuard busLock(busLocks[handle]);
+        Bus &bus = buses[handle];
+        if((bus.occupied | bus.held) & mask) return BookingStatus::SeatTaken;
+        bus.held |= mask;
+        history[handle].record(mask);
+        countSeats(handle, mask, 0, true);
+    }
+    // The id is not out yet, so nothing can end the hold before it is recorded
+    hold = holds.add(handle, mask, expiry);
+    return BookingStatus::Ok;
+}
+
+BookingStatus BusRegistry::confirmHold(HoldTable::Id id, const std::string& passenger, int* seatNumbers, int& count,
+                                       Paise& fareTotal, JournalWrite* log) {
+    // Taking the hold out of the table first means expiry can no longer free its seats
+    HoldTable::Hold held;
+    if(!holds.take(id, held)) return BookingStatus::NoHold;
+
+    const std::uint32_t key = nameKey(passenger);
+    std::shared_lock<std::shared_mutex> lock(mutex);
+    BusGuard busLock(busLocks[held.bus]);
+    Bus &bus = buses[held.bus];
+    count = countBits(held.seats);
+    bus.held &= ~held.seats;
+    // The seats already count as taken; put them back so occupyAll() takes them once
+    countSeats(held.bus, held.seats, 0, false);
+    fareTotal = occupyAll(held.bus, held.seats, passengers.acquire(passenger, count), key);
+
+    int n = 0;
+    for(SeatMask rest = held.seats; rest; rest &= rest - 1) seatNumbers[n++] = lowestBit(rest) + 1;
+    if(log) {
+        Journal::encodeReserveSeats(bus.getBusNumber(), seatNumbers, count, passenger, *log->record);
+        log->sequence = log->journal->append(*log->record);
+    }
+    return BookingStatus::Ok;
+}
+
+BookingStatus BusRegistry::releaseHold(HoldTable::Id id) {
+    HoldTable::Hold held;
+    if(!holds.take(id, held)) return BookingStatus::NoHold;
+    std::shared_lock<std::shared_mutex> lock(mutex);
+    unhold(held);
+    return BookingStatus::Ok;
+}
+
+std::size_t BusRegistry::expireHolds(std::uint64_t now) {
+    std::vector<HoldTable::Hold> expired;
+    holds.expire(now, expired);
+    if(expired.empty()) return 0;
+    std::shared_lock<std::shared_mutex> lock(mutex);
+    for(const HoldTable::Hold &held : expired) unhold(held);
+    return expired.size();
+}
+
+BookingStatus BusRegistry::bookingOf(const std::string& number, int seatNumber, BookingIndex::Id& booking) const {
+    std::shared_lock<std::shared_mutex> lock(mutex);
+    const Handle handle = findLocked(number);
+    if(handle == npos) return BookingStatus::BusNotFound;
+    if(!buses[handle].isValidSeat(seatNumber)) return BookingStatus::InvalidSeat;
+
+    BusGuard busLock(busLocks[handle]);
+    const Bus &bus = buses[handle];
+    if(!bus.isReserved(seatNumber)) return BookingStatus::SeatEmpty;
+    booking = bookingId(handle, serials[handle].of(seatNumber));
+    return BookingStatus::Ok;
+}
+
+BookingStatus BusRegistry::seatChanges(const std::string& number, std::uint32_t since, SeatDelta& delta) const {
+    std::shared_lock<std::shared_mutex> lock(mutex);
+    const Handle handle = findLocked(number);
+    if(handle == npos) return BookingStatus::BusNotFound;
+
+    BusGuard busLock(busLocks[handle]);
+    const Bus &bus = buses[handle];
+    delta.version = history[handle].version;
+    delta.changed = history[handle].changedSince(since, bus.allSeats());
+    delta.reserved = bus.occupied & delta.changed;
+    delta.held = bus.held & delta.changed;
+    for(SeatMask rest = delta.reserved; rest; rest &= rest - 1) {
+        const int seat = lowestBit(rest);
+        delta.passengers[seat] = bus.passengers[seat];
+    }
+    return BookingStatus::Ok;
+}
+
+BookingStatus BusRegistry::getBooking(BookingIndex::Id id, Booking& booking) const {
+    const Handle handle = static_cast<Handle>(id >> 32);
+    const std::uint32_t serial = static_cast<std::uint32_t>(id);
+    std::shared_lock<std::shared_mutex> lock(mutex);
+    if(serial == 0 || handle >= buses.size()) return BookingStatus::NoBooking;
+
+    BusGuard busLock(busLocks[handle]);
+    return describe(handle, serial, booking) ? BookingStatus::Ok : BookingStatus::NoBooking;
+}
+
+std::size_t BusRegistry::findBookings(const std::string& passenger, std::vector<Booking>& found) const {
+    found.clear();
+    thread_local std::vector<BookingIndex::Id> ids;
+    ids.clear();
+    bookings.find(nameKey(passenger), ids);
+    if(ids.empty()) return 0;
+
+    std::shared_lock<std::shared_mutex> lock(mutex);
+    Booking booking;
+    for(BookingIndex::Id id : ids) {
+        const Handle handle = static_cast<Handle>(id >> 32);
+        BusGuard busLock(busLocks[handle]);
+        // A booking may have been cancelled since the index was read
+        if(!describe(handle, static_cast<std::uint32_t>(id), booking)) continue;
+        // Different names can share a key; keep only true matches
+        if(!sameName(booking.passenger.data(), booking.passenger.size(), passenger.data(), passenger.size())) continue;
+        found.push_back(booking);
+    }
+    return found.size();
+}
+
+BookingStatus BusRegistry::cancelBooking(BookingIndex::Id id, int* seatNumbers, int& count, Paise& refund,
+                                         JournalWrite* log) {
+    const Handle handle = static_cast<Handle>(id >> 32);
+    const std::uint32_t serial = static_cast<std::uint32_t>(id);
+    std::shared_lock<std::shared_mutex> lock(mutex);
+    if(serial == 0 || handle >= buses.size()) return BookingStatus::NoBooking;
+
+    BusGuard busLock(busLocks[handle]);
+    Bus &bus = buses[handle];
+    const SeatMask mask = serials[handle].seatsOf(serial, bus.occupied);
+    if(!mask) return BookingStatus::NoBooking;
+
+    const PassengerStore::Id passenger = bus.passengerOf(lowestBit(mask) + 1);
+    count = 0;
+    refund = 0;
+    for(SeatMask rest = mask; rest; rest &= rest - 1) {
+        const int seatNumber = lowestBit(rest) + 1;
+        refund += bus.getFare(seatNumber);
+        seatNumbers[count++] = seatNumber;
+        bus.vacate(seatNumber);
+    }
+    history[handle].record(mask);
+    bookings.remove(keyOf(passenger), id);
+    passengers.release(passenger, count);
+    countSeats(handle, mask, refund, false);
+    if(log) {
+        Journal::encodeCancelSeats(bus.getBusNumber(), seatNumbers, count, *log->record);
+        log->sequence = log->journal->append(*log->record);
+    }
+    return BookingStatus::Ok;
+}
+
+bool BusRegistry::describe(Handle handle, std::uint32_t serial, Booking& booking) const {
+    const Bus &bus = buses[handle];
+    const SeatMask mask = serials[handle].seatsOf(serial, bus.occupied);
+    if(!mask) return false;
+    booking.id = bookingId(handle, serial);
+    booking.busNumber = bus.getBusNumber();
+    booking.seats = mask;
+    booking.passenger = passengers.name(bus.passengerOf(lowestBit(mask) + 1));
+    booking.fare = 0;
+    for(SeatMask rest = mask; rest; rest &= rest - 1) booking.fare += bus.getFare(lowestBit(rest) + 1);
+    return true;
+}
+
+void BusRegistry::unhold(const HoldTable::Hold& held) {
+    BusGuard busLock(busLocks[held.bus]);
+    buses[held.bus].held &= ~held.seats;
+    history[held.bus].record(held.seats);
+    countSeats(held.bus, held.seats, 0, false);
+}
+
+Paise BusRegistry::occupyAll(Handle handle, SeatMask mask, PassengerStore::Id passenger, std::uint32_t key) {
+    Bus &bus = buses[handle];
+    // The whole group is charged at the tier the bus was at before it
+    const int tier = tierOf(handle);
+    const Paise total = batchPrice(bus.fares, bus.layout, mask, tier);
+    const std::uint32_t serial = serials[handle].open(mask);
+    for(SeatMask rest = mask; rest; rest &= rest - 1) bus.occupy(lowestBit(rest) + 1, passenger, tier);
+    history[handle].record(mask);
+    bookings.add(key, bookingId(handle, serial));
+    countSeats(handle, mask, total, true);
+    return total;
+}
+
+int BusRegistry::tierOf(Handle handle) const {
+    // Not the free-seat counter, which also counts held seats as taken
+    const Bus &bus = buses[handle];
+    return demandTier(countBits(bus.occupied), bus.seatCount());
+}
+
+void BusRegistry::countSeats(Handle handle, SeatMask mask, Paise fares, bool booked) {
+    if(!mask) return;
+    const int seats = booked ? -countBits(mask) : countBits(mask);
+    columns.freeSeats(handle).fetch_add(seats, std::memory_order_relaxed);
+    routeFree[columns.route(handle)].fetch_add(seats, std::memory_order_relaxed);
+    fleetFree.fetch_add(seats, std::memory_order_relaxed);
+    revenue.fetch_add(booked ? fares : -fares, std::memory_order_relaxed);
+}
+
+std::int64_t BusRegistry::routeFreeSeats(StringPool::Id origin, StringPool::Id dest) const {
+    std::shared_lock<std::shared_mutex> lock(mutex);
+    const std::uint32_t route = routes.findRoute(origin, dest);
+    return route == RouteIndex::npos ? 0 : routeFree[route].load(std::memory_order_relaxed);
+}
+
+std::size_t BusRegistry::countMatching(const FleetFilter& filter) const {
+    Epoch::Guard guard;
+    return columns.count(filter, published.load(std::memory_order_acquire));
+}
+
+FleetOccupancy BusRegistry::occupancy() const {
+    Epoch::Guard guard;
+    return columns.occupancy(published.load(std::memory_order_acquire));
+}
+
+std::uint32_t BusRegistry::routeId(StringPool::Id origin, StringPool::Id dest) const {
+    Epoch::Guard guard;
+    return routes.findRoute(origin, dest);
+}
+
+BookingStatus BusRegistry::schedule(const std::string& number, ServiceDate first, ServiceDate last,
+                                    std::uint8_t weekdays, JournalWrite* log) {
+    // Exclusive, like add(): readers holding the shared lock may rely on the window
+    std::unique_lock<std::shared_mutex> lock(mutex);
+    const Handle handle = findLocked(number);
+    if(handle == npos) return BookingStatus::BusNotFound;
+
+    Bus &bus = buses[handle];
+    bus.firstDate = first;
+    bus.lastDate = last;
+    bus.weekdays = weekdays & EVERY_DAY;
+    if(log) log->sequence = log->journal->append(*log->record);
+    return BookingStatus::Ok;
+}
+
+BookingStatus BusRegistry::reserveTrip(const std::string& number, ServiceDate date, int seatNumber,
+                                       const std::string& passenger, JournalWrite* log) {
+    std::shared_lock<std::shared_mutex> lock(mutex);
+    const Handle handle = findLocked(number);
+    if(handle == npos) return BookingStatus::BusNotFound;
+    const Bus &bus = buses[handle];
+    if(!bus.isValidSeat(seatNumber)) return BookingStatus::InvalidSeat;
+
+    BusGuard busLock(busLocks[handle]);
+    if(!bus.runsOn(date)) return BookingStatus::NoTrip;
+    TripSeats &seats = *trips.findOrCreate(handle, date);
+    if(seats.isReserved(seatNumber)) return BookingStatus::SeatTaken;
+    const int tier = demandTier(seats.bookedCount(), bus.seatCount());
+    seats.occupy(seatNumber, passengers.acquire(passenger), tier);
+    revenue.fetch_add(unitPrice(bus.fares, bus.fareClassOf(seatNumber), tier), std::memory_order_relaxed);
+    if(log) log->sequence = log->journal->append(*log->record);
+    return BookingStatus::Ok;
+}
+
+BookingStatus BusRegistry::cancelTrip(const std::string& number, ServiceDate date, int seatNumber,
+                                      JournalWrite* log) {
+    std::shared_lock<std::shared_mutex> lock(mutex);
+    const Handle handle = findLocked(number);
+    if(handle == npos) return BookingStatus::BusNotFound;
+    const Bus &bus = buses[handle];
+    if(!bus.isValidSeat(seatNumber)) return BookingStatus::InvalidSeat;
+
+    BusGuard busLock(busLocks[handle]);
+    TripSeats* seats = trips.find(handle, date);
+    if(!seats || !seats->isReserved(seatNumber)) return BookingStatus::SeatEmpty;
+    const Paise refund = unitPrice(bus.fares, bus.fareClassOf(seatNumber), seats->paidTiers[seatNumber - 1]);
+    seats->vacate(seatNumber);
+    passengers.release(seats->passengers[seatNumber - 1]);
+    revenue.fetch_sub(refund, std::memory_order_relaxed);
+    if(log) log->sequence = log->journal->append(*log->record);
+    return BookingStatus::Ok;
+}
+
+TripSeats BusRegistry::tripSnapshot(Handle handle, ServiceDate date) const {
+    std::shared_lock<std::shared_mutex> lock(mutex);
+    BusGuard busLock(busLocks[handle]);
+    TripSeats copy;
+    if(const TripSeats* seats = trips.find(handle, date)) {
+        copy = *seats;
+    } else {
+        copy.occupied = 0;
+    }
+    return copy;
+}
+
+void BusRegistry::restoreTrip(Handle handle, ServiceDate date, const TripSeats& seats) {
+    std::shared_lock<std::shared_mutex> lock(mutex);
+    BusGuard busLock(busLocks[handle]);
+    const Bus &bus = buses[handle];
+    *trips.findOrCreate(handle, date) = seats;
+    Paise paid = 0;
+    for(SeatMask rest = seats.occupied; rest; rest &= rest - 1) {
+        const int seatNumber = lowestBit(rest) + 1;
+        paid += unitPrice(bus.fares, bus.fareClassOf(seatNumber), seats.paidTiers[seatNumber - 1]);
+    }
+    revenue.fetch_add(paid, std::memory_order_relaxed);
+}
+
+void BusRegistry::restoreBookings(Handle handle, const SeatBookings& booked) {
+    std::shared_lock<std::shared_mutex> lock(mutex);
+    BusGuard busLock(busLocks[handle]);
+    const Bus &bus = buses[handle];
+    serials[handle] = booked;
+    // Index each booking once, taking all of its seats off the list together
+    for(SeatMask rest = bus.occupied; rest; ) {
+        const int seat = lowestBit(rest);
+        rest &= ~booked.seatsOf(booked.serials[seat], bus.occupied);
+        bookings.add(keyOf(bus.passengers[seat]), bookingId(handle, booked.serials[seat]));
+    }
+}
+
+Bus BusRegistry::snapshot(Handle handle) const {
+    std::shared_lock<std::shared_mutex> lock(mutex);
+    BusGuard busLock(busLocks[handle]);
+    return buses[handle];
+}
+
+bool BusRegistry::canBoard(Handle handle, int seats, ServiceDate date) const {
+    if(date == NO_DATE) return columns.freeSeats(handle).load(std::memory_order_relaxed) >= seats;
+    const Bus &bus = buses[handle];
+    if(!bus.runsOn(date)) return false;
+    int booked = 0;
+    {
+        BusGuard busLock(busLocks[handle]);
+        if(const TripSeats* trip = trips.find(handle, date)) booked = trip->bookedCount();
+    }
+    return bus.seatCount() - booked >= seats;
+}
+
+void BusRegistry::refreshConnections() const {
+    {
+        std::shared_lock<std::shared_mutex> lock(mutex);
+        if(connections.coveredBuses() == buses.size()) return;
+    }
+    std::unique_lock<std::shared_mutex> lock(mutex);
+    // Another search may have rebuilt it while we waited
+    if(connections.coveredBuses() != buses.size()) connections.build(buses);
+}
+
+void BusRegistry::grow() {
+    const Slot empty = { 0, npos };
+    std::vector<Slot> bigger(slots.empty() ? 16 : slots.size() * 2, empty);
+    const std::size_t mask = bigger.size() - 1;
+    for(const Slot &slot : slots) {
+        if(slot.handle == npos) continue;
+        std::size_t i = slot.hash & mask;
+        while(bigger[i].handle != npos) i = (i + 1) & mask;
+        bigger[i] = slot;
+    }
+    slots.swap(bigger);
+}
@@ -0,0 +1,781 @@
+#ifndef BOOKING_BUSREGISTRY_H
+#define BOOKING_BUSREGISTRY_H
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <cstdint>
+#include <cstddef>
+#include <mutex>
+#include <atomic>
+#include <shared_mutex> // for the registry reader-writer lock
+
+#include "BookingIndex.h"
+#include "Bus.h"
+#include "BusStore.h"
+#include "ConnectionIndex.h"
+#include "Epoch.h"
+#include "FleetColumns.h"
+#include "HoldTable.h"
+#include "Journal.h"
+#include "Metrics.h"
+#include "PassengerStore.h"
+#include "RouteIndex.h"
+#include "SeatBookings.h"
+#include "SeatHistory.h"
+#include "StringPool.h"
+#include "TripStore.h"
+
+/**
+ * @file BusRegistry.h
+ * @brief Thread-safe owner of all buses, with bus-number and route indexes.
+ */
+
+/**
+ * @brief Outcome of a booking operation.
+ */
+enum class BookingStatus {
+    Ok,               /**< The operation succeeded. */
+    BusNotFound,      /**< No bus has the given number. */
+    InvalidSeat,      /**< The seat number does not exist on the bus. */
+    InvalidPassenger, /**< The passenger name is empty or longer than PassengerStore::MAX_NAME. */
+    SeatTaken,        /**< The seat is already reserved. */
+    SeatEmpty,        /**< The seat is not reserved, so there is nothing to cancel. */
+    DuplicateBus,     /**< A bus with the given number is already installed. */
+    InvalidBus,       /**< A required bus detail is empty, too long or out of range. */
+    NotEnoughSeats,   /**< The bus has fewer empty seats than the group asked for. */
+    NoTrip,           /**< The bus does not run on the given date. */
+    JournalFailed,    /**< The change was applied in memory but could not be made durable. */
+    NoHold,           /**< The hold was already confirmed, released or expired, or never existed. */
+    NoBooking,        /**< No seat is reserved under the booking id any more, or it never existed. */
+    ReadOnly          /**< The service is a follower and refuses changes until it is promoted. */
+};
+
+/**
+ * @struct Booking
+ * @brief One reservation: the seats it took on one bus, under one passenger name.
+ */
+struct Booking {
+    BookingIndex::Id id;     /**< Booking id. */
+    std::string busNumber;   /**< The bus. */
+    SeatMask seats;          /**< Seats still reserved under the booking (bit n - 1 for seat n). */
+    std::string passenger;   /**< Name the seats are booked under. */
+    Paise fare;              /**< Price paid for those seats, in paise. */
+};
+
+/**
+ * @struct SeatDelta
+ * @brief What changed on a bus's seat map since a version a client saw.
+ */
+struct SeatDelta {
+    std::uint32_t version;   /**< Version of the seat map now; the client's next since. */
+    SeatMask changed;        /**< Seats that may differ from the version asked about. */
+    SeatMask reserved;       /**< The changed seats that are reserved now. */
+    SeatMask held;           /**< The changed seats that are held now. */
+    PassengerStore::Id passengers[Bus::MAX_SEATS];  /**< Passenger record per reserved seat in reserved. */
+};
+
+/**
+ * @class BusRegistry
+ * @brief Owns every installed bus and indexes it by bus number.
+ *
+ * Buses are stored contiguously and addressed by a stable handle (their position,
+ * which never changes because buses are only ever appended). Bus numbers are
+ * indexed by an open-addressing hash table with linear probing, so a lookup costs
+ * one hash plus, in the common case, a single string compare, and never allocates.
+ *
+ * All public methods are thread-safe. A reader-writer lock guards the bus table and
+ * indexes: installing takes it exclusively, bookings and lookups share it. Seat state is
+ * guarded by a separate mutex per bus, so bookings on different buses never contend
+ * and a seat can only be claimed by one caller.
+ *
+ * Listing and route searches take no lock at all, so they never wait for an install and
+ * never hold one up. The bus table, the route index and the free-seat counters are read
+ * RCU-style under an Epoch::Guard: buses never move, each route's buses are an immutable
+ * version replaced whole by the installer, and tables that grow are replaced rather than
+ * resized in place, the old ones freed once no reader can still see them. An install
+ * publishes its bus to listing by bumping a count after every index has it, so a listing
+ * pass sees exactly the buses installed before it began, and a route search sees one
+ * version of its route.
+ *
+ * Availability is also kept as counters that every reserve and cancel updates in O(1):
+ * free seats per bus, per route and fleet-wide, and the revenue booked. They are atomics
+ * beside the bus table, so availability queries never read seat maps or take bus locks.
+ *
+ * The per-bus counters live in FleetColumns, beside each bus's route id, departure minute
+ * and seat count, so filters over the whole fleet (by free seats, by any of several
+ * routes, by departure window) and occupancy totals scan a few dense columns with SIMD
+ * kernels instead of walking the buses.
+ */
+class BusRegistry {
+public:
+    typedef std::uint32_t Handle;            /**< Stable handle of an installed bus. */
+    static const Handle npos = 0xFFFFFFFFu;  /**< Returned when a bus is not found. */
+
+    /**
+     * @brief Find a bus by its number.
+     *
+     * @param number The bus number to look up.
+     * @return Handle The bus handle, or npos if no such bus exists.
+     */
+    Handle find(const std::string& number) const;
+
+    /**
+     * @brief Add a bus to the registry, moving it into place.
+     *
+     * @param bus The bus to add. Its bus number must be non-empty. Any reserved seats must
+     *        hold references taken from passengerStore(), and be given their booking
+     *        serials with restoreBookings() before anything else changes the bus.
+     * @param log If given, the record is appended to its journal once the bus is added.
+     * @return Handle The new bus handle, or npos if the bus number is already taken (bus
+     *         is then left as it was).
+     */
+    Handle add(Bus&& bus, JournalWrite* log = nullptr);
+
+    /**
+     * @brief Add many buses under one exclusive lock, in order, moving them into place.
+     *
+     * The tables are grown once for the whole batch and route departures are sorted once
+     * at the end, rather than per bus. A bus whose number is already taken, by an
+     * installed bus or an earlier one in the batch, is skipped and left as it was.
+     *
+     * @param incoming The buses to add, each as add() takes it.
+     * @param log If given, the record is appended to its journal once all are added. It may
+     *        hold several framed records, e.g. one install per bus.
+     * @return std::size_t The number of buses added.
+     */
+    std::size_t addAll(std::vector<Bus>& incoming, JournalWrite* log = nullptr);
+
+    /**
+     * @brief Reserve a seat, failing if it is already taken.
+     *
+     * @param number The bus number.
+     * @param seatNumber The seat number (1 to the bus's seat count).
+     * @param passenger Name of the passenger; 1 to PassengerStore::MAX_NAME bytes.
+     * @param log If given, the record is appended to its journal once the seat is reserved.
+     * @return BookingStatus Ok, or why the seat was not reserved.
+     */
+    BookingStatus reserve(const std::string& number, int seatNumber, const std::string& passenger,
+                          JournalWrite* log = nullptr);
+
+    /**
+     * @brief Cancel the reservation of a seat.
+     *
+     * @param number The bus number.
+     * @param seatNumber The seat number (1 to the bus's seat count).
+     * @param log If given, the record is appended to its journal once the seat is cancelled.
+     * @return BookingStatus Ok, or why the seat was not cancelled.
+     */
+    BookingStatus cancel(const std::string& number, int seatNumber, JournalWrite* log = nullptr);
+
+    /**
+     * @brief Reserve several seats for one passenger, all or none.
+     *
+     * The bus is looked up and locked once, every seat is checked, and only then are they
+     * all reserved.
+     *
+     * @param number The bus number.
+     * @param seatNumbers The seats to reserve (each on the bus, no repeats).
+     * @param count Number of entries in seatNumbers.
+     * @param passenger Name the seats are booked under; 1 to PassengerStore::MAX_NAME bytes.
+     * @param fareTotal Receives the price charged for the seats, in paise, on success.
+     * @param log If given, the record is appended to its journal once the seats are reserved.
+     * @return BookingStatus Ok, BusNotFound, InvalidSeat or SeatTaken. Nothing is
+     *         reserved unless the result is Ok.
+     */
+    BookingStatus reserveSeats(const std::string& number, const int* seatNumbers, int count,
+                               const std::string& passenger, Paise& fareTotal, JournalWrite* log = nullptr);
+
+    /**
+     * @brief Reserve seats chosen by Bus::chooseSeats(), all or none.
+     *
+     * @param number The bus number.
+     * @param request Number of seats wanted and how to pick them.
+     * @param passenger Name the seats are booked under; 1 to PassengerStore::MAX_NAME bytes.
+     * @param seatNumbers Receives the chosen seats in ascending order; must have room for
+     *        request.count.
+     * @param fareTotal Receives the price charged for the seats, in paise, on success.
+     * @param log If given, its record must come from Journal::encodeReserveSeats() with
+     *        request.count placeholder seats; the chosen seats are filled in before it is
+     *        appended.
+     * @return BookingStatus Ok, BusNotFound, InvalidSeat or NotEnoughSeats.
+     */
+    BookingStatus reserveAuto(const std::string& number, const SeatRequest& request, const std::string& passenger,
+                              int* seatNumbers, Paise& fareTotal, JournalWrite* log = nullptr);
+
+    /**
+     * @brief Hold empty seats for a customer until a deadline, all or none, without
+     *        reserving them.
+     *
+     * Held seats count as taken by every reservation and by the availability counters,
+     * but are not sold, so they neither earn revenue nor raise the demand tier. A hold
+     * ends with confirmHold(), releaseHold() or, once its deadline passes, expireHolds().
+     * Holds are not journaled: after a restart every held seat is empty again.
+     *
+     * @param number The bus number.
+     * @param seatNumbers The seats to hold (each on the bus, no repeats).
+     * @param count Number of entries in seatNumbers.
+     * @param expiry Tick at which the hold lapses, on the clock passed to expireHolds().
+     * @param hold Receives the hold id on success.
+     * @return BookingStatus Ok, BusNotFound, InvalidSeat or SeatTaken (a seat is reserved
+     *         or held already).
+     */
+    BookingStatus hold(const std::string& number, const int* seatNumbers, int count, std::uint64_t expiry,
+                       HoldTable::Id& hold);
+
+    /**
+     * @brief Reserve the seats of a live hold for a passenger, at the bus's demand tier now.
+     *
+     * @param hold The hold.
+     * @param passenger Name the seats are booked under; 1 to PassengerStore::MAX_NAME bytes.
+     * @param seatNumbers Receives the seats in ascending order; must have room for
+     *        Bus::MAX_SEATS.
+     * @param count Receives the number of seats.
+     * @param fareTotal Receives the price charged for the seats, in paise.
+     * @param log If given, its record is overwritten with a ReserveSeats record for the
+     *        seats and appended, so replay needs no hold.
+     * @return BookingStatus Ok or NoHold.
+     */
+    BookingStatus confirmHold(HoldTable::Id hold, const std::string& passenger, int* seatNumbers, int& count,
+                              Paise& fareTotal, JournalWrite* log = nullptr);
+
+    /**
+     * @brief Give up a live hold, making its seats empty again.
+     *
+     * @return BookingStatus Ok or NoHold.
+     */
+    BookingStatus releaseHold(HoldTable::Id hold);
+
+    /**
+     * @brief Release every hold whose deadline has been reached.
+     *
+     * @param now The current tick; must not go backwards.
+     * @return std::size_t Holds released.
+     */
+    std::size_t expireHolds(std::uint64_t now);
+
+    /**
+     * @brief Number of live holds.
+     */
+    std::size_t holdCount() const { return holds.size(); }
+
+    /**
+     * @brief Booking a reserved seat belongs to.
+     *
+     * Each reserve, group reserve or confirmed hold is one booking. Its id stays the same
+     * across a restart, since replay hands out booking serials in the order the journal
+     * recorded them.
+     *
+     * @return BookingStatus Ok, BusNotFound, InvalidSeat or SeatEmpty.
+     */
+    BookingStatus bookingOf(const std::string& number, int seatNumber, BookingIndex::Id& booking) const;
+
+    /**
+     * @brief The seats of a bus that changed since a version of its seat map, and what
+     *        they are now, read under the bus's lock without copying the bus.
+     *
+     * @param number The bus number.
+     * @param since A version from an earlier delta, or 0 for the whole seat map.
+     * @param delta Receives the changes (see SeatHistory::changedSince()).
+     * @return BookingStatus Ok or BusNotFound.
+     */
+    BookingStatus seatChanges(const std::string& number, std::uint32_t since, SeatDelta& delta) const;
+
+    /**
+     * @brief Look a booking up by id.
+     *
+     * @return BookingStatus Ok or NoBooking.
+     */
+    BookingStatus getBooking(BookingIndex::Id id, Booking& booking) const;
+
+    /**
+     * @brief Every booking made under a passenger name, ignoring case and extra whitespace
+     *        (see nameKey()), newest first.
+     *
+     * @param passenger The name to look for.
+     * @param found Receives the bookings; cleared first.
+     * @return std::size_t Bookings found.
+     */
+    std::size_t findBookings(const std::string& passenger, std::vector<Booking>& found) const;
+
+    /**
+     * @brief Cancel every seat still reserved under a booking, all at once.
+     *
+     * @param id The booking.
+     * @param seatNumbers Receives the cancelled seats in ascending order; must have room
+     *        for Bus::MAX_SEATS.
+     * @param count Receives the number of seats.
+     * @param refund Receives the price that had been paid for them, in paise.
+     * @param log If given, its record is overwritten with a CancelSeats record for the
+     *        seats and appended.
+     * @return BookingStatus Ok or NoBooking.
+     */
+    BookingStatus cancelBooking(BookingIndex::Id id, int* seatNumbers, int& count, Paise& refund,
+                                JournalWrite* log = nullptr);
+
+    /**
+     * @brief Number of bookings with at least one seat still reserved.
+     */
+    std::size_t bookingCount() const { return bookings.size(); }
+
+    /**
+     * @brief Set the dates a bus runs on, replacing any earlier window.
+     *
+     * Takes the registry lock exclusively, so the window is as safe to read under the
+     * shared lock as the other bus details. Seats already sold on dates outside the new
+     * window stay sold and can still be cancelled, but no more are sold.
+     *
+     * @param number The bus number.
+     * @param first First service date.
+     * @param last Last service date, not before first.
+     * @param weekdays Days of the week it runs, bit 0 = Monday; 0 stops all trips.
+     * @param log If given, the record is appended to its journal once the window is set.
+     * @return BookingStatus Ok or BusNotFound.
+     */
+    BookingStatus schedule(const std::string& number, ServiceDate first, ServiceDate last,
+                           std::uint8_t weekdays, JournalWrite* log = nullptr);
+
+    /**
+     * @brief Reserve a seat on a dated trip, allocating the trip's seat map on first sale.
+     *
+     * @param number The bus number.
+     * @param date The service date; the bus must run on it.
+     * @param seatNumber The seat number (1 to the bus's seat count).
+     * @param passenger Name of the passenger; 1 to PassengerStore::MAX_NAME bytes.
+     * @param log If given, the record is appended to its journal once the seat is reserved.
+     * @return BookingStatus Ok, BusNotFound, InvalidSeat, NoTrip or SeatTaken.
+     */
+    BookingStatus reserveTrip(const std::string& number, ServiceDate date, int seatNumber,
+                              const std::string& passenger, JournalWrite* log = nullptr);
+
+    /**
+     * @brief Cancel a seat on a dated trip.
+     *
+     * @return BookingStatus Ok, BusNotFound, InvalidSeat or SeatEmpty.
+     */
+    BookingStatus cancelTrip(const std::string& number, ServiceDate date, int seatNumber,
+                             JournalWrite* log = nullptr);
+
+    /**
+     * @brief Copy of a trip's seat map; all seats are empty if it has sold nothing.
+     *
+     * @param handle A valid bus handle.
+     */
+    TripSeats tripSnapshot(Handle handle, ServiceDate date) const;
+
+    /**
+     * @brief Load a trip's seat map wholesale, e.g. from a snapshot. The bus must not have
+     *        sold seats on that date yet, and the reserved seats must hold references taken
+     *        from passengerStore().
+     *
+     * @param handle A valid bus handle.
+     */
+    void restoreTrip(Handle handle, ServiceDate date, const TripSeats& seats);
+
+    /**
+     * @brief Load the booking serials of a bus's reserved seats wholesale, e.g. from a
+     *        snapshot, and index its bookings by passenger name.
+     *
+     * @param handle A bus added with reserved seats and no booking serials yet.
+     * @param booked A serial no later than booked.last for every reserved seat.
+     */
+    void restoreBookings(Handle handle, const SeatBookings& booked);
+
+    /**
+     * @brief Call fn(const Bus&) with a bus held still and return what fn returns, for
+     *        readers that need a few of its fields rather than a copy of the whole bus.
+     *
+     * Holds the registry lock shared and the bus's lock while fn runs, so fn may call
+     * passengerName() but nothing else on the registry.
+     *
+     * @param handle A valid bus handle.
+     */
+    template <typename Fn>
+    decltype(auto) withBus(Handle handle, Fn fn) const {
+        std::shared_lock<std::shared_mutex> lock(mutex);
+        BusGuard busLock(busLocks[handle]);
+        return fn(buses[handle]);
+    }
+
+    /**
+     * @brief Consistent copy of a whole bus, for display.
+     *
+     * @param handle A valid bus handle.
+     */
+    Bus snapshot(Handle handle) const;
+
+    /**
+     * @brief Name of a passenger held by a reserved seat.
+     *
+     * @param id Passenger record id, e.g. from Bus::passengerOf(). See PassengerStore::name()
+     *        for ids read from a copy of a seat map.
+     */
+    std::string passengerName(PassengerStore::Id id) const { return passengers.name(id); }
+
+    /**
+     * @brief The passenger names, for loaders that take references before add() or
+     *        restoreTrip().
+     */
+    PassengerStore& passengerStore() { return passengers; }
+
+    /**
+     * @brief Call fn(const Bus&) for every bus, in installation order.
+     *
+     * Takes no lock: fn sees the buses installed before the call, and installing goes on
+     * meanwhile. Only the immutable bus details are safe to read from fn, not the service
+     * window schedule() sets; use snapshot() for seat state.
+     */
+    template <typename Fn>
+    void forEach(Fn fn) const {
+        Epoch::Guard guard;
+        const std::size_t count = published.load(std::memory_order_acquire);
+        for(std::size_t handle = 0; handle < count; ++handle) fn(buses[handle]);
+    }
+
+    /**
+     * @brief Call fn(const Bus&, SeatMask reserved, SeatMask held, Paise paid) for every
+     *        bus, in installation order, with its seats as they stood at that moment.
+     *
+     * Each bus's seats are read under its lock, which is released again before fn runs,
+     * so bookings only ever wait for the bus being read. Installation is blocked
+     * throughout.
+     */
+    template <typename Fn>
+    void forEachOccupancy(Fn fn) const {
+        std::shared_lock<std::shared_mutex> lock(mutex);
+        for(std::size_t handle = 0; handle < buses.size(); ++handle) {
+            const Bus &bus = buses[handle];
+            SeatMask reserved, held;
+            Paise paid = 0;
+            {
+                BusGuard busLock(busLocks[handle]);
+                reserved = bus.occupied;
+                held = bus.held;
+                for(SeatMask rest = reserved; rest; rest &= rest - 1) paid += bus.getFare(lowestBit(rest) + 1);
+            }
+            fn(bus, reserved, held, paid);
+        }
+    }
+
+    /**
+     * @brief Call fn(const Bus&) for every bus serving a route, in installation order.
+     *
+     * Same rules as forEach(); the buses are one version of the route.
+     *
+     * @return std::size_t The number of matching buses.
+     */
+    template <typename Fn>
+    std::size_t forEachOnRoute(StringPool::Id origin, StringPool::Id dest, Fn fn) const {
+        Epoch::Guard guard;
+        const RouteIndex::Buses matches = routes.find(origin, dest);
+        if(matches.empty()) return 0;
+        for(Handle handle : matches) fn(buses[handle]);
+        return matches.size();
+    }
+
+    /**
+     * @brief Call fn(const Bus&) for every bus on a route departing within a window, in
+     *        departure order.
+     *
+     * See RouteIndex::forEachDeparting() for the window and ordering rules. Same rules
+     * as forEachOnRoute().
+     *
+     * @return std::size_t The number of matching buses.
+     */
+    template <typename Fn>
+    std::size_t forEachDeparting(StringPool::Id origin, StringPool::Id dest, int fromMinute, int toMinute,
+                                 Fn fn) const {
+        Epoch::Guard guard;
+        return routes.forEachDeparting(origin, dest, fromMinute, toMinute,
+                                       [&](Handle handle) { fn(buses[handle]); });
+    }
+
+    /**
+     * @brief Find the earliest-arriving journey between two places, changing buses as
+     *        needed, and call fn(const Bus&, const JourneyLeg&) for each leg in travel order.
+     *
+     * Every leg must have query.seats empty seats: on the undated seat map if query.date
+     * is NO_DATE, otherwise on the bus's trip for the day the leg runs, which the bus must
+     * be scheduled on. The connection index is rebuilt first if buses were installed since
+     * it was last built. Installation is blocked while this runs; only the immutable bus
+     * details are safe to read from fn.
+     *
+     * @return std::size_t The number of legs, or 0 if no journey was found.
+     */
+    template <typename Fn>
+    std::size_t findJourney(StringPool::Id origin, StringPool::Id dest, const JourneyQuery& query, Fn fn) const {
+        refreshConnections();
+        std::shared_lock<std::shared_mutex> lock(mutex);
+        std::vector<JourneyLeg> legs;
+        connections.search(origin, dest, query.departAfter, query.minTransfer, [&](Handle handle, int day) {
+            return canBoard(handle, query.seats, query.date == NO_DATE ? NO_DATE : query.date + day);
+        }, legs);
+        for(const JourneyLeg &leg : legs) fn(buses[leg.bus], leg);
+        return legs.size();
+    }
+
+    /**
+     * @brief Call fn(const Bus&, int freeSeats) for every bus running a route on a date.
+     *
+     * Buses come from the route index in installation order and are filtered on their
+     * service window; a trip with no seat map is reported with every seat free without
+     * being allocated. Installation is blocked while this runs, and each trip's seat map is
+     * read under its bus's lock.
+     *
+     * @return std::size_t The number of trips passed to fn.
+     */
+    template <typename Fn>
+    std::size_t forEachTrip(StringPool::Id origin, StringPool::Id dest, ServiceDate date, Fn fn) const {
+        std::shared_lock<std::shared_mutex> lock(mutex);
+        const RouteIndex::Buses matches = routes.find(origin, dest);
+        if(matches.empty()) return 0;
+        std::size_t count = 0;
+        for(Handle handle : matches) {
+            const Bus &bus = buses[handle];
+            if(!bus.runsOn(date)) continue;
+            int booked = 0;
+            {
+                BusGuard busLock(busLocks[handle]);
+                if(const TripSeats* seats = trips.find(handle, date)) booked = seats->bookedCount();
+            }
+            fn(bus, bus.seatCount() - booked);
+            ++count;
+        }
+        return count;
+    }
+
+    /**
+     * @brief Call fn(const Bus&) for every bus on a route with at least minFree empty seats.
+     *
+     * Only the free-seat counters are consulted to filter, never the seat maps. Same
+     * rules as forEachOnRoute().
+     *
+     * @return std::size_t The number of buses passed to fn.
+     */
+    template <typename Fn>
+    std::size_t forEachWithFreeSeats(StringPool::Id origin, StringPool::Id dest, int minFree, Fn fn) const {
+        Epoch::Guard guard;
+        const RouteIndex::Buses matches = routes.find(origin, dest);
+        if(matches.empty()) return 0;
+        std::size_t count = 0;
+        for(Handle handle : matches) {
+            if(columns.freeSeats(handle).load(std::memory_order_relaxed) < minFree) continue;
+            fn(buses[handle]);
+            ++count;
+        }
+        return count;
+    }
+
+    /**
+     * @brief Empty seats on one bus.
+     *
+     * @param handle A valid bus handle.
+     */
+    int freeSeats(Handle handle) const {
+        Epoch::Guard guard;
+        return columns.freeSeats(handle).load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Call fn(const Bus&) for every bus that matches a filter, in installation
+     *        order.
+     *
+     * The filter is evaluated over the fleet columns, never the buses themselves, and only
+     * matching buses are touched. Same rules as forEach(); a bus's free seats are tested
+     * as they stood at some moment during the scan.
+     *
+     * @return std::size_t The number of matching buses.
+     */
+    template <typename Fn>
+    std::size_t forEachMatching(const FleetFilter& filter, Fn fn) const {
+        Epoch::Guard guard;
+        const std::size_t count = published.load(std::memory_order_acquire);
+        return columns.select(filter, count, [&](std::size_t handle) { fn(buses[handle]); });
+    }
+
+    /**
+     * @brief Number of buses that match a filter, without touching any of them.
+     */
+    std::size_t countMatching(const FleetFilter& filter) const;
+
+    /**
+     * @brief Seat totals over every bus, from the fleet columns.
+     */
+    FleetOccupancy occupancy() const;
+
+    /**
+     * @brief Id of a route, for FleetFilter::routes.
+     *
+     * @return std::uint32_t The route id, or RouteIndex::npos if no bus serves the route.
+     */
+    std::uint32_t routeId(StringPool::Id origin, StringPool::Id dest) const;
+
+    /**
+     * @brief Empty seats across every bus on a route, or 0 if no bus serves it.
+     */
+    std::int64_t routeFreeSeats(StringPool::Id origin, StringPool::Id dest) const;
+
+    /**
+     * @brief Empty seats across the whole fleet.
+     */
+    std::int64_t totalFreeSeats() const { return fleetFree.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief Prices paid for all currently reserved seats.
+     */
+    Paise revenuePaise() const { return revenue.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief Call fn(const BusStore&, const SeatBookingStore&, const TripStore&,
+     *        const PassengerStore&) with every bus, booking, trip and passenger name held
+     *        still.
+     *
+     * Takes the registry lock exclusively, so no bus is installed, reserved or cancelled
+     * until fn returns. Used to capture a consistent snapshot.
+     */
+    template <typename Fn>
+    void freeze(Fn fn) const {
+        std::unique_lock<std::shared_mutex> lock(mutex);
+        fn(buses, serials, trips, passengers);
+    }
+
+    bool empty() const { return published.load(std::memory_order_acquire) == 0; }
+
+    std::size_t size() const { return published.load(std::memory_order_acquire); }
+
+private:
+    /**
+     * @brief One hash table slot. A slot with handle == npos is empty.
+     *
+     * The full hash is kept next to the handle so that probes only touch the bus
+     * itself when the hashes already match.
+     */
+    struct Slot {
+        std::uint32_t hash;
+        Handle handle;
+    };
+
+    /**
+     * @brief Per-bus seat lock, padded to a cache line so neighbouring buses do not
+     *        share one.
+     *
+     * Locking first tries without blocking, so only contended acquisitions are counted
+     * and timed (Counter::BusLockWaits, Timer::BusLockWait).
+     */
+    struct alignas(64) BusLock {
+        mutable std::mutex mutex;
+
+        void lock() const {
+            if(mutex.try_lock()) return;
+            Metrics::count(Counter::BusLockWaits);
+            ScopedTimer waiting(Timer::BusLockWait);
+            mutex.lock();
+        }
+
+        void unlock() const { mutex.unlock(); }
+    };
+
+    typedef std::lock_guard<const BusLock> BusGuard;
+
+    BusStore buses;                /**< All installed buses, indexed by handle. */
+    std::deque<BusLock> busLocks;  /**< Seat lock per bus, indexed by handle. */
+    SeatBookingStore serials;      /**< Booking serials of reserved seats, indexed by handle. */
+    SeatHistoryStore history;      /**< Seat map version and recent changes, indexed by handle. */
+    std::vector<Slot> slots;       /**< Hash table; size is zero or a power of two. */
+    RouteIndex routes;             /**< Buses grouped by (origin, destination). */
+    TripStore trips;               /**< Seat maps of dated trips. */
+    PassengerStore passengers;     /**< Names held by reserved seats, undated and dated. */
+    HoldTable holds;               /**< Outstanding seat holds and their deadlines. */
+    BookingIndex bookings;         /**< Undated bookings by passenger name. */
+    mutable ConnectionIndex connections; /**< Timed buses for journey search; rebuilt on demand. */
+    mutable std::shared_mutex mutex; /**< Guards buses, busLocks, serials, history, slots, routes and connections. */
+    std::atomic<std::size_t> published{0}; /**< Buses the lock-free readers may see. */
+
+    FleetColumns columns;                             /**< Empty seats, route and departure per bus handle. */
+    std::deque<std::atomic<std::int64_t>> routeFree;  /**< Empty seats per route id. */
+    std::atomic<std::int64_t> fleetFree{0};           /**< Empty seats on all buses. */
+    std::atomic<Paise> revenue{0};                    /**< Prices paid for reserved seats. */
+
+    /**
+     * @brief find() for callers that already hold the registry lock.
+     */
+    Handle findLocked(const std::string& number) const;
+
+    /**
+     * @brief Body of add() once the number is known to be free and the hash table has
+     *        room. Caller holds the registry lock exclusively.
+     *
+     * @param sorted Publish the bus's route now, sorted by departure; if false the caller
+     *        calls routes.publishUnsorted() before releasing the lock. Either way the
+     *        caller publishes the bus count.
+     */
+    Handle insertLocked(Bus&& incoming, bool sorted);
+
+    /**
+     * @brief Reserve every empty seat in mask as one new booking at the bus's current
+     *        demand tier and return their price. Caller holds the bus lock.
+     *
+     * @param key Name key of the passenger, for the booking index.
+     */
+    Paise occupyAll(Handle handle, SeatMask mask, PassengerStore::Id passenger, std::uint32_t key);
+
+    /**
+     * @brief Demand tier of a bus, from its sold seats. Caller holds the bus lock.
+     */
+    int tierOf(Handle handle) const;
+
+    /**
+     * @brief Id of a booking from its bus and serial.
+     */
+    static BookingIndex::Id bookingId(Handle handle, std::uint32_t serial) {
+        return (static_cast<BookingIndex::Id>(handle) << 32) | serial;
+    }
+
+    /**
+     * @brief Name key of the passenger in a record, from the record itself.
+     */
+    std::uint32_t keyOf(PassengerStore::Id passenger) const {
+        std::uint32_t key = 0;
+        passengers.withName(passenger, [&](const char* name, std::size_t length) { key = nameKey(name, length); });
+        return key;
+    }
+
+    /**
+     * @brief Fill in a booking from the seats of its serial. Caller holds the bus lock.
+     *
+     * @return false If no seat is reserved under the serial.
+     */
+    bool describe(Handle handle, std::uint32_t serial, Booking& booking) const;
+
+    /**
+     * @brief Make the seats of an ended hold empty again. Caller holds the registry lock
+     *        (shared is enough) but no bus lock.
+     */
+    void unhold(const HoldTable::Hold& hold);
+
+    /**
+     * @brief Update the availability counters after the seats in mask were reserved
+     *        (booked == true) for fares paise, or cancelled with fares refunded. Caller
+     *        holds the bus lock.
+     */
+    void countSeats(Handle handle, SeatMask mask, Paise fares, bool booked);
+
+    /**
+     * @brief Check whether a bus has seats empty seats, undated or on a date. Caller holds
+     *        the registry lock (shared is enough).
+     */
+    bool canBoard(Handle handle, int seats, ServiceDate date) const;
+
+    /**
+     * @brief Rebuild the connection index under the exclusive lock if buses were installed
+     *        since it was built. Caller must not hold the registry lock.
+     */
+    void refreshConnections() const;
+
+    /**
+     * @brief Double the table (keeping the load factor at or below 1/2) and rehash.
+     */
+    void grow();
+};
+
+#endif // BOOKING_BUSREGISTRY_H
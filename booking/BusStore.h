@@ -0,0 +1,21 @@
+#ifndef BOOKING_BUSSTORE_H
+#define BOOKING_BUSSTORE_H
+
+#include "Bus.h"
+#include "SlabStore.h"
+
+/**
+ * @file BusStore.h
+ * @brief Slab arena holding every installed bus at a fixed address.
+ */
+
+/**
+ * @brief Append-only sequence of buses, indexed by handle, that never moves a bus.
+ *
+ * Installing a bus moves it in once; see SlabStore. The store is not thread-safe for
+ * appending; BusRegistry guards that with its lock and publishes how many buses readers
+ * may index without it.
+ */
+typedef SlabStore<Bus> BusStore;
+
+#endif // BOOKING_BUSSTORE_H
@@ -0,0 +1,109 @@
+// Calendar.cpp
+
+#include "Calendar.h"
+
+#include <cctype>
+
+namespace {
+
+bool isLeap(int year) {
+    return (year % 4 == 0 && year % 100 != 0) || year % 400 == 0;
+}
+
+int daysInMonth(int year, int month) {
+    static const int DAYS[12] = { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+    return month == 2 && isLeap(year) ? 29 : DAYS[month - 1];
+}
+
+/**
+ * @brief Read exactly count decimal digits from text at pos.
+ */
+bool readDigits(const std::string& text, std::size_t& pos, int count, int& value) {
+    value = 0;
+    for(int i = 0; i < count; ++i, ++pos) {
+        if(pos >= text.size() || !std::isdigit(static_cast<unsigned char>(text[pos]))) return false;
+        value = value * 10 + (text[pos] - '0');
+    }
+    return true;
+}
+
+} // namespace
+
+bool parseTime(const std::string& text, int& minutes) {
+    std::size_t pos = 0;
+    int hour, minute;
+    // One or two hour digits
+    const std::size_t colon = text.find(':');
+    if(colon != 1 && colon != 2) return false;
+    if(!readDigits(text, pos, static_cast<int>(colon), hour)) return false;
+    ++pos;
+    if(!readDigits(text, pos, 2, minute) || minute > 59) return false;
+
+    if(pos < text.size() && text[pos] == ' ') ++pos;
+    if(pos == text.size()) {
+        if(hour > 23) return false;
+    } else {
+        // 12-hour clock: 12am is midnight and 12pm is noon
+        if(text.size() - pos != 2 || std::tolower(static_cast<unsigned char>(text[pos + 1])) != 'm') return false;
+        const char half = static_cast<char>(std::tolower(static_cast<unsigned char>(text[pos])));
+        if((half != 'a' && half != 'p') || hour < 1 || hour > 12) return false;
+        hour = hour % 12 + (half == 'p' ? 12 : 0);
+    }
+    minutes = hour * 60 + minute;
+    return true;
+}
+
+bool parseDate(const std::string& text, ServiceDate& date) {
+    if(text.size() != 10 || text[4] != '-' || text[7] != '-') return false;
+    std::size_t pos = 0;
+    int year, month, day;
+    if(!readDigits(text, pos, 4, year)) return false;
+    ++pos;
+    if(!readDigits(text, pos, 2, month) || month < 1 || month > 12) return false;
+    ++pos;
+    if(!readDigits(text, pos, 2, day) || day < 1 || day > daysInMonth(year, month)) return false;
+    date = daysFromCivil(year, month, day);
+    return true;
+}
+
+ServiceDate daysFromCivil(int year, int month, int day) {
+    // Count from 0000-03-01 so the leap day falls at the end of each year
+    year -= month <= 2;
+    const int era = (year >= 0 ? year : year - 399) / 400;
+    const int yearOfEra = year - era * 400;
+    const int dayOfYear = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+    const int dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+    return era * 146097 + dayOfEra - 719468;
+}
+
+std::string formatDate(ServiceDate date) {
+    // Inverse of daysFromCivil()
+    const int z = date + 719468;
+    const int era = (z >= 0 ? z : z - 146096) / 146097;
+    const int dayOfEra = z - era * 146097;
+    const int yearOfEra = (dayOfEra - dayOfEra / 1460 + dayOfEra / 36524 - dayOfEra / 146096) / 365;
+    const int dayOfYear = dayOfEra - (365 * yearOfEra + yearOfEra / 4 - yearOfEra / 100);
+    const int mp = (5 * dayOfYear + 2) / 153;
+    const int day = dayOfYear - (153 * mp + 2) / 5 + 1;
+    const int month = mp < 10 ? mp + 3 : mp - 9;
+    const int year = yearOfEra + era * 400 + (month <= 2);
+
+    char text[16];
+    char* p = text;
+    for(int div = 1000; div; div /= 10) *p++ = static_cast<char>('0' + year / div % 10);
+    *p++ = '-';
+    *p++ = static_cast<char>('0' + month / 10);
+    *p++ = static_cast<char>('0' + month % 10);
+    *p++ = '-';
+    *p++ = static_cast<char>('0' + day / 10);
+    *p++ = static_cast<char>('0' + day % 10);
+    return std::string(text, p);
+}
+
+std::string formatTime(int minutes) {
+    const int hour = minutes / 60 % 24;
+    const int minute = minutes % 60;
+    const char text[5] = { static_cast<char>('0' + hour / 10), static_cast<char>('0' + hour % 10), ':',
+                           static_cast<char>('0' + minute / 10), static_cast<char>('0' + minute % 10) };
+    return std::string(text, sizeof text);
+}
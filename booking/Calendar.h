@@ -0,0 +1,75 @@
+#ifndef BOOKING_CALENDAR_H
+#define BOOKING_CALENDAR_H
+
+#include <string>
+#include <cstdint>
+
+/**
+ * @file Calendar.h
+ * @brief Integer encodings of service dates and times of day, and their text forms.
+ *
+ * A service date is a day number (days since 1970-01-01) and a time of day is minutes
+ * since midnight, so schedules compare and index as plain integers and are parsed only
+ * once, when a bus or trip is entered.
+ */
+
+typedef std::int32_t ServiceDate;  /**< Days since 1970-01-01. */
+
+const ServiceDate NO_DATE = INT32_MIN;  /**< A date that names no day. */
+const int NO_TIME = -1;  /**< Minutes value of a time that could not be parsed. */
+const int MINUTES_PER_DAY = 24 * 60;  /**< Times of day run from 0 to MINUTES_PER_DAY - 1. */
+
+/**
+ * @brief Weekday bits for schedules: bit 0 is Monday through bit 6 for Sunday.
+ */
+const std::uint8_t EVERY_DAY = 0x7F;
+
+/**
+ * @brief Parse a 24-hour "H:MM" or "HH:MM" time, optionally followed by "am" or "pm"
+ *        (any case, with or without a space) for a 12-hour time.
+ *
+ * @param text The time to parse.
+ * @param minutes Receives minutes since midnight (0 to 1439).
+ * @return true If text is a valid time.
+ */
+bool parseTime(const std::string& text, int& minutes);
+
+/**
+ * @brief Parse a "YYYY-MM-DD" date.
+ *
+ * @param text The date to parse.
+ * @param date Receives the day number.
+ * @return true If text is a valid calendar date.
+ */
+bool parseDate(const std::string& text, ServiceDate& date);
+
+/**
+ * @brief Format a day number as "YYYY-MM-DD".
+ */
+std::string formatDate(ServiceDate date);
+
+/**
+ * @brief Format minutes since midnight as a 24-hour "HH:MM" time.
+ *
+ * Minutes past the end of the day wrap around, so a time on the following day formats as
+ * its time of day.
+ */
+std::string formatTime(int minutes);
+
+/**
+ * @brief Day number of a proleptic Gregorian calendar date.
+ *
+ * @param month 1 to 12.
+ * @param day 1 to the length of the month.
+ */
+ServiceDate daysFromCivil(int year, int month, int day);
+
+/**
+ * @brief Weekday of a day number, 0 for Monday through 6 for Sunday.
+ */
+inline int weekdayOf(ServiceDate date) {
+    // 1970-01-01 was a Thursday
+    return static_cast<int>(((date + 3) % 7 + 7) % 7);
+}
+
+#endif // BOOKING_CALENDAR_H
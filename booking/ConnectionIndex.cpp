@@ -0,0 +1,36 @@
+// ConnectionIndex.cpp
+
+#include "ConnectionIndex.h"
+
+void ConnectionIndex::build(const BusStore& buses) {
+    stops.clear();
+    connections.clear();
+    auto indexed = [](const Bus& bus) {
+        return bus.getDepartureMinute() != NO_TIME && bus.getArrivalMinute() != NO_TIME
+            && bus.getOrigin() != bus.getDestination();
+    };
+
+    for(std::size_t handle = 0; handle < buses.size(); ++handle) {
+        const Bus &bus = buses[handle];
+        if(!indexed(bus)) continue;
+        stops.push_back(bus.getOrigin());
+        stops.push_back(bus.getDestination());
+    }
+    std::sort(stops.begin(), stops.end());
+    stops.erase(std::unique(stops.begin(), stops.end()), stops.end());
+
+    for(std::size_t handle = 0; handle < buses.size(); ++handle) {
+        const Bus &bus = buses[handle];
+        if(!indexed(bus)) continue;
+        std::int32_t arrival = bus.getArrivalMinute();
+        if(arrival < bus.getDepartureMinute()) arrival += MINUTES_PER_DAY;
+        connections.push_back(Connection{ stopOf(bus.getOrigin()), stopOf(bus.getDestination()),
+                                          bus.getDepartureMinute(), arrival,
+                                          static_cast<std::uint32_t>(handle) });
+    }
+    // Handles are already ascending, so a stable sort keeps installation order among equal times
+    std::stable_sort(connections.begin(), connections.end(), [](const Connection& a, const Connection& b) {
+        return a.departure < b.departure;
+    });
+    covered = buses.size();
+}
@@ -0,0 +1,180 @@
+#ifndef BOOKING_CONNECTIONINDEX_H
+#define BOOKING_CONNECTIONINDEX_H
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <algorithm>
+
+#include "Bus.h"
+#include "BusStore.h"
+#include "Calendar.h"
+#include "StringPool.h"
+
+/**
+ * @file ConnectionIndex.h
+ * @brief Multi-leg journey search over every timed bus, by Connection Scan.
+ *
+ * Each bus with a parsed departure and arrival time is one connection: a hop from its
+ * origin to its destination at fixed times of day. The connections are kept in a single
+ * array sorted by departure, and the time-expanded graph of the network is that array
+ * repeated once per day of the search window, so it is never materialised. A query is one
+ * forward pass over the array from the requested departure, relaxing the earliest arrival
+ * at each stop, and stops as soon as a departure is later than the best arrival found at
+ * the destination. Stops are numbered densely at build time, so the per-query state is two
+ * small arrays indexed by stop.
+ */
+
+/**
+ * @struct JourneyQuery
+ * @brief Parameters of a journey search.
+ */
+struct JourneyQuery {
+    int departAfter = 0;        /**< Earliest departure from the origin, minutes since midnight. */
+    int minTransfer = 15;       /**< Minutes needed to change buses at an intermediate stop. */
+    int seats = 1;              /**< Empty seats every leg must have. */
+    ServiceDate date = NO_DATE; /**< Travel date, or NO_DATE to use the undated seat maps. */
+};
+
+/**
+ * @struct JourneyLeg
+ * @brief One bus ride of a journey.
+ *
+ * Times are minutes since midnight of the day the journey starts, so a leg on the
+ * following day has times of MINUTES_PER_DAY or more.
+ */
+struct JourneyLeg {
+    std::uint32_t bus;  /**< Registry handle of the bus. */
+    int departure;      /**< Departure from the leg's origin. */
+    int arrival;        /**< Arrival at the leg's destination. */
+};
+
+/**
+ * @class ConnectionIndex
+ * @brief Departure-sorted connection array with a Connection Scan search.
+ *
+ * The index is built from the registry's bus store and is not thread-safe on its own; the
+ * BusRegistry rebuilds it under its exclusive lock and searches it under the shared lock.
+ */
+class ConnectionIndex {
+public:
+    static const std::uint32_t npos = 0xFFFFFFFFu;  /**< "No such stop". */
+    static const int SEARCH_DAYS = 2;  /**< Days of departures a search may use, starting with the query's. */
+
+    /**
+     * @brief Rebuild the index from every installed bus.
+     *
+     * Buses without a parsed departure or arrival time, or whose origin and destination
+     * are the same, are left out. A bus arriving at an earlier time of day than it departs
+     * is taken to arrive the next day.
+     *
+     * @param buses All installed buses, indexed by handle.
+     */
+    void build(const BusStore& buses);
+
+    /**
+     * @brief Number of buses (by handle) the index was last built from.
+     */
+    std::size_t coveredBuses() const { return covered; }
+
+    /**
+     * @brief Dense stop number of an interned place name, or npos if no indexed bus
+     *        serves it.
+     */
+    std::uint32_t stopOf(StringPool::Id place) const {
+        const std::vector<StringPool::Id>::const_iterator at = std::lower_bound(stops.begin(), stops.end(), place);
+        return at != stops.end() && *at == place ? static_cast<std::uint32_t>(at - stops.begin()) : npos;
+    }
+
+    /**
+     * @brief Find the journey from origin to dest that arrives earliest.
+     *
+     * Among journeys arriving at the same time, the one found first wins, which favours
+     * earlier departures on the first leg and installation order among equal times.
+     *
+     * @param departAfter Earliest departure from the origin, minutes since midnight.
+     * @param minTransfer Minutes needed between arriving at a stop and leaving it again.
+     * @param usable Called as usable(handle, day) for a connection that would improve an
+     *        arrival; day is 0 for the query's day and 1 for the next. Returns false to
+     *        skip the bus, for example when it has too few empty seats.
+     * @param legs Receives the rides in travel order; cleared if there is no journey.
+     * @return true If a journey was found.
+     */
+    template <typename Usable>
+    bool search(StringPool::Id origin, StringPool::Id dest, int departAfter, int minTransfer, Usable usable,
+                std::vector<JourneyLeg>& legs) const {
+        legs.clear();
+        const std::uint32_t from = stopOf(origin);
+        const std::uint32_t to = stopOf(dest);
+        if(from == npos || to == npos || from == to) return false;
+
+        std::vector<std::int32_t> arrival(stops.size(), UNREACHED);
+        std::vector<Step> inbound(stops.size());
+        // Ready to leave the origin at departAfter, as if having arrived one transfer earlier
+        arrival[from] = departAfter - minTransfer;
+
+        const std::size_t count = connections.size();
+        std::size_t i = std::lower_bound(connections.begin(), connections.end(), departAfter, departsBefore)
+                      - connections.begin();
+        bool settled = false;
+        for(int day = 0; day < SEARCH_DAYS && !settled; ++day, i = 0) {
+            const std::int32_t offset = day * MINUTES_PER_DAY;
+            for(; i < count; ++i) {
+                const Connection &c = connections[i];
+                const std::int32_t departure = c.departure + offset;
+                if(departure >= arrival[to]) {
+                    // Every later connection departs, and so arrives, no earlier than this
+                    settled = true;
+                    break;
+                }
+                if(arrival[c.from] == UNREACHED || departure < arrival[c.from] + minTransfer) continue;
+                const std::int32_t arrives = c.arrival + offset;
+                if(arrives >= arrival[c.to] || !usable(c.bus, day)) continue;
+                arrival[c.to] = arrives;
+                inbound[c.to] = Step{ static_cast<std::uint32_t>(i), static_cast<std::uint32_t>(day) };
+            }
+        }
+        if(arrival[to] == UNREACHED) return false;
+
+        // Each stop's inbound connection left a stop that was reached earlier
+        for(std::uint32_t at = to; at != from; ) {
+            const Step step = inbound[at];
+            const Connection &c = connections[step.connection];
+            const int offset = static_cast<int>(step.day) * MINUTES_PER_DAY;
+            legs.push_back(JourneyLeg{ c.bus, c.departure + offset, c.arrival + offset });
+            at = c.from;
+        }
+        std::reverse(legs.begin(), legs.end());
+        return true;
+    }
+
+private:
+    static constexpr std::int32_t UNREACHED = 0x7FFFFFFF;  /**< Arrival at a stop not reached yet. */
+
+    /**
+     * @brief One bus as a timed hop between two dense stop numbers.
+     */
+    struct Connection {
+        std::uint32_t from;       /**< Origin stop. */
+        std::uint32_t to;         /**< Destination stop. */
+        std::int32_t departure;   /**< Minutes since midnight. */
+        std::int32_t arrival;     /**< Minutes since midnight of the departure day; may pass midnight. */
+        std::uint32_t bus;        /**< Registry handle. */
+    };
+
+    /**
+     * @brief Where the best arrival at a stop came from.
+     */
+    struct Step {
+        std::uint32_t connection;  /**< Index into connections. */
+        std::uint32_t day;         /**< Day of the search window it ran on. */
+    };
+
+    static bool departsBefore(const Connection& c, int minute) { return c.departure < minute; }
+
+    std::vector<StringPool::Id> stops;      /**< Place id of each dense stop number, ascending. */
+    std::vector<Connection> connections;    /**< Sorted by departure, then by handle. */
+    std::size_t covered = 0;                /**< Buses the index was built from. */
+};
+
+#endif // BOOKING_CONNECTIONINDEX_H
@@ -0,0 +1,112 @@
+// Epoch.cpp
+
+#include "Epoch.h"
+
+#include <deque>
+#include <mutex>
+#include <vector>
+
+/**
+ * @brief Every announcement ever handed out, those whose thread has exited, and the
+ *        memory waiting to be freed.
+ */
+struct Epoch::Domain {
+    /**
+     * @brief One retired object and the epoch it was retired in.
+     */
+    struct Retired {
+        std::uint64_t epoch;
+        void* p;
+        void (*destroy)(void*);
+    };
+
+    std::mutex mutex;
+    std::atomic<std::uint64_t> current{0};  /**< Advanced by every retire(). */
+    std::deque<Reader> readers;             /**< Never shrinks, so readers stay put. */
+    std::vector<Reader*> idle;
+    std::vector<Retired> retired;
+
+    static Domain& instance() {
+        // Never destroyed: threads may still be exiting after static destruction starts
+        static Domain* domain = new Domain();
+        return *domain;
+    }
+};
+
+/**
+ * @brief A thread's claim on an announcement, given back when the thread exits.
+ */
+struct Epoch::Lease {
+    Reader* reader;
+
+    Lease() {
+        Domain &domain = Domain::instance();
+        std::lock_guard<std::mutex> lock(domain.mutex);
+        if(!domain.idle.empty()) {
+            reader = domain.idle.back();
+            domain.idle.pop_back();
+        } else {
+            domain.readers.emplace_back();
+            reader = &domain.readers.back();
+            reader->epoch.store(IDLE, std::memory_order_relaxed);
+        }
+    }
+
+    ~Lease() {
+        Domain &domain = Domain::instance();
+        std::lock_guard<std::mutex> lock(domain.mutex);
+        domain.idle.push_back(reader);
+    }
+};
+
+Epoch::Reader& Epoch::local() {
+    thread_local Lease lease;
+    return *lease.reader;
+}
+
+Epoch::Guard::Guard() {
+    Reader &reader = local();
+    if(reader.depth++ != 0) return;
+    reader.epoch.store(Domain::instance().current.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    // The announcement must be visible before the first pointer is read; pairs with the
+    // fence in reclaim(), so either the writer sees this reader or the reader sees the
+    // writer's unlink
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+}
+
+Epoch::Guard::~Guard() {
+    Reader &reader = local();
+    if(--reader.depth == 0) reader.epoch.store(IDLE, std::memory_order_release);
+}
+
+void Epoch::retire(void* p, void (*destroy)(void*)) {
+    Domain &domain = Domain::instance();
+    // Readers announcing this epoch or an earlier one may have reached p before it was unlinked
+    const std::uint64_t epoch = domain.current.fetch_add(1, std::memory_order_seq_cst);
+    std::lock_guard<std::mutex> lock(domain.mutex);
+    domain.retired.push_back(Domain::Retired{ epoch, p, destroy });
+    reclaim(domain);
+}
+
+std::size_t Epoch::pending() {
+    Domain &domain = Domain::instance();
+    std::lock_guard<std::mutex> lock(domain.mutex);
+    return domain.retired.size();
+}
+
+void Epoch::reclaim(Domain& domain) {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    std::uint64_t oldest = IDLE;
+    for(const Reader &reader : domain.readers) {
+        const std::uint64_t epoch = reader.epoch.load(std::memory_order_acquire);
+        if(epoch < oldest) oldest = epoch;
+    }
+
+    // Everything retired before the oldest reader arrived is out of every reader's reach
+    std::size_t kept = 0;
+    for(const Domain::Retired &item : domain.retired) {
+        if(item.epoch < oldest) item.destroy(item.p);
+        else domain.retired[kept++] = item;
+    }
+    domain.retired.resize(kept);
+}
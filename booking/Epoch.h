@@ -0,0 +1,101 @@
+#ifndef BOOKING_EPOCH_H
+#define BOOKING_EPOCH_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+
+/**
+ * @file Epoch.h
+ * @brief Epoch-based reclamation, so readers can walk shared structures without locks
+ *        while writers replace parts of them.
+ */
+
+/**
+ * @class Epoch
+ * @brief Process-wide epoch domain in the manner of RCU.
+ *
+ * A reader holds an Epoch::Guard while it follows pointers into a structure that writers
+ * may replace: the guard announces the epoch the reader started in, and costs a store and
+ * a fence, with no lock and no shared cache line written. A writer that unlinks an old
+ * version publishes the new one first, then passes the old one to retire(). Retired
+ * memory is freed only once every reader that started before it was retired has left its
+ * guard, so a reader never sees memory freed under it and never makes a writer wait:
+ * freeing is merely deferred.
+ *
+ * Each thread's announcement lives in a block of its own, claimed on the thread's first
+ * guard and handed to the next new thread once it exits.
+ */
+class Epoch {
+public:
+    /**
+     * @class Guard
+     * @brief Keeps everything reachable when it was made alive until it is destroyed.
+     *
+     * Guards nest; only the outermost one announces and withdraws the epoch.
+     */
+    class Guard {
+    public:
+        Guard();
+        ~Guard();
+
+        Guard(const Guard&) = delete;
+        Guard& operator=(const Guard&) = delete;
+    };
+
+    /**
+     * @brief Free p with destroy(p) once no reader can still be reading it.
+     *
+     * Call only after p has been unlinked, so that readers arriving from now on cannot
+     * reach it. Memory whose readers have all left is freed on the way.
+     */
+    static void retire(void* p, void (*destroy)(void*));
+
+    /**
+     * @brief retire() for an object made with new.
+     */
+    template <typename T>
+    static void retire(T* p) {
+        retire(const_cast<void*>(static_cast<const void*>(p)), [](void* q) { delete static_cast<T*>(q); });
+    }
+
+    /**
+     * @brief retire() for an array made with new[].
+     */
+    template <typename T>
+    static void retireArray(T* p) {
+        retire(const_cast<void*>(static_cast<const void*>(p)), [](void* q) { delete[] static_cast<T*>(q); });
+    }
+
+    /**
+     * @brief Number of retired objects not freed yet.
+     */
+    static std::size_t pending();
+
+private:
+    static const std::uint64_t IDLE = ~std::uint64_t(0);  /**< Announced by a thread outside any guard. */
+
+    /**
+     * @brief One thread's announcement, written only by that thread.
+     */
+    struct alignas(64) Reader {
+        std::atomic<std::uint64_t> epoch;
+        unsigned depth;  /**< Guards open on the thread; read by it alone. */
+    };
+
+    struct Domain;
+    struct Lease;
+
+    /**
+     * @brief The calling thread's announcement, claimed on first use.
+     */
+    static Reader& local();
+
+    /**
+     * @brief Free every retired object that no reader can still see. Caller holds the
+     *        domain lock.
+     */
+    static void reclaim(Domain& domain);
+};
+
+#endif // BOOKING_EPOCH_H
@@ -0,0 +1,61 @@
+#ifndef BOOKING_FILEUTIL_H
+#define BOOKING_FILEUTIL_H
+
+#include <string>
+#include <cstddef>
+
+/**
+ * @file FileUtil.h
+ * @brief Small POSIX file helpers shared by the journal, snapshot and bulk loading code.
+ */
+
+/**
+ * @brief Write a whole buffer, retrying on short writes and EINTR.
+ *
+ * @return true If every byte was written.
+ */
+bool writeAll(int fd, const char* data, std::size_t size);
+
+/**
+ * @brief Flush a file's data to stable storage (fdatasync where available).
+ */
+bool syncData(int fd);
+
+/**
+ * @brief Flush the directory containing path, making a rename or create in it durable.
+ */
+bool syncDirectoryOf(const std::string& path);
+
+/**
+ * @brief Check whether a file exists.
+ */
+bool fileExists(const std::string& path);
+
+/**
+ * @class MappedFile
+ * @brief Read-only mapping of a whole file, unmapped on destruction.
+ */
+class MappedFile {
+public:
+    MappedFile() = default;
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    /**
+     * @brief Map a file for reading.
+     *
+     * @return true If the file is non-empty and now mapped.
+     */
+    bool map(const std::string& path);
+
+    const char* data() const { return base; }
+    std::size_t size() const { return length; }
+
+private:
+    const char* base = nullptr;
+    std::size_t length = 0;
+};
+
+#endif // BOOKING_FILEUTIL_H
@@ -0,0 +1,262 @@
+// FleetColumns.cpp
+
+#include "FleetColumns.h"
+
+#include <cstring>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define FLEET_AVX2 1
+#include <immintrin.h>
+#endif
+
+// The kernels load the counters as plain 32-bit lanes
+static_assert(sizeof(std::atomic<std::int32_t>) == sizeof(std::int32_t), "counters must be bare 32-bit words");
+static_assert(std::atomic<std::int32_t>::is_always_lock_free, "counters must be lock-free");
+
+namespace {
+
+typedef std::size_t (*ScanKernel)(const FleetColumns::Run&, std::size_t, const FleetColumns::Predicate&,
+                                  std::uint16_t*);
+typedef void (*OccupancyKernel)(const FleetColumns::Run&, std::size_t, FleetOccupancy&);
+
+bool matches(const FleetColumns::Run& run, std::size_t i, const FleetColumns::Predicate& p) {
+    const std::int32_t departure = run.departure[i];
+    if(run.free[i] < p.minFree) return false;
+    if(!(departure >= p.low[0] && departure <= p.high[0]) && !(departure >= p.low[1] && departure <= p.high[1])) {
+        return false;
+    }
+    if(p.routeCount == 0) return true;
+    for(std::size_t r = 0; r < p.routeCount; ++r) {
+        if(run.route[i] == p.routes[r]) return true;
+    }
+    return false;
+}
+
+// Rows from..n, one at a time; also the tail of the vector kernels
+std::size_t scanTail(const FleetColumns::Run& run, std::size_t from, std::size_t n,
+                     const FleetColumns::Predicate& p, std::uint16_t* hits, std::size_t found) {
+    for(std::size_t i = from; i < n; ++i) {
+        const bool hit = matches(run, i, p);
+        if(hits) hits[found] = static_cast<std::uint16_t>(i);
+        found += hit;
+    }
+    return found;
+}
+
+std::size_t scanScalar(const FleetColumns::Run& run, std::size_t n, const FleetColumns::Predicate& p,
+                       std::uint16_t* hits) {
+    return scanTail(run, 0, n, p, hits, 0);
+}
+
+void occupancyTail(const FleetColumns::Run& run, std::size_t from, std::size_t n, FleetOccupancy& totals) {
+    for(std::size_t i = from; i < n; ++i) {
+        const std::int32_t empty = run.free[i];
+        totals.seats += run.seats[i];
+        totals.freeSeats += empty;
+        totals.soldOut += empty == 0;
+        totals.unsold += empty == run.seats[i];
+    }
+}
+
+void occupancyScalar(const FleetColumns::Run& run, std::size_t n, FleetOccupancy& totals) {
+    occupancyTail(run, 0, n, totals);
+}
+
+#ifdef FLEET_AVX2
+
+__attribute__((target("avx2")))
+std::size_t scanAvx2(const FleetColumns::Run& run, std::size_t n, const FleetColumns::Predicate& p,
+                     std::uint16_t* hits) {
+    // Every test is a signed greater-than: x >= a is x > a - 1, x <= b is b + 1 > x
+    const __m256i freeAbove = _mm256_set1_epi32(p.minFree - 1);
+    const __m256i low0 = _mm256_set1_epi32(p.low[0] - 1), high0 = _mm256_set1_epi32(p.high[0] + 1);
+    const __m256i low1 = _mm256_set1_epi32(p.low[1] - 1), high1 = _mm256_set1_epi32(p.high[1] + 1);
+    std::size_t found = 0;
+    std::size_t i = 0;
+    for(; i + 8 <= n; i += 8) {
+        const __m256i vacant = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(run.free + i));
+        const __m256i departure = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(run.departure + i));
+        __m256i hit = _mm256_cmpgt_epi32(vacant, freeAbove);
+        const __m256i in0 = _mm256_and_si256(_mm256_cmpgt_epi32(departure, low0), _mm256_cmpgt_epi32(high0, departure));
+        const __m256i in1 = _mm256_and_si256(_mm256_cmpgt_epi32(departure, low1), _mm256_cmpgt_epi32(high1, departure));
+        hit = _mm256_and_si256(hit, _mm256_or_si256(in0, in1));
+        if(p.routeCount) {
+            const __m256i route = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(run.route + i));
+            __m256i any = _mm256_setzero_si256();
+            for(std::size_t r = 0; r < p.routeCount; ++r) {
+                any = _mm256_or_si256(any, _mm256_cmpeq_epi32(route, _mm256_set1_epi32(static_cast<int>(p.routes[r]))));
+            }
+            hit = _mm256_and_si256(hit, any);
+        }
+        unsigned bits = static_cast<unsigned>(_mm256_movemask_ps(_mm256_castsi256_ps(hit)));
+        if(!hits) {
+            found += __builtin_popcount(bits);
+            continue;
+        }
+        for(; bits; bits &= bits - 1) hits[found++] = static_cast<std::uint16_t>(i + __builtin_ctz(bits));
+    }
+    return scanTail(run, i, n, p, hits, found);
+}
+
+__attribute__((target("avx2")))
+std::int64_t sumLanes(__m256i v) {
+    alignas(32) std::int32_t lanes[8];
+    _mm256_store_si256(reinterpret_cast<__m256i*>(lanes), v);
+    std::int64_t sum = 0;
+    for(std::int32_t lane : lanes) sum += lane;
+    return sum;
+}
+
+__attribute__((target("avx2")))
+void occupancyAvx2(const FleetColumns::Run& run, std::size_t n, FleetOccupancy& totals) {
+    // A run's lanes cannot overflow: at most SLAB_ROWS / 8 rows of 64 seats each
+    __m256i seats = _mm256_setzero_si256(), empty = _mm256_setzero_si256();
+    __m256i soldOut = _mm256_setzero_si256(), unsold = _mm256_setzero_si256();
+    const __m256i zero = _mm256_setzero_si256();
+    std::size_t i = 0;
+    for(; i + 8 <= n; i += 8) {
+        const __m256i vacant = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(run.free + i));
+        const __m256i total = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(run.seats + i));
+        seats = _mm256_add_epi32(seats, total);
+        empty = _mm256_add_epi32(empty, vacant);
+        // A true compare is -1 in every bit, so subtracting it counts one
+        soldOut = _mm256_sub_epi32(soldOut, _mm256_cmpeq_epi32(vacant, zero));
+        unsold = _mm256_sub_epi32(unsold, _mm256_cmpeq_epi32(vacant, total));
+    }
+    totals.seats += sumLanes(seats);
+    totals.freeSeats += sumLanes(empty);
+    totals.soldOut += static_cast<std::size_t>(sumLanes(soldOut));
+    totals.unsold += static_cast<std::size_t>(sumLanes(unsold));
+    occupancyTail(run, i, n, totals);
+}
+
+#endif // FLEET_AVX2
+
+struct Kernels {
+    const char* name;
+    ScanKernel scan;
+    OccupancyKernel occupancy;
+};
+
+// Best first; the first one the CPU runs is used unless useKernels() picks another
+const Kernels ALL_KERNELS[] = {
+#if defined(FLEET_AVX2)
+    { "avx2", scanAvx2, occupancyAvx2 },
+#endif
+    { "scalar", scanScalar, occupancyScalar },
+};
+
+bool runnable(const Kernels& k) {
+#if defined(FLEET_AVX2)
+    if(k.scan == scanAvx2) return __builtin_cpu_supports("avx2");
+#endif
+    (void)k;
+    return true;
+}
+
+const Kernels* pickKernels() {
+    for(const Kernels &k : ALL_KERNELS) {
+        if(runnable(k)) return &k;
+    }
+    return nullptr;
+}
+
+std::atomic<const Kernels*>& active() {
+    static std::atomic<const Kernels*> chosen(pickKernels());
+    return chosen;
+}
+
+const Kernels& kernels() {
+    return *active().load(std::memory_order_relaxed);
+}
+
+} // namespace
+
+FleetColumns::Predicate::Predicate(const FleetFilter& filter)
+    : minFree(filter.minFree > 0 ? filter.minFree : 0),
+      routes(filter.routes.data()),
+      routeCount(filter.routes.size()) {
+    // An empty range is low 1, high 0; a bus with no departure time is NO_TIME
+    low[1] = 1;
+    high[1] = 0;
+    if(filter.fromMinute == NO_TIME) {
+        low[0] = NO_TIME;
+        high[0] = MINUTES_PER_DAY;
+    } else if(filter.fromMinute <= filter.toMinute) {
+        low[0] = filter.fromMinute;
+        high[0] = filter.toMinute;
+    } else {
+        low[0] = filter.fromMinute;
+        high[0] = MINUTES_PER_DAY - 1;
+        low[1] = 0;
+        high[1] = filter.toMinute;
+    }
+}
+
+void FleetColumns::append(int seats, std::uint32_t route, int departureMinute) {
+    freeCounts.emplace(seats);
+    routes.push(std::uint32_t(route));
+    departures.push(std::int32_t(departureMinute));
+    seatCounts.push(std::int32_t(seats));
+}
+
+void FleetColumns::reserve(std::size_t n) {
+    freeCounts.reserve(n);
+    routes.reserve(n);
+    departures.reserve(n);
+    seatCounts.reserve(n);
+}
+
+FleetColumns::Run FleetColumns::slab(std::size_t start) const {
+    Run run;
+    run.free = reinterpret_cast<const std::int32_t*>(&freeCounts[start]);
+    run.route = &routes[start];
+    run.departure = &departures[start];
+    run.seats = &seatCounts[start];
+    return run;
+}
+
+std::size_t FleetColumns::scanRun(const Run& run, std::size_t n, const Predicate& predicate, std::uint16_t* hits) {
+    return kernels().scan(run, n, predicate, hits);
+}
+
+std::size_t FleetColumns::count(const FleetFilter& filter, std::size_t rows) const {
+    const Predicate predicate(filter);
+    std::size_t found = 0;
+    for(std::size_t start = 0; start < rows; start += SLAB_ROWS) {
+        found += scanRun(slab(start), rows - start < SLAB_ROWS ? rows - start : SLAB_ROWS, predicate, nullptr);
+    }
+    return found;
+}
+
+FleetOccupancy FleetColumns::occupancy(std::size_t rows) const {
+    FleetOccupancy totals;
+    totals.buses = rows;
+    const OccupancyKernel kernel = kernels().occupancy;
+    for(std::size_t start = 0; start < rows; start += SLAB_ROWS) {
+        kernel(slab(start), rows - start < SLAB_ROWS ? rows - start : SLAB_ROWS, totals);
+    }
+    return totals;
+}
+
+const char* FleetColumns::kernelName() {
+    return kernels().name;
+}
+
+std::vector<const char*> FleetColumns::kernelNames() {
+    std::vector<const char*> names;
+    for(const Kernels &k : ALL_KERNELS) {
+        if(runnable(k)) names.push_back(k.name);
+    }
+    return names;
+}
+
+bool FleetColumns::useKernels(const char* name) {
+    for(const Kernels &k : ALL_KERNELS) {
+        if(runnable(k) && std::strcmp(k.name, name) == 0) {
+            active().store(&k, std::memory_order_relaxed);
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,181 @@
+#ifndef BOOKING_FLEETCOLUMNS_H
+#define BOOKING_FLEETCOLUMNS_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+#include "Calendar.h"
+#include "SlabStore.h"
+
+/**
+ * @file FleetColumns.h
+ * @brief Per-bus availability, route and departure columns, scanned with SIMD kernels.
+ */
+
+/**
+ * @struct FleetFilter
+ * @brief Which buses a fleet scan matches; every condition given must hold.
+ */
+struct FleetFilter {
+    int minFree = 0;                         /**< Fewest empty seats a bus may have. */
+    std::vector<std::uint32_t> routes;       /**< Route ids, any of which matches; empty for every route. */
+    int fromMinute = NO_TIME;                /**< Earliest departure, or NO_TIME for no departure window. */
+    int toMinute = NO_TIME;                  /**< Latest departure, inclusive; before fromMinute wraps past midnight. */
+};
+
+/**
+ * @struct FleetOccupancy
+ * @brief Seat totals over the whole fleet, from one scan of the columns.
+ */
+struct FleetOccupancy {
+    std::size_t buses = 0;      /**< Buses scanned. */
+    std::int64_t seats = 0;     /**< Seats on them. */
+    std::int64_t freeSeats = 0; /**< Of those, empty (neither reserved nor held). */
+    std::size_t soldOut = 0;    /**< Buses with no empty seat. */
+    std::size_t unsold = 0;     /**< Buses with every seat empty. */
+};
+
+/**
+ * @class FleetColumns
+ * @brief The fields fleet-wide filters read, one column per field, indexed by bus handle.
+ *
+ * Walking Bus objects to filter the whole fleet pulls a full bus into cache per row to
+ * read a few bytes of it. Here each field the filters test is a column of 32-bit values
+ * instead: empty seats, route id, departure minute and seat count. A scan streams only the
+ * columns it needs and tests several rows per instruction: eight with AVX2 on x86-64 CPUs
+ * that have it (checked once at run time), and one at a time elsewhere. BookingBenchmark
+ * --check runs every kernel the CPU supports against a plain loop.
+ *
+ * Each column is a SlabStore, so rows never move and lock-free readers may scan while
+ * buses are appended; within a slab the rows are contiguous, and the kernels run over one
+ * slab at a time. The same rules as SlabStore apply: the owner serialises append(), and a
+ * reader without the owner's lock holds an Epoch::Guard and scans only the rows the owner
+ * has published.
+ *
+ * The empty-seat counts are atomics updated by every reserve and cancel. Scans read them
+ * with plain vector loads, which on these targets never tear a single aligned counter, so
+ * a scan sees each bus's count as it stood at some moment during the scan, like a relaxed
+ * load would.
+ */
+class FleetColumns {
+public:
+    static const std::size_t SHIFT = 12;                            /**< Log2 of rows per slab. */
+    static const std::size_t SLAB_ROWS = std::size_t(1) << SHIFT;  /**< Rows per slab, scanned as one run. */
+
+    /**
+     * @brief Append a row for the next bus handle.
+     *
+     * @param seats Seats on the bus, all of them empty to start with.
+     * @param route Route id of the bus.
+     * @param departureMinute Departure in minutes since midnight, or NO_TIME.
+     */
+    void append(int seats, std::uint32_t route, int departureMinute);
+
+    /**
+     * @brief Allocate slabs up front for a total of n rows.
+     */
+    void reserve(std::size_t n);
+
+    /**
+     * @brief Empty-seat counter of a row.
+     */
+    std::atomic<std::int32_t>& freeSeats(std::size_t row) { return freeCounts[row]; }
+    const std::atomic<std::int32_t>& freeSeats(std::size_t row) const { return freeCounts[row]; }
+
+    /**
+     * @brief Route id of a row.
+     */
+    std::uint32_t route(std::size_t row) const { return routes[row]; }
+
+    /**
+     * @brief Call fn(row) for every row below rows that matches filter, in row order.
+     *
+     * @return std::size_t The number of rows passed to fn.
+     */
+    template <typename Fn>
+    std::size_t select(const FleetFilter& filter, std::size_t rows, Fn fn) const {
+        const Predicate predicate(filter);
+        std::uint16_t hits[SLAB_ROWS];
+        std::size_t found = 0;
+        for(std::size_t start = 0; start < rows; start += SLAB_ROWS) {
+            const std::size_t n = rows - start < SLAB_ROWS ? rows - start : SLAB_ROWS;
+            const std::size_t k = scanRun(slab(start), n, predicate, hits);
+            for(std::size_t i = 0; i < k; ++i) fn(start + hits[i]);
+            found += k;
+        }
+        return found;
+    }
+
+    /**
+     * @brief Number of rows below rows that match filter.
+     */
+    std::size_t count(const FleetFilter& filter, std::size_t rows) const;
+
+    /**
+     * @brief Seat totals over the rows below rows.
+     */
+    FleetOccupancy occupancy(std::size_t rows) const;
+
+    /**
+     * @brief Name of the kernels in use: "avx2" or "scalar".
+     */
+    static const char* kernelName();
+
+    /**
+     * @brief Names of the kernels this build has and this CPU runs, the default first.
+     */
+    static std::vector<const char*> kernelNames();
+
+    /**
+     * @brief Switch every FleetColumns to the named kernels, for checking them against
+     *        each other. Not safe while any scan is running.
+     *
+     * @return false If the kernels are not among kernelNames(); nothing changes.
+     */
+    static bool useKernels(const char* name);
+
+    /**
+     * @brief One slab's worth of each column, starting at the same row.
+     */
+    struct Run {
+        const std::int32_t* free;
+        const std::uint32_t* route;
+        const std::int32_t* departure;
+        const std::int32_t* seats;
+    };
+
+    /**
+     * @brief A FleetFilter flattened for the kernels: the departure window as two
+     *        inclusive ranges, either of which matches.
+     */
+    struct Predicate {
+        std::int32_t minFree;
+        std::int32_t low[2];
+        std::int32_t high[2];
+        const std::uint32_t* routes;
+        std::size_t routeCount;
+
+        explicit Predicate(const FleetFilter& filter);
+    };
+
+private:
+    SlabStore<std::atomic<std::int32_t>, SHIFT> freeCounts;  /**< Empty seats per row. */
+    SlabStore<std::uint32_t, SHIFT> routes;                  /**< Route id per row. */
+    SlabStore<std::int32_t, SHIFT> departures;               /**< Departure minute per row, or NO_TIME. */
+    SlabStore<std::int32_t, SHIFT> seatCounts;               /**< Seats per row. */
+
+    /**
+     * @brief The columns from row start, which must begin a slab, to the end of its slab.
+     */
+    Run slab(std::size_t start) const;
+
+    /**
+     * @brief Write the offsets of the first n rows of run that match into hits, in order,
+     *        and return how many there were; hits may be null to only count them.
+     */
+    static std::size_t scanRun(const Run& run, std::size_t n, const Predicate& predicate, std::uint16_t* hits);
+};
+
+#endif // BOOKING_FLEETCOLUMNS_H
@@ -0,0 +1,50 @@
+// HoldTable.cpp
+
+#include "HoldTable.h"
+
+HoldTable::Id HoldTable::add(std::uint32_t bus, SeatMask seats, std::uint64_t expiry) {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::uint32_t index;
+    if(!freeRecords.empty()) {
+        index = freeRecords.back();
+        freeRecords.pop_back();
+    } else {
+        index = static_cast<std::uint32_t>(records.size());
+        records.push_back(Record{ Hold{ 0, 0 }, 1 });
+    }
+    Record &r = records[index];
+    r.hold.bus = bus;
+    r.hold.seats = seats;
+    timers.schedule(index, expiry);
+    return (static_cast<Id>(r.generation) << 32) | index;
+}
+
+bool HoldTable::take(Id id, Hold& hold) {
+    const std::uint32_t index = static_cast<std::uint32_t>(id);
+    const std::uint32_t generation = static_cast<std::uint32_t>(id >> 32);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if(index >= records.size()) return false;
+    const Record &r = records[index];
+    if(r.generation != generation || r.hold.seats == 0) return false;
+    timers.cancel(index);
+    hold = release(index);
+    return true;
+}
+
+void HoldTable::expire(std::uint64_t now, std::vector<Hold>& expired) {
+    expired.clear();
+    std::lock_guard<std::mutex> lock(mutex);
+    if(now <= timers.now()) return;
+    timers.advance(now, [&](std::uint32_t index) { expired.push_back(release(index)); });
+}
+
+HoldTable::Hold HoldTable::release(std::uint32_t index) {
+    Record &r = records[index];
+    const Hold hold = r.hold;
+    r.hold.seats = 0;
+    // Generation 0 is skipped so that no id is ever npos
+    if(++r.generation == 0) r.generation = 1;
+    freeRecords.push_back(index);
+    return hold;
+}
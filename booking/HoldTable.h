@@ -0,0 +1,93 @@
+#ifndef BOOKING_HOLDTABLE_H
+#define BOOKING_HOLDTABLE_H
+
+#include <vector>
+#include <mutex>
+#include <cstdint>
+#include <cstddef>
+
+#include "SeatLayout.h"
+#include "TimerWheel.h"
+
+/**
+ * @file HoldTable.h
+ * @brief Outstanding seat holds and the timer wheel that expires them.
+ */
+
+/**
+ * @class HoldTable
+ * @brief Temporary claims on seats, each with a deadline, addressed by versioned ids.
+ *
+ * A hold records which seats of which bus it keeps; the seats themselves are marked held
+ * in the bus by the registry. Records are recycled through a free list, and an id carries
+ * the record's generation, so an id that was confirmed, released or expired never matches
+ * the record's next use. Deadlines live in a TimerWheel, so expiring holds costs the same
+ * per tick whether thousands or millions are outstanding.
+ *
+ * The table is safe to use from many threads, with its own lock. The registry never calls
+ * in while holding a bus lock, and never takes one while the table is locked.
+ */
+class HoldTable {
+public:
+    typedef std::uint64_t Id;  /**< Hold id: generation in the high half, record in the low half. */
+    static const Id npos = 0;  /**< "No hold"; generations start at 1, so no id is 0. */
+
+    /**
+     * @struct Hold
+     * @brief The seats one hold keeps.
+     */
+    struct Hold {
+        std::uint32_t bus;  /**< Registry handle. */
+        SeatMask seats;     /**< Held seats; never 0 for a live hold. */
+    };
+
+    /**
+     * @brief Record a new hold that expires at a tick.
+     */
+    Id add(std::uint32_t bus, SeatMask seats, std::uint64_t expiry);
+
+    /**
+     * @brief Remove a live hold before it expires, e.g. to confirm or release it.
+     *
+     * @param hold Receives what the hold kept.
+     * @return false If the id is not a live hold.
+     */
+    bool take(Id id, Hold& hold);
+
+    /**
+     * @brief Remove every hold expiring by a tick.
+     *
+     * @param now The current tick; must not go backwards.
+     * @param expired Receives each expired hold; cleared first.
+     */
+    void expire(std::uint64_t now, std::vector<Hold>& expired);
+
+    /**
+     * @brief Number of live holds.
+     */
+    std::size_t size() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return timers.size();
+    }
+
+private:
+    /**
+     * @brief One hold. A record with seats == 0 is free.
+     */
+    struct Record {
+        Hold hold;
+        std::uint32_t generation;  /**< Bumped every time the record is freed. */
+    };
+
+    std::vector<Record> records;             /**< Indexed by the low half of an id. */
+    std::vector<std::uint32_t> freeRecords;  /**< Free record indices. */
+    TimerWheel timers;                       /**< Deadline of every live record, by index. */
+    mutable std::mutex mutex;                /**< Guards everything above. */
+
+    /**
+     * @brief Free a record and return what it kept.
+     */
+    Hold release(std::uint32_t index);
+};
+
+#endif // BOOKING_HOLDTABLE_H
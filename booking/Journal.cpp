@@ -0,0 +1,566 @@
+// Journal.cpp
+
+#include "Journal.h"
+#include "FileUtil.h"
+#include "Metrics.h"
+
+#include <vector>
+#include <chrono>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+namespace {
+
+/**
+ * @brief CRC-32 (IEEE 802.3) lookup table, built on first use.
+ */
+const std::uint32_t* crcTable() {
+    static std::uint32_t table[256];
+    static std::once_flag built;
+    std::call_once(built, []() {
+        for(std::uint32_t i = 0; i < 256; ++i) {
+            std::uint32_t c = i;
+            for(int k = 0; k < 8; ++k) c = (c & 1u) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            table[i] = c;
+        }
+    });
+    return table;
+}
+
+std::uint32_t crc32(const char* data, std::size_t size) {
+    const std::uint32_t* table = crcTable();
+    std::uint32_t c = 0xFFFFFFFFu;
+    for(std::size_t i = 0; i < size; ++i) {
+        c = table[(c ^ static_cast<unsigned char>(data[i])) & 0xFFu] ^ (c >> 8);
+    }
+    return c ^ 0xFFFFFFFFu;
+}
+
+void putU32(std::string& out, std::uint32_t v) {
+    for(int i = 0; i < 4; ++i) out.push_back(static_cast<char>((v >> (8 * i)) & 0xFFu));
+}
+
+std::uint32_t getU32(const char* p) {
+    std::uint32_t v = 0;
+    for(int i = 0; i < 4; ++i) v |= static_cast<std::uint32_t>(static_cast<unsigned char>(p[i])) << (8 * i);
+    return v;
+}
+
+void putU64(std::string& out, std::uint64_t v) {
+    putU32(out, static_cast<std::uint32_t>(v));
+    putU32(out, static_cast<std::uint32_t>(v >> 32));
+}
+
+std::uint64_t getU64(const char* p) {
+    return getU32(p) | (static_cast<std::uint64_t>(getU32(p + 4)) << 32);
+}
+
+// Callers refuse longer strings before anything is journaled; cutting one here would
+// replay as a different key
+void putString(std::string& out, const std::string& s) {
+    std::size_t n = s.size() > Journal::MAX_STRING ? Journal::MAX_STRING : s.size();
+    out.push_back(static_cast<char>(n & 0xFFu));
+    out.push_back(static_cast<char>(n >> 8));
+    out.append(s, 0, n);
+}
+
+/**
+ * @brief Bounds-checked reader over one record payload.
+ */
+struct Reader {
+    const char* p;
+    const char* end;
+
+    bool getString(std::string& s) {
+        if(end - p < 2) return false;
+        std::size_t n = static_cast<unsigned char>(p[0]) | (static_cast<std::size_t>(static_cast<unsigned char>(p[1])) << 8);
+        p += 2;
+        if(static_cast<std::size_t>(end - p) < n) return false;
+        s.assign(p, n);
+        p += n;
+        return true;
+    }
+
+    bool getSeat(int& seat) {
+        if(end - p < 1) return false;
+        seat = static_cast<unsigned char>(*p++);
+        return true;
+    }
+
+    bool getDate(ServiceDate& date) {
+        if(end - p < 4) return false;
+        date = static_cast<ServiceDate>(getU32(p));
+        p += 4;
+        return true;
+    }
+};
+
+/**
+ * @brief Start a framed record: reserve the length field and write the type byte.
+ */
+void beginRecord(std::string& out, JournalRecordType type) {
+    out.assign(4, '\0');
+    out.push_back(static_cast<char>(type));
+}
+
+/**
+ * @brief Finish a framed record: fill in the length field and append the CRC.
+ */
+void endRecord(std::string& out) {
+    const std::uint32_t length = static_cast<std::uint32_t>(out.size() - 4);
+    for(int i = 0; i < 4; ++i) out[i] = static_cast<char>((length >> (8 * i)) & 0xFFu);
+    putU32(out, crc32(out.data() + 4, length));
+}
+
+} // namespace
+
+Journal::Journal()
+    : fd(-1), appended(0), durable(0), flushes(0), fileBytes(0), totalBytes(0), currentEpoch(0),
+      compacted(false), previousEpoch(0), previousKeepFrom(0), previousHeaderBytes(0), failed(false),
+      stopping(false), paused(false), flushing(false)
+{
+}
+
+Journal::~Journal() {
+    close();
+}
+
+bool Journal::open(const std::string& journalPath, std::uint64_t validBytes, std::uint64_t epoch) {
+    close();
+
+    fd = ::open(journalPath.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if(fd < 0) return false;
+    bool ok = ::ftruncate(fd, static_cast<off_t>(validBytes)) == 0;
+    if(ok && validBytes == 0) {
+        std::string header;
+        encodeEpoch(epoch, header);
+        ok = writeAll(fd, header.data(), header.size()) && syncData(fd) && syncDirectoryOf(journalPath);
+        validBytes = header.size();
+    }
+    if(!ok) {
+        ::close(fd);
+        fd = -1;
+        return false;
+    }
+
+    path = journalPath;
+    appended = durable = flushes = 0;
+    fileBytes = totalBytes = validBytes;
+    currentEpoch = epoch;
+    compacted = failed = stopping = paused = flushing = false;
+    flusher = std::thread(&Journal::flushLoop, this);
+    return true;
+}
+
+void Journal::close() {
+    if(flusher.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_one();
+        flushed.notify_all();
+        flusher.join();
+    }
+    if(fd >= 0) {
+        ::close(fd);
+        fd = -1;
+    }
+}
+
+std::uint64_t Journal::append(const std::string& record) {
+    std::uint64_t sequence;
+    bool first;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        first = pending.empty();
+        pending += record;
+        totalBytes += record.size();
+        sequence = ++appended;
+    }
+    // Only the record that starts a batch needs to wake the flusher
+    if(first) wake.notify_one();
+    return sequence;
+}
+
+bool Journal::sync(std::uint64_t sequence) {
+    std::unique_lock<std::mutex> lock(mutex);
+    flushed.wait(lock, [&]() { return durable >= sequence || failed; });
+    return !failed;
+}
+
+std::uint64_t Journal::flushCount() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return flushes;
+}
+
+void Journal::position(std::uint64_t& bytes, std::uint64_t& sequence) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    bytes = totalBytes;
+    sequence = appended;
+}
+
+std::uint64_t Journal::epoch() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return currentEpoch;
+}
+
+bool Journal::compact(std::uint64_t keepFrom, std::uint64_t sequence, std::uint64_t newEpoch) {
+    if(!sync(sequence)) return false;
+
+    std::unique_lock<std::mutex> lock(mutex);
+    paused = true;
+    flushed.wait(lock, [&]() { return !flushing; });
+
+    // The file now holds exactly fileBytes bytes, which includes everything up to keepFrom
+    std::string rewritten;
+    encodeEpoch(newEpoch, rewritten);
+    const std::uint64_t headerBytes = rewritten.size();
+    bool ok = !failed && keepFrom <= fileBytes;
+    if(ok) {
+        rewritten.resize(headerBytes + (fileBytes - keepFrom));
+        int in = ::open(path.c_str(), O_RDONLY);
+        ok = in >= 0 &&
+             ::pread(in, &rewritten[headerBytes], fileBytes - keepFrom, static_cast<off_t>(keepFrom)) ==
+                 static_cast<ssize_t>(fileBytes - keepFrom);
+        if(in >= 0) ::close(in);
+    }
+
+    const std::string tmpPath = path + ".tmp";
+    int out = -1;
+    if(ok) {
+        out = ::open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+        ok = out >= 0 && writeAll(out, rewritten.data(), rewritten.size()) && syncData(out) &&
+             ::rename(tmpPath.c_str(), path.c_str()) == 0 && syncDirectoryOf(path);
+    }
+
+    if(ok) {
+        ::close(fd);
+        fd = out;
+        compacted = true;
+        previousEpoch = currentEpoch;
+        previousKeepFrom = keepFrom;
+        previousHeaderBytes = headerBytes;
+        fileBytes = rewritten.size();
+        totalBytes = fileBytes + pending.size();
+        currentEpoch = newEpoch;
+    } else if(out >= 0) {
+        ::close(out);
+        ::unlink(tmpPath.c_str());
+    }
+
+    paused = false;
+    lock.unlock();
+    wake.notify_one();
+    flushed.notify_all();  // tails carry their positions over while the previous epoch is known
+    return ok;
+}
+
+JournalTail Journal::tail(std::uint64_t& epoch, std::uint64_t& offset, std::uint64_t& end, int& reader,
+                          int timeoutMs) {
+    const std::chrono::steady_clock::time_point deadline =
+        std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+    std::unique_lock<std::mutex> lock(mutex);
+    while(true) {
+        if(failed || stopping) return JournalTail::Closed;
+        if(epoch != currentEpoch) {
+            if(!compacted || epoch != previousEpoch || offset < previousKeepFrom) return JournalTail::Lost;
+            offset = offset - previousKeepFrom + previousHeaderBytes;
+            epoch = currentEpoch;
+            // The reader still has the file of the previous epoch open
+            if(reader >= 0) ::close(reader);
+            reader = -1;
+        }
+        if(offset > totalBytes) return JournalTail::Lost;
+        if(fileBytes > offset) break;
+        if(flushed.wait_until(lock, deadline) == std::cv_status::timeout && fileBytes <= offset) {
+            return JournalTail::Timeout;
+        }
+    }
+
+    // Renames happen under the lock, so the path names the file of this epoch
+    if(reader < 0) {
+        reader = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if(reader < 0) return JournalTail::Closed;
+    }
+    end = fileBytes;
+    return JournalTail::Ready;
+}
+
+void Journal::flushLoop() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while(true) {
+        wake.wait(lock, [&]() { return (stopping || !pending.empty()) && !paused; });
+        if(pending.empty()) break;  // stopping, and nothing left to flush
+
+        // Take the whole batch; bookers keep appending to the fresh buffer meanwhile
+        writing.swap(pending);
+        const std::uint64_t batchEnd = appended;
+        flushing = true;
+        lock.unlock();
+
+        bool ok;
+        {
+            ScopedTimer timer(Timer::JournalFlush);
+            ok = writeAll(fd, writing.data(), writing.size()) && syncData(fd);
+        }
+        const std::uint64_t written = writing.size();
+        writing.clear();
+        Metrics::count(Counter::JournalFlushes);
+        Metrics::count(Counter::JournalBytes, written);
+
+        lock.lock();
+        if(!ok) failed = true;
+        flushing = false;
+        fileBytes += written;
+        durable = batchEnd;
+        ++flushes;
+        flushed.notify_all();
+    }
+}
+
+void Journal::encodeInstall(const BusInfo& bus, std::string& out) {
+    beginRecord(out, JournalRecordType::Install);
+    putString(out, bus.busNumber);
+    putString(out, bus.driverName);
+    putString(out, bus.arrivalTime);
+    putString(out, bus.departureTime);
+    putString(out, bus.from);
+    putString(out, bus.to);
+    out.push_back(static_cast<char>(bus.layout));
+    for(std::int32_t base : bus.fares.base) putU32(out, static_cast<std::uint32_t>(base));
+    endRecord(out);
+}
+
+void Journal::encodeReserve(const std::string& busNumber, int seatNumber,
+                            const std::string& passenger, std::string& out) {
+    beginRecord(out, JournalRecordType::Reserve);
+    putString(out, busNumber);
+    out.push_back(static_cast<char>(seatNumber));
+    putString(out, passenger);
+    endRecord(out);
+}
+
+void Journal::encodeCancel(const std::string& busNumber, int seatNumber, std::string& out) {
+    beginRecord(out, JournalRecordType::Cancel);
+    putString(out, busNumber);
+    out.push_back(static_cast<char>(seatNumber));
+    endRecord(out);
+}
+
+void Journal::encodeReserveSeats(const std::string& busNumber, const int* seatNumbers, int count,
+                                 const std::string& passenger, std::string& out) {
+    beginRecord(out, JournalRecordType::ReserveSeats);
+    putString(out, busNumber);
+    putString(out, passenger);
+    out.push_back(static_cast<char>(count));
+    for(int i = 0; i < count; ++i) out.push_back(static_cast<char>(seatNumbers ? seatNumbers[i] : 0));
+    endRecord(out);
+}
+
+void Journal::encodeCancelSeats(const std::string& busNumber, const int* seatNumbers, int count,
+                                std::string& out) {
+    beginRecord(out, JournalRecordType::CancelSeats);
+    putString(out, busNumber);
+    out.push_back(static_cast<char>(count));
+    for(int i = 0; i < count; ++i) out.push_back(static_cast<char>(seatNumbers[i]));
+    endRecord(out);
+}
+
+void Journal::fillSeats(const int* seatNumbers, int count, std::string& record) {
+    // The seats are the last bytes of the payload, just before the CRC
+    const std::size_t seatsAt = record.size() - 4 - count;
+    for(int i = 0; i < count; ++i) record[seatsAt + i] = static_cast<char>(seatNumbers[i]);
+    record.resize(record.size() - 4);
+    endRecord(record);
+}
+
+void Journal::encodeSchedule(const std::string& busNumber, ServiceDate first, ServiceDate last,
+                             std::uint8_t weekdays, std::string& out) {
+    beginRecord(out, JournalRecordType::Schedule);
+    putString(out, busNumber);
+    putU32(out, static_cast<std::uint32_t>(first));
+    putU32(out, static_cast<std::uint32_t>(last));
+    out.push_back(static_cast<char>(weekdays));
+    endRecord(out);
+}
+
+void Journal::encodeReserveTrip(const std::string& busNumber, ServiceDate date, int seatNumber,
+                                const std::string& passenger, std::string& out) {
+    beginRecord(out, JournalRecordType::ReserveTrip);
+    putString(out, busNumber);
+    putU32(out, static_cast<std::uint32_t>(date));
+    out.push_back(static_cast<char>(seatNumber));
+    putString(out, passenger);
+    endRecord(out);
+}
+
+void Journal::encodeCancelTrip(const std::string& busNumber, ServiceDate date, int seatNumber,
+                               std::string& out) {
+    beginRecord(out, JournalRecordType::CancelTrip);
+    putString(out, busNumber);
+    putU32(out, static_cast<std::uint32_t>(date));
+    out.push_back(static_cast<char>(seatNumber));
+    endRecord(out);
+}
+
+void Journal::encodeEpoch(std::uint64_t epoch, std::string& out) {
+    beginRecord(out, JournalRecordType::Epoch);
+    putU32(out, static_cast<std::uint32_t>(epoch));
+    putU32(out, static_cast<std::uint32_t>(epoch >> 32));
+    endRecord(out);
+}
+
+void Journal::encodeReplicated(std::uint64_t epoch, std::uint64_t offset, const char* records, std::size_t size,
+                               std::string& out) {
+    beginRecord(out, JournalRecordType::Replicated);
+    putU64(out, epoch);
+    putU64(out, offset);
+    if(size) out.append(records, size);
+    endRecord(out);
+}
+
+std::size_t Journal::wholeRecords(const char* data, std::size_t size) {
+    std::size_t offset = 0;
+    while(size - offset >= 4) {
+        const std::uint64_t frame = 4 + static_cast<std::uint64_t>(getU32(data + offset)) + 4;
+        if(frame > size - offset) break;
+        offset += frame;
+    }
+    return offset;
+}
+
+bool Journal::replay(const std::string& path,
+                     const std::function<void(const JournalRecord&)>& apply,
+                     std::uint64_t& validBytes) {
+    validBytes = 0;
+    int in = ::open(path.c_str(), O_RDONLY);
+    if(in < 0) return errno == ENOENT;
+
+    std::vector<char> data;
+    char chunk[1 << 16];
+    while(true) {
+        ssize_t n = ::read(in, chunk, sizeof(chunk));
+        if(n < 0) {
+            if(errno == EINTR) continue;
+            ::close(in);
+            return false;
+        }
+        if(n == 0) break;
+        data.insert(data.end(), chunk, chunk + n);
+    }
+    ::close(in);
+
+    validBytes = decode(data.data(), data.size(), apply);
+    return true;
+}
+
+std::size_t Journal::decode(const char* data, std::size_t size,
+                            const std::function<void(const JournalRecord&)>& apply) {
+    std::size_t offset = 0;
+    JournalRecord record;
+    while(size - offset >= 4) {
+        const char* frame = data + offset;
+        const std::uint32_t length = getU32(frame);
+        if(length == 0 || size - offset - 4 < static_cast<std::size_t>(length) + 4) break;
+        if(crc32(frame + 4, length) != getU32(frame + 4 + length)) break;
+
+        Reader reader = { frame + 5, frame + 4 + length };
+        record.type = static_cast<JournalRecordType>(frame[4]);
+        record.bus = BusInfo();
+        record.seatNumber = 0;
+        record.passenger.clear();
+        record.seatNumbers.clear();
+        record.epoch = 0;
+        record.sourceOffset = 0;
+        record.records = nullptr;
+        record.recordBytes = 0;
+        record.date = 0;
+        record.lastDate = 0;
+        record.weekdays = 0;
+        record.offset = offset;
+
+        bool ok;
+        switch(record.type) {
+            case JournalRecordType::Install:
+                ok = reader.getString(record.bus.busNumber) && reader.getString(record.bus.driverName) &&
+                     reader.getString(record.bus.arrivalTime) && reader.getString(record.bus.departureTime) &&
+                     reader.getString(record.bus.from) && reader.getString(record.bus.to);
+                ok = ok && reader.end - reader.p >= 1 + 4 * FARE_CLASS_COUNT;
+                if(ok) {
+                    record.bus.layout = static_cast<LayoutKind>(*reader.p++);
+                    for(std::int32_t &base : record.bus.fares.base) {
+                        base = static_cast<std::int32_t>(getU32(reader.p));
+                        reader.p += 4;
+                    }
+                }
+                break;
+            case JournalRecordType::Reserve:
+                ok = reader.getString(record.bus.busNumber) && reader.getSeat(record.seatNumber) &&
+                     reader.getString(record.passenger);
+                break;
+            case JournalRecordType::Cancel:
+                ok = reader.getString(record.bus.busNumber) && reader.getSeat(record.seatNumber);
+                break;
+            case JournalRecordType::ReserveSeats: {
+                int count = 0;
+                ok = reader.getString(record.bus.busNumber) && reader.getString(record.passenger) &&
+                     reader.getSeat(count);
+                for(int i = 0; ok && i < count; ++i) {
+                    int seatNumber = 0;
+                    ok = reader.getSeat(seatNumber);
+                    record.seatNumbers.push_back(seatNumber);
+                }
+                break;
+            }
+            case JournalRecordType::CancelSeats: {
+                int count = 0;
+                ok = reader.getString(record.bus.busNumber) && reader.getSeat(count);
+                for(int i = 0; ok && i < count; ++i) {
+                    int seatNumber = 0;
+                    ok = reader.getSeat(seatNumber);
+                    record.seatNumbers.push_back(seatNumber);
+                }
+                break;
+            }
+            case JournalRecordType::Schedule: {
+                int weekdays = 0;
+                ok = reader.getString(record.bus.busNumber) && reader.getDate(record.date) &&
+                     reader.getDate(record.lastDate) && reader.getSeat(weekdays);
+                record.weekdays = static_cast<std::uint8_t>(weekdays);
+                break;
+            }
+            case JournalRecordType::ReserveTrip:
+                ok = reader.getString(record.bus.busNumber) && reader.getDate(record.date) &&
+                     reader.getSeat(record.seatNumber) && reader.getString(record.passenger);
+                break;
+            case JournalRecordType::CancelTrip:
+                ok = reader.getString(record.bus.busNumber) && reader.getDate(record.date) &&
+                     reader.getSeat(record.seatNumber);
+                break;
+            case JournalRecordType::Epoch:
+                ok = reader.end - reader.p >= 8;
+                if(ok) record.epoch = getU64(reader.p);
+                break;
+            case JournalRecordType::Replicated:
+                ok = reader.end - reader.p >= 16;
+                if(ok) {
+                    record.epoch = getU64(reader.p);
+                    record.sourceOffset = getU64(reader.p + 8);
+                    record.records = reader.p + 16;
+                    record.recordBytes = static_cast<std::size_t>(reader.end - reader.p - 16);
+                }
+                break;
+            default:
+                ok = false;
+                break;
+        }
+        if(!ok) break;
+
+        apply(record);
+        offset += 4 + length + 4;
+    }
+    return offset;
+}
@@ -0,0 +1,344 @@
+#ifndef BOOKING_JOURNAL_H
+#define BOOKING_JOURNAL_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+
+#include "Bus.h"
+
+/**
+ * @file Journal.h
+ * @brief Append-only binary write-ahead log of installs, reservations and cancellations.
+ *
+ * Every record is framed as
+ *
+ *     u32 length | u8 type | payload | u32 crc32
+ *
+ * where length counts the type byte and payload, and the CRC covers the same bytes. All
+ * integers are little-endian and strings are stored as a u16 length followed by the bytes.
+ * A crash can leave a torn record at the end of the file; replay stops at the first record
+ * that is short or fails its CRC, and reopening truncates the file back to that point.
+ *
+ * Every journal starts with an Epoch record. Compaction after a snapshot rewrites the file
+ * as a new Epoch record followed by the records the snapshot does not cover, so the epoch
+ * tells recovery which snapshot a journal continues from. Journals written before epochs
+ * existed have no Epoch record and count as epoch 0.
+ *
+ * A follower (see Replication.h) logs the records it receives from its primary as
+ * Replicated batches: each one holds the primary's records verbatim, with the primary's
+ * position after them, so the follower's own journal says where to resume after a crash.
+ */
+
+/**
+ * @brief Kind of change a journal record describes.
+ */
+enum class JournalRecordType : std::uint8_t {
+    Install = 1,  /**< Payload: bus number, driver, arrival, departure, from, to, u8 layout,
+                       u32 base fare per fare class. */
+    Reserve = 2,  /**< Payload: bus number, u8 seat number, passenger name. */
+    Cancel = 3,   /**< Payload: bus number, u8 seat number. */
+    Epoch = 4,    /**< Payload: u64 epoch. Always the first record of a journal. */
+    ReserveSeats = 5, /**< Payload: bus number, passenger name, u8 count, count x u8 seat number. */
+    Schedule = 6,     /**< Payload: bus number, u32 first date, u32 last date, u8 weekdays. */
+    ReserveTrip = 7,  /**< Payload: bus number, u32 date, u8 seat number, passenger name. */
+    CancelTrip = 8,   /**< Payload: bus number, u32 date, u8 seat number. */
+    CancelSeats = 9,  /**< Payload: bus number, u8 count, count x u8 seat number. */
+    Replicated = 10   /**< Payload: u64 primary epoch, u64 primary offset, then a batch of the
+                           primary's records, framed as in its journal. Written by a follower;
+                           the position is where the primary's journal stands after the batch. */
+};
+
+/**
+ * @brief Primary epoch of a Replicated record with no records that ends replication: the
+ *        follower writing it was promoted.
+ */
+const std::uint64_t NO_PRIMARY = ~std::uint64_t(0);
+
+/**
+ * @brief Outcome of Journal::tail().
+ */
+enum class JournalTail {
+    Ready,    /**< Durable records follow the position. */
+    Timeout,  /**< Nothing new arrived in time. */
+    Lost,     /**< The position is not in the journal: compacted away, or never written. */
+    Closed    /**< The journal was closed or has failed. */
+};
+
+/**
+ * @struct JournalRecord
+ * @brief A decoded journal record, as handed to the replay callback.
+ */
+struct JournalRecord {
+    JournalRecordType type;  /**< Kind of change. */
+    BusInfo bus;             /**< Bus details; only busNumber is set for Reserve and Cancel. */
+    int seatNumber;          /**< Seat number for Reserve, Cancel, ReserveTrip and CancelTrip. */
+    std::vector<int> seatNumbers; /**< Seat numbers for ReserveSeats and CancelSeats. */
+    std::string passenger;   /**< Passenger name for Reserve, ReserveSeats and ReserveTrip. */
+    ServiceDate date;        /**< Trip date, or first date for Schedule. */
+    ServiceDate lastDate;    /**< Last date for Schedule. */
+    std::uint8_t weekdays;   /**< Running days for Schedule. */
+    std::uint64_t epoch;     /**< Epoch for Epoch records; the primary's epoch for Replicated. */
+    std::uint64_t sourceOffset; /**< The primary's journal offset for Replicated. */
+    const char* records;     /**< The primary's records for Replicated; valid during the callback only. */
+    std::size_t recordBytes; /**< Length of records. */
+    std::uint64_t offset;    /**< Byte offset of the record within the journal file. */
+};
+
+class Journal;
+
+/**
+ * @struct JournalWrite
+ * @brief An encoded record waiting to be appended by the registry.
+ *
+ * The registry appends the record while it still holds the lock that guards the change,
+ * so the journal order always matches the order in which changes were applied. The caller
+ * then waits for durability with Journal::sync(sequence) after the lock is released.
+ */
+struct JournalWrite {
+    Journal* journal;           /**< Journal to append to. */
+    std::string* record;        /**< Encoded, framed record. */
+    std::uint64_t sequence;     /**< Set by the registry to the record's sequence number. */
+};
+
+/**
+ * @class Journal
+ * @brief Durable, group-committed append-only log.
+ *
+ * append() only copies the record into an in-memory batch and is cheap enough to be
+ * called under a bus lock. A background flusher thread writes each batch with a single
+ * write() and makes it durable with a single fdatasync(), so many concurrent bookers
+ * share one flush. sync() blocks until a given record is durable.
+ */
+class Journal {
+public:
+    static const std::size_t MAX_STRING = 0xFFFF;  /**< Longest string a record can hold. */
+
+    Journal();
+    ~Journal();
+
+    Journal(const Journal&) = delete;
+    Journal& operator=(const Journal&) = delete;
+
+    /**
+     * @brief Open a journal for appending and start the flusher thread.
+     *
+     * @param path Journal file; created if missing.
+     * @param validBytes Length of the valid prefix found by replay(). Anything after it
+     *        (a torn record) is truncated away.
+     * @param epoch Epoch of the existing records, or of the new journal if validBytes is 0
+     *        (in which case an Epoch record is written first).
+     * @return true On success.
+     * @return false If the file could not be opened, truncated or initialised.
+     */
+    bool open(const std::string& path, std::uint64_t validBytes, std::uint64_t epoch);
+
+    /**
+     * @brief Flush everything appended so far, stop the flusher and close the file.
+     */
+    void close();
+
+    /**
+     * @brief Queue an encoded record for the next group commit.
+     *
+     * @param record A record produced by one of the encode functions.
+     * @return std::uint64_t The record's sequence number, for sync().
+     */
+    std::uint64_t append(const std::string& record);
+
+    /**
+     * @brief Wait until a record, and every record before it, is durable.
+     *
+     * @param sequence A sequence number returned by append().
+     * @return true If the record is on stable storage.
+     * @return false If a write or flush failed.
+     */
+    bool sync(std::uint64_t sequence);
+
+    /**
+     * @brief Number of group commits (write + fdatasync pairs) performed so far.
+     */
+    std::uint64_t flushCount() const;
+
+    /**
+     * @brief Position of the journal once everything appended so far is written.
+     *
+     * @param bytes Receives the journal length in bytes, counting pending records.
+     * @param sequence Receives the sequence number of the last appended record.
+     */
+    void position(std::uint64_t& bytes, std::uint64_t& sequence) const;
+
+    /**
+     * @brief Epoch of the current journal file.
+     */
+    std::uint64_t epoch() const;
+
+    /**
+     * @brief Drop the records a snapshot has made redundant.
+     *
+     * Waits until record sequence is durable, then atomically replaces the file with an
+     * Epoch record for newEpoch followed by every byte from keepFrom onwards. Appends
+     * block while the (short) tail is copied; pending records go to the new file.
+     *
+     * @param keepFrom Byte offset of the first record to keep, from position().
+     * @param sequence Sequence number returned by position() together with keepFrom.
+     * @param newEpoch Epoch of the compacted journal.
+     * @return true On success. On failure the journal is left unchanged.
+     */
+    bool compact(std::uint64_t keepFrom, std::uint64_t sequence, std::uint64_t newEpoch);
+
+    /**
+     * @brief Wait for durable records after a position, to ship them to a follower.
+     *
+     * A position is an epoch and a byte offset into the file of that epoch. A position in
+     * the file the last compaction replaced is carried over to the compacted file if every
+     * record after it was kept. Only durable bytes are ever reported, so a follower never
+     * holds a record the journal could still lose.
+     *
+     * @param epoch Epoch of the position; updated if it was carried over.
+     * @param offset Offset of the position; updated likewise.
+     * @param end Receives the durable length of the file, past offset, when Ready.
+     * @param reader A read-only descriptor of the file for pread(), or -1. It is closed when
+     *        the position is carried over, and when Ready it is open on the current file.
+     * @param timeoutMs Longest wait for new records.
+     */
+    JournalTail tail(std::uint64_t& epoch, std::uint64_t& offset, std::uint64_t& end, int& reader, int timeoutMs);
+
+    /**
+     * @brief Encode an install record into out, replacing its contents.
+     */
+    static void encodeInstall(const BusInfo& bus, std::string& out);
+
+    /**
+     * @brief Encode a reserve record into out, replacing its contents.
+     */
+    static void encodeReserve(const std::string& busNumber, int seatNumber,
+                              const std::string& passenger, std::string& out);
+
+    /**
+     * @brief Encode a cancel record into out, replacing its contents.
+     */
+    static void encodeCancel(const std::string& busNumber, int seatNumber, std::string& out);
+
+    /**
+     * @brief Encode a multi-seat reserve record into out, replacing its contents.
+     *
+     * @param seatNumbers The seats, or null to leave count placeholders for fillSeats().
+     */
+    static void encodeReserveSeats(const std::string& busNumber, const int* seatNumbers, int count,
+                                   const std::string& passenger, std::string& out);
+
+    /**
+     * @brief Encode a multi-seat cancel record into out, replacing its contents.
+     */
+    static void encodeCancelSeats(const std::string& busNumber, const int* seatNumbers, int count,
+                                  std::string& out);
+
+    /**
+     * @brief Fill in the seats of a record from encodeReserveSeats() and refresh its CRC.
+     *
+     * @param count Must match the count the record was encoded with.
+     */
+    static void fillSeats(const int* seatNumbers, int count, std::string& record);
+
+    /**
+     * @brief Encode a service window record into out, replacing its contents.
+     */
+    static void encodeSchedule(const std::string& busNumber, ServiceDate first, ServiceDate last,
+                               std::uint8_t weekdays, std::string& out);
+
+    /**
+     * @brief Encode a dated reserve record into out, replacing its contents.
+     */
+    static void encodeReserveTrip(const std::string& busNumber, ServiceDate date, int seatNumber,
+                                  const std::string& passenger, std::string& out);
+
+    /**
+     * @brief Encode a dated cancel record into out, replacing its contents.
+     */
+    static void encodeCancelTrip(const std::string& busNumber, ServiceDate date, int seatNumber,
+                                 std::string& out);
+
+    /**
+     * @brief Encode an epoch record into out, replacing its contents.
+     */
+    static void encodeEpoch(std::uint64_t epoch, std::string& out);
+
+    /**
+     * @brief Encode a replicated batch into out, replacing its contents.
+     *
+     * @param epoch The primary's epoch after the batch.
+     * @param offset The primary's journal offset after the batch.
+     * @param records Whole records from the primary's journal; may be empty.
+     */
+    static void encodeReplicated(std::uint64_t epoch, std::uint64_t offset, const char* records, std::size_t size,
+                                 std::string& out);
+
+    /**
+     * @brief Call apply for every valid record in a run of framed records, in order.
+     *
+     * Decoding stops at the first record that is short, fails its CRC or cannot be
+     * decoded. Record offsets are relative to data.
+     *
+     * @return std::size_t Length of the valid prefix.
+     */
+    static std::size_t decode(const char* data, std::size_t size,
+                              const std::function<void(const JournalRecord&)>& apply);
+
+    /**
+     * @brief Length of the longest prefix of data made of whole records, judged by their
+     *        length fields alone.
+     */
+    static std::size_t wholeRecords(const char* data, std::size_t size);
+
+    /**
+     * @brief Read a journal and call apply for every valid record, in order.
+     *
+     * A missing file is treated as an empty journal.
+     *
+     * @param path Journal file.
+     * @param apply Called once per record.
+     * @param validBytes Receives the length of the valid prefix, to pass to open().
+     * @return true If the file was read (possibly ending in a torn record).
+     * @return false If the file exists but could not be read.
+     */
+    static bool replay(const std::string& path,
+                       const std::function<void(const JournalRecord&)>& apply,
+                       std::uint64_t& validBytes);
+
+private:
+    std::string path;                    /**< Journal file path. */
+    int fd;                              /**< Journal file descriptor, or -1 when closed. */
+    std::string pending;                 /**< Records appended since the last batch was taken. */
+    std::string writing;                 /**< Batch being written; kept to reuse its capacity. */
+    std::uint64_t appended;              /**< Sequence number of the last appended record. */
+    std::uint64_t durable;               /**< Sequence number of the last durable record. */
+    std::uint64_t flushes;               /**< Group commits performed. */
+    std::uint64_t fileBytes;             /**< Bytes written to the file so far. */
+    std::uint64_t totalBytes;            /**< fileBytes plus records not yet written. */
+    std::uint64_t currentEpoch;          /**< Epoch of the current file. */
+    bool compacted;                      /**< The fields below describe the last compaction. */
+    std::uint64_t previousEpoch;         /**< Epoch of the file it replaced. */
+    std::uint64_t previousKeepFrom;      /**< First byte of that file it kept. */
+    std::uint64_t previousHeaderBytes;   /**< Where the kept bytes start in the current file. */
+    bool failed;                         /**< A write or flush has failed; nothing is durable any more. */
+    bool stopping;                       /**< close() has asked the flusher to exit. */
+    bool paused;                         /**< compact() is replacing the file; do not start a batch. */
+    bool flushing;                       /**< The flusher is writing a batch outside the lock. */
+    mutable std::mutex mutex;            /**< Guards everything above except fd and writing. */
+    std::condition_variable wake;        /**< Signals the flusher that records are pending. */
+    std::condition_variable flushed;     /**< Signals waiters that durable has advanced. */
+    std::thread flusher;                 /**< Background group-commit thread. */
+
+    /**
+     * @brief Body of the flusher thread.
+     */
+    void flushLoop();
+};
+
+#endif // BOOKING_JOURNAL_H
@@ -0,0 +1,187 @@
+// Metrics.cpp
+
+#include "Metrics.h"
+
+#include <deque>
+#include <mutex>
+#include <vector>
+
+/**
+ * @brief Every block ever handed out, and those whose thread has exited.
+ */
+struct Metrics::Pool {
+    std::mutex mutex;
+    std::deque<Block> blocks;   /**< Never shrinks, so blocks stay put. */
+    std::vector<Block*> idle;
+
+    static Pool& instance() {
+        // Never destroyed: threads may still be exiting after static destruction starts
+        static Pool* pool = new Pool();
+        return *pool;
+    }
+};
+
+/**
+ * @brief A thread's claim on a block, given back when the thread exits.
+ */
+struct Metrics::Lease {
+    Block* block;
+
+    Lease() {
+        Pool &pool = Pool::instance();
+        std::lock_guard<std::mutex> lock(pool.mutex);
+        if(!pool.idle.empty()) {
+            block = pool.idle.back();
+            pool.idle.pop_back();
+        } else {
+            // Value-initialised, so every count starts at zero
+            pool.blocks.emplace_back();
+            block = &pool.blocks.back();
+        }
+    }
+
+    ~Lease() {
+        Pool &pool = Pool::instance();
+        std::lock_guard<std::mutex> lock(pool.mutex);
+        pool.idle.push_back(block);
+    }
+};
+
+Metrics::Block& Metrics::local() {
+    thread_local Lease lease;
+    return *lease.block;
+}
+
+void Metrics::collect(MetricsSnapshot& snapshot) {
+    snapshot = MetricsSnapshot();
+    Pool &pool = Pool::instance();
+    std::lock_guard<std::mutex> lock(pool.mutex);
+    for(const Block &block : pool.blocks) {
+        for(int c = 0; c < COUNTER_COUNT; ++c) snapshot.counters[c] += block.counters[c].load(std::memory_order_relaxed);
+        for(int t = 0; t < TIMER_COUNT; ++t) {
+            LatencyHistogram &histogram = snapshot.timers[t];
+            histogram.sum += block.sums[t].load(std::memory_order_relaxed);
+            for(int b = 0; b < LatencyHistogram::BUCKETS; ++b) {
+                const std::uint64_t n = block.buckets[t][b].load(std::memory_order_relaxed);
+                histogram.buckets[b] += n;
+                histogram.count += n;
+            }
+        }
+    }
+}
+
+std::uint64_t LatencyHistogram::quantile(double q) const {
+    if(count == 0) return 0;
+    // Rank of the value wanted, from 1
+    std::uint64_t rank = static_cast<std::uint64_t>(q * static_cast<double>(count) + 0.5);
+    if(rank < 1) rank = 1;
+    if(rank > count) rank = count;
+    std::uint64_t seen = 0;
+    for(int b = 0; b < BUCKETS; ++b) {
+        seen += buckets[b];
+        if(seen >= rank) return upperBound(b);
+    }
+    return upperBound(BUCKETS - 1);
+}
+
+namespace {
+
+const char* const TIMER_NAMES[TIMER_COUNT] = {
+    "reserve", "cancel", "lookup", "route_search", "bus_lock_wait", "journal_flush", "journal_wait",
+    "fleet_scan"
+};
+
+const char* const TIMER_HELP[TIMER_COUNT] = {
+    "Latency of reserve calls, durability wait included, sampled one call in 16.",
+    "Latency of cancel calls, durability wait included, sampled one call in 16.",
+    "Latency of bus lookups by number, sampled one call in 16.",
+    "Latency of route and departure-window searches, sampled one call in 16.",
+    "Time spent waiting for a bus lock held by another thread.",
+    "Time to write and sync one journal group commit.",
+    "Time a change waited for its group commit to be durable.",
+    "Latency of fleet-wide filter and occupancy scans."
+};
+
+void appendNumber(std::string& out, std::uint64_t value) {
+    char digits[24];
+    char* p = digits + sizeof(digits);
+    do {
+        *--p = static_cast<char>('0' + value % 10);
+        value /= 10;
+    } while(value);
+    out.append(p, static_cast<std::size_t>(digits + sizeof(digits) - p));
+}
+
+/**
+ * @brief Append nanoseconds as seconds with nine decimals.
+ */
+void appendSeconds(std::string& out, std::uint64_t nanos) {
+    appendNumber(out, nanos / 1000000000u);
+    out.push_back('.');
+    const std::uint64_t fraction = nanos % 1000000000u;
+    for(std::uint64_t div = 100000000u; div; div /= 10) out.push_back(static_cast<char>('0' + fraction / div % 10));
+}
+
+void appendHeader(std::string& out, const char* name, const char* type, const char* help) {
+    out.append("# HELP ").append(name).append(" ").append(help).append("\n");
+    out.append("# TYPE ").append(name).append(" ").append(type).append("\n");
+}
+
+void appendSample(std::string& out, const char* name, const char* labels, std::uint64_t value) {
+    out.append(name);
+    if(labels) out.append("{").append(labels).append("}");
+    out.push_back(' ');
+    appendNumber(out, value);
+    out.push_back('\n');
+}
+
+} // namespace
+
+void Metrics::writePrometheus(const MetricsSnapshot& snapshot, std::string& out) {
+    appendHeader(out, "booking_reserve_total", "counter", "Reserve calls by outcome.");
+    appendSample(out, "booking_reserve_total", "outcome=\"ok\"", snapshot.counter(Counter::ReserveOk));
+    appendSample(out, "booking_reserve_total", "outcome=\"failed\"", snapshot.counter(Counter::ReserveFailed));
+    appendHeader(out, "booking_cancel_total", "counter", "Cancel calls by outcome.");
+    appendSample(out, "booking_cancel_total", "outcome=\"ok\"", snapshot.counter(Counter::CancelOk));
+    appendSample(out, "booking_cancel_total", "outcome=\"failed\"", snapshot.counter(Counter::CancelFailed));
+    appendHeader(out, "booking_bus_lock_waits_total", "counter", "Bus lock acquisitions that found the lock taken.");
+    appendSample(out, "booking_bus_lock_waits_total", nullptr, snapshot.counter(Counter::BusLockWaits));
+    appendHeader(out, "booking_journal_flushes_total", "counter", "Journal group commits written and synced.");
+    appendSample(out, "booking_journal_flushes_total", nullptr, snapshot.counter(Counter::JournalFlushes));
+    appendHeader(out, "booking_journal_bytes_total", "counter", "Bytes written by journal group commits.");
+    appendSample(out, "booking_journal_bytes_total", nullptr, snapshot.counter(Counter::JournalBytes));
+    appendHeader(out, "booking_shipped_bytes_total", "counter", "Journal bytes sent to followers.");
+    appendSample(out, "booking_shipped_bytes_total", nullptr, snapshot.counter(Counter::ShippedBytes));
+    appendHeader(out, "booking_replicated_batches_total", "counter", "Batches of the primary's records applied.");
+    appendSample(out, "booking_replicated_batches_total", nullptr, snapshot.counter(Counter::ReplicatedBatches));
+    appendHeader(out, "booking_replicated_bytes_total", "counter", "Bytes of the primary's records applied.");
+    appendSample(out, "booking_replicated_bytes_total", nullptr, snapshot.counter(Counter::ReplicatedBytes));
+
+    static const struct {
+        double q;
+        const char* label;
+    } QUANTILES[] = { { 0.5, "0.5" }, { 0.9, "0.9" }, { 0.99, "0.99" }, { 0.999, "0.999" } };
+
+    std::string name;
+    for(int t = 0; t < TIMER_COUNT; ++t) {
+        const LatencyHistogram &histogram = snapshot.timers[t];
+        name.assign("booking_").append(TIMER_NAMES[t]).append("_seconds");
+        appendHeader(out, name.c_str(), "summary", TIMER_HELP[t]);
+        for(const auto &quantile : QUANTILES) {
+            out.append(name).append("{quantile=\"").append(quantile.label).append("\"} ");
+            appendSeconds(out, histogram.quantile(quantile.q));
+            out.push_back('\n');
+        }
+        out.append(name).append("_sum ");
+        appendSeconds(out, histogram.sum);
+        out.push_back('\n');
+        out.append(name).append("_count ");
+        appendNumber(out, histogram.count);
+        out.push_back('\n');
+    }
+}
+
+void Metrics::writeGauge(std::string& out, const char* name, const char* help, std::uint64_t value) {
+    appendHeader(out, name, "gauge", help);
+    appendSample(out, name, nullptr, value);
+}
@@ -0,0 +1,229 @@
+#ifndef BOOKING_METRICS_H
+#define BOOKING_METRICS_H
+
+#include <string>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstddef>
+
+/**
+ * @file Metrics.h
+ * @brief Process-wide operation counters and latency histograms for the booking core.
+ */
+
+/**
+ * @brief Events counted by Metrics::count().
+ */
+enum class Counter : std::uint8_t {
+    ReserveOk = 0,      /**< Reserve calls that reserved their seats. */
+    ReserveFailed = 1,  /**< Reserve calls that reserved nothing. */
+    CancelOk = 2,       /**< Cancel calls that freed seats. */
+    CancelFailed = 3,   /**< Cancel calls that freed nothing. */
+    BusLockWaits = 4,   /**< Bus lock acquisitions that found the lock taken. */
+    JournalFlushes = 5, /**< Group commits written and synced. */
+    JournalBytes = 6,   /**< Bytes those group commits wrote. */
+    ShippedBytes = 7,   /**< Journal bytes a primary sent to its followers. */
+    ReplicatedBatches = 8, /**< Batches of the primary's records a follower applied. */
+    ReplicatedBytes = 9    /**< Bytes of records in those batches. */
+};
+
+const int COUNTER_COUNT = 10;  /**< Number of Counter values. */
+
+/**
+ * @brief Latencies recorded by Metrics::record().
+ */
+enum class Timer : std::uint8_t {
+    Reserve = 0,       /**< A reserve call, durability wait included. */
+    Cancel = 1,        /**< A cancel call, durability wait included. */
+    Lookup = 2,        /**< A bus lookup by number. */
+    RouteSearch = 3,   /**< A route or departure-window search, callbacks included. */
+    BusLockWait = 4,   /**< Waiting for a bus lock another thread held. */
+    JournalFlush = 5,  /**< Writing and syncing one group commit. */
+    JournalWait = 6,   /**< A change waiting for its group commit to be durable. */
+    FleetScan = 7      /**< A filter or occupancy scan over the whole fleet, callbacks included. */
+};
+
+const int TIMER_COUNT = 8;  /**< Number of Timer values. */
+
+/**
+ * @brief Timers below this value are on the hot path and time only one call in
+ *        Metrics::SAMPLE_EVERY per thread; the rest time every event.
+ */
+const int SAMPLED_TIMERS = 4;
+
+/**
+ * @class LatencyHistogram
+ * @brief Log-linear histogram of nanosecond latencies, in the manner of HdrHistogram.
+ *
+ * Values below 2 * SUB_BUCKETS get a bucket each. Above that, every power of two is split
+ * into SUB_BUCKETS equal buckets, so a bucket is never wider than 1 / SUB_BUCKETS of its
+ * values (6.25%) whatever the magnitude. Values from 2^MAX_BITS ns (about 18 minutes) up
+ * land in the last bucket.
+ */
+class LatencyHistogram {
+public:
+    static const int SUB_BITS = 4;
+    static const int SUB_BUCKETS = 1 << SUB_BITS;
+    static const int MAX_BITS = 40;
+    static const int BUCKETS = (MAX_BITS - SUB_BITS + 1) * SUB_BUCKETS;
+
+    /**
+     * @brief Bucket of a latency.
+     */
+    static int bucketOf(std::uint64_t nanos) {
+        if(nanos < static_cast<std::uint64_t>(2 * SUB_BUCKETS)) return static_cast<int>(nanos);
+        const int top = 63 - __builtin_clzll(nanos);
+        if(top >= MAX_BITS) return BUCKETS - 1;
+        const int shift = top - SUB_BITS;
+        return (shift + 1) * SUB_BUCKETS + static_cast<int>((nanos >> shift) - SUB_BUCKETS);
+    }
+
+    /**
+     * @brief Highest latency that falls in a bucket.
+     */
+    static std::uint64_t upperBound(int bucket) {
+        if(bucket < 2 * SUB_BUCKETS) return static_cast<std::uint64_t>(bucket);
+        const int shift = bucket / SUB_BUCKETS - 1;
+        const std::uint64_t low = static_cast<std::uint64_t>(SUB_BUCKETS + bucket % SUB_BUCKETS) << shift;
+        return low + (std::uint64_t(1) << shift) - 1;
+    }
+
+    std::uint64_t buckets[BUCKETS] = {};
+    std::uint64_t count = 0;
+    std::uint64_t sum = 0;   /**< Nanoseconds, over all recorded values. */
+
+    /**
+     * @brief Latency at or below which a fraction q of the values fall, to bucket
+     *        precision; 0 if the histogram is empty.
+     */
+    std::uint64_t quantile(double q) const;
+};
+
+/**
+ * @struct MetricsSnapshot
+ * @brief Every counter and histogram, summed over all threads at one moment.
+ */
+struct MetricsSnapshot {
+    std::uint64_t counters[COUNTER_COUNT] = {};
+    LatencyHistogram timers[TIMER_COUNT];
+
+    std::uint64_t counter(Counter c) const { return counters[static_cast<int>(c)]; }
+    const LatencyHistogram& timer(Timer t) const { return timers[static_cast<int>(t)]; }
+};
+
+/**
+ * @class Metrics
+ * @brief Counters and latency histograms kept per thread and merged when read.
+ *
+ * Each thread that records gets a block of its own, so the hot path never shares a cache
+ * line with another thread and never takes a lock: counting is a relaxed load and store
+ * of a value only that thread writes. collect() walks every block and sums them. A block
+ * whose thread has exited is handed to the next new thread, keeping its counts, so totals
+ * only ever grow and threads coming and going cost no memory.
+ */
+class Metrics {
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    /**
+     * @brief Every how many calls a sampled timer times one. Reading the clock twice costs
+     *        as much as a lookup does, so timing each call would be the bulk of the work.
+     */
+    static const std::uint32_t SAMPLE_EVERY = 16;
+
+    /**
+     * @brief Count one event, or n of them.
+     */
+    static void count(Counter c, std::uint64_t n = 1) {
+        bump(local().counters[static_cast<int>(c)], n);
+    }
+
+    /**
+     * @brief Record one latency.
+     */
+    static void record(Timer t, std::uint64_t nanos) {
+        Block &block = local();
+        const int timer = static_cast<int>(t);
+        bump(block.buckets[timer][LatencyHistogram::bucketOf(nanos)], 1);
+        bump(block.sums[timer], nanos);
+    }
+
+    /**
+     * @brief Whether this call of the timer should be timed; see SAMPLED_TIMERS. A thread's
+     *        first call is always timed.
+     */
+    static bool sample(Timer t) {
+        const int timer = static_cast<int>(t);
+        if(timer >= SAMPLED_TIMERS) return true;
+        return local().calls[timer]++ % SAMPLE_EVERY == 0;
+    }
+
+    /**
+     * @brief Sum every thread's counters and histograms.
+     */
+    static void collect(MetricsSnapshot& snapshot);
+
+    /**
+     * @brief Append the metrics in the Prometheus text exposition format: counters as
+     *        booking_*_total and each timer as a summary in seconds with its 0.5, 0.9,
+     *        0.99 and 0.999 quantiles.
+     */
+    static void writePrometheus(const MetricsSnapshot& snapshot, std::string& out);
+
+    /**
+     * @brief Append one gauge in the same format, for values read from elsewhere.
+     */
+    static void writeGauge(std::string& out, const char* name, const char* help, std::uint64_t value);
+
+private:
+    /**
+     * @brief One thread's counters, written only by that thread.
+     */
+    struct alignas(64) Block {
+        std::atomic<std::uint64_t> counters[COUNTER_COUNT];
+        std::atomic<std::uint64_t> sums[TIMER_COUNT];
+        std::atomic<std::uint64_t> buckets[TIMER_COUNT][LatencyHistogram::BUCKETS];
+        std::uint32_t calls[SAMPLED_TIMERS];  /**< Calls of each sampled timer; never collected. */
+    };
+
+    struct Pool;
+    struct Lease;
+
+    static void bump(std::atomic<std::uint64_t>& value, std::uint64_t n) {
+        value.store(value.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief The calling thread's block, claimed on first use.
+     */
+    static Block& local();
+};
+
+/**
+ * @class ScopedTimer
+ * @brief Records the time from its construction to its destruction under a Timer, if
+ *        Metrics::sample() picks the call.
+ */
+class ScopedTimer {
+public:
+    explicit ScopedTimer(Timer t) : timer(t), timing(Metrics::sample(t)) {
+        if(timing) start = Metrics::Clock::now();
+    }
+
+    ~ScopedTimer() {
+        if(!timing) return;
+        Metrics::record(timer, static_cast<std::uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(Metrics::Clock::now() - start).count()));
+    }
+
+    ScopedTimer(const ScopedTimer&) = delete;
+    ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+private:
+    Timer timer;
+    bool timing;
+    Metrics::Clock::time_point start;
+};
+
+#endif // BOOKING_METRICS_H
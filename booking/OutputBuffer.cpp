@@ -0,0 +1,59 @@
+// OutputBuffer.cpp
+
+#include "OutputBuffer.h"
+
+#include <cmath>
+
+OutputBuffer::OutputBuffer(std::ostream& stream, std::size_t page)
+    : out(stream), pageBytes(page)
+{
+    text.reserve(pageBytes + 4096);
+}
+
+OutputBuffer::~OutputBuffer() {
+    flush();
+}
+
+OutputBuffer& OutputBuffer::appendInt(long long value, int width) {
+    // Digits are produced backwards into a small scratch area
+    char digits[24];
+    char* end = digits + sizeof(digits);
+    char* p = end;
+    unsigned long long magnitude = value < 0 ? 0ull - static_cast<unsigned long long>(value)
+                                             : static_cast<unsigned long long>(value);
+    do {
+        *--p = static_cast<char>('0' + magnitude % 10);
+        magnitude /= 10;
+    } while(magnitude);
+    if(value < 0) *--p = '-';
+
+    const int length = static_cast<int>(end - p);
+    if(width > length) text.append(static_cast<std::size_t>(width - length), ' ');
+    text.append(p, static_cast<std::size_t>(length));
+    return endAppend();
+}
+
+OutputBuffer& OutputBuffer::appendFixed2(double value) {
+    return appendPaise(std::llround(value * 100.0));
+}
+
+OutputBuffer& OutputBuffer::appendPaise(long long paise) {
+    if(paise < 0) {
+        text.push_back('-');
+        paise = -paise;
+    }
+    appendInt(paise / 100);
+    const int cents = static_cast<int>(paise % 100);
+    text.push_back('.');
+    text.push_back(static_cast<char>('0' + cents / 10));
+    text.push_back(static_cast<char>('0' + cents % 10));
+    return endAppend();
+}
+
+bool OutputBuffer::flush() {
+    if(text.empty()) return true;
+    out.write(text.data(), static_cast<std::streamsize>(text.size()));
+    out.flush();
+    text.clear();
+    return static_cast<bool>(out);
+}
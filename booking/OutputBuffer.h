@@ -0,0 +1,88 @@
+#ifndef BOOKING_OUTPUTBUFFER_H
+#define BOOKING_OUTPUTBUFFER_H
+
+#include <string>
+#include <ostream>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @file OutputBuffer.h
+ * @brief Reusable text buffer with fast number formatting, written out in large chunks.
+ */
+
+/**
+ * @class OutputBuffer
+ * @brief Accumulates formatted text and hands it to a stream one page at a time.
+ *
+ * Appending never touches the stream: text goes into an internal buffer whose capacity is
+ * kept between pages, so steady-state rendering does not allocate. Once the buffer holds
+ * a page worth of text it is written with a single write() and flush(), and flush() emits
+ * whatever is left at the end of a screen. Numbers are formatted by hand instead of through
+ * iostream manipulators.
+ */
+class OutputBuffer {
+public:
+    /**
+     * @brief Buffer text for out, writing it whenever pageBytes have accumulated.
+     */
+    explicit OutputBuffer(std::ostream& out, std::size_t pageBytes = 64 * 1024);
+
+    /**
+     * @brief Flushes whatever is still buffered.
+     */
+    ~OutputBuffer();
+
+    OutputBuffer(const OutputBuffer&) = delete;
+    OutputBuffer& operator=(const OutputBuffer&) = delete;
+
+    OutputBuffer& append(const char* data, std::size_t size) { text.append(data, size); return endAppend(); }
+    OutputBuffer& append(const std::string& s) { text.append(s); return endAppend(); }
+    OutputBuffer& append(const char* s) { text.append(s); return endAppend(); }
+    OutputBuffer& append(char c) { text.push_back(c); return endAppend(); }
+
+    /**
+     * @brief Append count copies of c, e.g. a separator line.
+     */
+    OutputBuffer& fill(char c, std::size_t count) { text.append(count, c); return endAppend(); }
+
+    /**
+     * @brief Append an integer in decimal, right-aligned to at least width characters.
+     */
+    OutputBuffer& appendInt(long long value, int width = 0);
+
+    /**
+     * @brief Append an amount with exactly two decimals (e.g. "300.00"), rounded to the
+     *        nearest hundredth.
+     */
+    OutputBuffer& appendFixed2(double value);
+
+    /**
+     * @brief Append an amount of paise as rupees with two decimals (e.g. 30000 as "300.00").
+     */
+    OutputBuffer& appendPaise(long long paise);
+
+    /**
+     * @brief Write everything buffered so far to the stream and flush it.
+     *
+     * @return true If the stream accepted the text.
+     */
+    bool flush();
+
+    /**
+     * @brief Bytes currently buffered.
+     */
+    std::size_t size() const { return text.size(); }
+
+private:
+    std::ostream& out;       /**< Destination stream. */
+    std::size_t pageBytes;   /**< Buffered size that triggers a write. */
+    std::string text;        /**< Pending text; its capacity is reused across pages. */
+
+    OutputBuffer& endAppend() {
+        if(text.size() >= pageBytes) flush();
+        return *this;
+    }
+};
+
+#endif // BOOKING_OUTPUTBUFFER_H
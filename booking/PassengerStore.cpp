@@ -0,0 +1,116 @@
+// PassengerStore.cpp
+
+#include "PassengerStore.h"
+#include "StringPool.h"
+
+#include <cstring>
+#include <mutex>
+
+PassengerStore::Id PassengerStore::acquire(const std::string& name, int seats) {
+    if(name.empty() || name.size() > MAX_NAME) return npos;
+
+    const std::uint32_t h = hashString(name);
+    {
+        // Fast path: a returning passenger, or another seat of the same booking
+        std::shared_lock<std::shared_mutex> lock(mutex);
+        if(!slots.empty()) {
+            const Id id = slots[probe(h, name)].id;
+            if(id != npos) {
+                record(id).refs.fetch_add(static_cast<std::uint32_t>(seats), std::memory_order_relaxed);
+                return id;
+            }
+        }
+    }
+
+    std::unique_lock<std::shared_mutex> lock(mutex);
+    if((live + 1) * 2 > slots.size()) grow();
+
+    Slot &slot = slots[probe(h, name)];
+    if(slot.id != npos) {
+        record(slot.id).refs.fetch_add(static_cast<std::uint32_t>(seats), std::memory_order_relaxed);
+        return slot.id;
+    }
+
+    Id id = freeList;
+    if(id != npos) {
+        freeList = record(id).link;
+    } else {
+        if(used % SLAB_RECORDS == 0) slabs.emplace_back(new Record[SLAB_RECORDS]);
+        id = used++;
+    }
+    Record &r = record(id);
+    r.refs.store(static_cast<std::uint32_t>(seats), std::memory_order_relaxed);
+    r.link = h;
+    r.length = static_cast<std::uint8_t>(name.size());
+    std::memcpy(r.name, name.data(), name.size());
+
+    slot.hash = h;
+    slot.id = id;
+    ++live;
+    return id;
+}
+
+void PassengerStore::release(Id id, int seats) {
+    {
+        std::shared_lock<std::shared_mutex> lock(mutex);
+        const std::uint32_t before = record(id).refs.fetch_sub(static_cast<std::uint32_t>(seats),
+                                                               std::memory_order_acq_rel);
+        if(before != static_cast<std::uint32_t>(seats)) return;
+    }
+
+    std::unique_lock<std::shared_mutex> lock(mutex);
+    // Between the locks the name may have been booked again, or freed by another release
+    Record &r = record(id);
+    if(r.length == 0 || r.refs.load(std::memory_order_relaxed) != 0) return;
+    erase(id);
+    r.length = 0;
+    r.link = freeList;
+    freeList = id;
+    --live;
+}
+
+std::string PassengerStore::name(Id id) const {
+    std::shared_lock<std::shared_mutex> lock(mutex);
+    const Record &r = record(id);
+    return std::string(r.name, r.length);
+}
+
+std::size_t PassengerStore::probe(std::uint32_t hash, const std::string& name) const {
+    const std::size_t mask = slots.size() - 1;
+    for(std::size_t i = hash & mask; ; i = (i + 1) & mask) {
+        const Slot &slot = slots[i];
+        if(slot.id == npos) return i;
+        if(slot.hash != hash) continue;
+        const Record &r = record(slot.id);
+        if(r.length == name.size() && std::memcmp(r.name, name.data(), name.size()) == 0) return i;
+    }
+}
+
+void PassengerStore::erase(Id id) {
+    const std::size_t mask = slots.size() - 1;
+    std::size_t hole = record(id).link & mask;
+    while(slots[hole].id != id) hole = (hole + 1) & mask;
+
+    // Pull back every later entry of the run whose home slot is not after the hole
+    for(std::size_t i = (hole + 1) & mask; slots[i].id != npos; i = (i + 1) & mask) {
+        const std::size_t home = slots[i].hash & mask;
+        if(((i - home) & mask) >= ((i - hole) & mask)) {
+            slots[hole] = slots[i];
+            hole = i;
+        }
+    }
+    slots[hole].id = npos;
+}
+
+void PassengerStore::grow() {
+    const Slot empty = { 0, npos };
+    std::vector<Slot> bigger(slots.empty() ? 16 : slots.size() * 2, empty);
+    const std::size_t mask = bigger.size() - 1;
+    for(const Slot &slot : slots) {
+        if(slot.id == npos) continue;
+        std::size_t i = slot.hash & mask;
+        while(bigger[i].id != npos) i = (i + 1) & mask;
+        bigger[i] = slot;
+    }
+    slots.swap(bigger);
+}
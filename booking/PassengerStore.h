@@ -0,0 +1,155 @@
+#ifndef BOOKING_PASSENGERSTORE_H
+#define BOOKING_PASSENGERSTORE_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <shared_mutex> // for the passenger table reader-writer lock
+
+/**
+ * @file PassengerStore.h
+ * @brief Reference-counted passenger names in fixed-size slab records.
+ */
+
+/**
+ * @class PassengerStore
+ * @brief Passenger names held by reserved seats, recycled when their last seat is
+ *        cancelled.
+ *
+ * Each distinct name is stored once, inline in a 64-byte record carved from a slab, and
+ * seats keep only the record's id. Every reserved seat counts as one reference; when the
+ * last seat holding a name is cancelled its record goes on a free list and the next new
+ * name reuses it. Once the slabs and table have grown to the working set, reserving and
+ * cancelling never allocate. Names are found through an open-addressing table keyed on
+ * their hash; a removed entry is filled by shifting later entries back, so lookups never
+ * see tombstones.
+ *
+ * The store is safe to use from many threads, with its own reader-writer lock: taking a
+ * reference to a name already stored, or dropping one that is not the last, shares the
+ * lock; adding or removing a name takes it exclusively. The registry calls in while
+ * holding a bus lock, so this lock is always the innermost.
+ */
+class PassengerStore {
+public:
+    typedef std::uint32_t Id;                /**< Id of a passenger record. */
+    static const Id npos = 0xFFFFFFFFu;      /**< "No record". */
+    static const std::size_t MAX_NAME = 55;  /**< Longest name a record holds, in bytes. */
+
+    /**
+     * @brief Take references to a name, storing it if it is new.
+     *
+     * @param name The passenger name; 1 to MAX_NAME bytes.
+     * @param seats Number of references to take, one per seat booked under the name.
+     * @return Id The record holding the name, or npos if the name is empty or too long.
+     */
+    Id acquire(const std::string& name, int seats = 1);
+
+    /**
+     * @brief Drop references taken by acquire(), freeing the record with the last one.
+     *
+     * @param id A record with at least seats references.
+     */
+    void release(Id id, int seats = 1);
+
+    /**
+     * @brief The name held by a record.
+     *
+     * Ids are reused once a record is freed, so an id copied out of a seat map names the
+     * right passenger only while that seat stays reserved.
+     */
+    std::string name(Id id) const;
+
+    /**
+     * @brief Call fn(const char* name, std::size_t length) on the name held by a record,
+     *        without copying it.
+     *
+     * Acquiring and releasing block while this runs, so fn must do neither.
+     */
+    template <typename Fn>
+    void withName(Id id, Fn fn) const {
+        std::shared_lock<std::shared_mutex> lock(mutex);
+        const Record &r = record(id);
+        fn(static_cast<const char*>(r.name), static_cast<std::size_t>(r.length));
+    }
+
+    /**
+     * @brief Call fn(Id, const char* name, std::size_t length) for every record ever handed
+     *        out, in id order; free records have length 0.
+     *
+     * Acquiring and releasing block while this runs, so fn must do neither.
+     */
+    template <typename Fn>
+    void forEach(Fn fn) const {
+        std::shared_lock<std::shared_mutex> lock(mutex);
+        for(Id id = 0; id < used; ++id) {
+            const Record &r = record(id);
+            fn(id, r.name, static_cast<std::size_t>(r.length));
+        }
+    }
+
+    /**
+     * @brief Number of names currently stored.
+     */
+    std::size_t size() const {
+        std::shared_lock<std::shared_mutex> lock(mutex);
+        return live;
+    }
+
+    /**
+     * @brief Number of record ids handed out so far, stored or free.
+     */
+    std::size_t capacity() const {
+        std::shared_lock<std::shared_mutex> lock(mutex);
+        return used;
+    }
+
+private:
+    /**
+     * @brief One passenger name, sized to a cache line. A record with length 0 is free.
+     */
+    struct alignas(64) Record {
+        std::atomic<std::uint32_t> refs;  /**< Seats holding this name. */
+        std::uint32_t link;               /**< Hash of the name while stored; next free record while free. */
+        std::uint8_t length;              /**< Bytes of name in use. */
+        char name[MAX_NAME];              /**< The name, not NUL-terminated. */
+    };
+
+    /**
+     * @brief One hash table slot. A slot with id == npos is empty.
+     */
+    struct Slot {
+        std::uint32_t hash;
+        Id id;
+    };
+
+    static const std::size_t SLAB_RECORDS = 1024;  /**< Records per slab. */
+
+    std::vector<Slot> slots;                          /**< Hash table; size is zero or a power of two. */
+    std::vector<std::unique_ptr<Record[]>> slabs;     /**< Backing storage for records. */
+    Id used = 0;                                      /**< Record ids handed out, stored or free. */
+    Id freeList = npos;                               /**< First free record. */
+    std::size_t live = 0;                             /**< Names in the table. */
+    mutable std::shared_mutex mutex;                  /**< Guards slots, slabs, the free list and counts. */
+
+    Record& record(Id id) const { return slabs[id / SLAB_RECORDS][id % SLAB_RECORDS]; }
+
+    /**
+     * @brief Locate the slot holding a name, or the empty slot where it would go.
+     */
+    std::size_t probe(std::uint32_t hash, const std::string& name) const;
+
+    /**
+     * @brief Remove a record's slot, shifting later entries of its probe run back.
+     */
+    void erase(Id id);
+
+    /**
+     * @brief Double the table (keeping the load factor at or below 1/2) and rehash.
+     */
+    void grow();
+};
+
+#endif // BOOKING_PASSENGERSTORE_H
@@ -0,0 +1,125 @@
+#ifndef BOOKING_PRICING_H
+#define BOOKING_PRICING_H
+
+#include <cstdint>
+
+#include "SeatLayout.h"
+
+/**
+ * @file Pricing.h
+ * @brief Fare classes, per-bus fare tables and demand-based pricing, in integer paise.
+ *
+ * Every seat belongs to a fare class fixed by its position in the layout: the front row,
+ * the remaining window seats, and everything else. A bus keeps one base fare per class,
+ * and the price charged for a seat is its class's base fare scaled by a demand tier,
+ * chosen from how many seats of the bus are already booked. Amounts are whole paise
+ * throughout, so totals are exact, and a group of seats is priced from one popcount per
+ * fare class rather than seat by seat.
+ */
+
+typedef std::int64_t Paise;  /**< An amount of money in paise (hundredths of a rupee). */
+
+/**
+ * @brief Fare class of a seat, fixed by where it sits in the layout.
+ */
+enum class FareClass : std::uint8_t {
+    Standard = 0,  /**< Inner seats behind the front row. */
+    Window = 1,    /**< Window seats behind the front row. */
+    Front = 2      /**< Every seat of the front row. */
+};
+
+const int FARE_CLASS_COUNT = 3;  /**< Number of FareClass values. */
+
+/**
+ * @struct FareTable
+ * @brief Base fare of each fare class on one bus.
+ */
+struct FareTable {
+    std::int32_t base[FARE_CLASS_COUNT];  /**< Base fare per FareClass, in paise. */
+};
+
+/**
+ * @brief Fares a bus is installed with unless others are given: Rs. 300, 330 and 360.
+ */
+constexpr FareTable DEFAULT_FARES = { { 30000, 33000, 36000 } };
+
+/**
+ * @struct DemandTier
+ * @brief A price multiplier that applies once a bus is booked up to some share.
+ */
+struct DemandTier {
+    int bookedPercent;  /**< Applies when at least this percentage of seats is booked. */
+    int permille;       /**< Multiplier on the base fare, in thousandths. */
+};
+
+/**
+ * @brief Demand tiers in ascending order; a booking is priced at the highest tier the bus
+ *        has reached before it.
+ */
+constexpr DemandTier DEMAND_TIERS[] = {
+    { 0, 1000 },
+    { 50, 1100 },
+    { 75, 1250 },
+    { 90, 1500 },
+};
+
+const int DEMAND_TIER_COUNT = 4;  /**< Entries in DEMAND_TIERS. */
+
+/**
+ * @brief Demand tier of a bus with booked of its seats taken.
+ */
+inline int demandTier(int booked, int seats) {
+    int tier = 0;
+    while(tier + 1 < DEMAND_TIER_COUNT && booked * 100 >= DEMAND_TIERS[tier + 1].bookedPercent * seats) ++tier;
+    return tier;
+}
+
+/**
+ * @brief Price of one seat of a fare class at a demand tier, rounded to the nearest paisa.
+ */
+inline Paise unitPrice(const FareTable& fares, FareClass fareClass, int tier) {
+    const Paise base = fares.base[static_cast<int>(fareClass)];
+    return (base * DEMAND_TIERS[tier].permille + 500) / 1000;
+}
+
+/**
+ * @brief Mask of the seats of a layout that belong to a fare class.
+ */
+inline SeatMask fareClassSeats(LayoutKind layout, FareClass fareClass) {
+    const LayoutInfo &info = LAYOUTS[static_cast<int>(layout)];
+    switch(fareClass) {
+        case FareClass::Front: return info.front;
+        case FareClass::Window: return info.window & ~info.front;
+        case FareClass::Standard: break;
+    }
+    return info.all & ~info.window & ~info.front;
+}
+
+/**
+ * @brief Fare class of a seat.
+ *
+ * @param seatNumber The seat number (1 to the layout's seat count).
+ */
+inline FareClass fareClassOf(LayoutKind layout, int seatNumber) {
+    const LayoutInfo &info = LAYOUTS[static_cast<int>(layout)];
+    const SeatMask bit = SeatMask(1) << (seatNumber - 1);
+    if(info.front & bit) return FareClass::Front;
+    return info.window & bit ? FareClass::Window : FareClass::Standard;
+}
+
+/**
+ * @brief Total price of a set of seats, all charged at the same demand tier.
+ *
+ * Each seat is charged the same rounded unit price it would cost on its own, so the total
+ * equals the sum of the per-seat prices and a later refund of any one seat is exact.
+ */
+inline Paise batchPrice(const FareTable& fares, LayoutKind layout, SeatMask seats, int tier) {
+    Paise total = 0;
+    for(int k = 0; k < FARE_CLASS_COUNT; ++k) {
+        const FareClass fareClass = static_cast<FareClass>(k);
+        total += countBits(seats & fareClassSeats(layout, fareClass)) * unitPrice(fares, fareClass, tier);
+    }
+    return total;
+}
+
+#endif // BOOKING_PRICING_H
@@ -0,0 +1,175 @@
+#ifndef BOOKING_PROTOCOL_H
+#define BOOKING_PROTOCOL_H
+
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+/**
+ * @file Protocol.h
+ * @brief Length-prefixed binary protocol spoken by the booking server.
+ *
+ * Every request and response is one frame:
+ *
+ *     request:  u32 length | u32 request id | u8 opcode | payload
+ *     response: u32 length | u32 request id | u8 status | payload
+ *
+ * where length counts everything after the length field. Integers are little-endian and
+ * strings are a u16 length followed by the bytes, as in the journal. A client may pipeline
+ * any number of requests without waiting; responses on a connection come back in request
+ * order and echo the request id. The status is a BookingStatus value, or
+ * PROTOCOL_ERROR for a frame the server could not decode, after which the server closes
+ * the connection.
+ *
+ * Payloads, request then response (the response payload is present only when the status
+ * is Ok, unless noted):
+ *
+ *  - Install: bus number, driver, arrival, departure, from, to, u8 layout, 3 x u32 base
+ *    fare in paise (standard, window, front). Response: empty.
+ *  - Reserve: bus number, u8 seat, passenger. Response: empty.
+ *  - Cancel: bus number, u8 seat. Response: empty.
+ *  - Show: bus number. Response: driver, arrival, departure, from, to, u8 layout,
+ *    u64 occupied mask, then the passenger of each reserved seat in seat order.
+ *  - RouteSearch: from, to, u16 earliest and u16 latest departure in minutes since midnight
+ *    (ANY_TIME for the whole route), u16 most results wanted. Response: u16 count, then
+ *    per bus its number, u16 departure minute (ANY_TIME if unparsed) and u8 empty seats.
+ *    Buses come in installation order, or departure order for a window.
+ *  - ReserveSeats: bus number, passenger, u8 count, count x u8 seat. All or none.
+ *    Response: i64 price charged in paise.
+ *  - SeatChanges: bus number, u32 version (0 for none). Response: u32 version now,
+ *    u64 changed, u64 reserved and u64 held masks, then the passenger of each reserved
+ *    seat in seat order. Only the changed seats are described: reserved and held are
+ *    limited to them, and the rest of the seat map is as of the version sent. Every seat
+ *    counts as changed for version 0 or one too old, and versions restart with the server.
+ */
+
+namespace protocol {
+
+/**
+ * @brief What a request asks for.
+ */
+enum class Opcode : std::uint8_t {
+    Install = 1,
+    Reserve = 2,
+    Cancel = 3,
+    Show = 4,
+    RouteSearch = 5,
+    ReserveSeats = 6,
+    SeatChanges = 7
+};
+
+const std::uint8_t PROTOCOL_ERROR = 0xFF;     /**< Response status for an undecodable request. */
+const std::uint16_t ANY_TIME = 0xFFFF;        /**< Departure minute meaning "no window" or "unknown". */
+const std::size_t HEADER_BYTES = 9;           /**< Length, request id and opcode or status. */
+const std::size_t MAX_FRAME = 64 * 1024;      /**< Largest request frame accepted, length field included. */
+
+inline void putU8(std::string& out, std::uint8_t v) { out.push_back(static_cast<char>(v)); }
+
+inline void putU16(std::string& out, std::uint16_t v) {
+    out.push_back(static_cast<char>(v & 0xFFu));
+    out.push_back(static_cast<char>(v >> 8));
+}
+
+inline void putU32(std::string& out, std::uint32_t v) {
+    for(int i = 0; i < 4; ++i) out.push_back(static_cast<char>((v >> (8 * i)) & 0xFFu));
+}
+
+inline void putU64(std::string& out, std::uint64_t v) {
+    for(int i = 0; i < 8; ++i) out.push_back(static_cast<char>((v >> (8 * i)) & 0xFFu));
+}
+
+/**
+ * @brief Append a string, cut to 65535 bytes.
+ */
+inline void putString(std::string& out, const char* s, std::size_t n) {
+    if(n > 0xFFFFu) n = 0xFFFFu;
+    putU16(out, static_cast<std::uint16_t>(n));
+    out.append(s, n);
+}
+
+inline void putString(std::string& out, const std::string& s) { putString(out, s.data(), s.size()); }
+
+inline std::uint32_t getU32(const char* p) {
+    std::uint32_t v = 0;
+    for(int i = 0; i < 4; ++i) v |= static_cast<std::uint32_t>(static_cast<unsigned char>(p[i])) << (8 * i);
+    return v;
+}
+
+/**
+ * @brief Start a frame: reserve the length field, then write the request id and the opcode
+ *        or status byte.
+ *
+ * @return std::size_t Offset of the frame in out, for endFrame().
+ */
+inline std::size_t beginFrame(std::string& out, std::uint32_t requestId, std::uint8_t code) {
+    const std::size_t at = out.size();
+    out.append(4, '\0');
+    putU32(out, requestId);
+    putU8(out, code);
+    return at;
+}
+
+/**
+ * @brief Finish the frame started at offset at by filling in its length.
+ */
+inline void endFrame(std::string& out, std::size_t at) {
+    const std::uint32_t length = static_cast<std::uint32_t>(out.size() - at - 4);
+    for(int i = 0; i < 4; ++i) out[at + i] = static_cast<char>((length >> (8 * i)) & 0xFFu);
+}
+
+/**
+ * @struct Reader
+ * @brief Bounds-checked reader over one frame payload. Every getter returns false, and
+ *        reads nothing, if the payload is too short.
+ */
+struct Reader {
+    const char* p;
+    const char* end;
+
+    bool getU8(std::uint8_t& v) {
+        if(end - p < 1) return false;
+        v = static_cast<std::uint8_t>(*p++);
+        return true;
+    }
+
+    bool getU16(std::uint16_t& v) {
+        if(end - p < 2) return false;
+        v = static_cast<std::uint16_t>(static_cast<unsigned char>(p[0]) | (static_cast<unsigned char>(p[1]) << 8));
+        p += 2;
+        return true;
+    }
+
+    bool getU32(std::uint32_t& v) {
+        if(end - p < 4) return false;
+        v = protocol::getU32(p);
+        p += 4;
+        return true;
+    }
+
+    bool getU64(std::uint64_t& v) {
+        if(end - p < 8) return false;
+        v = 0;
+        for(int i = 0; i < 8; ++i) v |= static_cast<std::uint64_t>(static_cast<unsigned char>(p[i])) << (8 * i);
+        p += 8;
+        return true;
+    }
+
+    /**
+     * @brief Read a string into s, reusing its storage.
+     */
+    bool getString(std::string& s) {
+        std::uint16_t n;
+        if(end - p < 2) return false;
+        n = static_cast<std::uint16_t>(static_cast<unsigned char>(p[0]) | (static_cast<unsigned char>(p[1]) << 8));
+        if(end - p - 2 < n) return false;
+        s.assign(p + 2, n);
+        p += 2 + n;
+        return true;
+    }
+
+    bool atEnd() const { return p == end; }  /**< True once the whole payload is read. */
+};
+
+} // namespace protocol
+
+#endif // BOOKING_PROTOCOL_H
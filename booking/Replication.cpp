@@ -0,0 +1,467 @@
+// Replication.cpp
+
+#include "Replication.h"
+#include "Metrics.h"
+#include "Protocol.h"
+
+#include <cerrno>
+#include <cstring>
+#include <unistd.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+
+using namespace protocol;
+
+namespace {
+
+const std::size_t FRAME_HEADER = 9;                   /**< Length and kind. */
+const std::size_t HELLO_BYTES = 17;                   /**< Hello payload after the kind. */
+const std::size_t POSITION_BYTES = 16;                /**< Epoch and offset. */
+const std::size_t MAX_SHIP_BYTES = 1024 * 1024;       /**< Journal bytes read per Records frame, at most. */
+const std::uint64_t MAX_RECORDS_FRAME = 64u << 20;    /**< Largest Records frame a follower accepts. */
+const std::uint64_t MAX_IMAGE_FRAME = 1ull << 30;     /**< Largest Image frame a follower accepts. */
+const int HEARTBEAT_MS = 1000;                        /**< Idle time after which the primary sends a heartbeat. */
+const int SILENCE_MS = 5 * HEARTBEAT_MS;              /**< Silence after which a follower reconnects. */
+const int RETRY_MS = 1000;                            /**< Pause before a follower reconnects. */
+
+/**
+ * @brief Start a frame: reserve the length field and write the kind byte.
+ */
+void beginShipFrame(std::string& out, ReplicationFrame kind) {
+    out.assign(8, '\0');
+    putU8(out, static_cast<std::uint8_t>(kind));
+}
+
+/**
+ * @brief Fill in the length of a frame whose payload is out plus extra more bytes, sent
+ *        separately.
+ */
+void endShipFrame(std::string& out, std::uint64_t extra = 0) {
+    const std::uint64_t length = out.size() - 8 + extra;
+    for(int i = 0; i < 8; ++i) out[i] = static_cast<char>((length >> (8 * i)) & 0xFFu);
+}
+
+std::uint64_t getU64(const char* p) {
+    std::uint64_t v = 0;
+    for(int i = 0; i < 8; ++i) v |= static_cast<std::uint64_t>(static_cast<unsigned char>(p[i])) << (8 * i);
+    return v;
+}
+
+/**
+ * @brief Send everything, however many calls it takes, without raising SIGPIPE.
+ */
+bool sendAll(int fd, const char* data, std::size_t size) {
+    while(size > 0) {
+        const ssize_t n = ::send(fd, data, size, MSG_NOSIGNAL);
+        if(n < 0) {
+            if(errno == EINTR) continue;
+            return false;
+        }
+        data += n;
+        size -= static_cast<std::size_t>(n);
+    }
+    return true;
+}
+
+/**
+ * @brief Read exactly size bytes at offset from a file.
+ */
+bool readAt(int fd, char* data, std::size_t size, std::uint64_t offset) {
+    while(size > 0) {
+        const ssize_t n = ::pread(fd, data, size, static_cast<off_t>(offset));
+        if(n < 0 && errno == EINTR) continue;
+        if(n <= 0) return false;
+        data += n;
+        size -= static_cast<std::size_t>(n);
+        offset += static_cast<std::uint64_t>(n);
+    }
+    return true;
+}
+
+void signal(int wake) {
+    // write() is async-signal-safe; the eventfd stays readable, so the wake-up is never missed
+    const std::uint64_t one = 1;
+    ssize_t written = ::write(wake, &one, sizeof(one));
+    (void)written;
+}
+
+} // namespace
+
+ReplicationSource::ReplicationSource(BookingService& owner)
+    : service(owner), listener(-1), wake(eventfd(0, EFD_CLOEXEC)), boundPort(0), stopping(false), connected(0)
+{
+}
+
+ReplicationSource::~ReplicationSource() {
+    stop();
+    if(listener >= 0) ::close(listener);
+    if(wake >= 0) ::close(wake);
+}
+
+bool ReplicationSource::listen(std::uint16_t port) {
+    if(wake < 0) return false;
+    const int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if(fd < 0) return false;
+
+    const int on = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+    sockaddr_in address;
+    std::memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    address.sin_port = htons(port);
+    socklen_t length = sizeof(address);
+    if(::bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || ::listen(fd, SOMAXCONN) != 0 ||
+       getsockname(fd, reinterpret_cast<sockaddr*>(&address), &length) != 0) {
+        ::close(fd);
+        return false;
+    }
+
+    if(listener >= 0) ::close(listener);
+    listener = fd;
+    boundPort = ntohs(address.sin_port);
+    return true;
+}
+
+bool ReplicationSource::start() {
+    if(listener < 0 || !service.openedJournal() || acceptor.joinable()) return false;
+    stopping.store(false, std::memory_order_relaxed);
+    acceptor = std::thread(&ReplicationSource::acceptLoop, this);
+    return true;
+}
+
+void ReplicationSource::stop() {
+    if(!acceptor.joinable()) return;
+    stopping.store(true, std::memory_order_relaxed);
+    signal(wake);
+    acceptor.join();
+
+    // Shippers blocked sending notice the shutdown; those waiting on the journal, stopping
+    std::vector<std::thread> finishing;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for(int fd : sockets) ::shutdown(fd, SHUT_RDWR);
+        finishing.swap(shippers);
+        finished.clear();
+    }
+    for(std::thread &shipper : finishing) shipper.join();
+
+    std::uint64_t drained;
+    ssize_t n = ::read(wake, &drained, sizeof(drained));
+    (void)n;
+}
+
+void ReplicationSource::acceptLoop() {
+    pollfd waits[2] = { { listener, POLLIN, 0 }, { wake, POLLIN, 0 } };
+    while(!stopping.load(std::memory_order_relaxed)) {
+        if(::poll(waits, 2, -1) < 0 && errno != EINTR) break;
+        if(waits[1].revents) break;
+        if(!(waits[0].revents & POLLIN)) continue;
+
+        const int fd = accept4(listener, nullptr, nullptr, SOCK_CLOEXEC);
+        if(fd < 0) continue;
+        const int on = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+
+        // Join the shippers of followers gone since, so reconnects do not pile up threads
+        std::lock_guard<std::mutex> lock(mutex);
+        for(std::size_t i = 0; i < shippers.size();) {
+            bool done = false;
+            for(std::thread::id id : finished) done = done || id == shippers[i].get_id();
+            if(!done) {
+                ++i;
+                continue;
+            }
+            shippers[i].join();
+            shippers[i] = std::move(shippers.back());
+            shippers.pop_back();
+        }
+        finished.clear();
+        sockets.push_back(fd);
+        shippers.emplace_back(&ReplicationSource::ship, this, fd);
+    }
+}
+
+void ReplicationSource::ship(int fd) {
+    connected.fetch_add(1, std::memory_order_relaxed);
+
+    // The follower speaks first, and at once
+    char hello[FRAME_HEADER + HELLO_BYTES] = {};
+    std::size_t got = 0;
+    pollfd waits[2] = { { fd, POLLIN, 0 }, { wake, POLLIN, 0 } };
+    while(got < sizeof(hello) && ::poll(waits, 2, SILENCE_MS) > 0 && !waits[1].revents) {
+        const ssize_t n = ::recv(fd, hello + got, sizeof(hello) - got, 0);
+        if(n < 0 && errno == EINTR) continue;
+        if(n <= 0) break;
+        got += static_cast<std::size_t>(n);
+    }
+
+    Journal &journal = *service.openedJournal();
+    std::uint64_t epoch = getU64(hello + FRAME_HEADER);
+    std::uint64_t offset = getU64(hello + FRAME_HEADER + 8);
+    bool empty = hello[FRAME_HEADER + POSITION_BYTES] != 0;
+    bool open = got == sizeof(hello) && getU64(hello) == 1 + HELLO_BYTES &&
+                hello[8] == static_cast<char>(ReplicationFrame::Hello);
+
+    int reader = -1;
+    std::string frame, data, image;
+    while(open && !stopping.load(std::memory_order_relaxed)) {
+        std::uint64_t end = 0;
+        const JournalTail tail = journal.tail(epoch, offset, end, reader, HEARTBEAT_MS);
+        if(tail == JournalTail::Closed) break;
+        if(tail == JournalTail::Timeout) end = offset;
+
+        if(tail == JournalTail::Lost) {
+            if(!empty) {
+                beginShipFrame(frame, ReplicationFrame::Gone);
+                endShipFrame(frame);
+                sendAll(fd, frame.data(), frame.size());
+                break;
+            }
+            if(!service.replicaImage(image, epoch, offset)) break;
+            beginShipFrame(frame, ReplicationFrame::Image);
+            putU64(frame, epoch);
+            putU64(frame, offset);
+            endShipFrame(frame, image.size());
+            open = sendAll(fd, frame.data(), frame.size()) && sendAll(fd, image.data(), image.size());
+            std::string().swap(image);
+            empty = false;
+            continue;
+        }
+
+        // Ship whole records, so the follower can apply each frame as it comes
+        std::size_t size = 0;
+        if(tail == JournalTail::Ready) {
+            data.resize(static_cast<std::size_t>(std::min<std::uint64_t>(end - offset, MAX_SHIP_BYTES)));
+            if(!readAt(reader, &data[0], data.size(), offset)) break;
+            size = Journal::wholeRecords(data.data(), data.size());
+            if(size == 0) {
+                // One record longer than a frame's worth: send it whole
+                data.resize(8 + static_cast<std::size_t>(getU32(data.data())));
+                if(offset + data.size() > end || !readAt(reader, &data[0], data.size(), offset)) break;
+                size = data.size();
+            }
+        }
+        beginShipFrame(frame, ReplicationFrame::Records);
+        putU64(frame, epoch);
+        putU64(frame, offset);
+        putU64(frame, end);
+        endShipFrame(frame, size);
+        open = sendAll(fd, frame.data(), frame.size()) && sendAll(fd, data.data(), size);
+        offset += size;
+        Metrics::count(Counter::ShippedBytes, size);
+    }
+
+    if(reader >= 0) ::close(reader);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for(std::size_t i = 0; i < sockets.size(); ++i) {
+            if(sockets[i] != fd) continue;
+            sockets[i] = sockets.back();
+            sockets.pop_back();
+            break;
+        }
+        ::close(fd);
+        finished.push_back(std::this_thread::get_id());
+    }
+    connected.fetch_sub(1, std::memory_order_relaxed);
+}
+
+Follower::Follower(BookingService& owner)
+    : service(owner), port(0), wake(eventfd(0, EFD_CLOEXEC)), promoting(false), stopping(false),
+      current(FollowerState::Connecting), lag(0), failure(nullptr)
+{
+}
+
+Follower::~Follower() {
+    stop();
+    if(wake >= 0) ::close(wake);
+}
+
+bool Follower::start(const std::string& primaryHost, std::uint16_t primaryPort) {
+    if(wake < 0 || worker.joinable()) return false;
+    std::uint64_t epoch, offset;
+    if(!service.replicaPosition(epoch, offset) && !service.empty()) return false;
+
+    host = primaryHost;
+    port = primaryPort;
+    service.beginFollowing();
+    worker = std::thread(&Follower::run, this);
+    return true;
+}
+
+void Follower::promote() {
+    promoting.store(true, std::memory_order_relaxed);
+    signal(wake);
+}
+
+void Follower::stop() {
+    if(!worker.joinable()) return;
+    stopping.store(true, std::memory_order_relaxed);
+    signal(wake);
+    worker.join();
+}
+
+void Follower::fail(const char* reason) {
+    failure = reason;
+    current.store(FollowerState::Failed, std::memory_order_release);
+}
+
+void Follower::run() {
+    while(current.load(std::memory_order_relaxed) != FollowerState::Failed) {
+        current.store(FollowerState::Connecting, std::memory_order_release);
+        const int fd = connectToPrimary();
+        if(fd < 0) {
+            if(!pause(RETRY_MS)) break;
+            continue;
+        }
+        const Ending ending = session(fd);
+        ::close(fd);
+        if(ending == Ending::Woken) break;
+        if(ending == Ending::Disconnected && !pause(RETRY_MS)) break;
+    }
+
+    // A failed follower still waits, because promoting it is the way out
+    while(current.load(std::memory_order_relaxed) == FollowerState::Failed && pause(-1)) {}
+    if(promoting.load(std::memory_order_relaxed) && !stopping.load(std::memory_order_relaxed)) {
+        service.promote();
+        current.store(FollowerState::Promoted, std::memory_order_release);
+    }
+}
+
+int Follower::connectToPrimary() {
+    addrinfo hints;
+    std::memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo *found = nullptr;
+    if(getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &found) != 0) return -1;
+
+    int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    bool connected = false;
+    if(fd >= 0) {
+        // Connect without blocking, so that a wake-up or an unreachable primary does not hang
+        connected = ::connect(fd, found->ai_addr, found->ai_addrlen) == 0;
+        if(!connected && errno == EINPROGRESS) {
+            pollfd waits[2] = { { fd, POLLOUT, 0 }, { wake, POLLIN, 0 } };
+            int error = 0;
+            socklen_t length = sizeof(error);
+            connected = ::poll(waits, 2, SILENCE_MS) > 0 && !waits[1].revents && (waits[0].revents & POLLOUT) &&
+                        getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &length) == 0 && error == 0;
+        }
+    }
+    freeaddrinfo(found);
+    if(!connected) {
+        if(fd >= 0) ::close(fd);
+        return -1;
+    }
+    const int on = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    return fd;
+}
+
+Follower::Ending Follower::receive(int fd, char* data, std::size_t size, int timeoutMs) {
+    pollfd waits[2] = { { fd, POLLIN, 0 }, { wake, POLLIN, 0 } };
+    while(size > 0) {
+        const int ready = ::poll(waits, 2, timeoutMs);
+        if(ready < 0 && errno == EINTR) continue;
+        if(waits[1].revents) return Ending::Woken;
+        if(ready <= 0) return Ending::Disconnected;
+
+        const ssize_t n = ::recv(fd, data, size, 0);
+        if(n < 0 && (errno == EINTR || errno == EAGAIN)) continue;
+        if(n <= 0) return Ending::Disconnected;
+        data += n;
+        size -= static_cast<std::size_t>(n);
+    }
+    return Ending::Received;
+}
+
+bool Follower::pause(int ms) {
+    pollfd waits[1] = { { wake, POLLIN, 0 } };
+    while(true) {
+        const int ready = ::poll(waits, 1, ms);
+        if(ready < 0 && errno == EINTR) continue;
+        return ready == 0;
+    }
+}
+
+Follower::Ending Follower::session(int fd) {
+    std::uint64_t epoch = 0, offset = 0;
+    service.replicaPosition(epoch, offset);
+    std::string frame;
+    beginShipFrame(frame, ReplicationFrame::Hello);
+    putU64(frame, epoch);
+    putU64(frame, offset);
+    putU8(frame, service.empty() ? 1 : 0);
+    endShipFrame(frame);
+    if(!sendAll(fd, frame.data(), frame.size())) return Ending::Disconnected;
+    current.store(FollowerState::Streaming, std::memory_order_release);
+
+    std::vector<char> payload;
+    char header[FRAME_HEADER];
+    while(true) {
+        Ending ending = receive(fd, header, sizeof(header), SILENCE_MS);
+        if(ending != Ending::Received) return ending;
+        const std::uint64_t length = getU64(header);
+        const ReplicationFrame kind = static_cast<ReplicationFrame>(header[8]);
+        if(kind == ReplicationFrame::Image && length > MAX_IMAGE_FRAME) {
+            fail("the primary sent an image larger than a follower accepts");
+            return Ending::Failed;
+        }
+        if(length == 0 || (kind != ReplicationFrame::Image && length > MAX_RECORDS_FRAME)) {
+            fail("the primary sent a frame that could not be decoded");
+            return Ending::Failed;
+        }
+        payload.resize(static_cast<std::size_t>(length - 1));
+        ending = receive(fd, payload.data(), payload.size(), SILENCE_MS);
+        if(ending != Ending::Received) return ending;
+
+        const char* p = payload.data();
+        switch(kind) {
+            case ReplicationFrame::Records: {
+                if(payload.size() < POSITION_BYTES + 8) break;
+                const std::uint64_t batchEpoch = getU64(p);
+                const std::size_t size = payload.size() - POSITION_BYTES - 8;
+                const std::uint64_t batchEnd = getU64(p + 8) + size;
+                const std::uint64_t primaryEnd = getU64(p + POSITION_BYTES);
+                if(!service.applyReplicated(batchEpoch, batchEnd, p + POSITION_BYTES + 8, size)) {
+                    fail("a batch of records could not be applied or logged");
+                    return Ending::Failed;
+                }
+                if(size) {
+                    Metrics::count(Counter::ReplicatedBatches);
+                    Metrics::count(Counter::ReplicatedBytes, size);
+                }
+                lag.store(primaryEnd > batchEnd ? primaryEnd - batchEnd : 0, std::memory_order_relaxed);
+                continue;
+            }
+            case ReplicationFrame::Image: {
+                if(payload.size() < POSITION_BYTES) break;
+                const std::uint64_t imageEpoch = getU64(p), imageOffset = getU64(p + 8);
+                const bool loaded = service.loadReplicaImage(p + POSITION_BYTES, payload.size() - POSITION_BYTES,
+                                                             imageEpoch, imageOffset);
+                // An image is sent once, so its buffer is not kept for the records after it
+                std::vector<char>().swap(payload);
+                if(!loaded) {
+                    fail("the primary's image could not be loaded");
+                    return Ending::Failed;
+                }
+                continue;
+            }
+            case ReplicationFrame::Gone:
+                fail("the primary no longer holds this follower's position; start it again from an empty journal");
+                return Ending::Failed;
+            default:
+                break;
+        }
+        fail("the primary sent a frame that could not be decoded");
+        return Ending::Failed;
+    }
+}
@@ -0,0 +1,262 @@
+#ifndef BOOKING_REPLICATION_H
+#define BOOKING_REPLICATION_H
+
+#include <string>
+#include <vector>
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <mutex>
+#include <thread>
+
+#include "BookingService.h"
+
+/**
+ * @file Replication.h
+ * @brief Log-shipping replication of the booking journal to read-only followers.
+ *
+ * A primary runs a ReplicationSource beside its Server; each follower runs a Follower
+ * against it. The follower opens a TCP connection and says where its state stands in the
+ * primary's journal, as an epoch and byte offset. The primary then streams every durable
+ * journal byte after that position, as it becomes durable, in runs of whole records. The
+ * follower applies each run as one batch (see BookingService::applyReplicated()) and logs
+ * it to its own journal with one flush, so its state is an exact, slightly older copy of
+ * the primary's and survives a restart of either side.
+ *
+ * Every frame on the connection is
+ *
+ *     u64 length | u8 kind | payload
+ *
+ * where length counts the kind byte and payload, with integers little-endian:
+ *
+ *  - Hello, follower to primary: u64 epoch, u64 offset, u8 1 if the follower is empty
+ *    and may be sent an image. Sent once, first.
+ *  - Records: u64 epoch, u64 offset of the first byte, u64 durable length of the primary's
+ *    journal, then journal bytes. With no bytes it is a heartbeat, sent once a second
+ *    while the journal is idle; it may still move the position after a compaction.
+ *  - Image: u64 epoch, u64 offset, then a snapshot image of the primary's whole state up
+ *    to that position (see BookingService::replicaImage()). Sent instead of records when
+ *    the journal no longer holds the follower's position and the follower is empty. A
+ *    follower refuses an image over 1 GiB.
+ *  - Gone: empty. The journal no longer holds the position and the follower is not
+ *    empty; it has to be started again from an empty journal.
+ *
+ * A compaction on the primary rewrites its journal under a new epoch. A follower whose
+ * position was in the records kept is carried over to the new file without noticing; one
+ * that lags by more than a whole compaction needs an image.
+ *
+ * Failing over is promoting a follower: it stops following and accepts changes at once,
+ * with the state and journal it already has. Nothing fences off the old primary, which must
+ * be known dead, and followers of the old primary are not carried over to the new one:
+ * positions in one primary's journal mean nothing in another's, so they start again empty.
+ *
+ * Linux only.
+ */
+
+/**
+ * @brief Kinds of replication frame.
+ */
+enum class ReplicationFrame : std::uint8_t {
+    Hello = 1,
+    Records = 2,
+    Image = 3,
+    Gone = 4
+};
+
+/**
+ * @class ReplicationSource
+ * @brief Ships a primary's journal to every follower that connects.
+ *
+ * One thread accepts followers and each follower gets a thread of its own, which blocks
+ * on the journal until there is something to send; a primary has a handful of followers,
+ * not thousands of clients.
+ */
+class ReplicationSource {
+public:
+    /**
+     * @param service The primary. Its journal must be open, and it must outlive the source.
+     */
+    explicit ReplicationSource(BookingService& service);
+    ~ReplicationSource();
+
+    ReplicationSource(const ReplicationSource&) = delete;
+    ReplicationSource& operator=(const ReplicationSource&) = delete;
+
+    /**
+     * @brief Bind and listen on a TCP port of every local address.
+     *
+     * @param port The port, or 0 for one picked by the system (see port()).
+     * @return false If the socket could not be created, bound or listened on.
+     */
+    bool listen(std::uint16_t port);
+
+    /**
+     * @brief The port being listened on, once listen() succeeded.
+     */
+    std::uint16_t port() const { return boundPort; }
+
+    /**
+     * @brief Start accepting followers on a background thread.
+     *
+     * @return false If listen() has not succeeded, the service has no journal or the
+     *         source is already running.
+     */
+    bool start();
+
+    /**
+     * @brief Disconnect every follower and stop accepting new ones. Followers reconnect
+     *        once a source runs again.
+     */
+    void stop();
+
+    /**
+     * @brief Followers connected now.
+     */
+    std::size_t followerCount() const { return connected.load(std::memory_order_relaxed); }
+
+private:
+    BookingService& service;
+    int listener;                       /**< Listening socket, or -1. */
+    int wake;                           /**< eventfd made readable by stop(). */
+    std::uint16_t boundPort;
+    std::atomic<bool> stopping;
+    std::atomic<std::size_t> connected;
+    std::thread acceptor;
+    std::mutex mutex;                   /**< Guards the three lists below. */
+    std::vector<int> sockets;           /**< Follower connections still open. */
+    std::vector<std::thread> shippers;  /**< One per follower accepted, until joined. */
+    std::vector<std::thread::id> finished;  /**< Shippers that returned but are not joined yet. */
+
+    /**
+     * @brief Body of the accepting thread.
+     */
+    void acceptLoop();
+
+    /**
+     * @brief Serve one follower until it disconnects or the source stops.
+     */
+    void ship(int fd);
+};
+
+/**
+ * @brief What a Follower is doing.
+ */
+enum class FollowerState {
+    Connecting,  /**< Connecting to the primary, or waiting to retry. */
+    Streaming,   /**< Connected and applying records. */
+    Failed,      /**< Stopped following for good; see Follower::error(). Still read-only. */
+    Promoted     /**< Writable; the follower has finished. */
+};
+
+/**
+ * @class Follower
+ * @brief Keeps a BookingService a read-only copy of a primary until it is promoted.
+ *
+ * A background thread connects to the primary's ReplicationSource, applies what it sends,
+ * and reconnects whenever the connection fails or is silent for too long, resuming where
+ * the service's own journal says it stands. The service answers queries throughout,
+ * including while an image loads, when they see only part of it.
+ */
+class Follower {
+public:
+    /**
+     * @param service The follower's service: freshly opened on its own journal, empty or
+     *        with the position of an earlier run, and outliving the follower.
+     */
+    explicit Follower(BookingService& service);
+    ~Follower();
+
+    Follower(const Follower&) = delete;
+    Follower& operator=(const Follower&) = delete;
+
+    /**
+     * @brief Make the service read-only and start following a primary.
+     *
+     * @param host The primary's address or host name.
+     * @param port Its replication port.
+     * @return false If the service holds state that did not come from a primary (so there
+     *         is no position to resume from), or the follower already started.
+     */
+    bool start(const std::string& host, std::uint16_t port);
+
+    /**
+     * @brief Ask the follower to stop following and make the service writable.
+     *
+     * Records the primary made durable but had not sent yet are lost with it, as they would
+     * be in a crash. Returns at once; the promotion happens on the follower's thread,
+     * within a moment, even after a failure. Safe to call from any thread and from a signal
+     * handler.
+     */
+    void promote();
+
+    /**
+     * @brief Stop following, leaving the service read-only.
+     */
+    void stop();
+
+    FollowerState state() const { return current.load(std::memory_order_acquire); }
+
+    /**
+     * @brief Why the follower failed, or null if it has not.
+     */
+    const char* error() const { return state() == FollowerState::Failed ? failure : nullptr; }
+
+    /**
+     * @brief Durable journal bytes on the primary not yet applied here, as of the last
+     *        frame received.
+     */
+    std::uint64_t lagBytes() const { return lag.load(std::memory_order_relaxed); }
+
+private:
+    /**
+     * @brief How a connection to the primary ended, or Received while it goes on.
+     */
+    enum class Ending { Received, Disconnected, Woken, Failed };
+
+    BookingService& service;
+    std::string host;
+    std::uint16_t port;
+    int wake;                                /**< eventfd made readable by promote() and stop(). */
+    std::atomic<bool> promoting;
+    std::atomic<bool> stopping;
+    std::atomic<FollowerState> current;
+    std::atomic<std::uint64_t> lag;
+    const char* failure;                     /**< Set before current becomes Failed. */
+    std::thread worker;
+
+    /**
+     * @brief Body of the following thread.
+     */
+    void run();
+
+    /**
+     * @brief Follow the primary over one connection.
+     */
+    Ending session(int fd);
+
+    /**
+     * @brief Connect to the primary, giving up on a wake-up or after a while.
+     *
+     * @return int The connected socket, or -1.
+     */
+    int connectToPrimary();
+
+    /**
+     * @brief Read exactly size bytes.
+     *
+     * @param timeoutMs Longest silence allowed between two reads.
+     * @return Ending Received once they are all read.
+     */
+    Ending receive(int fd, char* data, std::size_t size, int timeoutMs);
+
+    /**
+     * @brief Sleep for a while, or until woken.
+     *
+     * @return false If woken.
+     */
+    bool pause(int ms);
+
+    void fail(const char* reason);
+};
+
+#endif // BOOKING_REPLICATION_H
@@ -0,0 +1,251 @@
+// RouteIndex.cpp
+
+#include "RouteIndex.h"
+
+#include <cmath>
+#include <new>
+#include <cstring>
+#include <utility>
+
+RouteIndex::~RouteIndex() {
+    if(Table* t = table.load(std::memory_order_relaxed)) Table::destroy(t);
+}
+
+RouteIndex::Route::~Route() {
+    const Version* version = current.load(std::memory_order_relaxed);
+    if(staged) discard(staged.release(), *version);
+    Block::destroy(const_cast<Block*>(version->buses));
+    Block::destroy(const_cast<Block*>(version->sorted));
+    Block::destroy(const_cast<Block*>(version->recent));
+    delete version;
+}
+
+RouteIndex::Buses RouteIndex::find(StringPool::Id origin, StringPool::Id dest) const {
+    Buses found;
+    const std::uint32_t id = findRoute(origin, dest);
+    if(id == npos) return found;
+    const Version &version = *routesList[id].current.load(std::memory_order_acquire);
+    if(version.busCount == 0) return found;
+    found.first = version.buses->handles();
+    found.count = version.busCount;
+    return found;
+}
+
+std::uint32_t RouteIndex::findRoute(StringPool::Id origin, StringPool::Id dest) const {
+    const Table* t = table.load(std::memory_order_acquire);
+    if(!t) return npos;
+    const std::uint32_t route = static_cast<std::uint32_t>(
+        t->slots()[probe(*t, hashRoute(origin, dest), origin, dest)].load(std::memory_order_acquire));
+    return route == EMPTY ? npos : route;
+}
+
+std::uint32_t RouteIndex::add(StringPool::Id origin, StringPool::Id dest, std::uint32_t handle,
+                              int departureMinute) {
+    const std::uint32_t id = routeFor(origin, dest);
+    Route &route = routesList[id];
+    // A route staged by addUnsorted() takes the bus into its staged version
+    if(route.staged) return addUnsorted(origin, dest, handle, departureMinute);
+
+    const Version &old = *route.current.load(std::memory_order_relaxed);
+    Version* next = new Version(old);
+    stage(*next, old, handle, departureMinute);
+    settle(*next, old);
+    publish(route, next);
+    return id;
+}
+
+std::uint32_t RouteIndex::addUnsorted(StringPool::Id origin, StringPool::Id dest, std::uint32_t handle,
+                                      int departureMinute) {
+    const std::uint32_t id = routeFor(origin, dest);
+    Route &route = routesList[id];
+    const Version &current = *route.current.load(std::memory_order_relaxed);
+    if(!route.staged) {
+        route.staged.reset(new Version(current));
+        unsortedRoutes.push_back(id);
+    }
+    stage(*route.staged, current, handle, departureMinute);
+    return id;
+}
+
+void RouteIndex::publishUnsorted() {
+    for(std::uint32_t id : unsortedRoutes) {
+        Route &route = routesList[id];
+        settle(*route.staged, *route.current.load(std::memory_order_relaxed));
+        publish(route, route.staged.release());
+    }
+    unsortedRoutes.clear();
+}
+
+RouteIndex::Block* RouteIndex::Block::make(std::size_t capacity, bool timed) {
+    const std::size_t bytes = sizeof(Block) + capacity * (sizeof(std::uint32_t) + (timed ? sizeof(std::int16_t) : 0));
+    Block* block = ::new(::operator new(bytes)) Block;
+    block->capacity = static_cast<std::uint32_t>(capacity);
+    return block;
+}
+
+RouteIndex::Table* RouteIndex::Table::make(std::size_t size) {
+    Table* t = ::new(::operator new(sizeof(Table) + size * sizeof(std::atomic<std::uint64_t>))) Table;
+    t->mask = size - 1;
+    std::atomic<std::uint64_t>* slots = t->slots();
+    for(std::size_t i = 0; i < size; ++i) ::new(static_cast<void*>(&slots[i])) std::atomic<std::uint64_t>(EMPTY);
+    return t;
+}
+
+void RouteIndex::stage(Version& next, const Version& published, std::uint32_t handle, int departureMinute) {
+    append(next.buses, next.busCount++, handle, NO_TIME, false, published.buses);
+    if(departureMinute != NO_TIME) {
+        // Settling sorts entries into the list, so it must not be one readers still walk
+        if(next.recent && next.recent == published.recent) {
+            Block* copy = Block::make(next.recent->capacity, true);
+            std::copy(next.recent->handles(), next.recent->handles() + next.recentCount, copy->handles());
+            std::copy(next.recent->minutes(), next.recent->minutes() + next.recentCount, copy->minutes());
+            next.recent = copy;
+        }
+        append(next.recent, next.recentCount++, handle, departureMinute, true, published.recent);
+    }
+}
+
+void RouteIndex::settle(Version& next, const Version& published) {
+    // Entries up to the published count are sorted already; stage() appended the rest
+    const std::size_t prefix = std::min(published.recentCount, next.recentCount);
+    if(next.recentCount > prefix) {
+        std::vector<std::pair<std::int16_t, std::uint32_t>> staged;
+        staged.reserve(next.recentCount - prefix);
+        for(std::size_t i = prefix; i < next.recentCount; ++i) {
+            staged.emplace_back(next.recent->minutes()[i], next.recent->handles()[i]);
+        }
+        std::stable_sort(staged.begin(), staged.end(),
+                         [](const std::pair<std::int16_t, std::uint32_t>& a,
+                            const std::pair<std::int16_t, std::uint32_t>& b) { return a.first < b.first; });
+
+        // Merge from the back so nothing is overwritten before it moves; the older entry
+        // stays first among equal times
+        Block &recent = *const_cast<Block*>(next.recent);
+        std::size_t i = prefix, j = staged.size(), k = next.recentCount;
+        while(j > 0) {
+            if(i > 0 && recent.minutes()[i - 1] > staged[j - 1].first) {
+                --i;
+                recent.minutes()[--k] = recent.minutes()[i];
+                recent.handles()[k] = recent.handles()[i];
+            } else {
+                --j;
+                recent.minutes()[--k] = staged[j].first;
+                recent.handles()[k] = staged[j].second;
+            }
+        }
+    }
+
+    if(next.recentCount <= recentLimit(next.sortedCount)) return;
+    const Block* sorted = mergeRecent(next);
+    // Published versions may still read the old recent list, so it is not reused
+    if(next.recent != published.recent) Block::destroy(const_cast<Block*>(next.recent));
+    next.sorted = sorted;
+    next.sortedCount += next.recentCount;
+    next.recent = nullptr;
+    next.recentCount = 0;
+}
+
+std::size_t RouteIndex::recentLimit(std::size_t sorted) {
+    return RECENT_BASE + static_cast<std::size_t>(std::sqrt(static_cast<double>(sorted)));
+}
+
+void RouteIndex::append(const Block*& block, std::size_t count, std::uint32_t handle, int minute, bool timed,
+                        const Block* published) {
+    if(!block || count == block->capacity) {
+        Block* bigger = Block::make(count ? count * 2 : 4, timed);
+        if(count) {
+            std::copy(block->handles(), block->handles() + count, bigger->handles());
+            if(timed) std::copy(block->minutes(), block->minutes() + count, bigger->minutes());
+        }
+        if(block && block != published) Block::destroy(const_cast<Block*>(block));
+        block = bigger;
+    }
+    // Past every published count, so no reader looks here until the next version
+    Block &target = *const_cast<Block*>(block);
+    target.handles()[count] = handle;
+    if(timed) target.minutes()[count] = static_cast<std::int16_t>(minute);
+}
+
+void RouteIndex::discard(Version* next, const Version& published) {
+    if(next->buses != published.buses) Block::destroy(const_cast<Block*>(next->buses));
+    if(next->sorted != published.sorted) Block::destroy(const_cast<Block*>(next->sorted));
+    if(next->recent != published.recent) Block::destroy(const_cast<Block*>(next->recent));
+    delete next;
+}
+
+RouteIndex::Block* RouteIndex::mergeRecent(const Version& version) {
+    // The sorted array is never appended to, so it gets no spare capacity
+    const std::size_t total = version.sortedCount + version.recentCount;
+    Block* merged = Block::make(total, true);
+    std::size_t i = 0, j = 0, k = 0;
+    // Sorted buses come first among equal times: they were installed before any recent one
+    while(i < version.sortedCount || j < version.recentCount) {
+        if(j == version.recentCount
+           || (i < version.sortedCount && version.sorted->minutes()[i] <= version.recent->minutes()[j])) {
+            merged->minutes()[k] = version.sorted->minutes()[i];
+            merged->handles()[k++] = version.sorted->handles()[i++];
+        } else {
+            merged->minutes()[k] = version.recent->minutes()[j];
+            merged->handles()[k++] = version.recent->handles()[j++];
+        }
+    }
+    return merged;
+}
+
+std::uint32_t RouteIndex::routeFor(StringPool::Id origin, StringPool::Id dest) {
+    if((routesList.size() + 1) * 2 > tableSize) grow();
+
+    Table &t = *table.load(std::memory_order_relaxed);
+    const std::uint32_t h = hashRoute(origin, dest);
+    std::atomic<std::uint64_t> &slot = t.slots()[probe(t, h, origin, dest)];
+    std::uint32_t route = static_cast<std::uint32_t>(slot.load(std::memory_order_relaxed));
+    if(route == EMPTY) {
+        route = static_cast<std::uint32_t>(routesList.size());
+        routesList.emplace(origin, dest);
+        // The route is complete before any reader can find it
+        slot.store((static_cast<std::uint64_t>(h) << 32) | route, std::memory_order_release);
+    }
+    return route;
+}
+
+std::size_t RouteIndex::probe(const Table& t, std::uint32_t hash, StringPool::Id origin, StringPool::Id dest) const {
+    const std::atomic<std::uint64_t>* slots = t.slots();
+    for(std::size_t i = hash & t.mask; ; i = (i + 1) & t.mask) {
+        const std::uint64_t slot = slots[i].load(std::memory_order_acquire);
+        const std::uint32_t route = static_cast<std::uint32_t>(slot);
+        if(route == EMPTY) return i;
+        if(static_cast<std::uint32_t>(slot >> 32) == hash) {
+            const Route &candidate = routesList[route];
+            if(candidate.from == origin && candidate.to == dest) return i;
+        }
+    }
+}
+
+void RouteIndex::publish(Route& route, const Version* next) {
+    const Version* old = route.current.load(std::memory_order_relaxed);
+    route.current.store(next, std::memory_order_release);
+    const Block* used[3] = { next->buses, next->sorted, next->recent };
+    const Block* unlinked[3] = { old->buses, old->sorted, old->recent };
+    for(const Block* block : unlinked) {
+        if(block && std::find(used, used + 3, block) == used + 3) Epoch::retire(const_cast<Block*>(block), Block::destroy);
+    }
+    Epoch::retire(const_cast<Version*>(old), Version::destroy);
+}
+
+void RouteIndex::grow() {
+    const std::size_t size = tableSize ? tableSize * 2 : 16;
+    Table* bigger = Table::make(size);
+    std::atomic<std::uint64_t>* slots = bigger->slots();
+
+    Table* old = table.load(std::memory_order_relaxed);
+    for(std::size_t j = 0; j < tableSize; ++j) {
+        const std::uint64_t slot = old->slots()[j].load(std::memory_order_relaxed);
+        if(static_cast<std::uint32_t>(slot) == EMPTY) continue;
+        std::size_t i = (slot >> 32) & bigger->mask;
+        while(static_cast<std::uint32_t>(slots[i].load(std::memory_order_relaxed)) != EMPTY) i = (i + 1) & bigger->mask;
+        slots[i].store(slot, std::memory_order_relaxed);
+    }
+    table.store(bigger, std::memory_order_release);
+    tableSize = size;
+    if(old) Epoch::retire(old, Table::destroy);
+}
@@ -0,0 +1,349 @@
+#ifndef BOOKING_ROUTEINDEX_H
+#define BOOKING_ROUTEINDEX_H
+
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <algorithm>
+
+#include "Calendar.h"
+#include "Epoch.h"
+#include "SlabStore.h"
+#include "StringPool.h"
+
+/**
+ * @file RouteIndex.h
+ * @brief Index from (origin, destination) to the buses serving that route.
+ */
+
+/**
+ * @class RouteIndex
+ * @brief Hash index from an (origin, destination) pair to the buses serving it.
+ *
+ * Each distinct route is stored once together with the handles of its buses, in
+ * installation order. Routes are keyed on the interned ids of both cities and found
+ * through an open-addressing table, so a search is a couple of integer compares and
+ * never touches other buses.
+ *
+ * Each route also keeps its timed buses sorted by departure minute, as a compact array of
+ * minutes beside the matching handles. A departure-window query binary-searches the
+ * minutes for the ends of the window and walks the handles in between, already in
+ * departure order. Buses installed since the array was last rebuilt wait in a short
+ * recent list, itself sorted by minute and bounded by about the square root of the sorted
+ * array; a query binary-searches it the same way and merges the two ranges as it walks
+ * them, without allocating or sorting anything.
+ *
+ * One writer at a time may change the index, while any number of readers search it
+ * without a lock. What a reader sees of a route is a small immutable version: how many
+ * entries of each array it may read. The array of all buses has spare capacity and is
+ * appended to in place past what any published version shows, a full one being replaced
+ * by one twice the size, so installing a bus never copies the route. The recent list is
+ * copied to insert into it, and merged into a new sorted array once it outgrows its
+ * bound, so a single install costs amortized O(sqrt n) on a route of n timed buses; a
+ * batch through addUnsorted() sorts its buses once and merges them in one pass. A reader
+ * sees a route either wholly before or wholly after a change. The hash table is replaced
+ * the same way when it grows. Replaced versions, arrays and tables are retired through
+ * Epoch, so a reader that does not exclude the writer must hold an Epoch::Guard while it
+ * searches and while it uses what a search returned.
+ */
+class RouteIndex {
+public:
+    static const std::uint32_t npos = 0xFFFFFFFFu;  /**< Returned when a route is not found. */
+
+    /**
+     * @brief The bus handles of one version of a route, as find() returns them.
+     */
+    struct Buses {
+        const std::uint32_t* first = nullptr;
+        std::size_t count = 0;
+
+        const std::uint32_t* begin() const { return first; }
+        const std::uint32_t* end() const { return first + count; }
+        std::size_t size() const { return count; }
+        bool empty() const { return count == 0; }
+    };
+
+    RouteIndex() = default;
+    ~RouteIndex();
+
+    RouteIndex(const RouteIndex&) = delete;
+    RouteIndex& operator=(const RouteIndex&) = delete;
+
+    /**
+     * @brief Buses serving a route.
+     *
+     * @param origin Interned origin location.
+     * @param dest Interned destination location.
+     * @return Buses Bus handles in installation order; empty if no bus serves the
+     *         route. They do not change; a later change to the route publishes new ones.
+     */
+    Buses find(StringPool::Id origin, StringPool::Id dest) const;
+
+    /**
+     * @brief Dense id of a route, for keeping per-route data alongside the index.
+     *
+     * @return std::uint32_t The route id, or npos if no bus serves the route.
+     */
+    std::uint32_t findRoute(StringPool::Id origin, StringPool::Id dest) const;
+
+    /**
+     * @brief Record that a bus serves a route, publishing the route's new version.
+     *
+     * @param origin Interned origin location.
+     * @param dest Interned destination location.
+     * @param handle Handle of the bus in the registry.
+     * @param departureMinute Departure in minutes since midnight, or NO_TIME to leave the
+     *        bus out of departure-window queries.
+     * @return std::uint32_t The route id. New routes get the next id in sequence.
+     */
+    std::uint32_t add(StringPool::Id origin, StringPool::Id dest, std::uint32_t handle,
+                      int departureMinute = NO_TIME);
+
+    /**
+     * @brief Like add(), but stage the bus in an unpublished version of the route.
+     *
+     * For loading many buses at once: each insertion is amortized O(1), and one
+     * publishUnsorted() call at the end sorts the new departures of every route touched
+     * and publishes them. Readers keep seeing the routes as they were until then.
+     */
+    std::uint32_t addUnsorted(StringPool::Id origin, StringPool::Id dest, std::uint32_t handle,
+                              int departureMinute = NO_TIME);
+
+    /**
+     * @brief Publish every route given buses by addUnsorted() since the last call, their
+     *        departures sorted with installation order kept among equal times.
+     *
+     * Sorts the buses staged on each route, merges them into its recent list, and merges
+     * that into the sorted array if it has outgrown its bound.
+     */
+    void publishUnsorted();
+
+    /**
+     * @brief Call fn(handle) for every bus on a route departing within a window, in
+     *        departure order (installation order among equal times).
+     *
+     * A window whose start is after its end wraps past midnight: buses from fromMinute to
+     * the end of the day come first, then those from midnight to toMinute. Every bus
+     * passed to fn comes from the same version of the route.
+     *
+     * @param fromMinute Earliest departure, minutes since midnight.
+     * @param toMinute Latest departure, inclusive.
+     * @return std::size_t The number of buses passed to fn.
+     */
+    template <typename Fn>
+    std::size_t forEachDeparting(StringPool::Id origin, StringPool::Id dest, int fromMinute, int toMinute,
+                                 Fn fn) const {
+        const std::uint32_t id = findRoute(origin, dest);
+        if(id == npos) return 0;
+        const Version &version = *routesList[id].current.load(std::memory_order_acquire);
+        if(fromMinute <= toMinute) return scanDepartures(version, fromMinute, toMinute, fn);
+        return scanDepartures(version, fromMinute, MINUTES_PER_DAY - 1, fn) + scanDepartures(version, 0, toMinute, fn);
+    }
+
+    /**
+     * @brief Number of distinct routes; route ids run from 0 to count() - 1. For the
+     *        writer only.
+     */
+    std::size_t count() const { return routesList.size(); }
+
+private:
+    /**
+     * @brief An array of bus handles, with a departure minute per handle if it was made
+     *        with them, in one allocation: this header, then capacity handles, then
+     *        capacity minutes.
+     *
+     * Entries below a published version's count never change; the writer fills the ones
+     * above it before publishing a version that covers them.
+     */
+    struct Block {
+        std::uint32_t capacity;
+
+        std::uint32_t* handles() { return reinterpret_cast<std::uint32_t*>(this + 1); }
+        const std::uint32_t* handles() const { return reinterpret_cast<const std::uint32_t*>(this + 1); }
+        std::int16_t* minutes() { return reinterpret_cast<std::int16_t*>(handles() + capacity); }
+        const std::int16_t* minutes() const { return reinterpret_cast<const std::int16_t*>(handles() + capacity); }
+
+        /**
+         * @brief Allocate a block of capacity entries, which are left unset.
+         */
+        static Block* make(std::size_t capacity, bool timed);
+
+        static void destroy(void* block) { ::operator delete(block); }
+    };
+
+    /**
+     * @brief The buses of one route at one moment; never changed once published.
+     *
+     * All buses in installation order, the timed buses sorted by departure minute, and the
+     * timed buses installed since then, also sorted by minute. Ties are in installation
+     * order within each array. A block is null while its count is zero. An unpublished
+     * version's recent list may end in entries not sorted yet; see settle().
+     */
+    struct Version {
+        const Block* buses = nullptr;
+        std::uint32_t busCount = 0;
+        const Block* sorted = nullptr;
+        std::uint32_t sortedCount = 0;
+        const Block* recent = nullptr;
+        std::uint32_t recentCount = 0;
+
+        static void destroy(void* version) { delete static_cast<Version*>(version); }
+    };
+
+    /**
+     * @brief Timed buses the recent list may hold before it is merged into the sorted
+     *        array, beyond the square root of the sorted array's length.
+     */
+    static const std::size_t RECENT_BASE = 32;
+
+    /**
+     * @brief One distinct route and the buses serving it.
+     */
+    struct Route {
+        StringPool::Id from;
+        StringPool::Id to;
+        std::atomic<const Version*> current;  /**< What readers see; never null. */
+        std::unique_ptr<Version> staged;      /**< The version addUnsorted() is building, or null. */
+
+        Route(StringPool::Id origin, StringPool::Id dest) : from(origin), to(dest), current(new Version()) {}
+        ~Route();
+    };
+
+    /**
+     * @brief Hash table, in one allocation: this header, then mask + 1 slots. Each slot
+     *        packs a route's hash (high half) and id (low half); a slot whose id is EMPTY
+     *        is empty. Slots go from empty to filled only.
+     */
+    struct Table {
+        std::size_t mask;
+
+        std::atomic<std::uint64_t>* slots() { return reinterpret_cast<std::atomic<std::uint64_t>*>(this + 1); }
+        const std::atomic<std::uint64_t>* slots() const {
+            return reinterpret_cast<const std::atomic<std::uint64_t>*>(this + 1);
+        }
+
+        /**
+         * @brief Allocate a table of size slots, all empty.
+         */
+        static Table* make(std::size_t size);
+
+        static void destroy(void* table) { ::operator delete(table); }
+    };
+
+    static const std::uint32_t EMPTY = 0xFFFFFFFFu;
+
+    SlabStore<Route, 8> routesList;         /**< Distinct routes, in order of first installation. */
+    std::atomic<Table*> table{nullptr};     /**< Size zero until the first route, then a power of two. */
+    std::size_t tableSize = 0;              /**< Slots in table; for the writer. */
+    std::vector<std::uint32_t> unsortedRoutes;  /**< Routes with staged versions waiting for publishUnsorted(). */
+
+    /**
+     * @brief Combined hash of an (origin, destination) pair.
+     */
+    static std::uint32_t hashRoute(StringPool::Id origin, StringPool::Id dest) {
+        std::uint64_t key = (static_cast<std::uint64_t>(origin) << 32) | dest;
+        key *= 0x9E3779B97F4A7C15ull;
+        return static_cast<std::uint32_t>(key >> 32);
+    }
+
+    /**
+     * @brief Call fn(handle) for the buses of a route departing from fromMinute to toMinute,
+     *        in departure order.
+     *
+     * Both arrays are sorted, so each is binary-searched for the window and the two ranges
+     * are merged as they are walked, sorted buses first among equal minutes: they were all
+     * installed before any recent one.
+     */
+    template <typename Fn>
+    static std::size_t scanDepartures(const Version& version, int fromMinute, int toMinute, Fn fn) {
+        std::size_t i = 0, last = 0, j = 0, recentLast = 0;
+        const std::int16_t* minutes = nullptr;
+        const std::int16_t* recentMinutes = nullptr;
+        if(version.sortedCount) {
+            minutes = version.sorted->minutes();
+            i = std::lower_bound(minutes, minutes + version.sortedCount, fromMinute) - minutes;
+            last = std::upper_bound(minutes + i, minutes + version.sortedCount, toMinute) - minutes;
+        }
+        if(version.recentCount) {
+            recentMinutes = version.recent->minutes();
+            j = std::lower_bound(recentMinutes, recentMinutes + version.recentCount, fromMinute) - recentMinutes;
+            recentLast = std::upper_bound(recentMinutes + j, recentMinutes + version.recentCount, toMinute) - recentMinutes;
+        }
+        const std::size_t found = (last - i) + (recentLast - j);
+        while(i < last || j < recentLast) {
+            if(j == recentLast || (i < last && minutes[i] <= recentMinutes[j])) fn(version.sorted->handles()[i++]);
+            else fn(version.recent->handles()[j++]);
+        }
+        return found;
+    }
+
+    /**
+     * @brief The route of an (origin, destination) pair, created if it is new.
+     */
+    std::uint32_t routeFor(StringPool::Id origin, StringPool::Id dest);
+
+    /**
+     * @brief Locate the slot holding a route, or the empty slot where it would go.
+     */
+    std::size_t probe(const Table& t, std::uint32_t hash, StringPool::Id origin, StringPool::Id dest) const;
+
+    /**
+     * @brief Append a bus to an unpublished version: to its buses, and to the end of its
+     *        recent list if it is timed, copying the list first if it is the published one.
+     *
+     * @param published The route's published version, whose blocks next starts from.
+     */
+    static void stage(Version& next, const Version& published, std::uint32_t handle, int departureMinute);
+
+    /**
+     * @brief Sort the entries stage() appended to an unpublished version's recent list into
+     *        the sorted ones before them, then merge the list into a new sorted array if it
+     *        has outgrown its bound.
+     */
+    static void settle(Version& next, const Version& published);
+
+    /**
+     * @brief Most entries the recent list may hold beside a sorted array of sorted entries.
+     */
+    static std::size_t recentLimit(std::size_t sorted);
+
+    /**
+     * @brief Append one entry to a block, replacing the block with one twice the size if
+     *        it is full. A replaced block is retired by publish() if it was published, and
+     *        freed at once if not.
+     *
+     * @param block The block, updated if replaced; may be null.
+     * @param count Entries already in the block; the new one goes after them.
+     * @param published The same block of the published version.
+     */
+    static void append(const Block*& block, std::size_t count, std::uint32_t handle, int minute, bool timed,
+                       const Block* published);
+
+    /**
+     * @brief A sorted block holding a version's sorted and recent buses together; both
+     *        must be sorted.
+     */
+    static Block* mergeRecent(const Version& version);
+
+    /**
+     * @brief Free the blocks of an unpublished version that the published one does not
+     *        share, and the version itself.
+     */
+    static void discard(Version* next, const Version& published);
+
+    /**
+     * @brief Make a route's changed version the one readers see, retiring the old one and
+     *        any of its blocks the new one no longer uses.
+     */
+    static void publish(Route& route, const Version* next);
+
+    /**
+     * @brief Double the table (keeping the load factor at or below 1/2), rehash into a
+     *        new one and publish it.
+     */
+    void grow();
+};
+
+#endif // BOOKING_ROUTEINDEX_H
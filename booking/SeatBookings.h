@@ -0,0 +1,68 @@
+#ifndef BOOKING_SEATBOOKINGS_H
+#define BOOKING_SEATBOOKINGS_H
+
+#include <cstdint>
+
+#include "Bus.h"
+#include "SlabStore.h"
+
+/**
+ * @file SeatBookings.h
+ * @brief Booking serials of each bus's reserved seats, kept beside the bus rather than in it.
+ */
+
+/**
+ * @struct SeatBookings
+ * @brief Which booking each reserved seat of one bus belongs to.
+ *
+ * Only cancelling and looking bookings up read the serials, so they live in a side table
+ * indexed by bus handle and a Bus stays small for the paths that scan or copy it. Guarded
+ * by the owning bus's lock in BusRegistry, like its seat map.
+ */
+struct SeatBookings {
+    /**
+     * @brief Booking serial of each reserved seat; the seats of one reservation share it.
+     *
+     * Only meaningful for seats whose occupancy bit is set on the bus.
+     */
+    std::uint32_t serials[Bus::MAX_SEATS];
+
+    std::uint32_t last;     /**< Serial of the latest booking on the bus, or 0. */
+
+    SeatBookings() : last(0) {}
+
+    /**
+     * @brief Booking serial of a reserved seat.
+     *
+     * @param seatNumber The seat number (1 to the bus's seat count). Must be reserved.
+     */
+    std::uint32_t of(int seatNumber) const { return serials[seatNumber - 1]; }
+
+    /**
+     * @brief Start a new booking on the seats in mask and return its serial.
+     */
+    std::uint32_t open(SeatMask mask) {
+        ++last;
+        for(SeatMask rest = mask; rest; rest &= rest - 1) serials[lowestBit(rest)] = last;
+        return last;
+    }
+
+    /**
+     * @brief Mask of the seats among occupied booked under serial, or 0 if none is left.
+     */
+    SeatMask seatsOf(std::uint32_t serial, SeatMask occupied) const {
+        SeatMask seats = 0;
+        for(SeatMask rest = occupied; rest; rest &= rest - 1) {
+            const int seat = lowestBit(rest);
+            if(serials[seat] == serial) seats |= SeatMask(1) << seat;
+        }
+        return seats;
+    }
+};
+
+/**
+ * @brief Booking serials of every installed bus, indexed by handle; see SlabStore.
+ */
+typedef SlabStore<SeatBookings> SeatBookingStore;
+
+#endif // BOOKING_SEATBOOKINGS_H
@@ -0,0 +1,68 @@
+#ifndef BOOKING_SEATHISTORY_H
+#define BOOKING_SEATHISTORY_H
+
+#include <cstdint>
+
+#include "SeatLayout.h"
+#include "SlabStore.h"
+
+/**
+ * @file SeatHistory.h
+ * @brief Version and recent changes of each bus's seat map, kept beside the bus.
+ */
+
+/**
+ * @struct SeatHistory
+ * @brief Version of one bus's seat map and the seats its last few changes touched.
+ *
+ * Only seat-change deltas read this, so it lives in a side table indexed by bus handle
+ * rather than in Bus. Guarded by the owning bus's lock in BusRegistry, like its seat map.
+ */
+struct SeatHistory {
+    static const int LOG = 16;  /**< Changes remembered for changedSince(). */
+
+    /**
+     * @brief Number of seat map changes so far, plus one: 1 for a bus just installed or
+     *        restored, so that 0 is never a version a client has seen.
+     *
+     * Versions count from 1 again when the bus is restored after a restart, so a client
+     * that reconnects starts over from 0.
+     */
+    std::uint32_t version;
+
+    SeatMask changes[LOG];      /**< Seats each of the last LOG changes touched, at its version modulo LOG. */
+
+    SeatHistory() : version(1) {}
+
+    /**
+     * @brief Count one change to the seat map, touching the given seats. Called once per
+     *        operation, however many seats it moves.
+     */
+    void record(SeatMask seats) {
+        ++version;
+        changes[version % LOG] = seats;
+    }
+
+    /**
+     * @brief Seats whose state (empty, held or reserved) may have changed since a version.
+     *
+     * @param since A version seen earlier, or 0 for none.
+     * @param all Mask of every seat on the bus.
+     * @return SeatMask The seats touched by the changes after since: at most a few for a
+     *         recent version, or all for 0, for a version more than LOG changes old, or for
+     *         one this bus never had.
+     */
+    SeatMask changedSince(std::uint32_t since, SeatMask all) const {
+        if(since == 0 || since > version || version - since > LOG) return all;
+        SeatMask changed = 0;
+        for(std::uint32_t v = since + 1; v <= version; ++v) changed |= changes[v % LOG];
+        return changed;
+    }
+};
+
+/**
+ * @brief Seat history of every installed bus, indexed by handle; see SlabStore.
+ */
+typedef SlabStore<SeatHistory> SeatHistoryStore;
+
+#endif // BOOKING_SEATHISTORY_H
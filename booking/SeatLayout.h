@@ -0,0 +1,268 @@
+#ifndef BOOKING_SEATLAYOUT_H
+#define BOOKING_SEATLAYOUT_H
+
+#include <array>
+#include <cstdint>
+
+/**
+ * @file SeatLayout.h
+ * @brief Seat geometries, as compile-time layouts with runtime dispatch between them.
+ *
+ * Seats are numbered row by row from 1, and seat n is bit (n - 1) of a 64-bit SeatMask.
+ * Each supported geometry is a SeatLayout specialisation whose row, column and mask values
+ * are constants, so the seat math in its member functions compiles to shifts and
+ * multiplies by constants. A bus records which layout it uses as a LayoutKind, and
+ * dispatchLayout() turns that back into the matching SeatLayout type.
+ */
+
+typedef std::uint64_t SeatMask;  /**< One bit per seat: bit n - 1 is seat n. */
+
+/**
+ * @brief Count the set bits in a seat mask.
+ */
+inline int countBits(SeatMask mask) {
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_popcountll(mask);
+#else
+    int count = 0;
+    for(; mask; mask &= mask - 1) ++count;
+    return count;
+#endif
+}
+
+/**
+ * @brief Index of the lowest set bit in a non-zero seat mask.
+ */
+inline int lowestBit(SeatMask mask) {
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_ctzll(mask);
+#else
+    int index = 0;
+    while(!(mask & 1u)) { mask >>= 1; ++index; }
+    return index;
+#endif
+}
+
+/**
+ * @brief Mask of count consecutive seats starting at seat 1.
+ */
+constexpr SeatMask seatRun(int count) {
+    return count >= 64 ? ~SeatMask(0) : (SeatMask(1) << count) - 1;
+}
+
+/**
+ * @brief Replicate the seat bits of one row across every row of a seat mask.
+ *
+ * @param bits Bits for columns 0 .. columns - 1 of a row.
+ */
+constexpr SeatMask repeatPerRow(SeatMask bits, int rows, int columns) {
+    SeatMask mask = 0;
+    for(int row = 0; row < rows; ++row) mask |= bits << (row * columns);
+    return mask;
+}
+
+/**
+ * @brief Which seats an automatically assigned booking should favour.
+ */
+enum class SeatPreference {
+    None,          /**< Any seat. */
+    Window,        /**< A seat in an outer column. */
+    Aisle,         /**< A seat in an inner column. */
+    NearCompanion  /**< A seat in the same row as SeatRequest::companionSeat. */
+};
+
+/**
+ * @brief How to choose between several rows that can take a booking.
+ */
+enum class SeatFit {
+    First,  /**< The lowest-numbered seats that fit. */
+    Best    /**< The fullest row that still fits, keeping empty rows free for groups. */
+};
+
+/**
+ * @struct SeatRequest
+ * @brief What to look for when the system, not the passenger, picks the seats.
+ *
+ * Preferences are soft: when no seats satisfy them, any empty seats are used instead.
+ */
+struct SeatRequest {
+    int count = 1;                                     /**< Seats wanted (1 to the bus's seat count). */
+    SeatPreference preference = SeatPreference::None;  /**< Seats to favour. */
+    SeatFit fit = SeatFit::First;                      /**< Tie-break between rows. */
+    int companionSeat = 0;                             /**< Seat to sit near, for NearCompanion. */
+};
+
+/**
+ * @struct SeatLayout
+ * @brief A seat geometry of Rows rows of Columns seats, the last row possibly partial.
+ *
+ * @tparam Rows Number of rows.
+ * @tparam Columns Seats in a full row.
+ * @tparam Seats Total seats; at most 64 and within the last row.
+ */
+template <int Rows, int Columns, int Seats = Rows * Columns>
+struct SeatLayout {
+    static_assert(Seats <= 64, "a seat map is one 64-bit mask");
+    static_assert(Seats > (Rows - 1) * Columns && Seats <= Rows * Columns, "seats must end in the last row");
+
+    static constexpr int ROWS = Rows;            /**< Seat rows. */
+    static constexpr int COLUMNS = Columns;      /**< Seats per full row. */
+    static constexpr int SEAT_COUNT = Seats;     /**< Total seats. */
+
+    /** @brief Every seat on the bus. */
+    static constexpr SeatMask ALL_SEATS = seatRun(Seats);
+    /** @brief Seats of row 0; shift left by row * COLUMNS for any other row. */
+    static constexpr SeatMask ROW_SEATS = seatRun(Columns);
+    /** @brief Seats in the outer columns of every row. */
+    static constexpr SeatMask WINDOW_SEATS =
+        repeatPerRow(SeatMask(1) | SeatMask(1) << (Columns - 1), Rows, Columns) & ALL_SEATS;
+    /** @brief Seats in the inner columns of every row. */
+    static constexpr SeatMask AISLE_SEATS = ALL_SEATS & ~WINDOW_SEATS;
+    /** @brief Seats of the front row. */
+    static constexpr SeatMask FRONT_SEATS = ROW_SEATS;
+
+    /**
+     * @brief blockStarts()[k]: seats where a block of k adjacent seats can start without
+     *        running past the end of its row.
+     */
+    static constexpr std::array<SeatMask, Columns + 1> blockStarts() {
+        std::array<SeatMask, Columns + 1> starts = {};
+        for(int k = 1; k <= Columns; ++k) starts[k] = repeatPerRow(seatRun(Columns - k + 1), Rows, Columns);
+        return starts;
+    }
+
+    /**
+     * @brief All seats in the row of a seat.
+     */
+    static constexpr SeatMask rowOf(int seatNumber) {
+        return ROW_SEATS << ((seatNumber - 1) / Columns * Columns);
+    }
+
+    /**
+     * @brief Pick empty seats for a booking; see Bus::chooseSeats().
+     */
+    static SeatMask chooseSeats(SeatMask occupied, const SeatRequest& request) {
+        const int count = request.count;
+        const SeatMask empty = ~occupied & ALL_SEATS;
+        if(count < 1 || count > Seats || countBits(empty) < count) return 0;
+
+        // A block that fits in one row keeps the group side by side
+        if(count <= Columns) {
+            SeatMask preferred = empty;
+            if(request.preference == SeatPreference::Window) preferred &= WINDOW_SEATS;
+            else if(request.preference == SeatPreference::Aisle) preferred &= AISLE_SEATS;
+            else if(request.preference == SeatPreference::NearCompanion &&
+                    request.companionSeat >= 1 && request.companionSeat <= Seats) {
+                preferred &= rowOf(request.companionSeat);
+            }
+
+            SeatMask block = findRowBlock(occupied, preferred, count, request.fit);
+            if(!block && preferred != empty) block = findRowBlock(occupied, empty, count, request.fit);
+            if(block) return block;
+        }
+
+        // Otherwise consecutive seats, which at least fill neighbouring rows
+        const SeatMask run = seatRun(count);
+        for(int start = 0; start + count <= Seats; ++start) {
+            if(!(occupied & (run << start))) return run << start;
+        }
+
+        // No contiguous block is free; take the lowest empty seats
+        SeatMask chosen = 0;
+        SeatMask rest = empty;
+        for(int i = 0; i < count; ++i) {
+            chosen |= rest & (0 - rest);
+            rest &= rest - 1;
+        }
+        return chosen;
+    }
+
+    /**
+     * @brief A block of count (at most Columns) adjacent seats within one row, all in
+     *        allowed, or 0.
+     */
+    static SeatMask findRowBlock(SeatMask occupied, SeatMask allowed, int count, SeatFit fit) {
+        static constexpr std::array<SeatMask, Columns + 1> STARTS = blockStarts();
+
+        // Bit i of starts is set when seats i .. i + count - 1 are all allowed and share a row
+        SeatMask starts = allowed & STARTS[count];
+        for(int k = 1; k < count; ++k) starts &= allowed >> k;
+        if(!starts) return 0;
+
+        const SeatMask run = seatRun(count);
+        if(fit == SeatFit::First) return run << lowestBit(starts);
+
+        // Best fit: the candidate whose row has the fewest empty seats left
+        int best = lowestBit(starts);
+        int bestEmpty = Columns + 1;
+        for(SeatMask rest = starts; rest; rest &= rest - 1) {
+            const int start = lowestBit(rest);
+            const int rowEmpty = countBits(~occupied & ALL_SEATS & rowOf(start + 1));
+            if(rowEmpty < bestEmpty) {
+                best = start;
+                bestEmpty = rowEmpty;
+            }
+        }
+        return run << best;
+    }
+};
+
+typedef SeatLayout<8, 4> CoachLayout;             /**< 2+2 coach: 8 rows of 4, 32 seats. */
+typedef SeatLayout<10, 3> SleeperLayout;          /**< 2+1 sleeper: 10 rows of 3, 30 berths. */
+typedef SeatLayout<13, 4, 49> DoubleDeckerLayout; /**< Double-decker: 12 rows of 4 plus a rear seat, 49 seats. */
+
+/**
+ * @brief The layouts a bus can have, as stored in the journal and snapshots.
+ */
+enum class LayoutKind : std::uint8_t {
+    Coach = 0,        /**< CoachLayout. */
+    Sleeper = 1,      /**< SleeperLayout. */
+    DoubleDecker = 2  /**< DoubleDeckerLayout. */
+};
+
+const int LAYOUT_COUNT = 3;  /**< Number of LayoutKind values. */
+
+/**
+ * @struct LayoutInfo
+ * @brief The geometry of a layout, for code that only needs the numbers.
+ */
+struct LayoutInfo {
+    int rows;         /**< Seat rows. */
+    int columns;      /**< Seats per full row. */
+    int seats;        /**< Total seats. */
+    SeatMask all;     /**< Every seat on the bus. */
+    SeatMask window;  /**< Seats in the outer columns. */
+    SeatMask front;   /**< Seats of the front row. */
+    const char* name; /**< Display name. */
+};
+
+/**
+ * @brief Geometry of every layout, indexed by LayoutKind.
+ */
+constexpr LayoutInfo LAYOUTS[LAYOUT_COUNT] = {
+    { CoachLayout::ROWS, CoachLayout::COLUMNS, CoachLayout::SEAT_COUNT, CoachLayout::ALL_SEATS,
+      CoachLayout::WINDOW_SEATS, CoachLayout::FRONT_SEATS, "2+2 coach" },
+    { SleeperLayout::ROWS, SleeperLayout::COLUMNS, SleeperLayout::SEAT_COUNT, SleeperLayout::ALL_SEATS,
+      SleeperLayout::WINDOW_SEATS, SleeperLayout::FRONT_SEATS, "2+1 sleeper" },
+    { DoubleDeckerLayout::ROWS, DoubleDeckerLayout::COLUMNS, DoubleDeckerLayout::SEAT_COUNT,
+      DoubleDeckerLayout::ALL_SEATS, DoubleDeckerLayout::WINDOW_SEATS, DoubleDeckerLayout::FRONT_SEATS,
+      "double-decker" },
+};
+
+/**
+ * @brief Call fn with a value of the SeatLayout type for kind, and return its result.
+ *
+ * fn is typically a generic lambda, so its body is compiled once per layout with that
+ * layout's constants.
+ */
+template <typename Fn>
+auto dispatchLayout(LayoutKind kind, Fn&& fn) -> decltype(fn(CoachLayout())) {
+    switch(kind) {
+        case LayoutKind::Sleeper: return fn(SleeperLayout());
+        case LayoutKind::DoubleDecker: return fn(DoubleDeckerLayout());
+        case LayoutKind::Coach: break;
+    }
+    return fn(CoachLayout());
+}
+
+#endif // BOOKING_SEATLAYOUT_H
@@ -0,0 +1,480 @@
+// Server.cpp
+
+#include "Server.h"
+#include "Protocol.h"
+
+#include <algorithm>
+#include <thread>
+#include <cerrno>
+#include <cstring>
+#include <unistd.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+
+using namespace protocol;
+
+namespace {
+
+const int MAX_EVENTS = 256;                    /**< Events taken per epoll_wait(). */
+const std::size_t READ_CHUNK = 16 * 1024;      /**< Bytes read per recv(). */
+const std::size_t MAX_OUTPUT = 1024 * 1024;    /**< Unsent response bytes at which a connection stops being read. */
+const std::size_t MAX_HTTP_REQUEST = 8 * 1024; /**< Longest HTTP request head accepted. */
+
+/**
+ * @brief Per-thread decode buffers, reused so a request does not allocate.
+ */
+struct Scratch {
+    BusInfo info;
+    std::string busNumber;
+    std::string passenger;
+    std::string from;
+    std::string to;
+    std::vector<int> seats;
+    std::vector<const Bus*> matches;
+    Bus bus;
+    SeatDelta delta;
+};
+
+Scratch& scratch() {
+    thread_local Scratch buffers;
+    return buffers;
+}
+
+bool getSeatNumber(Reader& in, int& seatNumber) {
+    std::uint8_t seat;
+    if(!in.getU8(seat)) return false;
+    seatNumber = seat;
+    return true;
+}
+
+bool getFare(Reader& in, std::int32_t& fare) {
+    std::uint32_t v;
+    if(!in.getU32(v)) return false;
+    // Fares past INT32_MAX come out negative and are refused as InvalidBus
+    fare = static_cast<std::int32_t>(v);
+    return true;
+}
+
+/**
+ * @brief Answer a request that could not be decoded.
+ *
+ * @return false Always, so the caller closes the connection.
+ */
+bool refuse(std::string& out, std::uint32_t requestId) {
+    endFrame(out, beginFrame(out, requestId, PROTOCOL_ERROR));
+    return false;
+}
+
+} // namespace
+
+/**
+ * @brief One client connection and its buffers.
+ */
+struct Server::Connection {
+    int fd;
+    std::size_t slot;                   /**< Position in the worker's list of open connections. */
+    std::string input;                  /**< Bytes received and not yet decoded. */
+    std::string output;                 /**< Encoded responses; output[sent..] is still to send. */
+    std::size_t sent = 0;
+    std::vector<std::size_t> deferred;  /**< Offsets in output of Ok statuses awaiting durability. */
+    std::uint32_t events = EPOLLIN;     /**< Events registered with epoll. */
+    bool touched = false;               /**< Queued for flushing this iteration. */
+    bool eof = false;                   /**< The peer has finished sending. */
+    bool failed = false;                /**< Close after the next flush. */
+
+    std::size_t pending() const { return output.size() - sent; }
+};
+
+Server::Server(BookingService& owner)
+    : service(owner), listener(-1), wake(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)), boundPort(0)
+{
+}
+
+Server::~Server() {
+    if(listener >= 0) ::close(listener);
+    if(wake >= 0) ::close(wake);
+}
+
+bool Server::listen(std::uint16_t port) {
+    if(wake < 0) return false;
+    const int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if(fd < 0) return false;
+
+    const int on = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+    sockaddr_in address;
+    std::memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    address.sin_port = htons(port);
+    socklen_t length = sizeof(address);
+    if(::bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || ::listen(fd, SOMAXCONN) != 0 ||
+       getsockname(fd, reinterpret_cast<sockaddr*>(&address), &length) != 0) {
+        ::close(fd);
+        return false;
+    }
+
+    if(listener >= 0) ::close(listener);
+    listener = fd;
+    boundPort = ntohs(address.sin_port);
+    return true;
+}
+
+bool Server::run(int threads) {
+    if(listener < 0) return false;
+    if(threads < 1) threads = 1;
+
+    std::vector<int> loops;
+    for(int i = 0; i < threads; ++i) {
+        const int epoll = epoll_create1(EPOLL_CLOEXEC);
+        if(epoll < 0) break;
+        loops.push_back(epoll);
+
+        // Only one worker is woken per new connection; every worker sees stop()
+        epoll_event event;
+        event.events = EPOLLIN | EPOLLEXCLUSIVE;
+        event.data.ptr = &listener;
+        epoll_ctl(epoll, EPOLL_CTL_ADD, listener, &event);
+        event.events = EPOLLIN;
+        event.data.ptr = &wake;
+        epoll_ctl(epoll, EPOLL_CTL_ADD, wake, &event);
+    }
+    if(loops.size() != static_cast<std::size_t>(threads)) {
+        for(int epoll : loops) ::close(epoll);
+        return false;
+    }
+
+    std::vector<std::thread> workers;
+    for(int i = 1; i < threads; ++i) workers.emplace_back(&Server::serve, this, loops[i]);
+    serve(loops[0]);
+    for(std::thread &worker : workers) worker.join();
+    for(int epoll : loops) ::close(epoll);
+
+    // Leave the wake-up unset so the server can run again
+    std::uint64_t drained;
+    while(::read(wake, &drained, sizeof(drained)) > 0) {}
+    return true;
+}
+
+void Server::stop() {
+    // write() is async-signal-safe; the eventfd stays readable, waking every worker
+    const std::uint64_t one = 1;
+    ssize_t written = ::write(wake, &one, sizeof(one));
+    (void)written;
+}
+
+void Server::serve(int epoll) {
+    epoll_event events[MAX_EVENTS];
+    std::vector<Connection*> open;
+    std::vector<Connection*> touched;
+    bool stopping = false;
+
+    while(!stopping) {
+        const int ready = epoll_wait(epoll, events, MAX_EVENTS, -1);
+        if(ready < 0) {
+            if(errno == EINTR) continue;
+            break;
+        }
+
+        service.beginDeferred();
+        for(int i = 0; i < ready; ++i) {
+            void *tag = events[i].data.ptr;
+            if(tag == &listener) {
+                acceptAll(epoll, open);
+            } else if(tag == &wake) {
+                stopping = true;
+            } else {
+                Connection &c = *static_cast<Connection*>(tag);
+                if(events[i].events & (EPOLLIN | EPOLLOUT | EPOLLHUP | EPOLLERR)) {
+                    if(!readRequests(c)) c.failed = true;
+                }
+                if(!c.touched) {
+                    c.touched = true;
+                    touched.push_back(&c);
+                }
+            }
+        }
+        const bool durable = service.endDeferred();
+
+        for(Connection *c : touched) {
+            c->touched = false;
+            if(!durable) {
+                for(std::size_t at : c->deferred) c->output[at] = static_cast<char>(BookingStatus::JournalFailed);
+            }
+            c->deferred.clear();
+
+            if(flush(epoll, *c) && !c->failed && !(c->eof && c->pending() == 0)) continue;
+            // Swap-remove from the open list before freeing
+            open[c->slot] = open.back();
+            open[c->slot]->slot = c->slot;
+            open.pop_back();
+            ::close(c->fd);
+            delete c;
+        }
+        touched.clear();
+    }
+
+    for(Connection *c : open) {
+        ::close(c->fd);
+        delete c;
+    }
+}
+
+void Server::acceptAll(int epoll, std::vector<Connection*>& open) {
+    for(;;) {
+        const int fd = accept4(listener, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if(fd < 0) {
+            if(errno == EINTR) continue;
+            // EAGAIN once the backlog is empty; anything else (say EMFILE) waits for the next wake-up
+            return;
+        }
+        // Responses are small and latency-bound; do not let Nagle hold them back
+        const int on = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+
+        Connection *c = new Connection();
+        c->fd = fd;
+        c->slot = open.size();
+        epoll_event event;
+        event.events = c->events;
+        event.data.ptr = c;
+        if(epoll_ctl(epoll, EPOLL_CTL_ADD, fd, &event) != 0) {
+            ::close(fd);
+            delete c;
+            continue;
+        }
+        open.push_back(c);
+    }
+}
+
+bool Server::readRequests(Connection& c) {
+    for(;;) {
+        // Decode every complete frame received so far, unless the peer is not reading
+        std::size_t at = 0;
+        while(c.pending() < MAX_OUTPUT && c.input.size() - at >= 4) {
+            const std::uint32_t length = getU32(c.input.data() + at);
+            if(length < HEADER_BYTES - 4 || length > MAX_FRAME - 4) {
+                // "GET " read as a length is far past MAX_FRAME, so no frame starts that way
+                if(at == 0 && c.sent == 0 && c.output.empty() && c.input.compare(0, 4, "GET ") == 0) {
+                    const std::size_t head = c.input.find("\r\n\r\n");
+                    if(head != std::string::npos) return answerHttp(c, head);
+                    if(c.input.size() > MAX_HTTP_REQUEST) return false;
+                    break;
+                }
+                return refuse(c.output, 0);
+            }
+            if(c.input.size() - at - 4 < length) break;
+            if(!handle(c, c.input.data() + at + 4, length)) return false;
+            at += 4 + length;
+        }
+        c.input.erase(0, at);
+
+        if(c.eof || c.pending() >= MAX_OUTPUT) return true;
+
+        const std::size_t have = c.input.size();
+        c.input.resize(have + READ_CHUNK);
+        const ssize_t n = ::recv(c.fd, &c.input[have], READ_CHUNK, 0);
+        c.input.resize(have + (n > 0 ? static_cast<std::size_t>(n) : 0));
+        if(n > 0) continue;
+        if(n == 0) {
+            c.eof = true;
+            return true;
+        }
+        if(errno == EINTR) continue;
+        return errno == EAGAIN || errno == EWOULDBLOCK;
+    }
+}
+
+bool Server::answerHttp(Connection& c, std::size_t head) {
+    // Only the request line matters: "GET /metrics HTTP/1.x", perhaps with a query
+    const std::size_t pathEnd = std::min(c.input.find_first_of(" ?\r", 4), head);
+    const bool metrics = c.input.compare(4, pathEnd - 4, "/metrics") == 0;
+    c.input.clear();
+
+    std::string body;
+    if(metrics) service.writeMetrics(body);
+    else body = "Not found\n";
+    c.output.append(metrics ? "HTTP/1.0 200 OK\r\n" : "HTTP/1.0 404 Not Found\r\n");
+    c.output.append(metrics ? "Content-Type: text/plain; version=0.0.4\r\n" : "Content-Type: text/plain\r\n");
+    c.output.append("Content-Length: ").append(std::to_string(body.size())).append("\r\n");
+    c.output.append("Connection: close\r\n\r\n").append(body);
+
+    // One request per connection: read no further and close once the response is sent
+    c.eof = true;
+    return true;
+}
+
+bool Server::handle(Connection& c, const char* frame, std::size_t length) {
+    const std::uint32_t requestId = getU32(frame);
+    const Opcode opcode = static_cast<Opcode>(static_cast<std::uint8_t>(frame[4]));
+    Reader in = { frame + 5, frame + length };
+    Scratch &s = scratch();
+    std::string &out = c.output;
+
+    BookingStatus status;
+    std::size_t response;
+    bool journaled = true;
+    switch(opcode) {
+        case Opcode::Install: {
+            std::uint8_t layout;
+            BusInfo &info = s.info;
+            if(!in.getString(info.busNumber) || !in.getString(info.driverName) || !in.getString(info.arrivalTime) ||
+               !in.getString(info.departureTime) || !in.getString(info.from) || !in.getString(info.to) ||
+               !in.getU8(layout) || !getFare(in, info.fares.base[0]) || !getFare(in, info.fares.base[1]) ||
+               !getFare(in, info.fares.base[2]) || !in.atEnd()) return refuse(out, requestId);
+            // Out-of-range layouts are refused by install() as InvalidBus
+            info.layout = static_cast<LayoutKind>(layout);
+            status = service.install(info);
+            response = beginFrame(out, requestId, static_cast<std::uint8_t>(status));
+            break;
+        }
+        case Opcode::Reserve: {
+            int seatNumber;
+            if(!in.getString(s.busNumber) || !getSeatNumber(in, seatNumber) || !in.getString(s.passenger) ||
+               !in.atEnd()) return refuse(out, requestId);
+            status = service.reserve(s.busNumber, seatNumber, s.passenger);
+            response = beginFrame(out, requestId, static_cast<std::uint8_t>(status));
+            break;
+        }
+        case Opcode::Cancel: {
+            int seatNumber;
+            if(!in.getString(s.busNumber) || !getSeatNumber(in, seatNumber) || !in.atEnd()) {
+                return refuse(out, requestId);
+            }
+            status = service.cancel(s.busNumber, seatNumber);
+            response = beginFrame(out, requestId, static_cast<std::uint8_t>(status));
+            break;
+        }
+        case Opcode::Show: {
+            if(!in.getString(s.busNumber) || !in.atEnd()) return refuse(out, requestId);
+            journaled = false;
+            Bus &bus = s.bus;
+            status = service.getBus(s.busNumber, bus);
+            response = beginFrame(out, requestId, static_cast<std::uint8_t>(status));
+            if(status != BookingStatus::Ok) break;
+            putString(out, service.text(bus.getDriverName()));
+            putString(out, service.text(bus.getArrivalTime()));
+            putString(out, service.text(bus.getDepartureTime()));
+            putString(out, service.text(bus.getOrigin()));
+            putString(out, service.text(bus.getDestination()));
+            putU8(out, static_cast<std::uint8_t>(bus.getLayout()));
+            putU64(out, bus.occupiedSeats());
+            for(int seatNumber = 1; seatNumber <= bus.seatCount(); ++seatNumber) {
+                if(bus.isReserved(seatNumber)) putString(out, service.passengerName(bus.passengerOf(seatNumber)));
+            }
+            break;
+        }
+        case Opcode::SeatChanges: {
+            std::uint32_t since;
+            if(!in.getString(s.busNumber) || !in.getU32(since) || !in.atEnd()) return refuse(out, requestId);
+            journaled = false;
+            SeatDelta &delta = s.delta;
+            status = service.seatChanges(s.busNumber, since, delta);
+            response = beginFrame(out, requestId, static_cast<std::uint8_t>(status));
+            if(status != BookingStatus::Ok) break;
+            putU32(out, delta.version);
+            putU64(out, delta.changed);
+            putU64(out, delta.reserved);
+            putU64(out, delta.held);
+            for(SeatMask rest = delta.reserved; rest; rest &= rest - 1) {
+                putString(out, service.passengerName(delta.passengers[lowestBit(rest)]));
+            }
+            break;
+        }
+        case Opcode::RouteSearch: {
+            std::uint16_t earliest, latest, limit;
+            if(!in.getString(s.from) || !in.getString(s.to) || !in.getU16(earliest) || !in.getU16(latest) ||
+               !in.getU16(limit) || !in.atEnd()) return refuse(out, requestId);
+            const bool window = earliest != ANY_TIME;
+            if(window && (earliest >= MINUTES_PER_DAY || latest >= MINUTES_PER_DAY)) return refuse(out, requestId);
+            journaled = false;
+
+            // Buses never move, and the details read below never change once installed
+            std::vector<const Bus*> &matches = s.matches;
+            matches.clear();
+            const auto collect = [&](const Bus& bus) {
+                if(matches.size() < limit) matches.push_back(&bus);
+            };
+            if(window) service.forEachDeparting(s.from, s.to, earliest, latest, collect);
+            else service.forEachOnRoute(s.from, s.to, collect);
+
+            // Seat counts are looked up after the registry lock is dropped
+            status = BookingStatus::Ok;
+            response = beginFrame(out, requestId, static_cast<std::uint8_t>(status));
+            putU16(out, static_cast<std::uint16_t>(matches.size()));
+            for(const Bus *bus : matches) {
+                const int departs = bus->getDepartureMinute();
+                const int empty = service.freeSeats(bus->getBusNumber());
+                putString(out, bus->getBusNumber());
+                putU16(out, departs == NO_TIME ? ANY_TIME : static_cast<std::uint16_t>(departs));
+                putU8(out, static_cast<std::uint8_t>(empty < 0 ? 0 : empty));
+            }
+            break;
+        }
+        case Opcode::ReserveSeats: {
+            std::uint8_t count;
+            if(!in.getString(s.busNumber) || !in.getString(s.passenger) || !in.getU8(count)) {
+                return refuse(out, requestId);
+            }
+            s.seats.resize(count);
+            for(int &seatNumber : s.seats) {
+                if(!getSeatNumber(in, seatNumber)) return refuse(out, requestId);
+            }
+            if(!in.atEnd()) return refuse(out, requestId);
+
+            Paise fareTotal = 0;
+            status = service.reserveSeats(s.busNumber, s.seats, s.passenger, fareTotal);
+            response = beginFrame(out, requestId, static_cast<std::uint8_t>(status));
+            if(status == BookingStatus::Ok) putU64(out, static_cast<std::uint64_t>(fareTotal));
+            break;
+        }
+        default:
+            return refuse(out, requestId);
+    }
+    endFrame(out, response);
+
+    // The status byte follows the length and request id
+    if(journaled && status == BookingStatus::Ok) c.deferred.push_back(response + 8);
+    return true;
+}
+
+bool Server::flush(int epoll, Connection& c) {
+    while(c.sent < c.output.size()) {
+        const ssize_t n = ::send(c.fd, c.output.data() + c.sent, c.output.size() - c.sent, MSG_NOSIGNAL);
+        if(n > 0) {
+            c.sent += static_cast<std::size_t>(n);
+        } else if(n < 0 && errno == EINTR) {
+            continue;
+        } else if(n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
+        } else {
+            return false;
+        }
+    }
+    if(c.sent == c.output.size()) {
+        // Keeps the capacity, so a steady stream of requests stops allocating
+        c.output.clear();
+        c.sent = 0;
+    } else if(c.sent >= MAX_OUTPUT) {
+        c.output.erase(0, c.sent);
+        c.sent = 0;
+    }
+
+    // Stop reading a peer that has stopped reading; wait for room while output is left
+    std::uint32_t wanted = 0;
+    if(!c.eof && c.pending() < MAX_OUTPUT) wanted |= EPOLLIN;
+    if(c.pending() > 0) wanted |= EPOLLOUT;
+    if(wanted != c.events) {
+        epoll_event event;
+        event.events = wanted;
+        event.data.ptr = &c;
+        if(epoll_ctl(epoll, EPOLL_CTL_MOD, c.fd, &event) != 0) return false;
+        c.events = wanted;
+    }
+    return true;
+}
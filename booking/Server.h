@@ -0,0 +1,122 @@
+#ifndef BOOKING_SERVER_H
+#define BOOKING_SERVER_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+#include "BookingService.h"
+
+/**
+ * @file Server.h
+ * @brief TCP front end serving the booking core over the binary protocol in Protocol.h.
+ */
+
+/**
+ * @class Server
+ * @brief Multi-threaded epoll server for one BookingService.
+ *
+ * Each worker thread runs its own epoll loop over non-blocking sockets; the listening
+ * socket is registered in every loop with EPOLLEXCLUSIVE, so a new connection wakes one
+ * worker and stays with it. A worker reads everything a connection has sent, answers every
+ * complete request in it in order (clients may pipeline freely), and writes the responses
+ * back in as few writes as the socket allows.
+ *
+ * With a journal open, each loop iteration handles its requests with durability deferred
+ * (see BookingService::beginDeferred()) and waits once for all of them before sending any
+ * response, so a response never reports a change that is not yet durable, and a busy worker
+ * pays for one group commit per iteration rather than one per request.
+ *
+ * The same port answers "GET /metrics" over HTTP with BookingService::writeMetrics(),
+ * for Prometheus to scrape; the connection closes after the response.
+ *
+ * Linux only.
+ */
+class Server {
+public:
+    explicit Server(BookingService& service);
+    ~Server();
+
+    Server(const Server&) = delete;
+    Server& operator=(const Server&) = delete;
+
+    /**
+     * @brief Bind and listen on a TCP port of every local address.
+     *
+     * @param port The port, or 0 for one picked by the system (see port()).
+     * @return true On success.
+     * @return false If the socket could not be created, bound or listened on.
+     */
+    bool listen(std::uint16_t port);
+
+    /**
+     * @brief The port being listened on, once listen() succeeded.
+     */
+    std::uint16_t port() const { return boundPort; }
+
+    /**
+     * @brief Serve connections until stop() is called.
+     *
+     * @param threads Worker threads; the calling thread is one of them.
+     * @return false If listen() has not succeeded or an epoll instance could not be made.
+     */
+    bool run(int threads);
+
+    /**
+     * @brief Make run() return once every worker finishes its current iteration. Open
+     *        connections are closed.
+     *
+     * Safe to call from any thread and from a signal handler.
+     */
+    void stop();
+
+private:
+    struct Connection;
+
+    BookingService& service;
+    int listener;               /**< Listening socket, or -1. */
+    int wake;                   /**< eventfd made readable by stop(). */
+    std::uint16_t boundPort;
+
+    /**
+     * @brief One worker's event loop.
+     */
+    void serve(int epoll);
+
+    /**
+     * @brief Accept every pending connection and register it with epoll.
+     */
+    void acceptAll(int epoll, std::vector<Connection*>& open);
+
+    /**
+     * @brief Read what a connection has sent and answer each complete request.
+     *
+     * @return false If the connection should be closed.
+     */
+    bool readRequests(Connection& c);
+
+    /**
+     * @brief Answer the HTTP request at the start of c.input, whose head ends at offset head.
+     *
+     * @return true Always; the connection closes once the response is sent.
+     */
+    bool answerHttp(Connection& c, std::size_t head);
+
+    /**
+     * @brief Decode and execute one request frame, appending its response to c.output.
+     *
+     * @return false If the frame could not be decoded.
+     */
+    bool handle(Connection& c, const char* frame, std::size_t length);
+
+    /**
+     * @brief Write as much pending output as the socket takes, and listen for writability
+     *        while some is left.
+     *
+     * @return false If the connection failed.
+     */
+    bool flush(int epoll, Connection& c);
+};
+
+#endif // BOOKING_SERVER_H
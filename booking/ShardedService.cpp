@@ -0,0 +1,331 @@
+// ShardedService.cpp
+
+#include "ShardedService.h"
+
+#include <algorithm>
+#include <chrono>
+#include <pthread.h>
+#include <sched.h>
+
+namespace {
+
+const std::size_t BATCH = 64;           /**< Requests a worker takes from one ring before moving on. */
+const int SPINS_BEFORE_PARKING = 256;   /**< Empty sweeps a worker makes before parking. */
+
+/**
+ * @brief True if the request changes journaled state, so its Ok waits for durability.
+ */
+bool journaled(ShardRequest::Op op) {
+    return op == ShardRequest::Op::Install || op == ShardRequest::Op::Reserve || op == ShardRequest::Op::Cancel ||
+           op == ShardRequest::Op::ReserveSeats;
+}
+
+/**
+ * @brief Carry out a request against the shard's own service.
+ */
+void execute(BookingService& service, ShardRequest& r) {
+    switch(r.op) {
+        case ShardRequest::Op::Install:
+            r.status = service.install(r.info);
+            break;
+        case ShardRequest::Op::Reserve:
+            r.status = service.reserve(r.busNumber, r.seatNumber, r.passenger);
+            break;
+        case ShardRequest::Op::Cancel:
+            r.status = service.cancel(r.busNumber, r.seatNumber);
+            break;
+        case ShardRequest::Op::ReserveSeats:
+            r.status = service.reserveSeats(r.busNumber, r.seats, r.passenger, r.fareTotal);
+            break;
+        case ShardRequest::Op::Show: {
+            r.passengers.clear();
+            r.status = service.getBus(r.busNumber, r.bus);
+            if(r.status != BookingStatus::Ok) break;
+            // Interned ids mean nothing outside the shard, so hand the details back as text
+            const Bus &bus = r.bus;
+            r.info.busNumber = bus.getBusNumber();
+            r.info.driverName = service.text(bus.getDriverName());
+            r.info.arrivalTime = service.text(bus.getArrivalTime());
+            r.info.departureTime = service.text(bus.getDepartureTime());
+            r.info.from = service.text(bus.getOrigin());
+            r.info.to = service.text(bus.getDestination());
+            r.info.layout = bus.getLayout();
+            r.info.fares = bus.getFares();
+            for(int seatNumber = 1; seatNumber <= bus.seatCount(); ++seatNumber) {
+                if(bus.isReserved(seatNumber)) r.passengers.push_back(service.passengerName(bus.passengerOf(seatNumber)));
+            }
+            break;
+        }
+        case ShardRequest::Op::Route: {
+            r.matches.clear();
+            const auto collect = [&](const Bus& bus) {
+                r.matches.push_back(RouteMatch{ bus.getBusNumber(), bus.getDepartureMinute(), 0 });
+            };
+            if(r.fromMinute == NO_TIME) service.forEachOnRoute(r.from, r.to, collect);
+            else service.forEachDeparting(r.from, r.to, r.fromMinute, r.toMinute, collect);
+            // Seat counts are looked up once the registry lock is dropped
+            for(RouteMatch &match : r.matches) match.freeSeats = service.freeSeats(match.busNumber);
+            r.status = BookingStatus::Ok;
+            break;
+        }
+    }
+}
+
+} // namespace
+
+/**
+ * @brief One partition: its booking state and the thread that owns it.
+ */
+struct ShardedService::Shard {
+    BookingService service;
+    std::thread worker;
+    std::atomic<bool> parked{false};      /**< The worker is (about to be) asleep on wakeup. */
+    std::mutex parkMutex;
+    std::condition_variable wakeup;
+};
+
+ShardedService::ShardedService(int count)
+    : sessionCount(0), stopping(false)
+{
+    if(count < 1) count = 1;
+    for(int k = 0; k < count; ++k) shards.emplace_back(new Shard());
+
+    const unsigned cores = std::thread::hardware_concurrency();
+    for(std::size_t k = 0; k < shards.size(); ++k) {
+        shards[k]->worker = std::thread(&ShardedService::work, this, k);
+        if(cores > 1) {
+            // Best effort; an unpinned worker still owns its shard
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            CPU_SET(k % cores, &set);
+            pthread_setaffinity_np(shards[k]->worker.native_handle(), sizeof(set), &set);
+        }
+    }
+}
+
+ShardedService::~ShardedService() {
+    stopping.store(true);
+    for(std::size_t k = 0; k < shards.size(); ++k) {
+        wake(k);
+        shards[k]->worker.join();
+    }
+}
+
+bool ShardedService::openJournals(const std::string& path, std::uint64_t checkpointBytes) {
+    for(std::size_t k = 0; k < shards.size(); ++k) {
+        BookingService &service = shards[k]->service;
+        if(!service.openJournal(path + "." + std::to_string(k), checkpointBytes)) return false;
+
+        bool owned = true;
+        service.forEachBus([&](const Bus& bus) {
+            if(shardOf(bus.getBusNumber()) != static_cast<int>(k)) owned = false;
+        });
+        if(!owned) return false;
+    }
+    return true;
+}
+
+bool ShardedService::checkpoint() {
+    bool all = true;
+    for(std::unique_ptr<Shard> &shard : shards) all = shard->service.checkpoint() && all;
+    return all;
+}
+
+ShardedService::Session* ShardedService::openSession() {
+    std::lock_guard<std::mutex> lock(sessionMutex);
+    const std::size_t count = sessionCount.load(std::memory_order_relaxed);
+    if(count == MAX_SESSIONS) return nullptr;
+    sessions[count].reset(new Session(*this));
+    // Workers only look at sessions below the published count
+    sessionCount.store(count + 1, std::memory_order_release);
+    return sessions[count].get();
+}
+
+std::size_t ShardedService::size() const {
+    std::size_t total = 0;
+    for(const std::unique_ptr<Shard> &shard : shards) total += shard->service.size();
+    return total;
+}
+
+Paise ShardedService::revenue() const {
+    Paise total = 0;
+    for(const std::unique_ptr<Shard> &shard : shards) total += shard->service.revenue();
+    return total;
+}
+
+std::int64_t ShardedService::totalFreeSeats() const {
+    std::int64_t total = 0;
+    for(const std::unique_ptr<Shard> &shard : shards) total += shard->service.totalFreeSeats();
+    return total;
+}
+
+void ShardedService::wake(std::size_t k) {
+    Shard &shard = *shards[k];
+    // Pairs with the fence in work(): either the worker sees the new request or we see it parked
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if(!shard.parked.load(std::memory_order_relaxed)) return;
+    std::lock_guard<std::mutex> lock(shard.parkMutex);
+    shard.parked.store(false, std::memory_order_relaxed);
+    shard.wakeup.notify_one();
+}
+
+void ShardedService::work(std::size_t k) {
+    Shard &shard = *shards[k];
+    std::vector<std::pair<ShardRequest*, Session*>> batch;
+    int idle = 0;
+
+    while(!stopping.load(std::memory_order_relaxed)) {
+        const std::size_t count = sessionCount.load(std::memory_order_acquire);
+
+        // One durability wait covers everything taken in a sweep
+        shard.service.beginDeferred();
+        for(std::size_t s = 0; s < count; ++s) {
+            Session &session = *sessions[s];
+            SpscQueue<ShardRequest*> &requests = session.links[k]->requests;
+            ShardRequest *request;
+            for(std::size_t taken = 0; taken < BATCH && requests.pop(request); ++taken) {
+                execute(shard.service, *request);
+                batch.emplace_back(request, &session);
+            }
+        }
+        const bool durable = shard.service.endDeferred();
+
+        for(const std::pair<ShardRequest*, Session*> &done : batch) {
+            ShardRequest &r = *done.first;
+            if(!durable && r.status == BookingStatus::Ok && journaled(r.op)) r.status = BookingStatus::JournalFailed;
+            // Never full: a session keeps at most RING_CAPACITY requests in flight per shard
+            done.second->links[k]->completions.push(done.first);
+        }
+        const bool worked = !batch.empty();
+        batch.clear();
+
+        if(worked) {
+            idle = 0;
+            continue;
+        }
+        if(++idle < SPINS_BEFORE_PARKING) {
+            std::this_thread::yield();
+            continue;
+        }
+
+        // Park, unless a request slipped in after the last sweep
+        shard.parked.store(true, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        bool pending = false;
+        for(std::size_t s = 0; s < sessionCount.load(std::memory_order_acquire) && !pending; ++s) {
+            pending = !sessions[s]->links[k]->requests.empty();
+        }
+        if(!pending) {
+            std::unique_lock<std::mutex> lock(shard.parkMutex);
+            // The timeout covers a session opened while parking; submitters always wake us
+            shard.wakeup.wait_for(lock, std::chrono::milliseconds(1), [&]() {
+                return !shard.parked.load(std::memory_order_relaxed) || stopping.load(std::memory_order_relaxed);
+            });
+        }
+        shard.parked.store(false, std::memory_order_relaxed);
+        idle = 0;
+    }
+}
+
+ShardedService::Session::Session(ShardedService& service)
+    : owner(service), fanout(service.shards.size())
+{
+    for(std::size_t k = 0; k < service.shards.size(); ++k) links.emplace_back(new Link());
+}
+
+bool ShardedService::Session::submitTo(int shard, ShardRequest& request) {
+    Link &link = *links[shard];
+    if(link.inFlight == RING_CAPACITY || !link.requests.push(&request)) return false;
+    ++link.inFlight;
+    owner.wake(static_cast<std::size_t>(shard));
+    return true;
+}
+
+ShardRequest* ShardedService::Session::poll() {
+    const std::size_t count = links.size();
+    for(std::size_t i = 0; i < count; ++i) {
+        const std::size_t k = (nextPoll + i) % count;
+        ShardRequest *done;
+        if(links[k]->completions.pop(done)) {
+            --links[k]->inFlight;
+            nextPoll = (k + 1) % count;
+            return done;
+        }
+    }
+    return nullptr;
+}
+
+void ShardedService::Session::await(const ShardRequest& request) {
+    for(;;) {
+        ShardRequest *done = poll();
+        if(done == &request) return;
+        if(!done) std::this_thread::yield();
+    }
+}
+
+BookingStatus ShardedService::Session::call(ShardRequest& request) {
+    while(!submit(request)) std::this_thread::yield();
+    await(request);
+    return request.status;
+}
+
+BookingStatus ShardedService::Session::install(const BusInfo& info) {
+    single.op = ShardRequest::Op::Install;
+    single.info = info;
+    return call(single);
+}
+
+BookingStatus ShardedService::Session::reserve(const std::string& busNumber, int seatNumber,
+                                               const std::string& passenger) {
+    single.op = ShardRequest::Op::Reserve;
+    single.busNumber = busNumber;
+    single.seatNumber = seatNumber;
+    single.passenger = passenger;
+    return call(single);
+}
+
+BookingStatus ShardedService::Session::cancel(const std::string& busNumber, int seatNumber) {
+    single.op = ShardRequest::Op::Cancel;
+    single.busNumber = busNumber;
+    single.seatNumber = seatNumber;
+    return call(single);
+}
+
+BookingStatus ShardedService::Session::reserveSeats(const std::string& busNumber, const std::vector<int>& seatNumbers,
+                                                    const std::string& passenger, Paise& fareTotal) {
+    single.op = ShardRequest::Op::ReserveSeats;
+    single.busNumber = busNumber;
+    single.seats = seatNumbers;
+    single.passenger = passenger;
+    const BookingStatus status = call(single);
+    if(status == BookingStatus::Ok) fareTotal = single.fareTotal;
+    return status;
+}
+
+std::size_t ShardedService::Session::searchRoute(const std::string& from, const std::string& to, int fromMinute,
+                                                 int toMinute, std::vector<RouteMatch>& matches) {
+    for(std::size_t k = 0; k < fanout.size(); ++k) {
+        ShardRequest &part = fanout[k];
+        part.op = ShardRequest::Op::Route;
+        part.from = from;
+        part.to = to;
+        part.fromMinute = fromMinute;
+        part.toMinute = toMinute;
+        while(!submitTo(static_cast<int>(k), part)) std::this_thread::yield();
+    }
+    for(std::size_t pending = fanout.size(); pending > 0; ) {
+        if(poll()) --pending;
+        else std::this_thread::yield();
+    }
+
+    matches.clear();
+    for(ShardRequest &part : fanout) matches.insert(matches.end(), part.matches.begin(), part.matches.end());
+    if(fromMinute != NO_TIME) {
+        // Each shard's answer is in window order already; order the union the same way
+        std::stable_sort(matches.begin(), matches.end(), [&](const RouteMatch& a, const RouteMatch& b) {
+            return (a.departure - fromMinute + MINUTES_PER_DAY) % MINUTES_PER_DAY <
+                   (b.departure - fromMinute + MINUTES_PER_DAY) % MINUTES_PER_DAY;
+        });
+    }
+    return matches.size();
+}
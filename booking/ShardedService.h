@@ -0,0 +1,262 @@
+#ifndef BOOKING_SHARDEDSERVICE_H
+#define BOOKING_SHARDEDSERVICE_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <cstddef>
+#include <cstdint>
+
+#include "Bus.h"
+#include "BookingService.h"
+#include "SpscQueue.h"
+
+/**
+ * @file ShardedService.h
+ * @brief Shared-nothing booking core: buses partitioned across single-threaded shards.
+ */
+
+/**
+ * @struct RouteMatch
+ * @brief One bus found by a sharded route search.
+ */
+struct RouteMatch {
+    std::string busNumber;
+    int departure;  /**< Minutes since midnight, or NO_TIME. */
+    int freeSeats;  /**< Empty seats on the undated seat map. */
+};
+
+/**
+ * @struct ShardRequest
+ * @brief One operation for a shard, filled in by the caller and answered by the shard.
+ *
+ * Requests are reusable: keeping one per in-flight operation lets the strings and vectors
+ * keep their capacity, so steady-state traffic does not allocate. The caller must leave a
+ * request alone from submission until a Session hands it back as completed.
+ */
+struct ShardRequest {
+    /**
+     * @brief The operation, and which fields it reads and fills in.
+     */
+    enum class Op : std::uint8_t {
+        Install,       /**< Reads info. */
+        Reserve,       /**< Reads busNumber, seatNumber and passenger. */
+        Cancel,        /**< Reads busNumber and seatNumber. */
+        ReserveSeats,  /**< Reads busNumber, seats and passenger; fills fareTotal. */
+        Show,          /**< Reads busNumber; fills info (details as text), bus and passengers. */
+        Route          /**< Reads from, to, fromMinute and toMinute; fills matches. Sent to one shard. */
+    };
+
+    Op op = Op::Reserve;
+    BusInfo info;
+    std::string busNumber;
+    std::string passenger;
+    int seatNumber = 0;
+    std::vector<int> seats;
+    std::string from;
+    std::string to;
+    int fromMinute = NO_TIME;  /**< Earliest departure, or NO_TIME for every bus on the route. */
+    int toMinute = NO_TIME;    /**< Latest departure, inclusive. */
+
+    BookingStatus status = BookingStatus::Ok;
+    Paise fareTotal = 0;
+    Bus bus;                              /**< Seat map copy; its interned ids belong to the shard. */
+    std::vector<std::string> passengers;  /**< Passenger of each reserved seat, in seat order. */
+    std::vector<RouteMatch> matches;      /**< In installation order, or departure order for a window. */
+
+    std::uint64_t tag = 0;  /**< Free for the caller, e.g. to match completions to clients. */
+};
+
+/**
+ * @class ShardedService
+ * @brief Partitions buses across shards by a hash of the bus number, each owned by one
+ *        worker thread.
+ *
+ * Every shard is a complete BookingService (symbol table, registry, route and connection
+ * indexes, journal) that only its worker thread ever touches, so its locks are never
+ * contended and no cache line of booking state moves between cores. Callers talk to the
+ * shards through Sessions: each session has one single-producer, single-consumer request
+ * ring and one completion ring per shard, so no queue ever has two writers.
+ *
+ * A worker drains its rings in batches. With a journal open it handles a batch with
+ * durability deferred (see BookingService::beginDeferred()) and waits once before
+ * completing any of it, so each shard pays for one group commit per batch. An idle worker
+ * spins briefly, then parks until a session submits to it.
+ *
+ * Route searches fan out to every shard and are merged; journeys that change buses would
+ * cross shards and are not offered here.
+ */
+class ShardedService {
+public:
+    static const std::size_t MAX_SESSIONS = 1024;  /**< Sessions a service can open. */
+    static const std::size_t RING_CAPACITY = 1024; /**< In-flight requests per session and shard. */
+
+    class Session;
+
+    /**
+     * @brief Start one worker thread per shard, pinned to a core where possible.
+     *
+     * @param shards Number of shards (at least 1).
+     */
+    explicit ShardedService(int shards);
+
+    /**
+     * @brief Stop the workers. Requests still queued are dropped.
+     */
+    ~ShardedService();
+
+    ShardedService(const ShardedService&) = delete;
+    ShardedService& operator=(const ShardedService&) = delete;
+
+    /**
+     * @brief Open one journal per shard, path + ".0" upwards; see BookingService::openJournal().
+     *
+     * Must be called before any session submits. Every shard's restored buses are checked
+     * against the partition, so a journal reopened with a different shard count is refused.
+     *
+     * @return false If a journal could not be opened or holds buses of another shard.
+     */
+    bool openJournals(const std::string& path, std::uint64_t checkpointBytes = 0);
+
+    /**
+     * @brief Checkpoint every shard; see BookingService::checkpoint().
+     *
+     * @return true If every shard wrote its snapshot.
+     */
+    bool checkpoint();
+
+    /**
+     * @brief Open a session for one producer thread. The session lives as long as the
+     *        service.
+     *
+     * Thread-safe.
+     *
+     * @return Session* The new session, or null once MAX_SESSIONS are open.
+     */
+    Session* openSession();
+
+    int shardCount() const { return static_cast<int>(shards.size()); }
+
+    /**
+     * @brief The shard owning a bus number.
+     *
+     * Uses the high bits of the multiplied hash, so the buses of one shard are still
+     * spread evenly over its own registry table, which indexes on the low bits.
+     */
+    int shardOf(const std::string& busNumber) const {
+        return static_cast<int>((static_cast<std::uint64_t>(hashString(busNumber)) * shards.size()) >> 32);
+    }
+
+    std::size_t size() const;            /**< Buses across every shard. */
+    Paise revenue() const;               /**< Revenue across every shard, in paise. */
+    std::int64_t totalFreeSeats() const; /**< Empty seats across every shard. */
+
+private:
+    struct Shard;
+
+    std::vector<std::unique_ptr<Shard>> shards;
+    std::unique_ptr<Session> sessions[MAX_SESSIONS];
+    std::atomic<std::size_t> sessionCount;  /**< Sessions published to the workers. */
+    std::mutex sessionMutex;                /**< Serialises openSession(). */
+    std::atomic<bool> stopping;
+
+    /**
+     * @brief Body of shard k's worker thread.
+     */
+    void work(std::size_t k);
+
+    /**
+     * @brief Wake shard k's worker if it is parked.
+     */
+    void wake(std::size_t k);
+};
+
+/**
+ * @class ShardedService::Session
+ * @brief One producer's channel to every shard.
+ *
+ * A session must only be used from one thread at a time. Requests are submitted with
+ * submit() and come back through poll() as their shards finish them; requests to one shard
+ * complete in submission order, while requests to different shards may overtake each other.
+ * The synchronous helpers submit and wait, and must not be mixed with outstanding
+ * asynchronous requests on the same session.
+ */
+class ShardedService::Session {
+public:
+    /**
+     * @brief Queue a request to the shard owning its bus (info.busNumber for Install).
+     *
+     * @return false If that shard already has RING_CAPACITY requests in flight from this
+     *         session; poll() and retry.
+     */
+    bool submit(ShardRequest& request) {
+        return submitTo(owner.shardOf(request.op == ShardRequest::Op::Install ? request.info.busNumber
+                                                                               : request.busNumber), request);
+    }
+
+    /**
+     * @brief Queue a request to a given shard, e.g. one part of a Route fan-out.
+     */
+    bool submitTo(int shard, ShardRequest& request);
+
+    /**
+     * @brief A request that has completed since the last call, or null if none has.
+     */
+    ShardRequest* poll();
+
+    /**
+     * @brief Submit a request and wait for it to complete.
+     *
+     * @return BookingStatus The request's status.
+     */
+    BookingStatus call(ShardRequest& request);
+
+    BookingStatus install(const BusInfo& info);
+    BookingStatus reserve(const std::string& busNumber, int seatNumber, const std::string& passenger);
+    BookingStatus cancel(const std::string& busNumber, int seatNumber);
+    BookingStatus reserveSeats(const std::string& busNumber, const std::vector<int>& seatNumbers,
+                               const std::string& passenger, Paise& fareTotal);
+
+    /**
+     * @brief Fan a route search out to every shard and merge the answers.
+     *
+     * Without a window (fromMinute == NO_TIME) buses come shard by shard, each shard's in
+     * installation order; with one they come in departure order, as in
+     * BookingService::forEachDeparting().
+     *
+     * @return std::size_t The number of matches.
+     */
+    std::size_t searchRoute(const std::string& from, const std::string& to, int fromMinute, int toMinute,
+                            std::vector<RouteMatch>& matches);
+
+private:
+    friend class ShardedService;
+
+    /**
+     * @brief The rings between this session and one shard.
+     */
+    struct Link {
+        SpscQueue<ShardRequest*> requests{RING_CAPACITY};     /**< Session to shard. */
+        SpscQueue<ShardRequest*> completions{RING_CAPACITY};  /**< Shard to session. */
+        std::size_t inFlight = 0;                             /**< Submitted and not yet polled. */
+    };
+
+    ShardedService& owner;
+    std::vector<std::unique_ptr<Link>> links;  /**< One per shard. */
+    std::size_t nextPoll = 0;                  /**< Shard poll() looks at first, for fairness. */
+    ShardRequest single;                       /**< Request used by the synchronous helpers. */
+    std::vector<ShardRequest> fanout;          /**< One Route request per shard. */
+
+    explicit Session(ShardedService& service);
+
+    /**
+     * @brief Wait until request has come back through poll().
+     */
+    void await(const ShardRequest& request);
+};
+
+#endif // BOOKING_SHARDEDSERVICE_H
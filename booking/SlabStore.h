@@ -0,0 +1,113 @@
+#ifndef BOOKING_SLABSTORE_H
+#define BOOKING_SLABSTORE_H
+
+#include <new>
+#include <atomic>
+#include <vector>
+#include <memory>
+#include <utility>
+#include <cstddef>
+#include <type_traits>
+
+#include "Epoch.h"
+
+/**
+ * @file SlabStore.h
+ * @brief Slab arena holding objects at fixed addresses, readable while it grows.
+ */
+
+/**
+ * @class SlabStore
+ * @brief Append-only sequence of objects, indexed by position, that never moves one.
+ *
+ * Objects are constructed in place in fixed-size slabs of raw storage, so appending one
+ * moves it in once and later growth only adds a slab: existing objects are never copied
+ * or relocated, and a reference to one stays valid for the life of the store. Indexing
+ * is a shift and a mask.
+ *
+ * Appending is not thread-safe; the owner serialises it. Indexing an object appended
+ * before, though, is safe from any thread at any time, even while a slab is being added:
+ * the table of slabs is replaced rather than grown in place, and the old table is retired
+ * through Epoch. A reader that indexes without the owner's lock must hold an
+ * Epoch::Guard, and must learn how many objects exist from the owner, published after
+ * they were appended.
+ */
+template <typename T, std::size_t SHIFT = 10>
+class SlabStore {
+public:
+    SlabStore() = default;
+    SlabStore(const SlabStore&) = delete;
+    SlabStore& operator=(const SlabStore&) = delete;
+
+    ~SlabStore() {
+        for(std::size_t i = 0; i < count; ++i) (*this)[i].~T();
+        delete[] directory.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Construct an object in the next position and return it.
+     */
+    template <typename... Args>
+    T& emplace(Args&&... args) {
+        if(count == slabs.size() * SLAB_SIZE) addSlab();
+        T* slot = ::new(static_cast<void*>(&slabs[count >> SHIFT][count & SLAB_MASK])) T(std::forward<Args>(args)...);
+        ++count;
+        return *slot;
+    }
+
+    /**
+     * @brief Move an object into the next position and return it.
+     */
+    T& push(T&& value) { return emplace(std::move(value)); }
+
+    /**
+     * @brief Allocate slabs up front for a total of n objects.
+     */
+    void reserve(std::size_t n) {
+        while(slabs.size() * SLAB_SIZE < n) addSlab();
+    }
+
+    T& operator[](std::size_t i) {
+        return *std::launder(reinterpret_cast<T*>(&directory.load(std::memory_order_acquire)[i >> SHIFT][i & SLAB_MASK]));
+    }
+
+    const T& operator[](std::size_t i) const {
+        return *std::launder(reinterpret_cast<const T*>(
+            &directory.load(std::memory_order_acquire)[i >> SHIFT][i & SLAB_MASK]));
+    }
+
+    std::size_t size() const { return count; }   /**< Objects stored; for the owner only. */
+    bool empty() const { return count == 0; }     /**< True if no object is stored; for the owner only. */
+
+private:
+    static const std::size_t SLAB_SIZE = std::size_t(1) << SHIFT;  /**< Objects per slab. */
+    static const std::size_t SLAB_MASK = SLAB_SIZE - 1;
+
+    typedef typename std::aligned_storage<sizeof(T), alignof(T)>::type Storage;
+
+    std::vector<std::unique_ptr<Storage[]>> slabs;  /**< Backing storage; slab k holds positions k * SLAB_SIZE on. */
+    std::atomic<Storage**> directory{nullptr};      /**< Slab addresses as readers see them. */
+    std::size_t capacity = 0;                       /**< Entries in directory. */
+    std::size_t count = 0;                          /**< Objects constructed so far. */
+
+    /**
+     * @brief Add one slab, publishing a bigger directory first if the current one is full.
+     */
+    void addSlab() {
+        Storage** table = directory.load(std::memory_order_relaxed);
+        if(slabs.size() == capacity) {
+            const std::size_t bigger = capacity ? capacity * 2 : 16;
+            Storage** replacement = new Storage*[bigger]();
+            for(std::size_t k = 0; k < slabs.size(); ++k) replacement[k] = table[k];
+            directory.store(replacement, std::memory_order_release);
+            if(table) Epoch::retireArray(table);
+            table = replacement;
+            capacity = bigger;
+        }
+        slabs.emplace_back(new Storage[SLAB_SIZE]);
+        // No reader indexes this entry until the objects in it are published
+        table[slabs.size() - 1] = slabs.back().get();
+    }
+};
+
+#endif // BOOKING_SLABSTORE_H
@@ -0,0 +1,389 @@
+// Snapshot.cpp
+
+#include "Snapshot.h"
+#include "FileUtil.h"
+
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace {
+
+const char MAGIC[8] = { 'B', 'U', 'S', 'S', 'N', 'A', 'P', '1' };
+const std::uint32_t VERSION = 6;
+
+/**
+ * @brief File header, at offset 0.
+ */
+struct Header {
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t busCount;
+    std::uint32_t poolCount;      /**< Interned strings; bus numbers follow them. */
+    std::uint32_t passengerCount; /**< Passenger names after the bus numbers. */
+    std::uint64_t epoch;
+    std::uint64_t coveredEpoch;
+    std::uint64_t coveredOffset;
+    std::uint64_t stringBytes;
+};
+
+/**
+ * @brief One bus, as stored in the file.
+ */
+struct Record {
+    std::uint32_t driverName;
+    std::uint32_t arrivalTime;
+    std::uint32_t departureTime;
+    std::uint32_t from;
+    std::uint32_t to;
+    std::uint8_t layout;
+    std::uint8_t reserved[3];
+    std::uint64_t occupied;
+    std::uint32_t passengers[Bus::MAX_SEATS];
+    std::int32_t fares[FARE_CLASS_COUNT];
+    std::uint8_t paidTiers[Bus::MAX_SEATS];
+    std::uint8_t padding[4];
+};
+
+/**
+ * @brief Counts of the sections that follow the bus records.
+ */
+struct Trailer {
+    std::uint64_t scheduleCount;
+    std::uint64_t tripCount;
+};
+
+/**
+ * @brief One bus's service window.
+ */
+struct ScheduleRecord {
+    std::uint32_t bus;            /**< Index of the bus record. */
+    std::int32_t firstDate;
+    std::int32_t lastDate;
+    std::uint8_t weekdays;
+    std::uint8_t reserved[3];
+};
+
+/**
+ * @brief One dated trip's seat map.
+ */
+struct TripRecord {
+    std::uint32_t bus;            /**< Index of the bus record. */
+    std::int32_t date;
+    std::uint64_t occupied;
+    std::uint32_t passengers[Bus::MAX_SEATS];
+    std::uint8_t paidTiers[Bus::MAX_SEATS];
+};
+
+/**
+ * @brief Booking serials of one bus that has taken bookings.
+ */
+struct BookingRecord {
+    std::uint32_t bus;            /**< Index of the bus record. */
+    std::uint32_t lastBooking;
+    std::uint32_t serials[Bus::MAX_SEATS];  /**< Per seat; 0 for vacant seats. */
+};
+
+static_assert(sizeof(Header) == 56, "snapshot header layout changed");
+static_assert(sizeof(Trailer) == 16, "snapshot trailer layout changed");
+static_assert(sizeof(ScheduleRecord) == 16, "snapshot schedule record layout changed");
+static_assert(sizeof(TripRecord) == 336, "snapshot trip record layout changed");
+static_assert(sizeof(BookingRecord) == 264, "snapshot booking record layout changed");
+static_assert(sizeof(Record) == 368, "snapshot record layout changed");
+
+std::uint64_t padTo8(std::uint64_t n) {
+    return (n + 7) & ~static_cast<std::uint64_t>(7);
+}
+
+} // namespace
+
+void Snapshot::encode(const StringPool& symbols, const BusStore& buses, const SeatBookingStore& booked,
+                      const TripStore& trips, const PassengerStore& passengers, const SnapshotInfo& info,
+                      std::string& image) {
+    std::vector<std::uint64_t> offsets;
+    std::string blob;
+    offsets.reserve(symbols.size() + buses.size() + passengers.capacity() + 1);
+    symbols.forEach([&](const std::string& s) {
+        offsets.push_back(blob.size());
+        blob += s;
+    });
+    const std::size_t poolCount = offsets.size();
+    for(std::size_t i = 0; i < buses.size(); ++i) {
+        offsets.push_back(blob.size());
+        blob += buses[i].getBusNumber();
+    }
+    // Passenger names go in record id order, free records as empty strings, so seats keep their ids
+    const std::size_t passengersAt = offsets.size();
+    passengers.forEach([&](PassengerStore::Id, const char* name, std::size_t length) {
+        offsets.push_back(blob.size());
+        blob.append(name, length);
+    });
+    const std::size_t passengerCount = offsets.size() - passengersAt;
+    offsets.push_back(blob.size());
+
+    Header header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.busCount = static_cast<std::uint32_t>(buses.size());
+    header.poolCount = static_cast<std::uint32_t>(poolCount);
+    header.passengerCount = static_cast<std::uint32_t>(passengerCount);
+    header.epoch = info.epoch;
+    header.coveredEpoch = info.coveredEpoch;
+    header.coveredOffset = info.coveredOffset;
+    header.stringBytes = blob.size();
+
+    Trailer trailer = { 0, trips.size() };
+    for(std::size_t i = 0; i < buses.size(); ++i) trailer.scheduleCount += buses[i].weekdays != 0;
+
+    const std::uint64_t recordsAt = padTo8(sizeof(Header) + offsets.size() * sizeof(std::uint64_t) + blob.size());
+    const std::uint64_t trailerAt = recordsAt + buses.size() * sizeof(Record);
+    const std::uint64_t schedulesAt = trailerAt + sizeof(Trailer);
+    const std::uint64_t tripsAt = schedulesAt + trailer.scheduleCount * sizeof(ScheduleRecord);
+    std::uint64_t bookingCount = 0;
+    for(std::size_t i = 0; i < buses.size(); ++i) bookingCount += booked[i].last != 0;
+    const std::uint64_t bookingsAt = tripsAt + trailer.tripCount * sizeof(TripRecord);
+    image.assign(bookingsAt + sizeof(bookingCount) + bookingCount * sizeof(BookingRecord), '\0');
+    char* out = &image[0];
+    std::memcpy(out, &header, sizeof(header));
+    std::memcpy(out + sizeof(Header), offsets.data(), offsets.size() * sizeof(std::uint64_t));
+    std::memcpy(out + sizeof(Header) + offsets.size() * sizeof(std::uint64_t), blob.data(), blob.size());
+
+    Record* records = reinterpret_cast<Record*>(out + recordsAt);
+    for(std::size_t i = 0; i < buses.size(); ++i) {
+        const Bus &bus = buses[i];
+        Record &r = records[i];
+        r.driverName = bus.driverName;
+        r.arrivalTime = bus.arrivalTime;
+        r.departureTime = bus.departureTime;
+        r.from = bus.from;
+        r.to = bus.to;
+        r.layout = static_cast<std::uint8_t>(bus.layout);
+        r.occupied = bus.occupied;
+        // Vacant seats may still hold a stale id; store 0 so the image is deterministic
+        for(int seat = 0; seat < Bus::MAX_SEATS; ++seat) {
+            const bool taken = (bus.occupied >> seat) & 1u;
+            r.passengers[seat] = taken ? bus.passengers[seat] : 0;
+            r.paidTiers[seat] = taken ? bus.paidTiers[seat] : 0;
+        }
+        std::memcpy(r.fares, bus.fares.base, sizeof(r.fares));
+    }
+
+    std::memcpy(out + trailerAt, &trailer, sizeof(trailer));
+    ScheduleRecord* schedules = reinterpret_cast<ScheduleRecord*>(out + schedulesAt);
+    for(std::size_t i = 0; i < buses.size(); ++i) {
+        const Bus &bus = buses[i];
+        if(!bus.weekdays) continue;
+        ScheduleRecord &s = *schedules++;
+        s.bus = static_cast<std::uint32_t>(i);
+        s.firstDate = bus.firstDate;
+        s.lastDate = bus.lastDate;
+        s.weekdays = bus.weekdays;
+    }
+
+    TripRecord* tripRecords = reinterpret_cast<TripRecord*>(out + tripsAt);
+    trips.forEach([&](std::uint32_t bus, ServiceDate date, const TripSeats& seats) {
+        TripRecord &t = *tripRecords++;
+        t.bus = bus;
+        t.date = date;
+        t.occupied = seats.occupied;
+        for(int seat = 0; seat < Bus::MAX_SEATS; ++seat) {
+            const bool taken = (seats.occupied >> seat) & 1u;
+            t.passengers[seat] = taken ? seats.passengers[seat] : 0;
+            t.paidTiers[seat] = taken ? seats.paidTiers[seat] : 0;
+        }
+    });
+
+    std::memcpy(out + bookingsAt, &bookingCount, sizeof(bookingCount));
+    char* section = out + bookingsAt + sizeof(bookingCount);
+    for(std::size_t i = 0; i < buses.size(); ++i) {
+        const Bus &bus = buses[i];
+        if(!booked[i].last) continue;
+        BookingRecord b;
+        b.bus = static_cast<std::uint32_t>(i);
+        b.lastBooking = booked[i].last;
+        for(int seat = 0; seat < Bus::MAX_SEATS; ++seat) {
+            b.serials[seat] = ((bus.occupied >> seat) & 1u) ? booked[i].serials[seat] : 0;
+        }
+        std::memcpy(section, &b, sizeof(b));
+        section += sizeof(b);
+    }
+}
+
+bool Snapshot::write(const std::string& path, const char* image, std::size_t size) {
+    const std::string tmpPath = path + ".tmp";
+    int fd = ::open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if(fd < 0) return false;
+    bool ok = writeAll(fd, image, size) && ::fsync(fd) == 0;
+    ::close(fd);
+    ok = ok && ::rename(tmpPath.c_str(), path.c_str()) == 0 && syncDirectoryOf(path);
+    if(!ok) ::unlink(tmpPath.c_str());
+    return ok;
+}
+
+bool Snapshot::load(const std::string& path, StringPool& symbols, BusRegistry& registry,
+                    SnapshotInfo& info) {
+    MappedFile file;
+    if(!file.map(path) || file.size() < sizeof(Header)) return false;
+
+    Header header;
+    std::memcpy(&header, file.data(), sizeof(header));
+    if(std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0) return false;
+    if(header.version != VERSION) return false;
+
+    // Check every section fits before touching it
+    const std::uint64_t passengerCount = header.passengerCount;
+    const std::uint64_t stringCount = static_cast<std::uint64_t>(header.poolCount) + header.busCount + passengerCount;
+    const std::uint64_t offsetsAt = sizeof(Header);
+    const std::uint64_t blobAt = offsetsAt + (stringCount + 1) * sizeof(std::uint64_t);
+    if(header.poolCount == 0 || header.stringBytes > file.size() || blobAt > file.size() - header.stringBytes) return false;
+    const std::uint64_t recordsAt = padTo8(blobAt + header.stringBytes);
+    if(recordsAt > file.size() || (file.size() - recordsAt) / sizeof(Record) < header.busCount) return false;
+
+    const std::uint64_t* offsets = reinterpret_cast<const std::uint64_t*>(file.data() + offsetsAt);
+    const char* blob = file.data() + blobAt;
+    for(std::uint64_t i = 0; i < stringCount; ++i) {
+        if(offsets[i] > offsets[i + 1] || offsets[i + 1] > header.stringBytes) return false;
+    }
+
+    // Re-intern in id order; a fresh pool hands out the same ids again
+    std::string text;
+    for(std::uint32_t id = 0; id < header.poolCount; ++id) {
+        text.assign(blob + offsets[id], offsets[id + 1] - offsets[id]);
+        if(symbols.intern(text) != id) return false;
+    }
+
+    // Later sections are read by copying, since only the bus records are known to be aligned
+    const std::uint64_t trailerAt = recordsAt + header.busCount * sizeof(Record);
+    Trailer trailer;
+    if(file.size() - trailerAt < sizeof(Trailer)) return false;
+    std::memcpy(&trailer, file.data() + trailerAt, sizeof(trailer));
+    const std::uint64_t room = file.size() - trailerAt - sizeof(Trailer);
+    if(trailer.scheduleCount > header.busCount ||
+       trailer.tripCount > room / sizeof(TripRecord) ||
+       trailer.scheduleCount * sizeof(ScheduleRecord) + trailer.tripCount * sizeof(TripRecord) > room) {
+        return false;
+    }
+
+    // Booking serials follow the trips, for the buses that have taken bookings
+    std::vector<const char*> bookingsOf(header.busCount, nullptr);
+    const std::uint64_t bookingsAt = trailerAt + sizeof(Trailer) + trailer.scheduleCount * sizeof(ScheduleRecord) +
+                                     trailer.tripCount * sizeof(TripRecord);
+    std::uint64_t bookingCount = 0;
+    if(file.size() - bookingsAt < sizeof(bookingCount)) return false;
+    std::memcpy(&bookingCount, file.data() + bookingsAt, sizeof(bookingCount));
+    if(bookingCount > header.busCount ||
+       bookingCount * sizeof(BookingRecord) > file.size() - bookingsAt - sizeof(bookingCount)) {
+        return false;
+    }
+    const char* bookingSection = file.data() + bookingsAt + sizeof(bookingCount);
+    for(std::uint64_t i = 0; i < bookingCount; ++i, bookingSection += sizeof(BookingRecord)) {
+        std::uint32_t bus;
+        std::memcpy(&bus, bookingSection, sizeof(bus));
+        if(bus >= header.busCount || bookingsOf[bus]) return false;
+        bookingsOf[bus] = bookingSection;
+    }
+
+    const Record* records = reinterpret_cast<const Record*>(file.data() + recordsAt);
+    const std::uint32_t limit = header.poolCount;
+
+    // Seats name passengers by record id, whose name follows the bus numbers
+    PassengerStore &store = registry.passengerStore();
+    auto takePassenger = [&](std::uint32_t stored, PassengerStore::Id& id) {
+        if(stored >= passengerCount) return false;
+        const std::uint64_t k = static_cast<std::uint64_t>(limit) + header.busCount + stored;
+        text.assign(blob + offsets[k], offsets[k + 1] - offsets[k]);
+        id = store.acquire(text);
+        return id != PassengerStore::npos;
+    };
+
+    std::vector<Bus> buses;
+    buses.reserve(header.busCount);
+    std::vector<SeatMask> seatsOf(header.busCount);
+    for(std::uint32_t i = 0; i < header.busCount; ++i) {
+        const Record &r = records[i];
+        if(r.driverName >= limit || r.arrivalTime >= limit || r.departureTime >= limit ||
+           r.from >= limit || r.to >= limit || r.layout >= LAYOUT_COUNT) {
+            return false;
+        }
+
+        const std::uint64_t k = limit + i;
+        text.assign(blob + offsets[k], offsets[k + 1] - offsets[k]);
+        FareTable fares;
+        for(int fareClass = 0; fareClass < FARE_CLASS_COUNT; ++fareClass) {
+            if(r.fares[fareClass] <= 0) return false;
+            fares.base[fareClass] = r.fares[fareClass];
+        }
+        int departs = NO_TIME, arrives = NO_TIME;
+        if(!parseTime(symbols.str(r.departureTime), departs)) departs = NO_TIME;
+        if(!parseTime(symbols.str(r.arrivalTime), arrives)) arrives = NO_TIME;
+        Bus bus(text, r.driverName, r.arrivalTime, r.departureTime, r.from, r.to,
+                static_cast<LayoutKind>(r.layout), fares, departs, arrives);
+        seatsOf[i] = bus.allSeats();
+        if(r.occupied & ~bus.allSeats()) return false;
+        if(text.empty()) return false;
+        for(int seat = 0; seat < Bus::MAX_SEATS; ++seat) {
+            if(r.paidTiers[seat] >= DEMAND_TIER_COUNT) return false;
+            if(((r.occupied >> seat) & 1u) && !takePassenger(r.passengers[seat], bus.passengers[seat])) return false;
+            bus.paidTiers[seat] = r.paidTiers[seat];
+        }
+        bus.occupied = r.occupied;
+        if(bookingsOf[i]) {
+            BookingRecord b;
+            std::memcpy(&b, bookingsOf[i], sizeof(b));
+            for(SeatMask rest = r.occupied; rest; rest &= rest - 1) {
+                const int seat = lowestBit(rest);
+                if(b.serials[seat] == 0 || b.serials[seat] > b.lastBooking) return false;
+            }
+        } else if(r.occupied) {
+            // Every reserved seat belongs to a booking
+            return false;
+        }
+        buses.push_back(std::move(bus));
+    }
+    // A bus number taken twice leaves one of them out
+    if(registry.addAll(buses) != header.busCount) return false;
+
+    // Buses were added to an empty registry, so a bus record's index is its handle
+    for(std::uint32_t i = 0; i < header.busCount; ++i) {
+        if(!bookingsOf[i]) continue;
+        BookingRecord b;
+        std::memcpy(&b, bookingsOf[i], sizeof(b));
+        SeatBookings booked;
+        std::memcpy(booked.serials, b.serials, sizeof(booked.serials));
+        booked.last = b.lastBooking;
+        registry.restoreBookings(i, booked);
+    }
+
+    const char* section = file.data() + trailerAt + sizeof(Trailer);
+    for(std::uint64_t i = 0; i < trailer.scheduleCount; ++i, section += sizeof(ScheduleRecord)) {
+        ScheduleRecord s;
+        std::memcpy(&s, section, sizeof(s));
+        if(s.bus >= header.busCount || s.lastDate < s.firstDate) return false;
+        const std::uint64_t k = limit + s.bus;
+        text.assign(blob + offsets[k], offsets[k + 1] - offsets[k]);
+        registry.schedule(text, s.firstDate, s.lastDate, s.weekdays);
+    }
+    for(std::uint64_t i = 0; i < trailer.tripCount; ++i, section += sizeof(TripRecord)) {
+        TripRecord t;
+        std::memcpy(&t, section, sizeof(t));
+        if(t.bus >= header.busCount || (t.occupied & ~seatsOf[t.bus])) return false;
+        // A trip whose seats were all cancelled again needs no seat map
+        if(!t.occupied) continue;
+        if(registry.tripSnapshot(t.bus, t.date).occupied) return false;
+        TripSeats seats;
+        seats.occupied = t.occupied;
+        for(int seat = 0; seat < Bus::MAX_SEATS; ++seat) {
+            if(t.paidTiers[seat] >= DEMAND_TIER_COUNT) return false;
+            if(((t.occupied >> seat) & 1u) && !takePassenger(t.passengers[seat], seats.passengers[seat])) return false;
+            seats.paidTiers[seat] = t.paidTiers[seat];
+        }
+        registry.restoreTrip(t.bus, t.date, seats);
+    }
+
+    info.epoch = header.epoch;
+    info.coveredEpoch = header.coveredEpoch;
+    info.coveredOffset = header.coveredOffset;
+    info.busCount = header.busCount;
+    return true;
+}
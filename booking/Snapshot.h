@@ -0,0 +1,99 @@
+#ifndef BOOKING_SNAPSHOT_H
+#define BOOKING_SNAPSHOT_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+#include "Bus.h"
+#include "BusRegistry.h"
+#include "BusStore.h"
+#include "PassengerStore.h"
+#include "SeatBookings.h"
+#include "StringPool.h"
+#include "TripStore.h"
+
+/**
+ * @file Snapshot.h
+ * @brief Fixed-layout image of the whole booking state, loaded with mmap on start-up.
+ *
+ * A snapshot file is laid out as
+ *
+ *     header | u64 string offsets[stringCount + 1] | string bytes | pad to 8 | bus records
+ *            | u64 schedule count | u64 trip count | schedule records | trip records
+ *            | u64 booking count | booking records
+ *
+ * The strings are every interned string in id order, then the bus numbers, then the name
+ * in each passenger record in record id order (empty for free records). Each bus record is
+ * a fixed 368-byte copy of a Bus's ids, layout, occupancy mask, passenger record ids, fare
+ * table and the demand tier each seat was paid at. A schedule record holds one bus's
+ * service window and a trip record one dated trip's seat map; trips that have sold nothing
+ * are not stored. A booking record holds the booking serial of each reserved seat of one
+ * bus, and the bus's last serial; buses that never took a booking have none.
+ *
+ * Everything is in native byte order, so the records can be read straight out of the
+ * mapping; a snapshot is not portable between machines of different endianness.
+ *
+ * The header also records which journal prefix the snapshot covers, so recovery knows
+ * which journal records still have to be replayed on top of it.
+ */
+
+/**
+ * @struct SnapshotInfo
+ * @brief Where a snapshot sits relative to the journal.
+ */
+struct SnapshotInfo {
+    std::uint64_t epoch;          /**< Epoch of the compacted journal that continues this snapshot. */
+    std::uint64_t coveredEpoch;   /**< Epoch of the journal the snapshot was taken from. */
+    std::uint64_t coveredOffset;  /**< Bytes of that journal the snapshot already includes. */
+    std::size_t busCount;         /**< Buses in the snapshot. */
+};
+
+/**
+ * @class Snapshot
+ * @brief Encodes, writes and loads snapshot files.
+ */
+class Snapshot {
+public:
+    /**
+     * @brief Encode the given state into image, replacing its contents.
+     *
+     * The caller must keep buses from changing while this runs (see BusRegistry::freeze()).
+     *
+     * @param symbols Every string the buses refer to.
+     * @param buses All installed buses, in handle order.
+     * @param booked Booking serials of their reserved seats, in the same order.
+     * @param trips Seat maps of their dated trips.
+     * @param passengers Names held by their reserved seats.
+     * @param info Journal position to record; busCount is ignored.
+     * @param image Receives the file contents.
+     */
+    static void encode(const StringPool& symbols, const BusStore& buses, const SeatBookingStore& booked,
+                       const TripStore& trips, const PassengerStore& passengers, const SnapshotInfo& info,
+                       std::string& image);
+
+    /**
+     * @brief Atomically replace the snapshot file with the size bytes of image.
+     *
+     * The image is written to a temporary file, flushed and renamed over path, so a crash
+     * leaves either the old snapshot or the new one.
+     *
+     * @return true If the new snapshot is durable.
+     */
+    static bool write(const std::string& path, const char* image, std::size_t size);
+
+    /**
+     * @brief Map a snapshot file and load it into an empty symbol table and registry.
+     *
+     * @param path Snapshot file.
+     * @param symbols A freshly constructed pool; ids are restored exactly.
+     * @param registry A registry with no buses.
+     * @param info Receives the journal position recorded in the snapshot.
+     * @return true If the snapshot was valid and fully loaded.
+     */
+    static bool load(const std::string& path, StringPool& symbols, BusRegistry& registry,
+                     SnapshotInfo& info);
+};
+
+#endif // BOOKING_SNAPSHOT_H
@@ -0,0 +1,96 @@
+#ifndef BOOKING_SPSCQUEUE_H
+#define BOOKING_SPSCQUEUE_H
+
+#include <atomic>
+#include <vector>
+#include <cstddef>
+
+/**
+ * @file SpscQueue.h
+ * @brief Bounded lock-free single-producer, single-consumer ring.
+ */
+
+/**
+ * @class SpscQueue
+ * @brief Fixed-capacity FIFO between exactly one producer thread and one consumer thread.
+ *
+ * The head and tail indices sit on separate cache lines, and each side keeps a private
+ * copy of the other side's index; it only re-reads the shared one when the ring looks
+ * full or empty. In steady state a push or pop touches just the slot and the side's own
+ * line. Neither side ever blocks or allocates.
+ *
+ * @tparam T A trivially copyable element, typically a pointer.
+ */
+template <typename T>
+class SpscQueue {
+public:
+    /**
+     * @param capacity Most elements held at once; rounded up to a power of two.
+     */
+    explicit SpscQueue(std::size_t capacity) {
+        std::size_t size = 2;
+        while(size < capacity) size *= 2;
+        slots.resize(size);
+        mask = size - 1;
+    }
+
+    SpscQueue(const SpscQueue&) = delete;
+    SpscQueue& operator=(const SpscQueue&) = delete;
+
+    /**
+     * @brief Append an element. Producer only.
+     *
+     * @return false If the ring is full.
+     */
+    bool push(const T& value) {
+        const std::size_t tail = producer.index.load(std::memory_order_relaxed);
+        if(tail - producer.cached > mask) {
+            producer.cached = consumer.index.load(std::memory_order_acquire);
+            if(tail - producer.cached > mask) return false;
+        }
+        slots[tail & mask] = value;
+        producer.index.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * @brief Take the oldest element. Consumer only.
+     *
+     * @return false If the ring is empty.
+     */
+    bool pop(T& value) {
+        const std::size_t head = consumer.index.load(std::memory_order_relaxed);
+        if(head == consumer.cached) {
+            consumer.cached = producer.index.load(std::memory_order_acquire);
+            if(head == consumer.cached) return false;
+        }
+        value = slots[head & mask];
+        consumer.index.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * @brief True if nothing is queued; exact only on the consumer's thread.
+     */
+    bool empty() const {
+        return consumer.index.load(std::memory_order_relaxed) == producer.index.load(std::memory_order_acquire);
+    }
+
+    std::size_t capacity() const { return mask + 1; }  /**< Most elements held at once. */
+
+private:
+    /**
+     * @brief One side's index and its copy of the other side's, on a line of their own.
+     */
+    struct alignas(64) Side {
+        std::atomic<std::size_t> index{0};  /**< Next slot this side will use; only ever grows. */
+        std::size_t cached = 0;             /**< Last value read of the other side's index. */
+    };
+
+    Side producer;             /**< Tail: written by push(). */
+    Side consumer;             /**< Head: written by pop(). */
+    std::vector<T> slots;
+    std::size_t mask;
+};
+
+#endif // BOOKING_SPSCQUEUE_H
@@ -0,0 +1,56 @@
+// StringPool.cpp
+
+#include "StringPool.h"
+
+#include <mutex>
+
+StringPool::Id StringPool::intern(const std::string& text) {
+    const std::uint32_t h = hashString(text);
+    {
+        // Fast path: the string is usually already interned
+        std::shared_lock<std::shared_mutex> lock(mutex);
+        if(!slots.empty()) {
+            const Slot &slot = slots[probe(h, text)];
+            if(slot.id != npos) return slot.id;
+        }
+    }
+
+    std::unique_lock<std::shared_mutex> lock(mutex);
+    if((strings.size() + 1) * 2 > slots.size()) grow();
+
+    Slot &slot = slots[probe(h, text)];
+    if(slot.id == npos) {
+        slot.hash = h;
+        slot.id = static_cast<Id>(strings.size());
+        strings.push_back(text);
+    }
+    return slot.id;
+}
+
+StringPool::Id StringPool::find(const std::string& text) const {
+    std::shared_lock<std::shared_mutex> lock(mutex);
+    if(slots.empty()) return npos;
+    return slots[probe(hashString(text), text)].id;
+}
+
+std::size_t StringPool::probe(std::uint32_t hash, const std::string& text) const {
+    const std::size_t mask = slots.size() - 1;
+    for(std::size_t i = hash & mask; ; i = (i + 1) & mask) {
+        const Slot &slot = slots[i];
+        if(slot.id == npos) return i;
+        if(slot.hash == hash && strings[slot.id] == text) return i;
+    }
+}
+
+void StringPool::grow() {
+    const Slot empty = { 0, npos };
+    std::vector<Slot> bigger(slots.empty() ? 16 : slots.size() * 2, empty);
+    const std::size_t mask = bigger.size() - 1;
+    for(const Slot &slot : slots) {
+        if(slot.id == npos) continue;
+        std::size_t i = slot.hash & mask;
+        while(bigger[i].id != npos) i = (i + 1) & mask;
+        bigger[i] = slot;
+    }
+    slots.swap(bigger);
+}
@@ -0,0 +1,118 @@
+#ifndef BOOKING_STRINGPOOL_H
+#define BOOKING_STRINGPOOL_H
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <cstdint>
+#include <cstddef>
+#include <shared_mutex> // for the symbol table reader-writer lock
+
+/**
+ * @file StringPool.h
+ * @brief String hashing and the interning symbol table shared by the booking core.
+ */
+
+/**
+ * @brief Compute a 32-bit FNV-1a hash of a string.
+ *
+ * @param text The string to hash.
+ * @return std::uint32_t The hash value.
+ */
+inline std::uint32_t hashString(const std::string& text) {
+    std::uint32_t h = 2166136261u;
+    for(unsigned char c : text) {
+        h ^= c;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+/**
+ * @class StringPool
+ * @brief Interning symbol table mapping strings to 32-bit ids.
+ *
+ * Each distinct string is stored once; buses and seats keep only its id. Ids are
+ * dense and never reused, and id 0 is always the empty string. Strings are found
+ * through an open-addressing table keyed on their hash, so interning an existing
+ * string or looking one up never allocates.
+ *
+ * The pool is safe to use from many threads: lookups share a reader lock and only
+ * the insertion of a new string takes it exclusively. Strings live in a deque, so
+ * the reference returned by str() stays valid while other threads intern.
+ */
+class StringPool {
+public:
+    typedef std::uint32_t Id;               /**< Id of an interned string. */
+    static const Id npos = 0xFFFFFFFFu;     /**< Returned when a string is not interned. */
+
+    /**
+     * @brief Construct a pool holding only the empty string (id 0).
+     */
+    StringPool() { intern(std::string()); }
+
+    /**
+     * @brief Intern a string.
+     *
+     * @param text The string to intern.
+     * @return Id The id of the string, adding it to the pool if it is new.
+     */
+    Id intern(const std::string& text);
+
+    /**
+     * @brief Look up a string without adding it.
+     *
+     * @param text The string to look up.
+     * @return Id The id of the string, or npos if it has never been interned.
+     */
+    Id find(const std::string& text) const;
+
+    /**
+     * @brief The string behind an id.
+     */
+    const std::string& str(Id id) const {
+        std::shared_lock<std::shared_mutex> lock(mutex);
+        return strings[id];
+    }
+
+    std::size_t size() const {
+        std::shared_lock<std::shared_mutex> lock(mutex);
+        return strings.size();
+    }
+
+    /**
+     * @brief Call fn(const std::string&) for every interned string, in id order.
+     *
+     * Interning blocks while this runs, so fn must not intern.
+     */
+    template <typename Fn>
+    void forEach(Fn fn) const {
+        std::shared_lock<std::shared_mutex> lock(mutex);
+        for(const std::string &s : strings) fn(s);
+    }
+
+private:
+    /**
+     * @brief One hash table slot. A slot with id == npos is empty.
+     */
+    struct Slot {
+        std::uint32_t hash;
+        Id id;
+    };
+
+    std::deque<std::string> strings;   /**< Interned strings, indexed by id. */
+    std::vector<Slot> slots;           /**< Hash table; size is zero or a power of two. */
+    mutable std::shared_mutex mutex;   /**< Guards strings and slots. */
+
+    /**
+     * @brief Locate the slot holding a string, or the empty slot where it would go.
+     */
+    std::size_t probe(std::uint32_t hash, const std::string& text) const;
+
+    /**
+     * @brief Double the table (keeping the load factor at or below 1/2) and rehash.
+     */
+    void grow();
+};
+
+#endif // BOOKING_STRINGPOOL_H
@@ -0,0 +1,178 @@
+#ifndef BOOKING_TIMERWHEEL_H
+#define BOOKING_TIMERWHEEL_H
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+/**
+ * @file TimerWheel.h
+ * @brief Hierarchical timing wheel for large numbers of expiring entries.
+ */
+
+/**
+ * @class TimerWheel
+ * @brief Timers keyed by small integer ids, each firing once at a given tick.
+ *
+ * There are LEVELS wheels of SLOTS slots each. A slot of level l spans SLOTS^l ticks, so
+ * level 0 has one slot per tick and the four levels together cover 2^32 ticks ahead. A
+ * timer sits in the slot of the lowest level whose span still separates its expiry from
+ * the current tick. When the lower wheels wrap, the next slot of the level above is
+ * emptied and its timers are placed again, one level lower.
+ *
+ * Scheduling and cancelling are O(1): every slot is an intrusive doubly-linked list
+ * threaded through a node per id. Advancing by one tick is O(1) plus the timers that fire
+ * or move down, and each timer moves down at most LEVELS - 1 times. Nothing is scanned
+ * per timer per tick, however many timers are pending.
+ *
+ * Not thread-safe; the owner guards it.
+ */
+class TimerWheel {
+public:
+    static const std::uint32_t npos = 0xFFFFFFFFu;  /**< "No timer". */
+
+    /**
+     * @param start Tick the wheel starts at.
+     */
+    explicit TimerWheel(std::uint64_t start = 0) : current(start), pending(0) {
+        for(std::uint32_t &head : heads) head = npos;
+    }
+
+    /**
+     * @brief Arm the timer of an id to fire at a tick.
+     *
+     * @param id Any id not currently armed; nodes grow to fit it.
+     * @param expiry Tick to fire at. A tick already reached fires on the next advance().
+     */
+    void schedule(std::uint32_t id, std::uint64_t expiry) {
+        if(id >= nodes.size()) nodes.resize(id + 1);
+        nodes[id].expiry = expiry > current ? expiry : current + 1;
+        place(id);
+        ++pending;
+    }
+
+    /**
+     * @brief Disarm the timer of an armed id.
+     */
+    void cancel(std::uint32_t id) {
+        unlink(id);
+        --pending;
+    }
+
+    /**
+     * @brief Move the wheel forward to a tick, calling fn(id) for every timer that expires
+     *        on the way, in expiry order.
+     *
+     * A timer is disarmed before fn sees it, so fn may schedule its id again; it must not
+     * cancel other timers.
+     *
+     * @return std::size_t Timers fired.
+     */
+    template <typename Fn>
+    std::size_t advance(std::uint64_t to, Fn fn) {
+        std::size_t fired = 0;
+        while(current < to) {
+            if(pending == 0) {
+                // Nothing to fire or move; jump straight there
+                current = to;
+                break;
+            }
+            ++current;
+            cascade();
+
+            const std::size_t bucket = current & MASK;
+            std::uint32_t id = heads[bucket];
+            heads[bucket] = npos;
+            while(id != npos) {
+                const std::uint32_t next = nodes[id].next;
+                nodes[id].bucket = npos;
+                --pending;
+                ++fired;
+                fn(id);
+                id = next;
+            }
+        }
+        return fired;
+    }
+
+    std::uint64_t now() const { return current; }  /**< Last tick reached. */
+    std::size_t size() const { return pending; }    /**< Timers armed. */
+
+private:
+    static const int LEVELS = 4;
+    static const int SLOT_BITS = 8;
+    static const std::uint32_t SLOTS = 1u << SLOT_BITS;
+    static const std::uint32_t MASK = SLOTS - 1;
+
+    /**
+     * @brief Links of one id's timer. bucket is npos while the timer is not armed.
+     */
+    struct Node {
+        std::uint64_t expiry = 0;
+        std::uint32_t prev = npos;
+        std::uint32_t next = npos;
+        std::uint32_t bucket = npos;  /**< level * SLOTS + slot. */
+    };
+
+    std::vector<Node> nodes;                 /**< Indexed by id. */
+    std::uint32_t heads[LEVELS * SLOTS];     /**< First node of each slot's list. */
+    std::uint64_t current;                   /**< Last tick reached. */
+    std::size_t pending;                     /**< Armed timers. */
+
+    /**
+     * @brief Put a timer in the slot matching the distance to its expiry, which is not
+     *        before the current tick.
+     */
+    void place(std::uint32_t id) {
+        const std::uint64_t expiry = nodes[id].expiry;
+        int level = 0;
+        // Lowest level where the expiry falls less than a full turn of slots ahead
+        while(level < LEVELS - 1 &&
+              (expiry >> (SLOT_BITS * level)) - (current >> (SLOT_BITS * level)) >= SLOTS) ++level;
+        std::uint64_t block = expiry >> (SLOT_BITS * level);
+        const std::uint64_t base = current >> (SLOT_BITS * level);
+        // Past the top wheel's reach: park in its furthest slot and place again from there
+        if(block - base >= SLOTS) block = base + MASK;
+        link(id, static_cast<std::uint32_t>(level) * SLOTS + static_cast<std::uint32_t>(block & MASK));
+    }
+
+    void link(std::uint32_t id, std::uint32_t bucket) {
+        Node &node = nodes[id];
+        node.bucket = bucket;
+        node.prev = npos;
+        node.next = heads[bucket];
+        if(node.next != npos) nodes[node.next].prev = id;
+        heads[bucket] = id;
+    }
+
+    void unlink(std::uint32_t id) {
+        Node &node = nodes[id];
+        if(node.prev != npos) nodes[node.prev].next = node.next;
+        else heads[node.bucket] = node.next;
+        if(node.next != npos) nodes[node.next].prev = node.prev;
+        node.bucket = npos;
+    }
+
+    /**
+     * @brief Empty the upper-level slots whose span starts at the current tick into the
+     *        levels below, highest first.
+     */
+    void cascade() {
+        if(current & MASK) return;
+        int top = 1;
+        while(top < LEVELS - 1 && ((current >> (SLOT_BITS * top)) & MASK) == 0) ++top;
+        for(int level = top; level >= 1; --level) {
+            const std::uint32_t bucket = static_cast<std::uint32_t>(level) * SLOTS +
+                                         static_cast<std::uint32_t>((current >> (SLOT_BITS * level)) & MASK);
+            std::uint32_t id = heads[bucket];
+            heads[bucket] = npos;
+            while(id != npos) {
+                const std::uint32_t next = nodes[id].next;
+                place(id);
+                id = next;
+            }
+        }
+    }
+};
+
+#endif // BOOKING_TIMERWHEEL_H
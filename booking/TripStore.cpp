@@ -0,0 +1,75 @@
+// TripStore.cpp
+
+#include "TripStore.h"
+
+#include <cstring>
+#include <mutex>
+
+namespace {
+
+/**
+ * @brief Mix a bus handle and a date into a well-spread 32-bit hash.
+ */
+std::uint32_t hashTrip(std::uint32_t bus, ServiceDate date) {
+    std::uint32_t h = bus * 0x9E3779B1u ^ static_cast<std::uint32_t>(date) * 0x85EBCA77u;
+    h ^= h >> 16;
+    h *= 0x7FEB352Du;
+    h ^= h >> 15;
+    return h;
+}
+
+} // namespace
+
+TripSeats* TripStore::find(std::uint32_t bus, ServiceDate date) const {
+    std::shared_lock<std::shared_mutex> lock(mutex);
+    const Slot* slot = findLocked(bus, date);
+    return slot ? slot->seats : nullptr;
+}
+
+TripStore::Slot* TripStore::findLocked(std::uint32_t bus, ServiceDate date) const {
+    if(slots.empty()) return nullptr;
+
+    const std::size_t mask = slots.size() - 1;
+    for(std::size_t i = hashTrip(bus, date) & mask; ; i = (i + 1) & mask) {
+        const Slot &slot = slots[i];
+        if(!slot.seats) return nullptr;
+        if(slot.bus == bus && slot.date == date) return const_cast<Slot*>(&slot);
+    }
+}
+
+TripSeats* TripStore::findOrCreate(std::uint32_t bus, ServiceDate date) {
+    if(TripSeats* seats = find(bus, date)) return seats;
+
+    std::unique_lock<std::shared_mutex> lock(mutex);
+    // Another bus may have created its own trip meanwhile, but never this one: the caller
+    // holds this bus's lock
+    if((count + 1) * 2 > slots.size()) grow();
+    if(slabUsed == SLAB_TRIPS) {
+        slabs.emplace_back(new TripSeats[SLAB_TRIPS]);
+        slabUsed = 0;
+    }
+    TripSeats* seats = &slabs.back()[slabUsed++];
+    std::memset(seats, 0, sizeof(TripSeats));
+
+    const std::size_t mask = slots.size() - 1;
+    std::size_t i = hashTrip(bus, date) & mask;
+    while(slots[i].seats) i = (i + 1) & mask;
+    slots[i].bus = bus;
+    slots[i].date = date;
+    slots[i].seats = seats;
+    ++count;
+    return seats;
+}
+
+void TripStore::grow() {
+    const Slot empty = { 0, 0, nullptr };
+    std::vector<Slot> bigger(slots.empty() ? 16 : slots.size() * 2, empty);
+    const std::size_t mask = bigger.size() - 1;
+    for(const Slot &slot : slots) {
+        if(!slot.seats) continue;
+        std::size_t i = hashTrip(slot.bus, slot.date) & mask;
+        while(bigger[i].seats) i = (i + 1) & mask;
+        bigger[i] = slot;
+    }
+    slots.swap(bigger);
+}
@@ -0,0 +1,112 @@
+#ifndef BOOKING_TRIPSTORE_H
+#define BOOKING_TRIPSTORE_H
+
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include <cstddef>
+#include <shared_mutex> // for the trip index reader-writer lock
+
+#include "Bus.h"
+#include "Calendar.h"
+
+/**
+ * @file TripStore.h
+ * @brief Seat maps of dated trips, allocated from a slab on first sale.
+ */
+
+/**
+ * @struct TripSeats
+ * @brief Seat state of one trip: a bus on one service date.
+ *
+ * Laid out like the seat map inside Bus, so the same bit tricks apply.
+ */
+struct TripSeats {
+    SeatMask occupied;                            /**< Bit n - 1 is set when seat n is reserved. */
+    PassengerStore::Id passengers[Bus::MAX_SEATS]; /**< Passenger record per reserved seat. */
+    std::uint8_t paidTiers[Bus::MAX_SEATS];       /**< Demand tier each reserved seat was charged at. */
+
+    bool isReserved(int seatNumber) const { return (occupied >> (seatNumber - 1)) & 1u; }
+    int bookedCount() const { return countBits(occupied); }
+
+    void occupy(int seatNumber, PassengerStore::Id passenger, int tier) {
+        passengers[seatNumber - 1] = passenger;
+        paidTiers[seatNumber - 1] = static_cast<std::uint8_t>(tier);
+        occupied |= SeatMask(1) << (seatNumber - 1);
+    }
+
+    void vacate(int seatNumber) { occupied &= ~(SeatMask(1) << (seatNumber - 1)); }
+};
+
+/**
+ * @class TripStore
+ * @brief Index from (bus handle, service date) to the seat map of that trip.
+ *
+ * A trip that has never sold a seat has no entry and no storage, so a bus scheduled for
+ * a year ahead costs nothing until its dates sell. Seat maps are carved out of fixed-size
+ * slabs and never move, so a pointer returned here stays valid for the life of the store.
+ * Trips are found through an open-addressing table keyed on the bus and date.
+ *
+ * The index is guarded by its own reader-writer lock; the seat maps themselves are
+ * guarded by the owning bus's lock in BusRegistry.
+ */
+class TripStore {
+public:
+    /**
+     * @brief Seat map of a trip, or nullptr if it has sold nothing yet.
+     */
+    TripSeats* find(std::uint32_t bus, ServiceDate date) const;
+
+    /**
+     * @brief Seat map of a trip, allocating an empty one on first use.
+     */
+    TripSeats* findOrCreate(std::uint32_t bus, ServiceDate date);
+
+    /**
+     * @brief Call fn(bus, date, const TripSeats&) for every trip with a seat map.
+     *
+     * The caller must keep seat maps from changing while this runs.
+     */
+    template <typename Fn>
+    void forEach(Fn fn) const {
+        std::shared_lock<std::shared_mutex> lock(mutex);
+        for(const Slot &slot : slots) {
+            if(slot.seats) fn(slot.bus, slot.date, *slot.seats);
+        }
+    }
+
+    /**
+     * @brief Number of trips with a seat map.
+     */
+    std::size_t size() const {
+        std::shared_lock<std::shared_mutex> lock(mutex);
+        return count;
+    }
+
+private:
+    /**
+     * @brief One hash table slot. A slot with seats == nullptr is empty.
+     */
+    struct Slot {
+        std::uint32_t bus;
+        ServiceDate date;
+        TripSeats* seats;
+    };
+
+    static const std::size_t SLAB_TRIPS = 256;  /**< Seat maps per slab. */
+
+    std::vector<Slot> slots;                            /**< Hash table; size is zero or a power of two. */
+    std::vector<std::unique_ptr<TripSeats[]>> slabs;    /**< Backing storage for seat maps. */
+    std::size_t slabUsed = SLAB_TRIPS;                  /**< Seat maps handed out from the last slab. */
+    std::size_t count = 0;                              /**< Trips in the table. */
+    mutable std::shared_mutex mutex;                    /**< Guards slots, slabs and counts. */
+
+    Slot* findLocked(std::uint32_t bus, ServiceDate date) const;
+
+    /**
+     * @brief Double the table (keeping the load factor at or below 1/2) and rehash.
+     */
+    void grow();
+};
+
+#endif // BOOKING_TRIPSTORE_H